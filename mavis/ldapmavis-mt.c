@@ -13,6 +13,7 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <time.h>
+#include <errno.h>
 #include <ldap.h>
 #include <ctype.h>
 #include <sys/resource.h>
@@ -26,6 +27,8 @@
 #define TRISTATE_YES    1
 #define TRISTATE_NO     2
 static int is_mt = TRISTATE_DUNNO;
+static int use_tlv = 0;		// caller accepts MAVIS_EXT_MAGIC_V2
+static int use_batch = 0;	// caller knows we accept MAVIS_EXT_MAGIC_BATCH
 
 static int scope = LDAP_SCOPE_SUBTREE;
 static int scope_group = LDAP_SCOPE_SUBTREE;
@@ -51,6 +54,11 @@ static pcre2_code *ldap_memberof_filter = NULL;
 static pcre2_code *ad_result_regex = NULL;
 static pcre2_code *ad_dsid_regex = NULL;
 static int ldap_sizelimit = 100;
+static int ldap_threads = 16;
+static time_t ldap_healthcheck_interval = 60;
+static time_t ldap_group_cache_ttl = 300;
+static int ldap_async;
+static int ldap_async_queue = 1024;
 
 
 static void usage(void)
@@ -74,7 +82,13 @@ Leaving the ones below as-is is likely safe:\n\
  LDAP_NETWORK_TIMEOUT          5 [seconds]\n\
  LDAP_TACMEMBER                tacMember\n\
  LDAP_TACMEMBER_MAP_OU         unset (set to map OUs to TACMEMBER)\n\
- LDAP_NESTED_MEMBEROF_DEPTH    unset (set to limit group membership lookup depth)\n"
+ LDAP_NESTED_MEMBEROF_DEPTH    unset (set to limit group membership lookup depth)\n\
+ LDAP_THREADS                  16 (maximum number of worker threads and connections)\n\
+ LDAP_HEALTHCHECK_INTERVAL     60 [seconds] (0 disables health checks)\n\
+ LDAP_GROUP_CACHE_TTL          300 [seconds] (0 disables the nested group cache)\n\
+ LDAP_ASYNC_CONNECTIONS        unset (set to multiplex lookups over that many connections\n\
+                               from a single thread instead of using worker threads)\n\
+ LDAP_ASYNC_QUEUE              1024 (maximum number of outstanding asynchronous lookups)\n"
 #ifdef LDAP_OPT_X_TLS_PROTOCOL_TLS1_3
 	    " LDAP_TLS_PROTOCOL_MIN         TLS1_2 (TLS1_0, TLS1_1, TLS1_2, TLS1_3)\n"
 #else
@@ -387,6 +401,161 @@ static int LDAP_bind_user(LDAP *ldap, const char *ldap_dn, const char *ldap_pass
     return LDAP_INVALID_CREDENTIALS;
 }
 
+/*
+ * Worker threads keep their LDAP connection across requests. While idle, a
+ * connection is bound as LDAP_USER (or anonymously). Authenticating a user
+ * changes the bind identity, so the service bind is restored before the
+ * connection gets reused.
+ */
+struct ldap_conn {
+    LDAP *ldap;
+    time_t last_used;
+    int user_bound;
+};
+
+#define LDAP_CONN_LOST(A) ((A) == LDAP_SERVER_DOWN || (A) == LDAP_CONNECT_ERROR || (A) == LDAP_UNAVAILABLE)
+
+static void ldap_conn_close(struct ldap_conn *c)
+{
+    if (c->ldap)
+	ldap_unbind_ext_s(c->ldap, NULL, NULL);
+    c->ldap = NULL;
+    c->user_bound = 0;
+}
+
+static int LDAP_ping(LDAP *ldap)
+{
+    char *attrs[] = { LDAP_NO_ATTRS, NULL };
+    struct timeval tv = {.tv_sec = ldap_network_timeout };
+    LDAPMessage *res = NULL;
+    int rc = ldap_search_ext_s(ldap, "", LDAP_SCOPE_BASE, "(objectClass=*)", attrs, 0, NULL, NULL, &tv, 1, &res);
+    if (res)
+	ldap_msgfree(res);
+    return rc;
+}
+
+static LDAP *ldap_conn_get(struct ldap_conn *c)
+{
+    time_t now = time(NULL);
+    if (c->ldap) {
+	int rc = LDAP_SUCCESS;
+	if (c->user_bound)
+	    rc = LDAP_bind(c->ldap, ldap_dn, ldap_pw);
+	else if (ldap_healthcheck_interval > 0 && now - c->last_used >= ldap_healthcheck_interval)
+	    rc = LDAP_ping(c->ldap);
+	c->user_bound = 0;
+	if (rc != LDAP_SUCCESS) {
+	    fprintf(stderr, "%d: %s, reconnecting\n", __LINE__, ldap_err2string(rc));
+	    ldap_conn_close(c);
+	}
+    }
+    if (!c->ldap)
+	LDAP_init(&c->ldap, &capabilities);
+    c->last_used = now;
+    return c->ldap;
+}
+
+/*
+ * Nested group lookups are cached across requests and threads. An entry maps
+ * a DN to the DNs the directory returned for it, either its memberOf values
+ * or the groupOfNames entries listing it as a member.
+ */
+#define GROUPCACHE_MEMBEROF 0
+#define GROUPCACHE_GROUPOFNAMES 1
+#define GROUPCACHE_BUCKETS 1024
+#define GROUPCACHE_MAX 65536
+
+struct groupcache {
+    struct groupcache *next;
+    time_t expires;
+    int type;
+    char **list;
+    char dn[1];
+};
+
+static struct groupcache *groupcache[GROUPCACHE_BUCKETS];
+static int groupcache_count = 0;
+static pthread_mutex_t groupcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// NULL-terminated string vector, allocated as a single block
+static char **strv_dup(char **v)
+{
+    size_t n = 0, len = 0;
+    for (; v[n]; n++)
+	len += strlen(v[n]) + 1;
+    char **r = malloc((n + 1) * sizeof(char *) + len);
+    char *p = (char *) (r + n + 1);
+    for (size_t i = 0; i < n; i++) {
+	size_t l = strlen(v[i]) + 1;
+	r[i] = memcpy(p, v[i], l);
+	p += l;
+    }
+    r[n] = NULL;
+    return r;
+}
+
+static u_int groupcache_hash(char *dn, int type)
+{
+    u_int h = (u_int) type;
+    for (; *dn; dn++)
+	h = h * 31 + (u_char) * dn;
+    return h % GROUPCACHE_BUCKETS;
+}
+
+static void groupcache_unlink(struct groupcache **g)
+{
+    struct groupcache *next = (*g)->next;
+    free((*g)->list);
+    free(*g);
+    *g = next;
+    groupcache_count--;
+}
+
+static char **groupcache_get(char *dn, int type)
+{
+    if (ldap_group_cache_ttl < 1)
+	return NULL;
+    time_t now = time(NULL);
+    char **res = NULL;
+    pthread_mutex_lock(&groupcache_lock);
+    struct groupcache **g = &groupcache[groupcache_hash(dn, type)];
+    while (*g) {
+	if ((*g)->expires < now)
+	    groupcache_unlink(g);
+	else if ((*g)->type == type && !strcmp((*g)->dn, dn)) {
+	    res = strv_dup((*g)->list);
+	    break;
+	} else
+	    g = &(*g)->next;
+    }
+    pthread_mutex_unlock(&groupcache_lock);
+    return res;
+}
+
+static void groupcache_set(char *dn, int type, char **list)
+{
+    if (ldap_group_cache_ttl < 1)
+	return;
+    size_t len = strlen(dn);
+    pthread_mutex_lock(&groupcache_lock);
+    struct groupcache **g = &groupcache[groupcache_hash(dn, type)];
+    while (*g) {
+	if ((*g)->type == type && !strcmp((*g)->dn, dn))
+	    groupcache_unlink(g);
+	else
+	    g = &(*g)->next;
+    }
+    if (groupcache_count < GROUPCACHE_MAX) {
+	*g = calloc(1, sizeof(struct groupcache) + len);
+	(*g)->expires = time(NULL) + ldap_group_cache_ttl;
+	(*g)->type = type;
+	(*g)->list = strv_dup(list);
+	memcpy((*g)->dn, dn, len + 1);
+	groupcache_count++;
+    }
+    pthread_mutex_unlock(&groupcache_lock);
+}
+
 struct dnhash {
     struct dnhash *next;
     size_t len;
@@ -437,9 +606,9 @@ static int dnhash_add(struct dnhash **ha, char *dn, size_t match_start, size_t m
     return 0;
 }
 
-static int dnhash_add_entry(LDAP *ldap, struct dnhash **h, char *dn, int level)
+// Adds a memberOf group. Returns 0 if it wasn't known before, so its own groups need to be looked up.
+static int dnhash_add_group(struct dnhash **h, char *dn)
 {
-
     if (ldap_memberof_filter) {
 	pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(ldap_memberof_filter, NULL);
 	int pcre_res = pcre2_match((pcre2_code *) ldap_memberof_filter, (PCRE2_SPTR8) dn, (PCRE2_SIZE) strlen(dn), 0, 0, match_data, NULL);
@@ -479,91 +648,145 @@ static int dnhash_add_entry(LDAP *ldap, struct dnhash **h, char *dn, int level)
     int rc = dnhash_add(h, dn, match_start, match_len, matched);
     if (match_data)
 	pcre2_match_data_free(match_data);
-    if (rc)
+    return rc ? -1 : 0;
+}
+
+// Group DNs from the result of a memberOf search, see dnhash_add_entry().
+static char **memberof_list(LDAP *ldap, char *dn, LDAPMessage *res)
+{
+    struct berval **v = NULL;
+    if (ldap_count_entries(ldap, res) == 1)
+	v = ldap_get_values_len(ldap, ldap_first_entry(ldap, res), "memberOf");
+    int count = v ? ldap_count_values_len(v) : 0;
+    char *values[count + 1];
+    for (int i = 0; i < count; i++)
+	values[i] = v[i]->bv_val;
+    values[count] = NULL;
+    char **list = strv_dup(values);
+    groupcache_set(dn, GROUPCACHE_MEMBEROF, list);
+    if (v)
+	ldap_value_free_len(v);
+    return list;
+}
+
+static int dnhash_add_entry(LDAP *ldap, struct dnhash **h, char *dn, int level)
+{
+    if (dnhash_add_group(h, dn))
 	return -1;
 
     if (level < 1 && ldap_group_depth > -2)
 	return 0;
 
-    char *attrs[] = { "memberOf", NULL };
-    LDAPMessage *res = NULL;
-    rc = ldap_search_ext_s(ldap, dn, LDAP_SCOPE_BASE, "(objectClass=*)", attrs, 0, NULL, NULL, NULL, ldap_sizelimit, &res);
-    if (rc != LDAP_SUCCESS)
-	fprintf(stderr, "%d: %s\n", __LINE__, ldap_err2string(rc));
+    char **list = groupcache_get(dn, GROUPCACHE_MEMBEROF);
+    if (!list) {
+	char *attrs[] = { "memberOf", NULL };
+	LDAPMessage *res = NULL;
+	int rc = ldap_search_ext_s(ldap, dn, LDAP_SCOPE_BASE, "(objectClass=*)", attrs, 0, NULL, NULL, NULL, ldap_sizelimit, &res);
+	if (rc != LDAP_SUCCESS)
+	    fprintf(stderr, "%d: %s\n", __LINE__, ldap_err2string(rc));
 
-    if (rc == LDAP_SUCCESS && ldap_count_entries(ldap, res) == 1) {
-	LDAPMessage *entry = ldap_first_entry(ldap, res);
+	if (rc == LDAP_SUCCESS)
+	    list = memberof_list(ldap, dn, res);
+	if (res)
+	    ldap_msgfree(res);
+    }
 
-	BerElement *be = NULL;
-	for (char *attribute = ldap_first_attribute(ldap, entry, &be); attribute; attribute = ldap_next_attribute(ldap, entry, be)) {
-	    struct berval **v = ldap_get_values_len(ldap, entry, attribute);
-	    if (v) {
-		if (!strcasecmp(attribute, "memberOf")) {
-		    int i = 0;
-		    for (; v[i]; i++)
-			dnhash_add_entry(ldap, h, v[i]->bv_val, level - 1);
-		}
-	    }
-	    ldap_value_free_len(v);
-	}
+    if (list) {
+	for (char **l = list; *l; l++)
+	    dnhash_add_entry(ldap, h, *l, level - 1);
+	free(list);
     }
-    if (res)
-	ldap_msgfree(res);
 
     return 0;
 }
 
+// Group DNs from the result of a groupOfNames search, see dnhash_add_entry_groupOfNames().
+static char **groupofnames_list(LDAP *ldap, char *dn, LDAPMessage *res, int cacheable)
+{
+    int count = ldap_count_entries(ldap, res);
+    if (count < 0)
+	count = 0;
+    char *values[count + 1];
+    int n = 0;
+    for (LDAPMessage * entry = ldap_first_entry(ldap, res); entry && n < count; entry = ldap_next_entry(ldap, entry))
+	values[n++] = ldap_get_dn(ldap, entry);
+    values[n] = NULL;
+    char **list = strv_dup(values);
+    if (cacheable)
+	groupcache_set(dn, GROUPCACHE_GROUPOFNAMES, list);
+    for (int i = 0; i < n; i++)
+	ldap_memfree(values[i]);
+    return list;
+}
+
+// Returns 0 if gdn was added and its own groups need to be looked up, 1 if not, -1 on error.
+static int dnhash_add_gdn(struct dnhash **h, char *gdn)
+{
+    int res = 1;
+    pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(ldap_memberof_regex, NULL);
+    int pcre_res = pcre2_match((pcre2_code *) ldap_memberof_regex, (PCRE2_SPTR8) gdn, (PCRE2_SIZE) strlen(gdn), 0, 0, match_data, NULL);
+    if (pcre_res < 0 && pcre_res != PCRE2_ERROR_NOMATCH) {
+	fprintf(stderr, "PCRE2 matching error: %d [%d]\n", pcre_res, __LINE__);
+	res = -1;
+    } else if (pcre_res != PCRE2_ERROR_NOMATCH) {
+	PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+	uint32_t ovector_count = pcre2_get_ovector_count(match_data);
+
+	if (ovector_count < 1)
+	    res = -1;
+	else {
+	    size_t match_start = 0;
+	    size_t match_len = 0;
+	    if (ovector_count > 1) {
+		match_start = ovector[2];
+		match_len = ovector[3] - ovector[2];
+	    }
+	    if (!dnhash_add(h, gdn, match_start, match_len, 1 /* FIXME? */ ))
+		res = 0;
+	}
+    }
+    if (match_data)
+	pcre2_match_data_free(match_data);
+    return res;
+}
+
 static int dnhash_add_entry_groupOfNames(LDAP *ldap, struct dnhash **h, char *dn, int level)
 {
     if (level < 1 && ldap_group_depth > -2)
 	return 0;
 
-    char *attrs[] = { "member", NULL };
-    LDAPMessage *res = NULL;
-    size_t filter_len = strlen(dn) + ldap_filter_group_len;
-    char filter[filter_len];
-    snprintf(filter, filter_len, ldap_filter_group, dn);
-    int rc = ldap_search_ext_s(ldap, base_dn_group, scope_group, filter, attrs, 0, NULL, NULL, NULL, ldap_sizelimit, &res);
-    if (rc != LDAP_SUCCESS)
-	fprintf(stderr, "%d: %s\n", __LINE__, ldap_err2string(rc));
+    // The user's own group list is looked up fresh, only group nesting is cached.
+    int cacheable = (level != ldap_group_depth);
+    char **list = cacheable ? groupcache_get(dn, GROUPCACHE_GROUPOFNAMES) : NULL;
+    if (!list) {
+	char *attrs[] = { "member", NULL };
+	LDAPMessage *res = NULL;
+	size_t filter_len = strlen(dn) + ldap_filter_group_len;
+	char filter[filter_len];
+	snprintf(filter, filter_len, ldap_filter_group, dn);
+	int rc = ldap_search_ext_s(ldap, base_dn_group, scope_group, filter, attrs, 0, NULL, NULL, NULL, ldap_sizelimit, &res);
+	if (rc != LDAP_SUCCESS)
+	    fprintf(stderr, "%d: %s\n", __LINE__, ldap_err2string(rc));
 
-    if (rc == LDAP_SUCCESS) {
-	LDAPMessage *entry;
-	for (entry = ldap_first_entry(ldap, res); entry; entry = ldap_next_entry(ldap, entry)) {
-	    char *gdn = ldap_get_dn(ldap, entry);
-	    fprintf(stderr, "checking gdn %s\n", gdn);
-	    pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(ldap_memberof_regex, NULL);
-	    int pcre_res = pcre2_match((pcre2_code *) ldap_memberof_regex, (PCRE2_SPTR8) gdn, (PCRE2_SIZE) strlen(gdn), 0, 0, match_data, NULL);
-	    if (pcre_res < 0 && pcre_res != PCRE2_ERROR_NOMATCH) {
-		fprintf(stderr, "PCRE2 matching error: %d [%d]\n", pcre_res, __LINE__);
-		return -1;
-	    }
-	    if (pcre_res != PCRE2_ERROR_NOMATCH) {
-		PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
-		uint32_t ovector_count = pcre2_get_ovector_count(match_data);
-
-		if (ovector_count < 1)
-		    return -1;
-
-		size_t match_start = 0;
-		size_t match_len = 0;
-		if (ovector_count > 1) {
-		    match_start = ovector[2];
-		    match_len = ovector[3] - ovector[2];
-		}
+	if (rc == LDAP_SUCCESS)
+	    list = groupofnames_list(ldap, dn, res, cacheable);
+	if (res)
+	    ldap_msgfree(res);
+    }
+    if (!list)
+	return 0;
 
-		int rc = dnhash_add(h, gdn, match_start, match_len, 1 /* FIXME? */ );
-		if (!rc)
-		    dnhash_add_entry_groupOfNames(ldap, h, gdn, level - 1);
-	    }
-	    if (match_data)
-		pcre2_match_data_free(match_data);
-	    ldap_memfree(gdn);
-	}
+    int res = 0;
+    for (char **l = list; *l && !res; l++) {
+	fprintf(stderr, "checking gdn %s\n", *l);
+	int rc = dnhash_add_gdn(h, *l);
+	if (rc < 0)
+	    res = -1;
+	else if (!rc)
+	    dnhash_add_entry_groupOfNames(ldap, h, *l, level - 1);
     }
-    if (res)
-	ldap_msgfree(res);
-    return 0;
+    free(list);
+    return res;
 }
 
 struct ad_error_codes {
@@ -631,13 +854,18 @@ static pthread_mutex_t mutex_lock;
 
 static void av_write(av_ctx *ac, uint32_t result)
 {
-    size_t len = av_array_to_char_len(ac);
+    int tlv = use_tlv && is_mt == TRISTATE_YES;
+    size_t len = tlv ? av_array_to_tlv_len(ac) : av_array_to_char_len(ac);
     char buf[len + sizeof(struct mavis_ext_hdr_v1)];
     if (is_mt == TRISTATE_YES) {
-	len = av_array_to_char(ac, buf + sizeof(struct mavis_ext_hdr_v1), len, NULL);
-
 	struct mavis_ext_hdr_v1 *h = (struct mavis_ext_hdr_v1 *) buf;
-	h->magic = htonl(MAVIS_EXT_MAGIC_V1);
+	if (tlv) {
+	    len = av_array_to_tlv(ac, buf + sizeof(struct mavis_ext_hdr_v1), len, NULL);
+	    h->magic = htonl(MAVIS_EXT_MAGIC_V2);
+	} else {
+	    len = av_array_to_char(ac, buf + sizeof(struct mavis_ext_hdr_v1), len, NULL);
+	    h->magic = htonl(MAVIS_EXT_MAGIC_V1);
+	}
 	h->body_len = htonl((uint32_t) len);
 	h->result = htonl(result);
 
@@ -653,20 +881,212 @@ static void av_write(av_ctx *ac, uint32_t result)
     av_free(ac);
 }
 
-static void *run_thread(void *arg)
+#define USER_ATTRS { \
+	"shadowExpire", "memberOf", "dn", "uidNumber", "gidNumber", "loginShell", \
+	"homeDirectory", "sshPublicKey", "krbPasswordExpiration", ldap_tacmember_attr, NULL \
+    }
+
+// Sets the AV pairs derived from a user attribute, except for memberOf.
+static void user_attr(av_ctx *ac, char *attribute, struct berval **v, time_t *expiry)
+{
+    if (!strcasecmp(attribute, ldap_tacmember_attr)) {
+	size_t b_len = 4;
+	int i = 0;
+	for (i = 0; v[i]; i++)
+	    b_len += v[i]->bv_len;
+	char *b = calloc(1, b_len);
+	char *p = b;
+	for (i = 0; v[i]; i++) {
+	    if (*p != *b)
+		*p++ = ',';
+	    *p++ = '"';
+	    memcpy(p, v[i]->bv_val, v[i]->bv_len);
+	    p += v[i]->bv_len;
+	    *p++ = '"';
+	}
+	av_set(ac, AV_A_TACMEMBER, b);
+	free(b);
+    } else if (!strcasecmp(attribute, "sshPublicKey")) {
+	size_t b_len = 4;
+	int i = 0;
+	for (i = 0; v[i]; i++)
+	    b_len += v[i]->bv_len;
+	char *b = calloc(1, b_len);
+	char *p = b;
+	for (i = 0; v[i]; i++) {
+	    if (*p != *b)
+		*p++ = ',';
+	    *p++ = '"';
+	    memcpy(p, v[i]->bv_val, v[i]->bv_len);
+	    p += v[i]->bv_len;
+	    *p++ = '"';
+	}
+	av_set(ac, AV_A_SSHKEY, b);
+	free(b);
+    } else if (*v) {
+	if (!strcasecmp(attribute, "uidNumber")) {
+	    av_set(ac, AV_A_UID, v[0]->bv_val);
+	} else if (!strcasecmp(attribute, "gidNumber")) {
+	    av_set(ac, AV_A_GID, v[0]->bv_val);
+	} else if (!strcasecmp(attribute, "loginShell")) {
+	    av_set(ac, AV_A_SHELL, v[0]->bv_val);
+	} else if (!strcasecmp(attribute, "homeDirectory")) {
+	    av_set(ac, AV_A_SHELL, v[0]->bv_val);
+	} else if (!strcasecmp(attribute, "shadowExpire")) {
+	    int i = atoi(v[0]->bv_val);
+	    if (i > -1)
+		*expiry = i * 86400;
+	} else if (!strcasecmp(attribute, "krbPasswordExpiration")) {
+	    struct tm tm = { 0 };
+	    char z;
+	    if (7 == sscanf(v[0]->bv_val, "%4d%2d%2d%2d%2d%2d%c", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &z)
+		&& z == 'Z') {
+		tm.tm_year -= 1900;
+		tm.tm_mon -= 1;
+		*expiry = mktime(&tm);
+	    }
+	}
+    }
+}
+
+// Sets MEMBEROF and TACMEMBER from the groups collected in hash.
+static void set_groups(av_ctx *ac, char *dn, struct dnhash **hash)
 {
-    LDAP *ldap = NULL;
-    LDAP_init(&ldap, &capabilities);
+    char *tacmember_ou = "";
+    if (ldap_tacmember_map_ou) {
+	tacmember_ou = alloca(strlen(dn));
+	char *d = dn;
+	char *t = tacmember_ou;
+	while (*d && *d != ',')
+	    d++;
+	while (*d) {
+	    if (d[0] == ',' && tolower((int) d[1]) == 'o' && tolower((int) d[2]) == 'u' && d[3] == '=') {
+		d += 4;
+		if (t != tacmember_ou)
+		    *t++ = ',';
+		*t++ = '"';
+		while (*d && *d != ',')
+		    *t++ = *d++;
+		*t++ = '"';
+		if (*d)
+		    d++;
+	    } else
+		do {
+		    d++;
+		} while (*d && *d != ',');
+	}
+	*t = 0;
+    }
+
+    int i;
+    int tacmember_len = strlen(tacmember_ou) + 1;
+    int memberof_len = 0;
+    for (i = 0; i < 256; i++) {
+	struct dnhash *h = hash[i];
+	for (; h; h = h->next) {
+	    memberof_len += 3 + h->len;
+	    tacmember_len += 3 + h->match_len;
+	}
+    }
+    if (tacmember_len || memberof_len) {
+	char *t = alloca(tacmember_len < memberof_len ? memberof_len : tacmember_len);
+	if (memberof_len) {
+	    char *b = t;
+	    for (i = 0; i < 256; i++) {
+		struct dnhash *h = hash[i];
+		for (; h; h = h->next) {
+		    if (!h->add)
+			continue;
+		    if (b != t)
+			*b++ = ',';
+		    *b++ = '"';
+		    memcpy(b, h->name, h->len);
+		    b += h->len;
+		    *b++ = '"';
+		}
+	    }
+	    *b = 0;
+	    av_set(ac, AV_A_MEMBEROF, t);
+	}
+	if (tacmember_len) {
+	    char *b = t;
+	    while (*tacmember_ou)
+		*b++ = *tacmember_ou++;
+	    for (i = 0; i < 256; i++) {
+		struct dnhash *h = hash[i];
+		for (; h; h = h->next) {
+		    if (!h->add)
+			continue;
+		    if (b != t)
+			*b++ = ',';
+		    *b++ = '"';
+		    memcpy(b, h->name + h->match_start, h->match_len);
+		    b += h->match_len;
+		    *b++ = '"';
+		}
+	    }
+	    *b = 0;
+	    av_set(ac, AV_A_TACMEMBER, t);
+	}
+    }
+}
+
+// Returns 1 if the password has expired and can't be changed, with RESULT set to FAIL.
+static int password_expired(av_ctx *ac, time_t expiry)
+{
+    if (expiry > -1 && expiry < time(NULL)) {
+	char *cap = av_get(ac, AV_A_CALLER_CAP);
+	av_set(ac, AV_A_USER_RESPONSE, "Password has expired.");
+	if (cap && strstr(cap, ":chpw:") && (capabilities & (CAP_PWMODIFY | CAP_AD)))
+	    av_set(ac, AV_A_PASSWORD_MUSTCHANGE, "1");
+	else {
+	    av_set(ac, AV_A_RESULT, AV_V_RESULT_FAIL);
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+// Evaluates the outcome of a user bind. diag is the server's diagnostic message, if any.
+static int bind_result(av_ctx *ac, int rc, char *diag, int result)
+{
+    char *cap = av_get(ac, AV_A_CALLER_CAP);
+    int caller_cap_chpw = (cap && strstr(cap, ":chpw:"));
+
+    if (rc == LDAP_SUCCESS) {
+	av_set(ac, AV_A_RESULT, AV_V_RESULT_OK);
+	result = MAVIS_FINAL;
+    } else {
+	char *out = NULL;
+	char *err = ldap_err2string(rc);
+	if (rc == LDAP_INVALID_CREDENTIALS && (capabilities & CAP_AD) && caller_cap_chpw && diag
+	    && !pcre2_match((pcre2_code *) ad_dsid_regex, (PCRE2_SPTR8) diag, (PCRE2_SIZE) strlen(diag), 0, 0, NULL, NULL)
+	    ) {
+	    if (!strcmp(av_get(ac, AV_A_TACTYPE), AV_V_TACTYPE_AUTH)) {
+		av_set(ac, AV_A_USER_RESPONSE, "Password has expired.");
+		av_set(ac, AV_A_RESULT, AV_V_RESULT_OK);
+		av_set(ac, AV_A_PASSWORD_MUSTCHANGE, "1");
+		result = MAVIS_FINAL;
+	    }
+	} else {
+	    av_set(ac, AV_A_USER_RESPONSE, translate_ldap_error(err, diag, &out));
+	    av_set(ac, AV_A_RESULT, AV_V_RESULT_FAIL);
+	}
+	if (out)
+	    free(out);
+    }
+    return result;
+}
+
+static void process_query(struct ldap_conn *conn, av_ctx *ac)
+{
+    LDAP *ldap = ldap_conn_get(conn);
 
     char buf[4096];
     *buf = 0;
-    av_ctx *ac = (av_ctx *) arg;
     int result = MAVIS_DOWN;
 
-    char *attrs[] = {
-	"shadowExpire", "memberOf", "dn", "uidNumber", "gidNumber", "loginShell",
-	"homeDirectory", "sshPublicKey", "krbPasswordExpiration", ldap_tacmember_attr, NULL
-    };
+    char *attrs[] = USER_ATTRS;
     char *username = av_get(ac, AV_A_USER);
     size_t filter_len = ldap_filter_len + strlen(username);
     char filter[filter_len];
@@ -674,10 +1094,20 @@ static void *run_thread(void *arg)
 
     LDAPMessage *res = NULL;
     int rc = ldap_search_ext_s(ldap, base_dn, scope, filter, attrs, 0, NULL, NULL, NULL, ldap_sizelimit, &res);
+    if (LDAP_CONN_LOST(rc)) {
+	// stale connection, reconnect and try once more
+	if (res)
+	    ldap_msgfree(res);
+	res = NULL;
+	ldap_conn_close(conn);
+	ldap = ldap_conn_get(conn);
+	rc = ldap_search_ext_s(ldap, base_dn, scope, filter, attrs, 0, NULL, NULL, NULL, ldap_sizelimit, &res);
+    }
     if (rc != LDAP_SUCCESS)
 	fprintf(stderr, "%d: %s\n", __LINE__, ldap_err2string(rc));
 
     if (rc == LDAP_SUCCESS && ldap_count_entries(ldap, res) != 1) {
+	ldap_msgfree(res);
 	av_set(ac, AV_A_RESULT, AV_V_RESULT_FAIL);
 	result = MAVIS_FINAL;
     } else if (rc == LDAP_SUCCESS) {
@@ -702,64 +1132,8 @@ static void *run_thread(void *arg)
 		    int i = 0;
 		    for (i = 0; v[i]; i++)
 			memberOfAdded |= !dnhash_add_entry(ldap, hash, v[i]->bv_val, ldap_group_depth);
-		} else if (!strcasecmp(attribute, ldap_tacmember_attr)) {
-		    size_t b_len = 4;
-		    int i = 0;
-		    for (i = 0; v[i]; i++)
-			b_len += v[i]->bv_len;
-		    char *b = calloc(1, b_len);
-		    char *p = b;
-		    for (i = 0; v[i]; i++) {
-			if (*p != *b)
-			    *p++ = ',';
-			*p++ = '"';
-			memcpy(p, v[i]->bv_val, v[i]->bv_len);
-			p += v[i]->bv_len;
-			*p++ = '"';
-		    }
-		    av_set(ac, AV_A_TACMEMBER, b);
-		    free(b);
-		} else if (!strcasecmp(attribute, "sshPublicKey")) {
-		    size_t b_len = 4;
-		    int i = 0;
-		    for (i = 0; v[i]; i++)
-			b_len += v[i]->bv_len;
-		    char *b = calloc(1, b_len);
-		    char *p = b;
-		    for (i = 0; v[i]; i++) {
-			if (*p != *b)
-			    *p++ = ',';
-			*p++ = '"';
-			memcpy(p, v[i]->bv_val, v[i]->bv_len);
-			p += v[i]->bv_len;
-			*p++ = '"';
-		    }
-		    av_set(ac, AV_A_SSHKEY, b);
-		    free(b);
-		} else if (*v) {
-		    if (!strcasecmp(attribute, "uidNumber")) {
-			av_set(ac, AV_A_UID, v[0]->bv_val);
-		    } else if (!strcasecmp(attribute, "gidNumber")) {
-			av_set(ac, AV_A_GID, v[0]->bv_val);
-		    } else if (!strcasecmp(attribute, "loginShell")) {
-			av_set(ac, AV_A_SHELL, v[0]->bv_val);
-		    } else if (!strcasecmp(attribute, "homeDirectory")) {
-			av_set(ac, AV_A_SHELL, v[0]->bv_val);
-		    } else if (!strcasecmp(attribute, "shadowExpire")) {
-			int i = atoi(v[0]->bv_val);
-			if (i > -1)
-			    expiry = i * 86400;
-		    } else if (!strcasecmp(attribute, "krbPasswordExpiration")) {
-			struct tm tm = { 0 };
-			char z;
-			if (7 == sscanf(v[0]->bv_val, "%4d%2d%2d%2d%2d%2d%c", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &z)
-			    && z == 'Z') {
-			    tm.tm_year -= 1900;
-			    tm.tm_mon -= 1;
-			    expiry = mktime(&tm);
-			}
-		    }
-		}
+		} else
+		    user_attr(ac, attribute, v, &expiry);
 		ldap_value_free_len(v);
 	    }
 	}
@@ -767,131 +1141,25 @@ static void *run_thread(void *arg)
 	if (!memberOfAdded)
 	    memberOfAdded |= !dnhash_add_entry_groupOfNames(ldap, hash, dn, ldap_group_depth);
 
-	char *tacmember_ou = "";
-	if (ldap_tacmember_map_ou) {
-	    tacmember_ou = alloca(strlen(dn));
-	    char *d = dn;
-	    char *t = tacmember_ou;
-	    while (*d && *d != ',')
-		d++;
-	    while (*d) {
-		if (d[0] == ',' && tolower((int) d[1]) == 'o' && tolower((int) d[2]) == 'u' && d[3] == '=') {
-		    d += 4;
-		    if (t != tacmember_ou)
-			*t++ = ',';
-		    *t++ = '"';
-		    while (*d && *d != ',')
-			*t++ = *d++;
-		    *t++ = '"';
-		    if (*d)
-			d++;
-		} else
-		    do {
-			d++;
-		    } while (*d && *d != ',');
-	    }
-	    *t = 0;
-	}
-
-	int i;
-	int tacmember_len = strlen(tacmember_ou) + 1;
-	int memberof_len = 0;
-	for (i = 0; i < 256; i++) {
-	    struct dnhash *h = hash[i];
-	    for (; h; h = h->next) {
-		memberof_len += 3 + h->len;
-		tacmember_len += 3 + h->match_len;
-	    }
-	}
-	if (tacmember_len || memberof_len) {
-	    char *t = alloca(tacmember_len < memberof_len ? memberof_len : tacmember_len);
-	    if (memberof_len) {
-		char *b = t;
-		for (i = 0; i < 256; i++) {
-		    struct dnhash *h = hash[i];
-		    for (; h; h = h->next) {
-			if (!h->add)
-			    continue;
-			if (b != t)
-			    *b++ = ',';
-			*b++ = '"';
-			memcpy(b, h->name, h->len);
-			b += h->len;
-			*b++ = '"';
-		    }
-		}
-		*b = 0;
-		av_set(ac, AV_A_MEMBEROF, t);
-	    }
-	    if (tacmember_len) {
-		char *b = t;
-		while (*tacmember_ou)
-		    *b++ = *tacmember_ou++;
-		for (i = 0; i < 256; i++) {
-		    struct dnhash *h = hash[i];
-		    for (; h; h = h->next) {
-			if (!h->add)
-			    continue;
-			if (b != t)
-			    *b++ = ',';
-			*b++ = '"';
-			memcpy(b, h->name + h->match_start, h->match_len);
-			b += h->match_len;
-			*b++ = '"';
-		    }
-		}
-		*b = 0;
-		av_set(ac, AV_A_TACMEMBER, t);
-	    }
-	}
+	set_groups(ac, dn, hash);
 	dnhash_drop(hash);
 
 	ldap_msgfree(res);
 
 	if (is_auth) {
-	    char *cap = av_get(ac, AV_A_CALLER_CAP);
-	    int caller_cap_chpw = (cap && strstr(cap, ":chpw:"));
-
-	    if (expiry > -1 && expiry < time(NULL)) {
-		av_set(ac, AV_A_USER_RESPONSE, "Password has expired.");
-		if (caller_cap_chpw && (capabilities & (CAP_PWMODIFY | CAP_AD)))
-		    av_set(ac, AV_A_PASSWORD_MUSTCHANGE, "1");
-		else {
-		    av_set(ac, AV_A_RESULT, AV_V_RESULT_FAIL);
-		    av_write(ac, MAVIS_FINAL);
-		    ldap_memfree(dn);
-		    if (ldap)
-			ldap_unbind_ext_s(ldap, NULL, NULL);
-		    return NULL;
-		}
+	    if (password_expired(ac, expiry)) {
+		av_write(ac, MAVIS_FINAL);
+		ldap_memfree(dn);
+		return;
 	    }
+	    conn->user_bound = 1;
 	    rc = LDAP_bind_user(ldap, dn, av_get(ac, AV_A_PASSWORD));
-	    if (rc == LDAP_SUCCESS) {
-		av_set(ac, AV_A_RESULT, AV_V_RESULT_OK);
-		result = MAVIS_FINAL;
-	    } else {
-		char *diag = NULL;
-		char *out = NULL;
+	    char *diag = NULL;
+	    if (rc != LDAP_SUCCESS)
 		ldap_get_option(ldap, LDAP_OPT_DIAGNOSTIC_MESSAGE, (void *) &diag);
-		char *err = ldap_err2string(rc);
-		if (rc == LDAP_INVALID_CREDENTIALS && (capabilities & CAP_AD) && caller_cap_chpw
-		    && !pcre2_match((pcre2_code *) ad_dsid_regex, (PCRE2_SPTR8) diag, (PCRE2_SIZE) strlen(diag), 0, 0, NULL, NULL)
-		    ) {
-		    if (!strcmp(tactype, AV_V_TACTYPE_AUTH)) {
-			av_set(ac, AV_A_USER_RESPONSE, "Password has expired.");
-			av_set(ac, AV_A_RESULT, AV_V_RESULT_OK);
-			av_set(ac, AV_A_PASSWORD_MUSTCHANGE, "1");
-			result = MAVIS_FINAL;
-		    }
-		} else {
-		    av_set(ac, AV_A_USER_RESPONSE, translate_ldap_error(err, diag, &out));
-		    av_set(ac, AV_A_RESULT, AV_V_RESULT_FAIL);
-		}
-		if (out)
-		    free(out);
-		if (diag)
-		    ldap_memfree(diag);
-	    }
+	    result = bind_result(ac, rc, diag, result);
+	    if (diag)
+		ldap_memfree(diag);
 	} else if (!strcmp(tactype, AV_V_TACTYPE_INFO)) {
 	    result = MAVIS_FINAL;
 	    av_set(ac, AV_A_RESULT, AV_V_RESULT_OK);
@@ -983,17 +1251,660 @@ static void *run_thread(void *arg)
 	    result = MAVIS_FINAL;
 	}
 
-	if (ldap)
-	    ldap_unbind_ext_s(ldap, NULL, NULL);
 	ldap_memfree(dn);
     } else {
+	if (res)
+	    ldap_msgfree(res);
+	if (LDAP_CONN_LOST(rc))
+	    ldap_conn_close(conn);
 	av_set(ac, AV_A_RESULT, AV_V_RESULT_ERROR);
 	result = MAVIS_FINAL;
     }
     av_write(ac, result);
+}
+
+/*
+ * Bounded worker pool. Threads are started on demand, up to LDAP_THREADS,
+ * and each one owns a persistent LDAP connection.
+ */
+struct query {
+    struct query *next;
+    av_ctx *ac;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct query *head;
+    struct query *tail;
+    int queued;
+    int idle;
+    int threads;
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER,.cond = PTHREAD_COND_INITIALIZER };
+
+static void *pool_thread(void *arg __attribute__((unused)))
+{
+    struct ldap_conn conn = { 0 };
+    while (1) {
+	pthread_mutex_lock(&pool.lock);
+	pool.idle++;
+	while (!pool.head)
+	    pthread_cond_wait(&pool.cond, &pool.lock);
+	pool.idle--;
+	struct query *q = pool.head;
+	pool.head = q->next;
+	if (!pool.head)
+	    pool.tail = NULL;
+	pool.queued--;
+	pthread_mutex_unlock(&pool.lock);
+
+	process_query(&conn, q->ac);
+	free(q);
+    }
+    return NULL;
+}
+
+static int pool_enqueue(av_ctx *ac, char **fname)
+{
+    int res = 0;
+    pthread_mutex_lock(&pool.lock);
+    if (pool.queued >= pool.idle && pool.threads < ldap_threads) {
+	pthread_t thread;
+	pthread_attr_t thread_attr;
+	pthread_attr_init(&thread_attr);
+	*fname = "pthread_create";
+	res = pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+	if (res)
+	    *fname = "pthread_attr_setdetachstate";
+	else
+	    res = pthread_create(&thread, &thread_attr, pool_thread, NULL);
+	pthread_attr_destroy(&thread_attr);
+	if (!res)
+	    pool.threads++;
+	else if (pool.threads)
+	    res = 0;		// existing threads will pick it up
+    }
+    if (!res) {
+	struct query *q = calloc(1, sizeof(struct query));
+	q->ac = ac;
+	if (pool.tail)
+	    pool.tail->next = q;
+	else
+	    pool.head = q;
+	pool.tail = q;
+	pool.queued++;
+	pthread_cond_signal(&pool.cond);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return res;
+}
+
+/*
+ * Asynchronous mode, enabled by setting LDAP_ASYNC_CONNECTIONS. A single
+ * thread multiplexes user and group searches over that many connections
+ * bound as LDAP_USER, matching responses to queries by message id. A user
+ * bind changes the identity of the whole connection, so binds go to a
+ * separate set of connections with at most one bind in flight on each.
+ * Password changes still use the worker pool.
+ */
+#define OP_USER 0
+#define OP_MEMBEROF 1
+#define OP_GROUPOFNAMES 2
+#define OP_BIND 3
+
+struct aquery {
+    struct aquery *next;
+    av_ctx *ac;
+    char *dn;
+    struct dnhash **hash;
+    time_t expiry;
+    int pending;		// outstanding operations
+    int result;
+    int done;			// RESULT is set
+    int error;
+    int failed;			// connection lost, retried once
+    int tries;
+};
+
+struct aop {
+    struct aop *next;
+    struct aquery *q;
+    time_t start;
+    int msgid;
+    int kind;
+    int level;
+    char dn[1];
+};
+
+struct aconn {
+    struct ldap_conn conn;
+    struct aop *ops;
+    int count;
+};
+
+static struct aconn *async_search_conns = NULL;
+static struct aconn *async_bind_conns = NULL;
+static struct aquery *async_ready = NULL;
+static struct aquery *async_wait_head = NULL;
+static struct aquery *async_wait_tail = NULL;
+
+static struct {
+    pthread_mutex_t lock;
+    struct aquery *head;
+    struct aquery *tail;
+    int pipe[2];
+    int outstanding;		// queries accepted, but not yet answered
+} async = {.lock = PTHREAD_MUTEX_INITIALIZER,.pipe = { -1, -1 } };
+
+static void async_reply(struct aquery *q, int result)
+{
+    av_write(q->ac, result);
+    if (q->dn)
+	ldap_memfree(q->dn);
+    if (q->hash)
+	dnhash_drop(q->hash);
+    free(q);
+    pthread_mutex_lock(&async.lock);
+    async.outstanding--;
+    pthread_mutex_unlock(&async.lock);
+}
+
+static void async_error(struct aquery *q)
+{
+    av_set(q->ac, AV_A_RESULT, AV_V_RESULT_ERROR);
+    async_reply(q, MAVIS_FINAL);
+}
+
+// Called when an operation of q has finished. The query continues from the event loop.
+static void async_done(struct aquery *q)
+{
+    if (!--q->pending) {
+	q->next = async_ready;
+	async_ready = q;
+    }
+}
+
+static LDAP *async_conn_get(struct aconn *c)
+{
+    // Health checks are pointless while responses are outstanding.
+    if (c->count && c->conn.ldap) {
+	c->conn.last_used = time(NULL);
+	return c->conn.ldap;
+    }
+    return ldap_conn_get(&c->conn);
+}
+
+static void async_conn_close(struct aconn *c)
+{
+    struct aop *op = c->ops;
+    c->ops = NULL;
+    c->count = 0;
+    ldap_conn_close(&c->conn);
+    while (op) {
+	struct aop *next = op->next;
+	op->q->failed = 1;
+	async_done(op->q);
+	free(op);
+	op = next;
+    }
+}
+
+static void async_op_add(struct aconn *c, struct aquery *q, int kind, char *dn, int level, int msgid)
+{
+    size_t len = dn ? strlen(dn) : 0;
+    struct aop *op = calloc(1, sizeof(struct aop) + len);
+    op->q = q;
+    op->kind = kind;
+    op->level = level;
+    op->msgid = msgid;
+    op->start = time(NULL);
+    if (dn)
+	memcpy(op->dn, dn, len);
+    op->next = c->ops;
+    c->ops = op;
+    c->count++;
+    q->pending++;
+}
+
+static struct aop *async_op_take(struct aconn *c, int msgid)
+{
+    for (struct aop ** op = &c->ops; *op; op = &(*op)->next)
+	if ((*op)->msgid == msgid) {
+	    struct aop *res = *op;
+	    *op = res->next;
+	    c->count--;
+	    return res;
+	}
+    return NULL;
+}
+
+static int async_search(struct aquery *q, int kind, char *dn, int level)
+{
+    char *user_attrs[] = USER_ATTRS;
+    char *memberof_attrs[] = { "memberOf", NULL };
+    char *groupofnames_attrs[] = { "member", NULL };
+    char **attrs = user_attrs;
+    char *base = base_dn;
+    int sc = scope;
+    char *filter = "(objectClass=*)";
+
+    if (kind == OP_USER) {
+	char *username = av_get(q->ac, AV_A_USER);
+	size_t filter_len = ldap_filter_len + strlen(username);
+	filter = alloca(filter_len);
+	snprintf(filter, filter_len, ldap_filter, username);
+    } else if (kind == OP_MEMBEROF) {
+	attrs = memberof_attrs;
+	base = dn;
+	sc = LDAP_SCOPE_BASE;
+    } else {
+	size_t filter_len = strlen(dn) + ldap_filter_group_len;
+	filter = alloca(filter_len);
+	snprintf(filter, filter_len, ldap_filter_group, dn);
+	attrs = groupofnames_attrs;
+	base = base_dn_group;
+	sc = scope_group;
+    }
+
+    /*
+     * Reconnecting fails all operations of the connection, possibly including
+     * some of q's. Hold a reference meanwhile, so q isn't completed (and
+     * restarted or freed) while a search is added to it.
+     */
+    q->pending++;
+    int res = -1;
+    struct timeval tv = {.tv_sec = ldap_timeout };
+    for (int i = 0; i < 2; i++) {
+	struct aconn *c = async_search_conns;
+	for (int j = 1; j < ldap_async; j++)
+	    if (async_search_conns[j].count < c->count)
+		c = &async_search_conns[j];
+	int msgid = 0;
+	LDAP *ldap = async_conn_get(c);
+	int rc = ldap_search_ext(ldap, base, sc, filter, attrs, 0, NULL, NULL, &tv, ldap_sizelimit, &msgid);
+	if (rc == LDAP_SUCCESS) {
+	    async_op_add(c, q, kind, dn, level, msgid);
+	    res = 0;
+	    break;
+	}
+	fprintf(stderr, "%d: %s\n", __LINE__, ldap_err2string(rc));
+	if (!LDAP_CONN_LOST(rc))
+	    break;
+	// stale connection, reconnect and try once more
+	async_conn_close(c);
+    }
+    // Callers hold a reference of their own, or handle the failure.
+    q->pending--;
+    return res;
+}
+
+static int async_memberof(struct aquery *, char *, int);
+static void async_groupofnames(struct aquery *, char *, int);
+
+static void async_memberof_list(struct aquery *q, char **list, int level)
+{
+    for (char **l = list; *l; l++)
+	async_memberof(q, *l, level - 1);
+    free(list);
+}
+
+// Asynchronous variant of dnhash_add_entry().
+static int async_memberof(struct aquery *q, char *dn, int level)
+{
+    if (dnhash_add_group(q->hash, dn))
+	return -1;
+    if (level < 1 && ldap_group_depth > -2)
+	return 0;
+    char **list = groupcache_get(dn, GROUPCACHE_MEMBEROF);
+    if (list)
+	async_memberof_list(q, list, level);
+    else
+	async_search(q, OP_MEMBEROF, dn, level);
+    return 0;
+}
+
+static void async_groupofnames_list(struct aquery *q, char **list, int level)
+{
+    int res = 0;
+    for (char **l = list; *l && !res; l++) {
+	res = dnhash_add_gdn(q->hash, *l);
+	if (!res)
+	    async_groupofnames(q, *l, level - 1);
+	else if (res > 0)
+	    res = 0;
+    }
+    free(list);
+}
+
+// Asynchronous variant of dnhash_add_entry_groupOfNames().
+static void async_groupofnames(struct aquery *q, char *dn, int level)
+{
+    if (level < 1 && ldap_group_depth > -2)
+	return;
+    char **list = (level != ldap_group_depth) ? groupcache_get(dn, GROUPCACHE_GROUPOFNAMES) : NULL;
+    if (list)
+	async_groupofnames_list(q, list, level);
+    else
+	async_search(q, OP_GROUPOFNAMES, dn, level);
+}
+
+static void async_user(struct aquery *q, LDAP *ldap, LDAPMessage *res)
+{
+    if (ldap_count_entries(ldap, res) != 1) {
+	av_set(q->ac, AV_A_RESULT, AV_V_RESULT_FAIL);
+	q->result = MAVIS_FINAL;
+	q->done = 1;
+	return;
+    }
+
+    LDAPMessage *entry = ldap_first_entry(ldap, res);
+    q->dn = ldap_get_dn(ldap, entry);
+    av_set(q->ac, AV_A_DN, q->dn);
+
+    // Group lookups may need to reconnect, so ldap is done with before they start.
+    struct berval **memberof = NULL;
+    BerElement *be = NULL;
+    for (char *attribute = ldap_first_attribute(ldap, entry, &be); attribute; attribute = ldap_next_attribute(ldap, entry, be)) {
+	struct berval **v = ldap_get_values_len(ldap, entry, attribute);
+	if (v && !memberof && !strcasecmp(attribute, "memberOf"))
+	    memberof = v;
+	else if (v) {
+	    user_attr(q->ac, attribute, v, &q->expiry);
+	    ldap_value_free_len(v);
+	}
+	ldap_memfree(attribute);
+    }
+    if (be)
+	ber_free(be, 0);
+
+    int memberOfAdded = 0;
+    if (memberof) {
+	for (int i = 0; memberof[i]; i++)
+	    memberOfAdded |= !async_memberof(q, memberof[i]->bv_val, ldap_group_depth);
+	ldap_value_free_len(memberof);
+    }
+    if (!memberOfAdded)
+	async_groupofnames(q, q->dn, ldap_group_depth);
+}
+
+static void async_result(struct aconn *c, struct aop *op, LDAPMessage *msg)
+{
+    struct aquery *q = op->q;
+    LDAP *ldap = c->conn.ldap;
+    char *diag = NULL;
+    int rc = LDAP_OTHER;
+    int prc = ldap_parse_result(ldap, msg, &rc, NULL, &diag, NULL, NULL, 0);
+    if (prc != LDAP_SUCCESS)
+	rc = prc;
+    if (rc != LDAP_SUCCESS && op->kind != OP_BIND)
+	fprintf(stderr, "%d: %s\n", __LINE__, ldap_err2string(rc));
+
+    if (LDAP_CONN_LOST(rc))
+	q->failed = 1;
+    else
+	switch (op->kind) {
+	case OP_USER:
+	    if (rc == LDAP_SUCCESS)
+		async_user(q, ldap, msg);
+	    else
+		q->error = 1;
+	    break;
+	case OP_MEMBEROF:
+	    if (rc == LDAP_SUCCESS)
+		async_memberof_list(q, memberof_list(ldap, op->dn, msg), op->level);
+	    break;
+	case OP_GROUPOFNAMES:
+	    if (rc == LDAP_SUCCESS)
+		async_groupofnames_list(q, groupofnames_list(ldap, op->dn, msg, op->level != ldap_group_depth), op->level);
+	    break;
+	case OP_BIND:
+	    q->result = bind_result(q->ac, rc, diag, MAVIS_DOWN);
+	    q->done = 1;
+	    break;
+	}
+    if (diag)
+	ldap_memfree(diag);
+    async_done(q);
+}
+
+static void async_read(struct aconn *c)
+{
+    struct timeval zero = { 0 };
+    LDAPMessage *msg = NULL;
+    int rc;
+    while (c->count && (rc = ldap_result(c->conn.ldap, LDAP_RES_ANY, LDAP_MSG_ALL, &zero, &msg))) {
+	if (rc < 0) {
+	    rc = LDAP_SERVER_DOWN;
+	    ldap_get_option(c->conn.ldap, LDAP_OPT_RESULT_CODE, &rc);
+	    fprintf(stderr, "%d: %s, reconnecting\n", __LINE__, ldap_err2string(rc));
+	    async_conn_close(c);
+	    return;
+	}
+	struct aop *op = async_op_take(c, ldap_msgid(msg));
+	if (op) {
+	    async_result(c, op, msg);
+	    free(op);
+	}
+	ldap_msgfree(msg);
+    }
+}
+
+static void async_expire(struct aconn *c)
+{
+    time_t now = time(NULL);
+    int drop = 0;
+    for (struct aop ** op = &c->ops; *op;)
+	if ((*op)->start + ldap_timeout < now) {
+	    struct aop *o = *op;
+	    *op = o->next;
+	    c->count--;
+	    // A bind can't be abandoned, the connection has to go.
+	    if (o->kind == OP_BIND)
+		drop = 1;
+	    else
+		ldap_abandon_ext(c->conn.ldap, o->msgid, NULL, NULL);
+	    fprintf(stderr, "%d: %s\n", __LINE__, ldap_err2string(LDAP_TIMEOUT));
+	    o->q->error = 1;
+	    async_done(o->q);
+	    free(o);
+	} else
+	    op = &(*op)->next;
+    if (drop)
+	async_conn_close(c);
+}
+
+static void async_bind(struct aquery *q)
+{
+    char *password = av_get(q->ac, AV_A_PASSWORD);
+    if (!password || !*password) {
+	async_reply(q, bind_result(q->ac, LDAP_INVALID_CREDENTIALS, NULL, MAVIS_DOWN));
+	return;
+    }
+
+    struct aconn *c = NULL;
+    for (int i = 0; i < ldap_async && !c; i++)
+	if (!async_bind_conns[i].count)
+	    c = &async_bind_conns[i];
+    if (!c) {
+	q->next = NULL;
+	if (async_wait_tail)
+	    async_wait_tail->next = q;
+	else
+	    async_wait_head = q;
+	async_wait_tail = q;
+	return;
+    }
+
+    struct berval ber = {.bv_len = strlen(password),.bv_val = password };
+    for (int i = 0; i < 2; i++) {
+	int msgid = 0;
+	LDAP *ldap = async_conn_get(c);
+	int rc = ldap_sasl_bind(ldap, q->dn, LDAP_SASL_SIMPLE, &ber, NULL, NULL, &msgid);
+	if (rc == LDAP_SUCCESS) {
+	    async_op_add(c, q, OP_BIND, NULL, 0, msgid);
+	    return;
+	}
+	fprintf(stderr, "%d: %s\n", __LINE__, ldap_err2string(rc));
+	if (!LDAP_CONN_LOST(rc))
+	    break;
+	async_conn_close(c);
+    }
+    async_error(q);
+}
+
+static void async_start(struct aquery *q)
+{
+    q->expiry = -1;
+    q->hash = dnhash_new();
+    if (async_search(q, OP_USER, NULL, 0))
+	async_error(q);
+}
+
+static void async_continue(struct aquery *q)
+{
+    if (q->failed && !q->tries++) {
+	if (q->dn)
+	    ldap_memfree(q->dn);
+	q->dn = NULL;
+	dnhash_drop(q->hash);
+	q->failed = q->error = q->done = 0;
+	async_start(q);
+    } else if (q->failed || q->error)
+	async_error(q);
+    else if (q->done)
+	async_reply(q, q->result);
+    else {
+	// User search and group lookups have finished.
+	set_groups(q->ac, q->dn, q->hash);
+	dnhash_drop(q->hash);
+	q->hash = NULL;
+	char *tactype = av_get(q->ac, AV_A_TACTYPE);
+	if (!strcmp(tactype, AV_V_TACTYPE_AUTH)) {
+	    if (password_expired(q->ac, q->expiry))
+		async_reply(q, MAVIS_FINAL);
+	    else
+		async_bind(q);
+	} else {
+	    av_set(q->ac, AV_A_RESULT, strcmp(tactype, AV_V_TACTYPE_INFO) ? AV_V_RESULT_FAIL : AV_V_RESULT_OK);
+	    async_reply(q, MAVIS_FINAL);
+	}
+    }
+}
+
+static void *async_thread(void *arg __attribute__((unused)))
+{
+    struct pollfd pfd[2 * ldap_async + 1];
+    struct aconn *pconn[2 * ldap_async + 1];
+
+    while (1) {
+	int n = 0;
+	pfd[n].fd = async.pipe[0];
+	pfd[n].events = POLLIN;
+	pconn[n++] = NULL;
+	for (int i = 0; i < 2 * ldap_async; i++) {
+	    struct aconn *c = (i < ldap_async) ? &async_search_conns[i] : &async_bind_conns[i - ldap_async];
+	    int fd = -1;
+	    if (c->count && c->conn.ldap && ldap_get_option(c->conn.ldap, LDAP_OPT_DESC, &fd) == LDAP_OPT_SUCCESS && fd > -1) {
+		pfd[n].fd = fd;
+		pfd[n].events = POLLIN;
+		pconn[n++] = c;
+	    }
+	}
+
+	poll(pfd, n, 1000);
+
+	if (pfd[0].revents & POLLIN) {
+	    char b[64];
+	    while (read(async.pipe[0], b, sizeof(b)) == sizeof(b));
+	}
+	pthread_mutex_lock(&async.lock);
+	struct aquery *q = async.head;
+	async.head = async.tail = NULL;
+	pthread_mutex_unlock(&async.lock);
+	while (q) {
+	    struct aquery *next = q->next;
+	    async_start(q);
+	    q = next;
+	}
+
+	for (int i = 1; i < n; i++)
+	    if (pfd[i].revents)
+		async_read(pconn[i]);
+
+	for (int i = 0; i < ldap_async; i++) {
+	    async_expire(&async_search_conns[i]);
+	    async_expire(&async_bind_conns[i]);
+	}
+
+	do {
+	    while (async_ready) {
+		q = async_ready;
+		async_ready = q->next;
+		async_continue(q);
+	    }
+	    while (async_wait_head) {
+		int i;
+		for (i = 0; i < ldap_async && async_bind_conns[i].count; i++);
+		if (i == ldap_async)
+		    break;
+		q = async_wait_head;
+		async_wait_head = q->next;
+		if (!async_wait_head)
+		    async_wait_tail = NULL;
+		async_bind(q);
+	    }
+	} while (async_ready);
+    }
     return NULL;
 }
 
+static int async_enqueue(av_ctx *ac, char **fname)
+{
+    if (async.pipe[0] < 0) {
+	pthread_t thread;
+	pthread_attr_t thread_attr;
+	*fname = "pipe";
+	if (pipe(async.pipe))
+	    return errno;
+	fcntl(async.pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(async.pipe[1], F_SETFL, O_NONBLOCK);
+	async_search_conns = calloc(ldap_async, sizeof(struct aconn));
+	async_bind_conns = calloc(ldap_async, sizeof(struct aconn));
+	pthread_attr_init(&thread_attr);
+	*fname = "pthread_create";
+	int res = pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+	if (res)
+	    *fname = "pthread_attr_setdetachstate";
+	else
+	    res = pthread_create(&thread, &thread_attr, async_thread, NULL);
+	pthread_attr_destroy(&thread_attr);
+	if (res) {
+	    close(async.pipe[0]);
+	    close(async.pipe[1]);
+	    async.pipe[0] = async.pipe[1] = -1;
+	    return res;
+	}
+    }
+
+    pthread_mutex_lock(&async.lock);
+    if (async.outstanding >= ldap_async_queue) {
+	pthread_mutex_unlock(&async.lock);
+	*fname = "async_enqueue";
+	return EAGAIN;
+    }
+    async.outstanding++;
+    struct aquery *q = calloc(1, sizeof(struct aquery));
+    q->ac = ac;
+    if (async.tail)
+	async.tail->next = q;
+    else
+	async.head = q;
+    async.tail = q;
+    pthread_mutex_unlock(&async.lock);
+    write(async.pipe[1], "", 1);
+    return 0;
+}
+
 int main(int argc, char **argv __attribute__((unused)))
 {
     if (argc > 1)
@@ -1089,6 +2000,32 @@ int main(int argc, char **argv __attribute__((unused)))
     if (tmp)
 	ldap_group_depth = atoi(tmp);
 
+    tmp = getenv("LDAP_THREADS");
+    if (tmp)
+	ldap_threads = atoi(tmp);
+    if (ldap_threads < 1)
+	ldap_threads = 1;
+
+    tmp = getenv("LDAP_ASYNC_CONNECTIONS");
+    if (tmp)
+	ldap_async = atoi(tmp);
+    if (ldap_async < 0)
+	ldap_async = 0;
+
+    tmp = getenv("LDAP_ASYNC_QUEUE");
+    if (tmp)
+	ldap_async_queue = atoi(tmp);
+    if (ldap_async_queue < 1)
+	ldap_async_queue = 1;
+
+    tmp = getenv("LDAP_HEALTHCHECK_INTERVAL");
+    if (tmp)
+	ldap_healthcheck_interval = atoi(tmp);
+
+    tmp = getenv("LDAP_GROUP_CACHE_TTL");
+    if (tmp)
+	ldap_group_cache_ttl = atoi(tmp);
+
     tmp = getenv("LDAP_TLS_PROTOCOL_MIN");
     if (tmp) {
 	if (!strcmp(tmp, "TLS1_0"))
@@ -1132,8 +2069,10 @@ int main(int argc, char **argv __attribute__((unused)))
 	fprintf(stderr, "PCRE2 error: %s\n", buffer);
     }
 
-    LDAP *ldap = NULL;
-    int result = LDAP_init(&ldap, &capabilities);
+    // initial connection, reused for legacy (single-threaded) requests
+    struct ldap_conn main_conn = { 0 };
+    int result = LDAP_init(&main_conn.ldap, &capabilities);
+    main_conn.last_used = time(NULL);
     if (result)
 	fprintf(stderr, "%d: %s\n", __LINE__, ldap_err2string(result));
 
@@ -1157,39 +2096,40 @@ int main(int argc, char **argv __attribute__((unused)))
 
     while (1) {
 	struct mavis_ext_hdr_v1 hdr;
-	size_t hdr_off = 0;
 	av_ctx *ac = NULL;
 
-	if (is_mt != TRISTATE_NO) {
-	    while (sizeof(struct mavis_ext_hdr_v1) != hdr_off) {
-		int len = read(0, (char *) &hdr + hdr_off, sizeof(struct mavis_ext_hdr_v1) - hdr_off);
-		if (len < 1) {
-		    exit(-1);
-		}
-		hdr_off += len;
-	    }
-	}
+	if (is_mt != TRISTATE_NO && mavis_ext_read_hdr(0, &hdr))
+	    exit(-1);
 
-	if (is_mt != TRISTATE_NO && ntohl(hdr.magic) == MAVIS_EXT_MAGIC_V1) {
+	uint32_t magic = ntohl(hdr.magic);
+	if (is_mt != TRISTATE_NO && (magic == MAVIS_EXT_MAGIC_V1 || magic == MAVIS_EXT_MAGIC_V2)) {
 	    if (is_mt == TRISTATE_DUNNO) {
 		if (pthread_mutex_init(&mutex_lock, NULL))
 		    fprintf(stderr, "pthread_mutex_init() failed, expect trouble\n");
 		is_mt = TRISTATE_YES;
+		ldap_conn_close(&main_conn);
 	    }
 	    size_t len = ntohl(hdr.body_len);
 	    char *b = calloc(1, len + 1);
-	    size_t off = 0;
-	    while (len - off > 0) {
-		size_t nlen = read(0, b + off, len - off);
-		if (nlen < 1) {
-		    fprintf(stderr, "Short read (body).\n");
-		    exit(1);
-		}
-		off += nlen;
+	    if (mavis_ext_read_body(0, b, len)) {
+		fprintf(stderr, "Short read (body).\n");
+		exit(1);
 	    }
 	    ac = av_new(NULL, NULL);
-	    av_char_to_array(ac, b, NULL);
+	    if (magic == MAVIS_EXT_MAGIC_V2)
+		av_tlv_to_array(ac, b, len, NULL);
+	    else
+		av_char_to_array(ac, b, NULL);
 	    free(b);
+	    if (magic == MAVIS_EXT_MAGIC_V2 || (ntohl(hdr.result) & MAVIS_EXT_CAP_TLV))
+		use_tlv = 1;
+	    if ((ntohl(hdr.result) & MAVIS_EXT_CAP_BATCH) && !use_batch) {
+		struct mavis_ext_hdr_v1 h = {.magic = htonl(MAVIS_EXT_MAGIC_BATCH) };
+		use_batch = 1;
+		pthread_mutex_lock(&mutex_lock);
+		write(1, &h, sizeof(h));
+		pthread_mutex_unlock(&mutex_lock);
+	    }
 	} else {
 	    if (is_mt == TRISTATE_YES) {
 		fprintf(stderr, "Bad magic.\n");
@@ -1253,15 +2193,12 @@ int main(int argc, char **argv __attribute__((unused)))
 	    av_set(ac, AV_A_RESULT, AV_V_RESULT_FAIL);
 	    av_write(ac, MAVIS_FINAL);
 	} else if (is_mt == TRISTATE_YES) {
-	    pthread_t thread;
-	    pthread_attr_t thread_attr;
-	    pthread_attr_init(&thread_attr);
-	    char *fname = "pthread_create";
-	    int res = pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
-	    if (res)
-		fname = "pthread_attr_setdetachstate";
+	    char *fname = NULL;
+	    int res;
+	    if (ldap_async && strcmp(tactype, AV_V_TACTYPE_CHPW))
+		res = async_enqueue(ac, &fname);
 	    else
-		res = pthread_create(&thread, &thread_attr, run_thread, ac);
+		res = pool_enqueue(ac, &fname);
 	    if (res) {
 		char *err = strerror(res);
 		av_setf(ac, AV_A_COMMENT, "%s(): %s%s[%d]", fname, err ? err : "", err ? " " : "", res);
@@ -1270,7 +2207,7 @@ int main(int argc, char **argv __attribute__((unused)))
 		av_write(ac, MAVIS_FINAL);
 	    }
 	} else {
-	    run_thread(ac);
+	    process_query(&main_conn, ac);
 	}
     }
     exit(EX_OK);
@@ -372,6 +372,71 @@ int av_char_to_array(av_ctx * ac, char *buffer, fd_set * set)
     return 0;
 }
 
+/*
+ * Binary (TLV) encoding, used for MAVIS_EXT_MAGIC_V2 bodies. Each attribute is
+ * sent as a 16 bit attribute number and a 32 bit value length (both in network
+ * byte order), followed by the value itself. Values are neither escaped nor
+ * NUL-terminated.
+ */
+#define AV_TLV_HDR_LEN 6
+
+size_t av_array_to_tlv_len(av_ctx * ac)
+{
+    size_t j = 0;
+    for (int i = 0; i < AV_A_ARRAYSIZE; i++)
+	if (ac->arr[i])
+	    j += AV_TLV_HDR_LEN + strlen(ac->arr[i]);
+    return j;
+}
+
+int av_array_to_tlv(av_ctx * ac, char *buffer, size_t buflen, fd_set * set)
+{
+    char *t = buffer;
+
+    for (int i = 0; i < AV_A_ARRAYSIZE; i++)
+	if ((!set || FD_ISSET(i, set)) && ac->arr[i]) {
+	    size_t len = strlen(ac->arr[i]);
+	    if (AV_TLV_HDR_LEN + len > (size_t) (buffer + buflen - t))
+		return -1;
+	    uint16_t a = htons((uint16_t) i);
+	    uint32_t l = htonl((uint32_t) len);
+	    memcpy(t, &a, sizeof(a));
+	    memcpy(t + sizeof(a), &l, sizeof(l));
+	    memcpy(t + AV_TLV_HDR_LEN, ac->arr[i], len);
+	    t += AV_TLV_HDR_LEN + len;
+	}
+
+    return (int) (t - buffer);
+}
+
+int av_tlv_to_array(av_ctx * ac, char *buffer, size_t buflen, fd_set * set)
+{
+    char *t = buffer;
+    char *end = buffer + buflen;
+
+    while (end - t >= AV_TLV_HDR_LEN) {
+	uint16_t a;
+	uint32_t l;
+	memcpy(&a, t, sizeof(a));
+	memcpy(&l, t + sizeof(a), sizeof(l));
+	a = ntohs(a);
+	l = ntohl(l);
+	t += AV_TLV_HDR_LEN;
+	if (l > (size_t) (end - t))
+	    return -1;
+	if (a < AV_A_ARRAYSIZE && (!set || FD_ISSET(a, set))) {
+	    // The length is known, so the value is copied exactly once.
+	    Xfree(&ac->arr[a]);
+	    ac->arr[a] = Xcalloc(1, l + 1);
+	    memcpy(ac->arr[a], t, l);
+	    Debug((DEBUG_AV, " %s(%s) = %-20s\n", __func__, av_char[a].name, ac->arr[a]));
+	}
+	t += l;
+    }
+
+    return (t == end) ? 0 : -1;
+}
+
 av_ctx *av_new(void *cb, void *ctx)
 {
     av_ctx *a = Xcalloc((size_t) 1, sizeof(av_ctx));
@@ -454,6 +519,64 @@ void mavis_detach(void)
     fcntl(1, F_SETFD, fcntl(1, F_GETFD, 0) | FD_CLOEXEC);
 }
 
+/*
+ * Input side of external-mt children. Requests packed into a
+ * MAVIS_EXT_MAGIC_BATCH frame are returned one at a time, as if they had
+ * been sent individually. Both functions return 0 on success and -1 on
+ * end of file or malformed input. Not thread-safe, there's supposed to be
+ * just one reader.
+ */
+static char *ext_batch = NULL;
+static size_t ext_batch_len = 0;
+static size_t ext_batch_off = 0;
+
+static int ext_read(int fd, char *buf, size_t len)
+{
+    if (ext_batch) {
+	if (ext_batch_len - ext_batch_off < len)
+	    return -1;
+	memcpy(buf, ext_batch + ext_batch_off, len);
+	ext_batch_off += len;
+	if (ext_batch_off == ext_batch_len)
+	    Xfree(&ext_batch);
+	return 0;
+    }
+    for (size_t off = 0; off < len;) {
+	ssize_t l = read(fd, buf + off, len - off);
+	if (l < 1)
+	    return -1;
+	off += (size_t) l;
+    }
+    return 0;
+}
+
+int mavis_ext_read_hdr(int fd, struct mavis_ext_hdr_v1 *hdr)
+{
+    while (!ext_read(fd, (char *) hdr, sizeof(struct mavis_ext_hdr_v1))) {
+	if (ntohl(hdr->magic) != MAVIS_EXT_MAGIC_BATCH)
+	    return 0;
+	if (ext_batch)		// no nesting
+	    return -1;
+	size_t len = ntohl(hdr->body_len);
+	if (len) {
+	    char *b = Xcalloc(1, len);
+	    if (ext_read(fd, b, len)) {
+		free(b);
+		return -1;
+	    }
+	    ext_batch = b;
+	    ext_batch_len = len;
+	    ext_batch_off = 0;
+	}
+    }
+    return -1;
+}
+
+int mavis_ext_read_body(int fd, char *buf, size_t len)
+{
+    return ext_read(fd, buf, len);
+}
+
 char *escape_string(char *in, size_t inlen, char *out, size_t *outlen)
 {
     char *v = out;
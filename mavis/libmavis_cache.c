@@ -20,22 +20,33 @@
 #include <time.h>
 #include <sysexits.h>
 #include <dlfcn.h>
+#include <stdint.h>
 
 #include "log.h"
 #include "debug.h"
+#include "misc/strops.h"
 #include "misc/memops.h"
 #include "misc/rb.h"
 #include "misc/crc32.h"
+#include "misc/mymd5.h"
+#include "misc/shmtab.h"
 
 static const char rcsid[] __attribute__((used)) = "$Id$";
 
-#define AVPC_TABLE_SIZE 1
+#define AVPC_TABLE_SIZE 2
 
 struct cache {
     char *type;
+    char *tactype;		/* if set, only cache queries of this TACTYPE */
+    char *flight_tactype[3];	/* if set, only coalesce queries of these TACTYPEs */
     time_t maxage;
+    time_t negative_maxage;	/* for NOTFOUND (and, if cache_fail is set, FAIL) answers */
+    time_t stale;		/* expired entries may be served for this long */
+    int cache_fail;		/* FAIL doesn't depend on the password */
     fd_set cmp_set;
     fd_set add_set;
+    fd_set neg_set;		/* add_set plus the result */
+    fd_set flight_set;		/* cmp_set plus query-only attributes */
     u_int count;
     unsigned long long counter_query;
     unsigned long long counter_cached;
@@ -46,6 +57,15 @@ struct cache {
 
 #define MAVIS_CTX_PRIVATE			\
 	int initialized;			\
+	char *shm_path;				\
+	u_int shm_size;				\
+	size_t shm_data_size;			\
+	struct shmtab *shm;			\
+	int coalesce;				\
+	rb_tree_t *flights;			\
+	rb_tree_t *flights_by_serial;		\
+	rb_tree_t *waiters;			\
+	rb_tree_t *refreshes;			\
 	time_t purge_outdated;			\
 	struct cache cache[AVPC_TABLE_SIZE];	\
 	time_t lastdump;			\
@@ -57,11 +77,317 @@ struct cache {
 
 struct item {
     time_t expire;
+    time_t refresh;		/* of the pending background refresh */
     u_int crc32;
     char *add;
     char cmp[1];
 };
 
+/*
+ * Shared cache, for use by all processes on a host (see misc/shmtab.c).
+ * Entries are keyed by a digest of the table index and the compare string,
+ * and hold the compare string, too, followed by the attributes to add.
+ */
+#define SHM_DATA_SIZE 960	/* larger entries stay process-local; makes for 1 kByte slots */
+#define SHM_QUERY(i) (2 * (i))	/* shared counters */
+#define SHM_CACHED(i) (2 * (i) + 1)
+
+#define REFRESH_RETRY 10	/* seconds until a failed refresh of a stale entry is retried */
+
+static void shm_key(int type, char *cmp, size_t cmp_len, u_char *key)
+{
+    myMD5_CTX m;
+    u_char t = (u_char) type;
+    myMD5Init(&m);
+    myMD5Update(&m, &t, 1);
+    myMD5Update(&m, (u_char *) cmp, cmp_len);
+    myMD5Final(key, &m);
+}
+
+/*
+ * Coalescing of identical in-flight queries. The first query for a key is
+ * passed down and registered as a flight; identical queries arriving before
+ * its answer attach to the flight as waiters instead of being sent down. The
+ * answer is copied to every waiter, whose sessions are then resumed from the
+ * event loop, just as if a lower module had answered them.
+ */
+struct waiter;
+
+struct flight {
+    u_int crc32;
+    char *serial;		/* of the query that was sent down */
+    void *app_ctx;		/* ditto */
+    struct waiter *waiters;
+    char key[1];
+};
+
+struct waiter {
+    struct waiter *next;
+    struct flight *flight;	/* NULL once the answer is available */
+    mavis_ctx *mcx;
+    void *app_ctx;
+    av_ctx *ac;
+    int result;
+};
+
+static int cmp_flight(const void *a, const void *b)
+{
+    if (((struct flight *) a)->crc32 < ((struct flight *) b)->crc32)
+	return -1;
+    if (((struct flight *) a)->crc32 > ((struct flight *) b)->crc32)
+	return +1;
+    return strcmp(((struct flight *) a)->key, ((struct flight *) b)->key);
+}
+
+static int cmp_flight_serial(const void *a, const void *b)
+{
+    return strcmp(((struct flight *) a)->serial, ((struct flight *) b)->serial);
+}
+
+static int cmp_waiter(const void *a, const void *b)
+{
+    if (((struct waiter *) a)->app_ctx < ((struct waiter *) b)->app_ctx)
+	return -1;
+    if (((struct waiter *) a)->app_ctx > ((struct waiter *) b)->app_ctx)
+	return +1;
+    return 0;
+}
+
+static int flight_index(mavis_ctx * mcx, av_ctx * ac)
+{
+    char *s = av_get(ac, AV_A_TYPE);
+    char *t = av_get(ac, AV_A_TACTYPE);
+
+    for (int i = 0; i < AVPC_TABLE_SIZE; i++)
+	if (!strcasecmp(mcx->cache[i].type, s)) {
+	    if (!mcx->cache[i].flight_tactype[0])
+		return i;
+	    for (char **f = mcx->cache[i].flight_tactype; t && *f; f++)
+		if (!strcmp(*f, t))
+		    return i;
+	    return -1;
+	}
+    return -1;
+}
+
+static void flight_wakeup(struct waiter *w)
+{
+    io_sched_pop(w->mcx->io, w);
+    ((void (*)(void *)) w->ac->app_cb) (w->ac->app_ctx);
+}
+
+static void flight_ready(struct waiter *w, int result)
+{
+    w->flight = NULL;
+    w->result = result;
+    io_sched_add(w->mcx->io, w, (void *) flight_wakeup, 0, 0);
+}
+
+static void flight_free(mavis_ctx * mcx, struct flight *f)
+{
+    RB_search_and_delete(mcx->flights_by_serial, f);
+    RB_search_and_delete(mcx->flights, f);
+    free(f->serial);
+    free(f);
+}
+
+// Send the waiters of a flight down individually.
+static void flight_redispatch(mavis_ctx * mcx, struct flight *f)
+{
+    struct waiter *w, *next;
+    for (w = f->waiters; w; w = next) {
+	next = w->next;
+	int result = mcx->down->send(mcx->down, &w->ac);
+	if (result == MAVIS_DEFERRED) {
+	    // The lower module owns the query now and will call back.
+	    RB_search_and_delete(mcx->waiters, w);
+	    free(w);
+	} else
+	    flight_ready(w, result == MAVIS_DOWN ? MAVIS_FINAL : result);
+    }
+    f->waiters = NULL;
+}
+
+static void flight_finish(mavis_ctx * mcx, struct flight *fp, av_ctx * ac, int result)
+{
+    // One-time passwords may not be shared, and other failures are up to the waiters.
+    if ((result != MAVIS_FINAL && result != MAVIS_TIMEOUT) || (result == MAVIS_FINAL && av_get(ac, AV_A_PASSWORD_ONESHOT))) {
+	flight_redispatch(mcx, fp);
+	flight_free(mcx, fp);
+	return;
+    }
+
+    for (struct waiter * w = fp->waiters; w; w = w->next) {
+	if (result == MAVIS_FINAL) {
+	    char *serial = Xstrdup(av_get(w->ac, AV_A_SERIAL));
+	    char *timestamp = av_get(w->ac, AV_A_TIMESTAMP);
+	    if (timestamp)
+		timestamp = Xstrdup(timestamp);
+	    av_copy(w->ac, ac);
+	    av_set(w->ac, AV_A_SERIAL, serial);
+	    av_set(w->ac, AV_A_TIMESTAMP, timestamp);
+	    av_unset(w->ac, AV_A_CURRENT_MODULE);
+	    if (!av_get(w->ac, AV_A_COMMENT))
+		av_set(w->ac, AV_A_COMMENT, "coalesced");
+	    free(serial);
+	    free(timestamp);
+	}
+	flight_ready(w, result);
+    }
+    fp->waiters = NULL;
+    flight_free(mcx, fp);
+}
+
+static void flight_done(mavis_ctx * mcx, av_ctx * ac, int result)
+{
+    struct flight f;
+    rb_node_t *r;
+
+    if (mcx->flights_by_serial && (f.serial = av_get(ac, AV_A_SERIAL)) && (r = RB_search(mcx->flights_by_serial, &f)))
+	flight_finish(mcx, RB_payload(r, struct flight *), ac, result);
+}
+
+// The query that was sent down is gone, so send the first waiter's query instead.
+static void flight_promote(mavis_ctx * mcx, struct flight *fp)
+{
+    struct waiter *w = fp->waiters;
+
+    if (!w) {
+	flight_free(mcx, fp);
+	return;
+    }
+
+    RB_search_and_delete(mcx->flights_by_serial, fp);
+    RB_search_and_delete(mcx->waiters, w);
+    fp->waiters = w->next;
+    free(fp->serial);
+    fp->serial = Xstrdup(av_get(w->ac, AV_A_SERIAL));
+    fp->app_ctx = w->app_ctx;
+    RB_insert(mcx->flights_by_serial, fp);
+
+    int result = mcx->down->send(mcx->down, &w->ac);
+    if (result == MAVIS_DEFERRED) {
+	free(w);
+	return;
+    }
+
+    if (result == MAVIS_DOWN)
+	result = MAVIS_FINAL;
+    flight_finish(mcx, fp, w->ac, result);
+    RB_insert(mcx->waiters, w);
+    flight_ready(w, result);
+}
+
+static int flight_join(mavis_ctx * mcx, av_ctx ** ac)
+{
+    int i = flight_index(mcx, *ac);
+    char *serial = av_get(*ac, AV_A_SERIAL);
+    if (i < 0 || !serial)
+	return MAVIS_DOWN;
+
+    struct flight *f = alloca(sizeof(struct flight) + BUFSIZE_MAVIS);
+    int len = av_array_to_char(*ac, f->key, BUFSIZE_MAVIS, &mcx->cache[i].flight_set);
+    if (len <= 0)
+	return MAVIS_DOWN;
+    f->crc32 = crc32_update(INITCRC32, (u_char *) f->key, len);
+
+    rb_node_t *r = RB_search(mcx->flights, f);
+    if (r) {
+	struct flight *fp = RB_payload(r, struct flight *);
+	struct waiter *w = Xcalloc(1, sizeof(struct waiter));
+	w->mcx = mcx;
+	w->flight = fp;
+	w->app_ctx = (*ac)->app_ctx;
+	w->ac = *ac;
+	w->next = fp->waiters;
+	fp->waiters = w;
+	RB_insert(mcx->waiters, w);
+	*ac = NULL;
+	return MAVIS_DEFERRED;
+    }
+
+    struct flight *fp = Xcalloc(1, sizeof(struct flight) + len);
+    memcpy(fp->key, f->key, len + 1);
+    fp->crc32 = f->crc32;
+    fp->serial = Xstrdup(serial);
+    fp->app_ctx = (*ac)->app_ctx;
+    RB_insert(mcx->flights, fp);
+    RB_insert(mcx->flights_by_serial, fp);
+    return MAVIS_DOWN;
+}
+
+/*
+ * Serving stale entries. An entry that expired less than "expire stale"
+ * seconds ago is still returned, and a copy of the query is passed down in
+ * the background once the current one is finished. The answer takes the
+ * regular path back through this module and replaces the entry.
+ */
+struct refresh {
+    mavis_ctx *mcx;
+    av_ctx *ac;			/* NULL once a lower module owns the query */
+};
+
+static void cache_answer(mavis_ctx *, av_ctx *);
+
+static int cmp_refresh(const void *a, const void *b)
+{
+    if (a < b)
+	return -1;
+    if (a > b)
+	return +1;
+    return 0;
+}
+
+static time_t stale_period(mavis_ctx * mcx, int type)
+{
+    // Without a lower module, nothing would ever refresh the entry.
+    return (mcx->io && mcx->down) ? mcx->cache[type].stale : 0;
+}
+
+static void refresh_free(struct refresh *r)
+{
+    RB_search_and_delete(r->mcx->refreshes, r);
+    av_free(r->ac);
+    free(r);
+}
+
+static void refresh_done(struct refresh *r)
+{
+    av_ctx *ac = NULL;
+
+    // The answer is cached by mavis_recv_out on its way up.
+    if (mavis_recv(r->mcx->top, &ac, r) == MAVIS_DEFERRED)
+	return;
+    av_free(ac);
+    refresh_free(r);
+}
+
+static void refresh_start(struct refresh *r)
+{
+    mavis_ctx *mcx = r->mcx;
+
+    io_sched_pop(mcx->io, r);
+    int result = mcx->down->send(mcx->down, &r->ac);
+    if (result == MAVIS_DEFERRED)
+	return;
+    if (result == MAVIS_FINAL && r->ac)
+	cache_answer(mcx, r->ac);
+    refresh_free(r);
+}
+
+static void refresh_schedule(mavis_ctx * mcx, av_ctx * ac)
+{
+    struct refresh *r = Xcalloc(1, sizeof(struct refresh));
+    char *serial = av_get(ac, AV_A_SERIAL);
+
+    r->mcx = mcx;
+    r->ac = av_new((void *) refresh_done, r);
+    av_copy(r->ac, ac);
+    av_setf(r->ac, AV_A_SERIAL, "%s-%lx", serial ? serial : "refresh", (u_long) r);
+    RB_insert(mcx->refreshes, r);
+    io_sched_add(mcx->io, r, (void *) refresh_start, 0, 0);
+}
+
 static void free_item(void *payload)
 {
     free(payload);
@@ -76,18 +402,44 @@ static int cmp_item(const void *a, const void *b)
     return strcmp(((struct item *) a)->cmp, ((struct item *) b)->cmp);
 }
 
-static int find_entry(av_ctx * ac, struct cache *cache)
+static int find_entry(mavis_ctx * mcx, av_ctx * ac, int type)
 {
+    struct cache *cache = &mcx->cache[type];
     rb_node_t *result;
     struct item *i = (struct item *) alloca(sizeof(struct item) + BUFSIZE_MAVIS);
+    int len;
 
     Debug((DEBUG_PROC, "+ %s: %.8lx\n", __func__, (u_long) cache));
 
-    if ((av_array_to_char(ac, i->cmp, BUFSIZE_MAVIS, &cache->cmp_set) > 0)
-	&& ((i->crc32 = crc32_update(INITCRC32, (u_char *) i->cmp, strlen(i->cmp))), (result = RB_search(cache->items, i)))) {
+    if ((len = av_array_to_char(ac, i->cmp, BUFSIZE_MAVIS, &cache->cmp_set)) <= 0)
+	return 0;
+
+    i->crc32 = crc32_update(INITCRC32, (u_char *) i->cmp, len);
+
+    time_t stale = stale_period(mcx, type);
+
+    if (mcx->shm) {
+	char *data = alloca(mcx->shm_data_size + 1);
+	u_char key[SHMTAB_KEYLEN];
+	int refresh = 0;
+	shm_key(type, i->cmp, (size_t) len, key);
+	if (shmtab_fetch(mcx->shm, key, data, mcx->shm_data_size + 1, stale, REFRESH_RETRY, &refresh) > len && !memcmp(data, i->cmp, len + 1)) {
+	    if (refresh)
+		refresh_schedule(mcx, ac);
+	    av_char_to_array(ac, data + len + 1, &cache->neg_set);
+	    Debug((DEBUG_PROC, "- %s (found in shared cache)\n", __func__));
+	    return -1;
+	}
+    }
+
+    if ((result = RB_search(cache->items, i))) {
 	Debug((DEBUG_PROC, " found\n"));
-	if (io_now.tv_sec < (i = RB_payload(result, struct item *))->expire) {
-	    av_char_to_array(ac, i->add, &cache->add_set);
+	if (io_now.tv_sec < (i = RB_payload(result, struct item *))->expire + stale) {
+	    if (i->expire <= io_now.tv_sec && i->refresh + REFRESH_RETRY <= io_now.tv_sec) {
+		i->refresh = io_now.tv_sec;
+		refresh_schedule(mcx, ac);
+	    }
+	    av_char_to_array(ac, i->add, &cache->neg_set);
 	    Debug((DEBUG_PROC, "- %s (expired)\n", __func__));
 	    return -1;
 	}
@@ -107,7 +459,7 @@ static void garbage_collection(mavis_ctx * mcx)
 
     for (int i = 0; i < AVPC_TABLE_SIZE; i++)
 	for (t = RB_first(mcx->cache[i].items); t; t = u)
-	    if (u = RB_next(t), RB_payload(t, struct item *)->expire < io_now.tv_sec) {
+	    if (u = RB_next(t), RB_payload(t, struct item *)->expire + mcx->cache[i].stale < io_now.tv_sec) {
 		RB_delete(mcx->cache[i].items, t);
 		mcx->cache[i].count--;
 	    }
@@ -115,6 +467,17 @@ static void garbage_collection(mavis_ctx * mcx)
     DebugOut(DEBUG_PROC);
 }
 
+static int cache_index(mavis_ctx * mcx, av_ctx * ac)
+{
+    char *s = av_get(ac, AV_A_TYPE);
+    char *t = av_get(ac, AV_A_TACTYPE);
+
+    for (int i = 0; i < AVPC_TABLE_SIZE; i++)
+	if (!strcasecmp(mcx->cache[i].type, s))
+	    return (!mcx->cache[i].tactype || (t && !strcmp(mcx->cache[i].tactype, t))) ? i : -1;
+    return -1;
+}
+
 static int cache_lookup(mavis_ctx * mcx, av_ctx * ac)
 {
     char *s = av_get(ac, AV_A_TYPE);
@@ -130,6 +493,11 @@ static int cache_lookup(mavis_ctx * mcx, av_ctx * ac)
 		       mcx->cache[i].counter_cached,
 		       (long long) (io_now.tv_sec - mcx->startup_time),
 		       mcx->cache[i].counter_p_query, mcx->cache[i].counter_p_cached, (long long) (io_now.tv_sec - mcx->lastdump), mcx->cache[i].count);
+	    if (mcx->shm && shmtab_counter(mcx->shm, SHM_QUERY(i), 0))
+		logmsg("STAT %s: %s: shared: Q=%llu C=%llu #=%u",
+		       MAVIS_name, mcx->cache[i].type,
+		       (unsigned long long) shmtab_counter(mcx->shm, SHM_QUERY(i), 0),
+		       (unsigned long long) shmtab_counter(mcx->shm, SHM_CACHED(i), 0), shmtab_count(mcx->shm, (u_int) i));
 	    mcx->cache[i].counter_p_query = mcx->cache[i].counter_p_cached = 0;
 	}
 
@@ -137,65 +505,96 @@ static int cache_lookup(mavis_ctx * mcx, av_ctx * ac)
 	return 0;
     }
 
-    for (int i = 0; i < AVPC_TABLE_SIZE; i++)
-	if (!strcasecmp(mcx->cache[i].type, s)) {
-	    mcx->cache[i].counter_query++, mcx->cache[i].counter_p_query++;
-	    if (mcx->cache[i].items && find_entry(ac, &mcx->cache[i])) {
-		mcx->cache[i].counter_cached++, mcx->cache[i].counter_p_cached++;
-		return -1;
-	    }
-	    return 0;
-	}
+    int i = cache_index(mcx, ac);
+    if (i < 0)
+	return 0;
+
+    mcx->cache[i].counter_query++, mcx->cache[i].counter_p_query++;
+    if (mcx->shm)
+	shmtab_counter(mcx->shm, SHM_QUERY(i), 1);
+    if (mcx->cache[i].items && find_entry(mcx, ac, i)) {
+	mcx->cache[i].counter_cached++, mcx->cache[i].counter_p_cached++;
+	if (mcx->shm)
+	    shmtab_counter(mcx->shm, SHM_CACHED(i), 1);
+	return -1;
+    }
     return 0;
 }
 
-static void cache_set(mavis_ctx * mcx, av_ctx * ac)
+static void cache_set(mavis_ctx * mcx, av_ctx * ac, int i, time_t maxage, fd_set * add_set)
 {
     Debug((DEBUG_PROC, " cache_set\n"));
 
-    char *s = av_get(ac, AV_A_TYPE);
+    Debug((DEBUG_PROC, "  cache @ %.8lx\n", (u_long) mcx->cache + i));
+    if (mcx->cache[i].items && 0 < maxage) {
+	struct item *item;
+	char buffer[BUFSIZE_MAVIS];
+	int length1, length2;
+	rb_node_t *rbn;
 
-    for (int i = 0; i < AVPC_TABLE_SIZE; i++)
-	if (!strcasecmp(mcx->cache[i].type, s)) {
-	    Debug((DEBUG_PROC, "  cache @ %.8lx\n", (u_long) mcx->cache + i));
-	    if (mcx->cache[i].items && 0 < mcx->cache[i].maxage) {
-		struct item *item;
-		char buffer[BUFSIZE_MAVIS];
-		int length1, length2;
-		rb_node_t *rbn;
-
-		length1 = av_array_to_char(ac, buffer, sizeof(buffer), &mcx->cache[i].cmp_set);
-
-		length2 = av_array_to_char(ac, buffer + length1 + 1, sizeof(buffer) - length1 - 1, &mcx->cache[i].add_set);
-
-		if (length1 < 0 || length2 < 0)
-		    return;
-
-		item = Xcalloc(1, sizeof(struct item) + length1 + length2 + 1);
-
-		item->expire = io_now.tv_sec + mcx->cache[i].maxage;
-		item->add = item->cmp + length1 + 1;
-		memcpy(item->cmp, buffer, length1 + length2 + 2);
-		item->crc32 = crc32_update(INITCRC32, (u_char *) item->cmp, length1);
-
-		rbn = RB_search(mcx->cache[i].items, item);
-		if (rbn) {
-		    Debug((DEBUG_PROC, " already cached\n"));
-		    free(item);
-		} else {
-		    Debug((DEBUG_PROC, " inserted\n"));
-		    RB_insert(mcx->cache[i].items, item);
-		    mcx->cache[i].count++;
-		}
-	    }
+	length1 = av_array_to_char(ac, buffer, sizeof(buffer), &mcx->cache[i].cmp_set);
+	if (length1 <= 0)
+	    return;
+
+	length2 = av_array_to_char(ac, buffer + length1 + 1, sizeof(buffer) - length1 - 1, add_set);
+
+	if (length2 < 0)
 	    return;
+
+	uint32_t crc = crc32_update(INITCRC32, (u_char *) buffer, length1);
+
+	// Entries that don't fit into a shared slot stay process-local.
+	if (mcx->shm) {
+	    u_char key[SHMTAB_KEYLEN];
+	    shm_key(i, buffer, (size_t) length1, key);
+	    if (!shmtab_set(mcx->shm, key, (u_int) i, buffer, (size_t) (length1 + length2 + 1), io_now.tv_sec + maxage)) {
+		Debug((DEBUG_PROC, " inserted into shared cache\n"));
+		return;
+	    }
+	}
+
+	item = Xcalloc(1, sizeof(struct item) + length1 + length2 + 1);
+
+	item->expire = io_now.tv_sec + maxage;
+	item->add = item->cmp + length1 + 1;
+	memcpy(item->cmp, buffer, length1 + length2 + 2);
+	item->crc32 = crc;
+
+	rbn = RB_search(mcx->cache[i].items, item);
+	if (rbn) {
+	    // Replaces a stale entry.
+	    Debug((DEBUG_PROC, " already cached\n"));
+	    RB_delete(mcx->cache[i].items, rbn);
+	    mcx->cache[i].count--;
 	}
+	Debug((DEBUG_PROC, " inserted\n"));
+	RB_insert(mcx->cache[i].items, item);
+	mcx->cache[i].count++;
+    }
+}
+
+static void cache_answer(mavis_ctx * mcx, av_ctx * ac)
+{
+    char *r = av_get(ac, AV_A_RESULT);
+    int i = cache_index(mcx, ac);
+
+    if (i < 0 || av_get(ac, AV_A_PASSWORD_ONESHOT))
+	return;
+
+    if (av_get(ac, AV_A_DBPASSWORD) || (r && !strcmp(r, AV_V_RESULT_OK)))
+	cache_set(mcx, ac, i, mcx->cache[i].maxage, &mcx->cache[i].add_set);
+    else if (r && (!strcmp(r, AV_V_RESULT_NOTFOUND) || (mcx->cache[i].cache_fail && !strcmp(r, AV_V_RESULT_FAIL))))
+	cache_set(mcx, ac, i, mcx->cache[i].negative_maxage, &mcx->cache[i].neg_set);
 }
 
 #define HAVE_mavis_init_in
 static int mavis_init_in(mavis_ctx * mcx)
 {
     int i = 0;
+
+    if (mcx->shm_path && !mcx->shm && !(mcx->shm = shmtab_open(mcx->shm_path, mcx->shm_size, mcx->shm_data_size)))
+	logerr("%s: %s", MAVIS_name, mcx->shm_path);
+
     if (mcx->initialized)
 	return MAVIS_INIT_OK;
 
@@ -222,6 +621,53 @@ static int mavis_init_in(mavis_ctx * mcx)
     A(AV_A_DBPASSWORD);
     A(AV_A_DBCERTSUBJ);
     A(AV_A_SHELL);
+    mcx->cache[i].neg_set = mcx->cache[i].add_set;
+    FD_SET(AV_A_RESULT, &mcx->cache[i].neg_set);
+    mcx->cache[i].flight_set = mcx->cache[i].cmp_set;
+    FD_SET(AV_A_PASSWORD, &mcx->cache[i].flight_set);
+    i++;
+
+    // Only INFO queries are cached, as AUTH results depend on the password.
+    mcx->cache[i].type = AV_V_TYPE_TACPLUS;
+    mcx->cache[i].tactype = AV_V_TACTYPE_INFO;
+    C(AV_A_USER);
+    C(AV_A_TACTYPE);
+    C(AV_A_REALM);
+    C(AV_A_SERVERIP);
+    C(AV_A_IPADDR);
+    C(AV_A_ARGS);
+    C(AV_A_CUSTOM_0);
+    C(AV_A_CUSTOM_1);
+    C(AV_A_CUSTOM_2);
+    C(AV_A_CUSTOM_3);
+    A(AV_A_RESULT);
+    A(AV_A_DN);
+    A(AV_A_MEMBEROF);
+    A(AV_A_TACMEMBER);
+    A(AV_A_TACPROFILE);
+    A(AV_A_SSHKEY);
+    A(AV_A_SSHKEYHASH);
+    A(AV_A_SSHKEYID);
+    A(AV_A_PATH);
+    A(AV_A_UID);
+    A(AV_A_GID);
+    A(AV_A_HOME);
+    A(AV_A_ROOT);
+    A(AV_A_SHELL);
+    A(AV_A_GIDS);
+    A(AV_A_RARGS);
+    A(AV_A_VERDICT);
+    A(AV_A_IDENTITY_SOURCE);
+    A(AV_A_PASSWORD_EXPIRY);
+    mcx->cache[i].neg_set = mcx->cache[i].add_set;
+    // INFO queries carry no password, so a FAIL answer is as good as NOTFOUND.
+    mcx->cache[i].cache_fail = 1;
+    // Coalescing includes AUTH, so the password has to be part of the key.
+    mcx->cache[i].flight_tactype[0] = AV_V_TACTYPE_INFO;
+    mcx->cache[i].flight_tactype[1] = AV_V_TACTYPE_AUTH;
+    mcx->cache[i].flight_set = mcx->cache[i].cmp_set;
+    FD_SET(AV_A_PASSWORD, &mcx->cache[i].flight_set);
+    FD_SET(AV_A_CALLER_CAP, &mcx->cache[i].flight_set);
     i++;
 
 #undef A
@@ -240,6 +686,37 @@ static void mavis_drop_in(mavis_ctx * mcx)
 {
     for (int k = 0; k < AVPC_TABLE_SIZE; k++)
 	RB_tree_delete(mcx->cache[k].items);
+    if (mcx->waiters) {
+	for (rb_node_t * r = RB_first(mcx->waiters); r; r = RB_next(r)) {
+	    struct waiter *w = RB_payload(r, struct waiter *);
+	    if (!w->flight)
+		io_sched_pop(mcx->io, w);
+	    av_free(w->ac);
+	    free(w);
+	}
+	RB_tree_delete(mcx->waiters);
+    }
+    if (mcx->flights) {
+	for (rb_node_t * r = RB_first(mcx->flights); r; r = RB_next(r)) {
+	    struct flight *f = RB_payload(r, struct flight *);
+	    free(f->serial);
+	    free(f);
+	}
+	RB_tree_delete(mcx->flights);
+	RB_tree_delete(mcx->flights_by_serial);
+    }
+    if (mcx->refreshes) {
+	for (rb_node_t * r = RB_first(mcx->refreshes); r; r = RB_next(r)) {
+	    struct refresh *rp = RB_payload(r, struct refresh *);
+	    if (rp->ac)
+		io_sched_pop(mcx->io, rp);
+	    av_free(rp->ac);
+	    free(rp);
+	}
+	RB_tree_delete(mcx->refreshes);
+    }
+    shmtab_close(mcx->shm);
+    free(mcx->shm_path);
 }
 
 #define HAVE_mavis_parse_in
@@ -249,6 +726,10 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
 	mcx->lastdump = mcx->lastpurge = mcx->startup_time = io_now.tv_sec;
 	for (int i = 0; i < AVPC_TABLE_SIZE; i++)
 	    mcx->cache[i].items = RB_tree_new(cmp_item, free_item);
+	mcx->flights = RB_tree_new(cmp_flight, NULL);
+	mcx->flights_by_serial = RB_tree_new(cmp_flight_serial, NULL);
+	mcx->waiters = RB_tree_new(cmp_waiter, NULL);
+	mcx->refreshes = RB_tree_new(cmp_refresh, NULL);
 	mavis_init_in(mcx);
 	mcx->initialized = 1;
     }
@@ -266,7 +747,17 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
 	    continue;
 	case S_expire:
 	    sym_get(sym);
-	    if (sym->code == S_equal) {
+	    if (sym->code == S_negative || sym->code == S_stale) {
+		enum token t = sym->code;
+		sym_get(sym);
+		parse(sym, S_equal);
+		time_t j = (time_t) parse_int(sym);
+		for (int i = 0; i < AVPC_TABLE_SIZE; i++)
+		    if (t == S_negative)
+			mcx->cache[i].negative_maxage = j;
+		    else
+			mcx->cache[i].stale = j;
+	    } else if (sym->code == S_equal) {
 		int i, j;
 		sym_get(sym);
 		j = parse_int(sym);
@@ -283,6 +774,35 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
 		}
 	    }
 
+	    continue;
+	case S_coalesce:
+	    sym_get(sym);
+	    parse(sym, S_equal);
+	    mcx->coalesce = parse_bool(sym);
+	    continue;
+	case S_shared:
+	    sym_get(sym);
+	    switch (sym->code) {
+	    case S_file:
+		sym_get(sym);
+		parse(sym, S_equal);
+		strset(&mcx->shm_path, sym->buf);
+		sym_get(sym);
+		break;
+	    case S_size:
+		sym_get(sym);
+		parse(sym, S_equal);
+		mcx->shm_size = (u_int) parse_int(sym);
+		break;
+	    case S_data:
+		sym_get(sym);
+		parse(sym, S_size);
+		parse(sym, S_equal);
+		mcx->shm_data_size = (size_t) parse_int(sym);
+		break;
+	    default:
+		parse_error_expect(sym, S_file, S_size, S_data, S_unknown);
+	    }
 	    continue;
 	case S_eof:
 	case S_closebra:
@@ -291,7 +811,7 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
 	    mavis_module_parse_action(mcx, sym);
 	    continue;
 	default:
-	    parse_error_expect(sym, S_script, S_purge, S_expire, S_action, S_closebra, S_unknown);
+	    parse_error_expect(sym, S_script, S_purge, S_expire, S_coalesce, S_shared, S_action, S_closebra, S_unknown);
 	}
     }
 }
@@ -310,25 +830,87 @@ static int mavis_send_in(mavis_ctx * mcx, av_ctx ** ac)
 	return MAVIS_FINAL;
     }
 
+    if (mcx->coalesce && mcx->io && mcx->down)
+	return flight_join(mcx, ac);
+
+    return MAVIS_DOWN;
+}
+
+#define HAVE_mavis_send_out
+static int mavis_send_out(mavis_ctx * mcx, av_ctx ** ac, int result)
+{
+    /*
+     * Complete the flight before the interim script gets a chance to skip
+     * mavis_recv_out. A lower module declining (MAVIS_DOWN) completes it,
+     * too. Waiters run the interim script on their own copy of the answer.
+     */
+    if (*ac && result != MAVIS_DEFERRED)
+	flight_done(mcx, *ac, result);
+    return result;
+}
+
+#define HAVE_mavis_cancel_in
+static int mavis_cancel_in(mavis_ctx * mcx, void *app_ctx)
+{
+    struct waiter w = {.app_ctx = app_ctx };
+    rb_node_t *r;
+
+    if (!mcx->waiters)
+	return MAVIS_DOWN;
+
+    if ((r = RB_search(mcx->waiters, &w))) {
+	struct waiter *wp = RB_payload(r, struct waiter *);
+	RB_delete(mcx->waiters, r);
+	if (wp->flight) {
+	    struct waiter **wpp = &wp->flight->waiters;
+	    while (*wpp != wp)
+		wpp = &(*wpp)->next;
+	    *wpp = wp->next;
+	} else
+	    io_sched_pop(mcx->io, wp);
+	av_free(wp->ac);
+	free(wp);
+	return MAVIS_FINAL;
+    }
+
+    for (r = RB_first(mcx->flights); r; r = RB_next(r)) {
+	struct flight *fp = RB_payload(r, struct flight *);
+	if (fp->app_ctx == app_ctx) {
+	    flight_promote(mcx, fp);
+	    break;
+	}
+    }
     return MAVIS_DOWN;
 }
 
 #define HAVE_mavis_recv_in
-static int mavis_recv_in(mavis_ctx * mcx, av_ctx ** ac __attribute__((unused)), char *serial __attribute__((unused)))
+static int mavis_recv_in(mavis_ctx * mcx, av_ctx ** ac, void *app_ctx)
 {
+    struct waiter w = {.app_ctx = app_ctx };
+    rb_node_t *r;
+
     mcx->cache_lookup_succeeded = 0;
+
+    if (mcx->waiters && (r = RB_search(mcx->waiters, &w))) {
+	struct waiter *wp = RB_payload(r, struct waiter *);
+	if (wp->flight)
+	    return MAVIS_DEFERRED;
+	RB_delete(mcx->waiters, r);
+	*ac = wp->ac;
+	int result = wp->result;
+	free(wp);
+	// The answer was cached already, if at all.
+	mcx->cache_lookup_succeeded = 1;
+	return result;
+    }
     return MAVIS_DOWN;
 }
 
 #define HAVE_mavis_recv_out
 static int mavis_recv_out(mavis_ctx * mcx, av_ctx ** ac)
 {
-    char *r = av_get(*ac, AV_A_RESULT);
-    char *d = av_get(*ac, AV_A_DBPASSWORD);
-    char *o = av_get(*ac, AV_A_PASSWORD_ONESHOT);
-    if (!o && (d || (r && !strcmp(r, AV_V_RESULT_OK)))
-	&& !mcx->cache_lookup_succeeded)
-	cache_set(mcx, *ac);
+    if (!mcx->cache_lookup_succeeded)
+	cache_answer(mcx, *ac);
     mcx->cache_lookup_succeeded = 0;
     return MAVIS_FINAL;
 }
@@ -337,6 +919,11 @@ static int mavis_recv_out(mavis_ctx * mcx, av_ctx ** ac)
 static void mavis_new(mavis_ctx * mcx)
 {
     mcx->purge_outdated = 300;
+    mcx->shm_size = 65536;
+    mcx->shm_data_size = SHM_DATA_SIZE;
+    mcx->coalesce = 1;
+    // Answers from this module stand for the modules below, so NOTFOUND is final.
+    mcx->action_notfound = S_unknown;
 }
 
 #include "mavis_glue.c"
@@ -39,6 +39,7 @@ static const char rcsid[] __attribute__((used)) = "$Id$";
 
 #define REAPMAX 30		/* terminated ctx history table size */
 #define REAPINT 30		/* terminated ctx interval (seconds) */
+#define LATENCY_WEIGHT 8	/* EWMA weight for per-child latency */
 
 #define MAVIS_CTX_PRIVATE			\
   struct io_context *io_context_local;		\
@@ -46,7 +47,12 @@ static const char rcsid[] __attribute__((used)) = "$Id$";
   char *path;					\
   char **argv;					\
   int argc;					\
-  struct context *ctx;				\
+  struct context **cx;				\
+  int child_count;				\
+  u_int depth;					\
+  int timeout;					\
+  struct query *pending;			\
+  struct query *pending_last;			\
   rb_tree_t *by_serial;				\
   rb_tree_t *by_app_ctx;			\
   int envcount;					\
@@ -60,6 +66,7 @@ struct iobuf {
     char *buf;
     size_t len;
     size_t off;
+    struct query *q;		/* set until the buffer is part of a batch */
     struct iobuf *next;
 };
 
@@ -79,11 +86,15 @@ struct context {
     int fd_in;
     int fd_out;
     int fd_err;
-    int result;
+    int index;
+    int tlv;			/* child understands MAVIS_EXT_MAGIC_V2 */
+    int batch;			/* child understands MAVIS_EXT_MAGIC_BATCH */
+    u_int outstanding;		/* queries sent, but not answered yet */
+    unsigned long long latency;	/* EWMA, microseconds */
     unsigned long long counter;
 };
 
-static int fork_ctx(mavis_ctx *);
+static int fork_ctx(mavis_ctx *, int);
 
 struct query {
     mavis_ctx *mcx;
@@ -92,6 +103,10 @@ struct query {
     uint32_t serial_crc;
     u_int canceled:1;
     int result;
+    int tries;			/* number of children that didn't answer in time */
+    struct context *ctx;	/* NULL while pending */
+    struct timeval start;
+    struct query *next;		/* pending queue */
 };
 
 static int compare_serial(const void *v1, const void *v2)
@@ -113,6 +128,9 @@ static int compare_app_ctx(const void *v1, const void *v2)
 }
 
 static void write_to_child(struct context *, int);
+static void periodic(mavis_ctx *);
+static void child_died(struct context *, int);
+static void dispatch(mavis_ctx *);
 
 #define HAVE_mavis_init_in
 static int mavis_init_in(mavis_ctx * mcx)
@@ -130,7 +148,11 @@ static int mavis_init_in(mavis_ctx * mcx)
 	mcx->io_context_local = mcx->io = io_init();
     mcx->by_serial = RB_tree_new(compare_serial, NULL);
     mcx->by_app_ctx = RB_tree_new(compare_app_ctx, NULL);
-    fork_ctx(mcx);
+    mcx->cx = Xcalloc(mcx->child_count, sizeof(struct context *));
+    for (int i = 0; i < mcx->child_count; i++)
+	fork_ctx(mcx, i);
+    if (mcx->io_context_parent)
+	io_sched_add(mcx->io, mcx, (void *) periodic, 1, 0);
     DebugOut(DEBUG_MAVIS);
     return MAVIS_INIT_OK;
 }
@@ -188,6 +210,23 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
 		}
 		continue;
 	    }
+	case S_childs:
+	    sym_get(sym);
+	    parse(sym, S_equal);
+	    mcx->child_count = parse_int(sym);
+	    if (mcx->child_count < 1)
+		mcx->child_count = 1;
+	    continue;
+	case S_depth:
+	    sym_get(sym);
+	    parse(sym, S_equal);
+	    mcx->depth = (u_int) parse_int(sym);
+	    continue;
+	case S_timeout:
+	    sym_get(sym);
+	    parse(sym, S_equal);
+	    mcx->timeout = parse_int(sym);
+	    continue;
 	case S_eof:
 	case S_closebra:
 	    if (!mcx->argv)
@@ -197,7 +236,7 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
 	    mavis_module_parse_action(mcx, sym);
 	    continue;
 	default:
-	    parse_error_expect(sym, S_script, S_setenv, S_exec, S_action, S_closebra, S_unknown);
+	    parse_error_expect(sym, S_script, S_setenv, S_exec, S_childs, S_depth, S_timeout, S_action, S_closebra, S_unknown);
 	}
     }
 }
@@ -213,28 +252,33 @@ static void mavis_drop_in(mavis_ctx * mcx)
 	Xfree(&mcx->argv[i]);
     Xfree(&mcx->argv);
 
-    if (mcx->ctx) {
-	if (mcx->ctx->fd_in > -1)
-	    io_close(mcx->io, mcx->ctx->fd_in);
-	if (mcx->ctx->fd_out > -1)
-	    io_close(mcx->io, mcx->ctx->fd_out);
-	if (mcx->ctx->fd_err > -1)
-	    io_close(mcx->io, mcx->ctx->fd_err);
-	if (mcx->ctx) {
-	    kill(mcx->ctx->pid, SIGTERM);
-	}
+    if (mcx->io_context_parent)
+	io_sched_del(mcx->io, mcx, (void *) periodic);
+
+    for (i = 0; mcx->cx && i < mcx->child_count; i++) {
+	struct context *ctx = mcx->cx[i];
+	if (!ctx)
+	    continue;
+	if (ctx->fd_in > -1)
+	    io_close(mcx->io, ctx->fd_in);
+	if (ctx->fd_out > -1)
+	    io_close(mcx->io, ctx->fd_out);
+	if (ctx->fd_err > -1)
+	    io_close(mcx->io, ctx->fd_err);
+	if (ctx->pid > 0)
+	    kill(ctx->pid, SIGTERM);
 
-	if (mcx->ctx->b_in)
-	    free(mcx->ctx->b_in);
-	while (mcx->ctx->b_out) {
-	    struct iobuf *next = mcx->ctx->b_out->next;
-	    free(mcx->ctx->b_out->buf);
-	    free(mcx->ctx->b_out);
-	    mcx->ctx->b_out = next;
+	if (ctx->b_in)
+	    free(ctx->b_in);
+	while (ctx->b_out) {
+	    struct iobuf *next = ctx->b_out->next;
+	    free(ctx->b_out->buf);
+	    free(ctx->b_out);
+	    ctx->b_out = next;
 	}
-	free(mcx->ctx);
-	mcx->ctx = NULL;
+	free(ctx);
     }
+    Xfree(&mcx->cx);
 
     if (mcx->env) {
 	for (i = 0; i < mcx->envcount; i++)
@@ -258,15 +302,59 @@ static void ctx_closed_stderr(struct context *ctx, int cur __attribute__((unused
 }
 
 static void write_to_child(struct context *, int);
-static void start_query(struct context *, av_ctx *);
+static void start_query(struct context *, struct query *);
 static int mavis_send_in(mavis_ctx *, av_ctx **);
 
+static void enqueue(mavis_ctx * mcx, struct query *q)
+{
+    q->next = NULL;
+    if (mcx->pending)
+	mcx->pending_last->next = q;
+    else
+	mcx->pending = q;
+    mcx->pending_last = q;
+}
+
+// Pick the child with the fewest outstanding queries, preferring the faster one on ties.
+static struct context *select_ctx(mavis_ctx * mcx)
+{
+    struct context *best = NULL;
+    for (int i = 0; i < mcx->child_count; i++) {
+	struct context *ctx = mcx->cx[i];
+	if (!ctx || ctx->fd_out < 0 || (mcx->depth && ctx->outstanding >= mcx->depth))
+	    continue;
+	if (!best || ctx->outstanding < best->outstanding || (ctx->outstanding == best->outstanding && ctx->latency < best->latency))
+	    best = ctx;
+    }
+    return best;
+}
+
+static void dispatch(mavis_ctx * mcx)
+{
+    struct context *ctx;
+    while (mcx->pending && (ctx = select_ctx(mcx))) {
+	struct query *q = mcx->pending;
+	mcx->pending = q->next;
+	if (q->canceled) {
+	    RB_search_and_delete(mcx->by_serial, q);
+	    RB_search_and_delete(mcx->by_app_ctx, q);
+	    av_free(q->ac);
+	    free(q);
+	    continue;
+	}
+	q->ctx = ctx;
+	q->start = io_now;
+	ctx->outstanding++;
+	start_query(ctx, q);
+    }
+}
+
 static void child_died(struct context *ctx, int cur __attribute__((unused)))
 {
     if (ctx->fd_in > -1) {
 	DebugIn(DEBUG_PROC);
 
-	if (ctx->counter < 2) {
+	if (!ctx->counter) {
 	    logmsg("%s: %lu: terminated before finishing first request", ctx->mcx->argv[0], (u_long) ctx->pid);
 	    ctx->mcx->reaphist[ctx->mcx->reapcur] = io_now.tv_sec + REAPINT;
 	    ctx->mcx->reapcur++;
@@ -293,28 +381,97 @@ static void child_died(struct context *ctx, int cur __attribute__((unused)))
 	    ctx->fd_err = -1;
 	}
 
-	fork_ctx(ctx->mcx);
+	if (ctx->b_in) {
+	    free(ctx->b_in->buf);
+	    free(ctx->b_in);
+	    ctx->b_in = NULL;
+	}
+	ctx->hdr_len = 0;
+	while (ctx->b_out) {
+	    struct iobuf *next = ctx->b_out->next;
+	    free(ctx->b_out->buf);
+	    free(ctx->b_out);
+	    ctx->b_out = next;
+	}
+
+	fork_ctx(ctx->mcx, ctx->index);
 
-	if (!RB_empty(ctx->mcx->by_serial)) {
-	    for (rb_node_t *rbn = RB_first(ctx->mcx->by_serial); rbn;) {
-		struct query *q = RB_payload(rbn, struct query *);
-		rb_node_t *next = RB_next(rbn);
+	// Queries the child didn't answer go to the back of the queue.
+	for (rb_node_t *rbn = RB_first(ctx->mcx->by_serial); rbn;) {
+	    struct query *q = RB_payload(rbn, struct query *);
+	    rb_node_t *next = RB_next(rbn);
+	    if (q->ctx == ctx) {
+		q->ctx = NULL;
 		if (q->canceled) {
+		    RB_search_and_delete(ctx->mcx->by_app_ctx, q);
 		    RB_delete(ctx->mcx->by_serial, rbn);
-		    RB_delete(ctx->mcx->by_app_ctx, rbn);
-		    free(q->ac);
+		    av_free(q->ac);
 		    free(q);
 		} else
-		    start_query(ctx, q->ac);
-		rbn = next;
+		    enqueue(ctx->mcx, q);
 	    }
+	    rbn = next;
 	}
+	ctx->outstanding = 0;
+
+	dispatch(ctx->mcx);
 
 	DebugOut(DEBUG_PROC);
     }
 }
 
 
+static void handle_reply(struct context *ctx, uint32_t magic, uint32_t result, char *buf, size_t len)
+{
+    av_ctx *ac_in = av_new(NULL, NULL);
+    if (magic == MAVIS_EXT_MAGIC_V2) {
+	ctx->tlv = 1;
+	av_tlv_to_array(ac_in, buf, len, NULL);
+    } else if (magic == MAVIS_EXT_MAGIC_V1)
+	av_char_to_array(ac_in, buf, NULL);
+    struct query q_tmp;
+    q_tmp.serial = av_get(ac_in, AV_A_SERIAL);
+    if (!q_tmp.serial) {
+	av_free(ac_in);
+	return;
+    }
+    q_tmp.serial_crc = crc32_update(INITCRC32, (u_char *) q_tmp.serial, strlen(q_tmp.serial));
+    rb_node_t *rbn = RB_search(ctx->mcx->by_serial, &q_tmp);
+    if (!rbn) {
+	fprintf(stderr, "Request not found\n");
+	av_free(ac_in);
+	return;
+    }
+    struct query *q = RB_payload(rbn, struct query *);
+    if (q->ctx == ctx) {
+	long long usec = (io_now.tv_sec - q->start.tv_sec) * 1000000LL + io_now.tv_usec - q->start.tv_usec;
+	if (usec < 0)
+	    usec = 0;
+	ctx->latency = ctx->counter++ ? (ctx->latency * (LATENCY_WEIGHT - 1) + (unsigned long long) usec) / LATENCY_WEIGHT : (unsigned long long) usec;
+	ctx->outstanding--;
+	q->ctx = NULL;
+    }
+    ac_in->app_ctx = q->ac->app_ctx;
+    ac_in->app_cb = q->ac->app_cb;
+    av_free(q->ac);
+    q->ac = ac_in;
+    q->result = (int) result;
+
+    if (q->result == MAVIS_FINAL) {
+	char *r = av_get(ac_in, AV_A_RESULT);
+	if (r && (!strcmp(r, AV_V_RESULT_OK) || !strcmp(r, AV_V_RESULT_FAIL)))
+	    av_set(ac_in, AV_A_IDENTITY_SOURCE, ctx->mcx->identity_source_name);
+    }
+
+    if (q->canceled) {
+	RB_delete(ctx->mcx->by_serial, rbn);
+	RB_search_and_delete(ctx->mcx->by_app_ctx, q);
+	av_free(q->ac);
+	free(q);
+    } else
+	((void (*)(void *)) q->ac->app_cb) (q->ac->app_ctx);
+}
+
 // assuption here was that the ctx's answer can be fully read and
 // we don't really need to care for blocking read() calls
 static void read_from_child(struct context *ctx, int cur __attribute__((unused)))
@@ -337,8 +494,18 @@ static void read_from_child(struct context *ctx, int cur __attribute__((unused))
 	    DebugOut(DEBUG_MAVIS);
 	    return;
 	}
-	if (ntohl(ctx->hdr.magic) != MAVIS_EXT_MAGIC_V1)	// Ma<version>
+	switch (ntohl(ctx->hdr.magic)) {	// Ma<version>
+	case MAVIS_EXT_MAGIC_V1:
+	    break;
+	case MAVIS_EXT_MAGIC_V2:
+	    ctx->tlv = 1;
+	    break;
+	case MAVIS_EXT_MAGIC_BATCH:
+	    ctx->batch = 1;
+	    break;
+	default:
 	    goto read_error;
+	}
     }
 
     size_t hbl = ntohl(ctx->hdr.body_len);
@@ -356,56 +523,116 @@ static void read_from_child(struct context *ctx, int cur __attribute__((unused))
 	    return;
 	}
     }
-    av_ctx *ac_in = av_new(NULL, NULL);
-    av_char_to_array(ac_in, ctx->b_in->buf, NULL);
-    struct query q_tmp;
-    q_tmp.serial = av_get(ac_in, AV_A_SERIAL);
-    q_tmp.serial_crc = crc32_update(INITCRC32, (u_char *) q_tmp.serial, strlen(q_tmp.serial));
-    rb_node_t *rbn = RB_search(ctx->mcx->by_serial, &q_tmp);
-    if (!rbn) {
-	fprintf(stderr, "Request not found\n");
-	av_free(ac_in);
-	goto bye;
-    }
-    struct query *q = RB_payload(rbn, struct query *);
-    ac_in->app_ctx = q->ac->app_ctx;
-    ac_in->app_cb = q->ac->app_cb;
-    av_free(q->ac);
-    q->ac = ac_in;
-    q->result = ntohl(ctx->hdr.result);
-
-    if (q->result == MAVIS_FINAL) {
-	char *r = av_get(ac_in, AV_A_RESULT);
-	if (r && (!strcmp(r, AV_V_RESULT_OK) || !strcmp(r, AV_V_RESULT_FAIL)))
-	    av_set(ac_in, AV_A_IDENTITY_SOURCE, ctx->mcx->identity_source_name);
-    }
-
-    if (!q->canceled)
-	((void (*)(void *)) q->ac->app_cb) (q->ac->app_ctx);
-
-#if 0				// mavis_recv_in will do this
-    RB_search_and_delete(ctx->mcx->by_serial, q);
-    RB_search_and_delete(ctx->mcx->by_app_ctx, q);
-    av_free(q->ac);
-    free(q);
-#endif
+    struct iobuf *b = ctx->b_in;
+    struct mavis_ext_hdr_v1 hdr = ctx->hdr;
+    ctx->b_in = NULL;
+    ctx->hdr_len = 0;
+    if (ntohl(hdr.magic) == MAVIS_EXT_MAGIC_BATCH) {
+	for (size_t off = 0; off + sizeof(struct mavis_ext_hdr_v1) <= hbl;) {
+	    struct mavis_ext_hdr_v1 *h = (struct mavis_ext_hdr_v1 *) (b->buf + off);
+	    size_t l = ntohl(h->body_len);
+	    off += sizeof(struct mavis_ext_hdr_v1);
+	    if (l > hbl - off)
+		break;
+	    // av_char_to_array() wants a terminated string
+	    char c = b->buf[off + l];
+	    b->buf[off + l] = 0;
+	    handle_reply(ctx, ntohl(h->magic), ntohl(h->result), b->buf + off, l);
+	    b->buf[off + l] = c;
+	    off += l;
+	}
+    } else
+	handle_reply(ctx, ntohl(hdr.magic), ntohl(hdr.result), b->buf, hbl);
+    free(b->buf);
+    free(b);
+    dispatch(ctx->mcx);
+    DebugOut(DEBUG_MAVIS);
+    return;
 
   bye:
     ctx->hdr_len = 0;
     free(ctx->b_in->buf);
     free(ctx->b_in);
     ctx->b_in = NULL;
+    dispatch(ctx->mcx);
     DebugOut(DEBUG_MAVIS);
 }
 
-static void write_to_child(struct context *ctx, int cur)
+// Queries started since the last write go out in one piece, packed into a batch
+// frame if the child supports that. Queries canceled in the meantime are dropped.
+static void coalesce(struct context *ctx)
 {
-    ssize_t len = -1;
+    mavis_ctx *mcx = ctx->mcx;
+    struct iobuf **p = &ctx->b_out;
+    while (*p && ((*p)->off || !(*p)->q))
+	p = &(*p)->next;
+
+    int dropped = 0;
+    for (struct iobuf ** b = p; *b;) {
+	struct iobuf *o = *b;
+	if (o->q->canceled) {
+	    *b = o->next;
+	    ctx->outstanding--;
+	    RB_search_and_delete(mcx->by_serial, o->q);
+	    RB_search_and_delete(mcx->by_app_ctx, o->q);
+	    av_free(o->q->ac);
+	    free(o->q);
+	    free(o->buf);
+	    free(o);
+	    dropped++;
+	} else
+	    b = &o->next;
+    }
+    ctx->b_out_last = ctx->b_out;
+    while (ctx->b_out_last && ctx->b_out_last->next)
+	ctx->b_out_last = ctx->b_out_last->next;
+    if (!ctx->b_out)
+	io_clr_o(mcx->io, ctx->fd_out);
+    if (dropped)
+	dispatch(mcx);
+
+    size_t total = 0;
+    uint32_t count = 0;
+    for (struct iobuf * o = *p; o; o = o->next) {
+	total += o->len;
+	count++;
+    }
+    if (count < 2)
+	return;
 
+    size_t hl = ctx->batch ? sizeof(struct mavis_ext_hdr_v1) : 0;
+    struct iobuf *m = calloc(1, sizeof(struct iobuf));
+    m->buf = calloc(1, hl + total);
+    if (hl) {
+	struct mavis_ext_hdr_v1 *hdr = (struct mavis_ext_hdr_v1 *) m->buf;
+	hdr->magic = htonl(MAVIS_EXT_MAGIC_BATCH);
+	hdr->body_len = htonl((uint32_t) total);
+	hdr->result = htonl(count);
+    }
+    m->len = hl;
+    for (struct iobuf * o = *p; o;) {
+	struct iobuf *next = o->next;
+	memcpy(m->buf + m->len, o->buf, o->len);
+	m->len += o->len;
+	free(o->buf);
+	free(o);
+	o = next;
+    }
+    *p = m;
+    ctx->b_out_last = m;
+}
+
+static void write_to_child(struct context *ctx, int cur)
+{
     DebugIn(DEBUG_PROC);
 
-    if (ctx->b_out)
-	len = Write(ctx->fd_out, ctx->b_out->buf + ctx->b_out->off, ctx->b_out->len - ctx->b_out->off);
+    coalesce(ctx);
+    if (!ctx->b_out) {
+	DebugOut(DEBUG_PROC);
+	return;
+    }
+
+    ssize_t len = Write(ctx->fd_out, ctx->b_out->buf + ctx->b_out->off, ctx->b_out->len - ctx->b_out->off);
 
     if (len > 0) {
 	ctx->b_out->off += len;
@@ -462,7 +689,7 @@ static void read_err_from_child(struct context *ctx, int cur __attribute__((unus
     DebugOut(DEBUG_PROC);
 }
 
-static int fork_ctx(mavis_ctx * mcx)
+static int fork_ctx(mavis_ctx * mcx, int index)
 {
     int fi[2], fo[2], fe[2];
     pid_t ctxpid;
@@ -547,48 +774,118 @@ static int fork_ctx(mavis_ctx * mcx)
     fcntl(fo[0], F_SETFL, O_NONBLOCK);
     fcntl(fe[0], F_SETFL, O_NONBLOCK);
 
-    if (!mcx->ctx)
-	mcx->ctx = Xcalloc(1, sizeof(struct context));
-    mcx->ctx->mcx = mcx;
-    mcx->ctx->pid = ctxpid;
-    mcx->ctx->fd_out = fi[1];
-    mcx->ctx->fd_in = fo[0];
-    mcx->ctx->fd_err = fe[0];
-
-    io_register(mcx->io, mcx->ctx->fd_out, mcx->ctx);
-    io_set_cb_o(mcx->io, mcx->ctx->fd_out, (void *) write_to_child);
-    io_clr_cb_i(mcx->io, mcx->ctx->fd_out);
-    io_set_cb_h(mcx->io, mcx->ctx->fd_out, (void *) child_died);
-    io_set_cb_e(mcx->io, mcx->ctx->fd_out, (void *) child_died);
-
-    io_register(mcx->io, mcx->ctx->fd_in, mcx->ctx);
-    io_clr_cb_o(mcx->io, mcx->ctx->fd_in);
-    io_set_cb_i(mcx->io, mcx->ctx->fd_in, (void *) read_from_child);
-    io_set_cb_h(mcx->io, mcx->ctx->fd_in, (void *) child_died);
-    io_set_cb_e(mcx->io, mcx->ctx->fd_in, (void *) child_died);
-    io_set_i(mcx->io, mcx->ctx->fd_err);
-
-    io_register(mcx->io, mcx->ctx->fd_err, mcx->ctx);
-    io_clr_cb_o(mcx->io, mcx->ctx->fd_err);
-    io_set_cb_i(mcx->io, mcx->ctx->fd_err, (void *) read_err_from_child);
-    io_set_cb_h(mcx->io, mcx->ctx->fd_err, (void *) ctx_closed_stderr);
-    io_set_cb_e(mcx->io, mcx->ctx->fd_err, (void *) ctx_closed_stderr);
-    io_set_i(mcx->io, mcx->ctx->fd_err);
+    if (!mcx->cx[index])
+	mcx->cx[index] = Xcalloc(1, sizeof(struct context));
+    struct context *ctx = mcx->cx[index];
+    ctx->mcx = mcx;
+    ctx->index = index;
+    ctx->pid = ctxpid;
+    ctx->tlv = 0;
+    ctx->batch = 0;
+    ctx->latency = 0;
+    ctx->fd_out = fi[1];
+    ctx->fd_in = fo[0];
+    ctx->fd_err = fe[0];
+
+    io_register(mcx->io, ctx->fd_out, ctx);
+    io_set_cb_o(mcx->io, ctx->fd_out, (void *) write_to_child);
+    io_clr_cb_i(mcx->io, ctx->fd_out);
+    io_set_cb_h(mcx->io, ctx->fd_out, (void *) child_died);
+    io_set_cb_e(mcx->io, ctx->fd_out, (void *) child_died);
+
+    io_register(mcx->io, ctx->fd_in, ctx);
+    io_clr_cb_o(mcx->io, ctx->fd_in);
+    io_set_cb_i(mcx->io, ctx->fd_in, (void *) read_from_child);
+    io_set_cb_h(mcx->io, ctx->fd_in, (void *) child_died);
+    io_set_cb_e(mcx->io, ctx->fd_in, (void *) child_died);
+    io_set_i(mcx->io, ctx->fd_err);
+
+    io_register(mcx->io, ctx->fd_err, ctx);
+    io_clr_cb_o(mcx->io, ctx->fd_err);
+    io_set_cb_i(mcx->io, ctx->fd_err, (void *) read_err_from_child);
+    io_set_cb_h(mcx->io, ctx->fd_err, (void *) ctx_closed_stderr);
+    io_set_cb_e(mcx->io, ctx->fd_err, (void *) ctx_closed_stderr);
+    io_set_i(mcx->io, ctx->fd_err);
 
     return 0;
 }
 
-static void start_query(struct context *ctx, av_ctx * ac)
+// Respawn children that couldn't be started before, and replace children that
+// didn't answer within the configured timeout.
+static void periodic(mavis_ctx * mcx)
+{
+    int eject[mcx->child_count];
+    struct query *failed = NULL;
+
+    memset(eject, 0, sizeof(eject));
+
+    if (mcx->timeout)
+	for (rb_node_t * rbn = RB_first(mcx->by_serial); rbn; rbn = RB_next(rbn)) {
+	    struct query *q = RB_payload(rbn, struct query *);
+	    if (q->ctx && q->start.tv_sec + mcx->timeout < io_now.tv_sec) {
+		eject[q->ctx->index] = 1;
+		// A query that wedges a second child won't be retried.
+		if (++q->tries > 1) {
+		    q->ctx->outstanding--;
+		    q->ctx = NULL;
+		    q->next = failed;
+		    failed = q;
+		}
+	    }
+	}
+
+    for (int i = 0; i < mcx->child_count; i++) {
+	struct context *ctx = mcx->cx[i];
+	if (eject[i]) {
+	    logmsg("%s: %lu: no answer within %d seconds (%u queries outstanding, average latency %llu ms). Restarting.",
+		   mcx->argv[0], (u_long) ctx->pid, mcx->timeout, ctx->outstanding, ctx->latency / 1000);
+	    kill(ctx->pid, SIGKILL);
+	    child_died(ctx, ctx->fd_in);
+	} else if ((!ctx || ctx->fd_out < 0) && mcx->reaphist[mcx->reapcur] < io_now.tv_sec)
+	    fork_ctx(mcx, i);
+    }
+
+    dispatch(mcx);
+
+    while (failed) {
+	struct query *q = failed;
+	failed = q->next;
+	q->result = MAVIS_FINAL;
+	av_set(q->ac, AV_A_RESULT, AV_V_RESULT_ERROR);
+	av_set(q->ac, AV_A_COMMENT, "backend timeout");
+	if (q->canceled) {
+	    RB_search_and_delete(mcx->by_serial, q);
+	    RB_search_and_delete(mcx->by_app_ctx, q);
+	    av_free(q->ac);
+	    free(q);
+	} else
+	    ((void (*)(void *)) q->ac->app_cb) (q->ac->app_ctx);
+    }
+
+    io_sched_renew(mcx->io, mcx);
+}
+
+static void start_query(struct context *ctx, struct query *q)
 {
-    size_t len = av_array_to_char_len(ac);
+    av_ctx *ac = q->ac;
+    size_t len = ctx->tlv ? av_array_to_tlv_len(ac) : av_array_to_char_len(ac);
     struct iobuf *o = calloc(1, sizeof(struct iobuf));
     o->buf = calloc(1, len + sizeof(struct mavis_ext_hdr_v1));
+    o->q = q;
 
     Debug((DEBUG_PROC, "starting query (%s)\n", av_get(ac, AV_A_SERIAL)));
 
-    o->len = av_array_to_char(ac, o->buf + sizeof(struct mavis_ext_hdr_v1), len, NULL);
     struct mavis_ext_hdr_v1 *hdr = (struct mavis_ext_hdr_v1 *) o->buf;
-    hdr->magic = htonl(MAVIS_EXT_MAGIC_V1);
+    if (ctx->tlv) {
+	o->len = av_array_to_tlv(ac, o->buf + sizeof(struct mavis_ext_hdr_v1), len, NULL);
+	hdr->magic = htonl(MAVIS_EXT_MAGIC_V2);
+    } else {
+	o->len = av_array_to_char(ac, o->buf + sizeof(struct mavis_ext_hdr_v1), len, NULL);
+	hdr->magic = htonl(MAVIS_EXT_MAGIC_V1);
+	hdr->result = htonl(MAVIS_EXT_CAP_TLV);
+    }
+    if (!ctx->batch)
+	hdr->result |= htonl(MAVIS_EXT_CAP_BATCH);
     hdr->body_len = htonl((uint32_t) o->len);
     o->len += sizeof(struct mavis_ext_hdr_v1);
     if (ctx->b_out) {
@@ -617,7 +914,8 @@ static int mavis_send_in(mavis_ctx * mcx, av_ctx ** ac)
 
     RB_insert(mcx->by_serial, q);
     RB_insert(mcx->by_app_ctx, q);
-    start_query(mcx->ctx, *ac);
+    enqueue(mcx, q);
+    dispatch(mcx);
     *ac = NULL;
 
     if (!mcx->io_context_parent) {	// this if for mavistest, actually.
@@ -681,6 +979,7 @@ static int mavis_recv_in(mavis_ctx * mcx, av_ctx ** ac, void *app_ctx)
 static void mavis_new(mavis_ctx * mcx)
 {
     mcx->io_context_parent = mcx->io;
+    mcx->child_count = 1;
 }
 
 #include "mavis_glue.c"
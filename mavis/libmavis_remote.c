@@ -36,12 +36,19 @@
 
 struct remote_addr_s;
 
+#define RTT_SAMPLES 128		/* ring buffer size for hedging percentile */
+#define RTT_WEIGHT 8		/* EWMA weight for per-peer round trip time */
+
 #define MAVIS_CTX_PRIVATE			\
 	int sock;				\
 	int tries;				\
 	int timeout;				\
 	int rebalance;				\
 	int request_count;			\
+	int hedge;				\
+	u_int rtt_sample[RTT_SAMPLES];		\
+	u_int rtt_sample_count;			\
+	u_int hedge_delay;			\
 	sockaddr_union *local_addr;		\
 	struct remote_addr_s *remote_addr;	\
 	rb_tree_t *retransmit;			\
@@ -65,12 +72,24 @@ struct remote_addr_s {
     unsigned long long count_s_p;
     unsigned long long count_r;
     unsigned long long count_r_p;
+    unsigned long long rtt;	/* EWMA, microseconds, 0 if unknown */
+    time_t rtt_time;		/* last update of rtt */
     struct remote_addr_s *next;
 };
 
+struct query;
+
+struct hedge {
+    struct query *q;		/* io_sched key for the hedging timer */
+};
+
 struct query {
     mavis_ctx *mcx;
     struct remote_addr_s *ra;
+    struct remote_addr_s *hedge_ra;	/* peer the duplicate went to */
+    struct timeval sent;
+    struct timeval hedge_sent;
+    struct hedge hedge;
     av_ctx *ac;
     int tries;
     int result;
@@ -156,6 +175,103 @@ static void free_payload(void *p)
     free(p);
 }
 
+static long long usec_since(struct timeval *tv)
+{
+    return (io_now.tv_sec - tv->tv_sec) * 1000000LL + io_now.tv_usec - tv->tv_usec;
+}
+
+static int compare_u_int(const void *a, const void *b)
+{
+    return (*(u_int *) a > *(u_int *) b) - (*(u_int *) a < *(u_int *) b);
+}
+
+static void rtt_update(mavis_ctx * mcx, struct remote_addr_s *ra, struct timeval *sent)
+{
+    long long usec = usec_since(sent);
+    if (usec < 0)
+	usec = 0;
+    ra->rtt = ra->rtt ? (ra->rtt * (RTT_WEIGHT - 1) + (unsigned long long) usec) / RTT_WEIGHT : (unsigned long long) usec;
+    ra->rtt_time = io_now.tv_sec;
+
+    if (!mcx->hedge)
+	return;
+
+    mcx->rtt_sample[mcx->rtt_sample_count++ % RTT_SAMPLES] = (u_int) usec;
+    // Recalculate the hedging delay every now and then, once there's enough data.
+    if (mcx->rtt_sample_count >= RTT_SAMPLES / 4 && !(mcx->rtt_sample_count % 16)) {
+	u_int n = mcx->rtt_sample_count < RTT_SAMPLES ? mcx->rtt_sample_count : RTT_SAMPLES;
+	u_int sorted[RTT_SAMPLES];
+	memcpy(sorted, mcx->rtt_sample, n * sizeof(u_int));
+	qsort(sorted, n, sizeof(u_int), compare_u_int);
+	mcx->hedge_delay = sorted[(n - 1) * mcx->hedge / 100];
+    }
+}
+
+// A peer that didn't answer in time looks slower than it used to.
+static void rtt_penalize(mavis_ctx * mcx, struct remote_addr_s *ra)
+{
+    unsigned long long t = mcx->timeout * 1000000ULL;
+    ra->rtt = ra->rtt * 2 > t ? ra->rtt * 2 : t;
+    if (ra->rtt > 16 * t)
+	ra->rtt = 16 * t;
+    ra->rtt_time = io_now.tv_sec;
+}
+
+/*
+ * Pick the peer with the lowest expected latency, taking its backlog into
+ * account. Estimates that haven't been updated recently are halved every
+ * ten seconds, so peers that were slow will eventually be tried again.
+ */
+static struct remote_addr_s *select_ra(mavis_ctx * mcx, struct remote_addr_s *exclude)
+{
+    struct remote_addr_s *ra = NULL;
+    unsigned long long score = 0;
+    for (struct remote_addr_s * rat = mcx->remote_addr; rat; rat = rat->next)
+	if (rat != exclude) {
+	    time_t idle = (io_now.tv_sec - rat->rtt_time) / 10;
+	    unsigned long long s = ((idle < 64 ? rat->rtt >> idle : 0) + 1) * (rat->backlog + 1);
+	    if (!ra || s < score)
+		ra = rat, score = s;
+	}
+    return ra;
+}
+
+static void hedge(struct hedge *, int);
+
+static void hedge_arm(struct query *q)
+{
+    mavis_ctx *mcx = q->mcx;
+    if (mcx->hedge && mcx->hedge_delay && mcx->remote_addr && mcx->remote_addr->next && mcx->hedge_delay < mcx->timeout * 1000000U)
+	io_sched_add(mcx->io, &q->hedge, (void *) hedge, mcx->hedge_delay / 1000000, mcx->hedge_delay % 1000000);
+}
+
+// Stop waiting for the duplicate, if any.
+static void hedge_disarm(struct query *q)
+{
+    io_sched_del(q->mcx->io, &q->hedge, (void *) hedge);
+    if (q->hedge_ra) {
+	if (q->hedge_ra->backlog > 0)
+	    q->hedge_ra->backlog--;
+	q->hedge_ra = NULL;
+    }
+}
+
+static void hedge(struct hedge *h, int fd __attribute__((unused)))
+{
+    struct query *q = h->q;
+    io_sched_pop(q->mcx->io, h);
+    struct remote_addr_s *ra = select_ra(q->mcx, q->ra);
+    if (ra) {
+	Debug((DEBUG_PROC, "hedging query after %u us\n", q->mcx->hedge_delay));
+	ra->count_s++, ra->count_s_p++;
+	if (MAVIS_DEFERRED == av_send(q->ac, q->mcx->sock, &ra->sa, ra->blowfish)) {
+	    ra->backlog++;
+	    q->hedge_ra = ra;
+	    q->hedge_sent = io_now;
+	}
+    }
+}
+
 static void udp_error(void *ctx __attribute__((unused)), int cur)
 {
     int sockerr;
@@ -265,6 +381,13 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
 	    parse(sym, S_equal);
 	    mcx->tries = parse_int(sym);
 	    continue;
+	case S_hedge:
+	    sym_get(sym);
+	    parse(sym, S_equal);
+	    mcx->hedge = parse_int(sym);
+	    if (mcx->hedge < 0 || mcx->hedge > 100)
+		parse_error(sym, "Expected a percentile between 0 and 100");
+	    continue;
 	case S_server:
 	case S_dst:{
 		ad = NULL, po = NULL;
@@ -339,7 +462,7 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
 		mavis_module_parse_action(mcx, sym);
 		continue;
 	default:
-		parse_error_expect(sym, S_script, S_userid, S_groupid, S_path, S_mode, S_action, S_closebra, S_unknown);
+		parse_error_expect(sym, S_script, S_local, S_rebalance, S_timeout, S_tries, S_hedge, S_server, S_action, S_closebra, S_unknown);
 	    }
 	}
     }
@@ -367,6 +490,7 @@ static void mavis_drop_in(mavis_ctx * mcx)
 	struct query *q = RB_payload(rb, struct query *);
 	rbn = RB_next(rb);
 	io_sched_pop(mcx->io, q);
+	io_sched_del(mcx->io, &q->hedge, (void *) hedge);
 	free_payload(q);
     }
 
@@ -385,6 +509,7 @@ static int mavis_cancel_in(mavis_ctx * mcx, void
     if (r) {
 	struct query *qp = RB_payload(r, struct query *);
 	io_sched_pop(mcx->io, qp);
+	hedge_disarm(qp);
 	if (qp->ra->backlog > 0)
 	    qp->ra->backlog--;
 	RB_search_and_delete(mcx->retransmit, qp);
@@ -398,9 +523,13 @@ static int mavis_cancel_in(mavis_ctx * mcx, void
 
 static void retransmit(struct query *q, int fd __attribute__((unused)))
 {
-    struct remote_addr_s *rat, *ra = q->ra;
+    struct remote_addr_s *ra = q->ra;
     if (ra->backlog > 0)
 	ra->backlog--;
+    rtt_penalize(q->mcx, ra);
+    if (q->hedge_ra)
+	rtt_penalize(q->mcx, q->hedge_ra);
+    hedge_disarm(q);
     Debug((DEBUG_PROC, "retransmit-counter is at %d\n", q->tries + 1));
     Debug((DEBUG_PROC, "               max is at %d\n", q->mcx->tries));
     if (++q->tries == q->mcx->tries) {
@@ -423,13 +552,13 @@ static void retransmit(struct query *q, int fd __attribute__((unused)))
 	}
     } else {
 	io_sched_renew(q->mcx->io, q);
-	for (ra = rat = q->mcx->remote_addr; rat; rat = rat->next)
-	    if (ra->backlog > rat->backlog)
-		ra = rat;
+	ra = select_ra(q->mcx, NULL);
 	q->ra = ra;
+	q->sent = io_now;
 	ra->count_s++, ra->count_s_p++;
 	if (MAVIS_DEFERRED == av_send(q->ac, q->mcx->sock, &ra->sa, ra->blowfish))
 	    ra->backlog++;
+	hedge_arm(q);
     }
 }
 
@@ -450,8 +579,8 @@ static int mavis_send_in(mavis_ctx * mcx, av_ctx ** ac)
 	    su_ntoa(&rat->sa, buf, (socklen_t) sizeof(buf));
 	    logmsg
 		("STAT %s: [%s]:%d O=%llu I=%llu B=%lu "
-		 "o=%llu i=%llu b=%lu", MAVIS_name, buf,
-		 su_get_port(&rat->sa), rat->count_s, rat->count_r, rat->backlog_max, rat->count_s_p, rat->count_r_p, rat->backlog_max_p);
+		 "o=%llu i=%llu b=%lu L=%llu", MAVIS_name, buf,
+		 su_get_port(&rat->sa), rat->count_s, rat->count_r, rat->backlog_max, rat->count_s_p, rat->count_r_p, rat->backlog_max_p, rat->rtt / 1000);
 	    count_s += rat->count_s;
 	    count_r += rat->count_r;
 	    backlog_max += rat->backlog_max;
@@ -475,12 +604,10 @@ static int mavis_send_in(mavis_ctx * mcx, av_ctx ** ac)
  */
     if (mcx->rebalance && ++mcx->request_count > mcx->rebalance)
 	for (mcx->request_count = 0, rat = mcx->remote_addr; rat; rat = rat->next)
-	    rat->backlog = 0;
+	    rat->backlog = 0, rat->rtt = 0;
     if (mcx->io) {
 	int result;
-	for (ra = rat = mcx->remote_addr; rat; rat = rat->next)
-	    if (ra->backlog > rat->backlog)
-		ra = rat;
+	ra = select_ra(mcx, NULL);
 	if (ra) {
 	    ra->count_s++, ra->count_s_p++;
 	    result = av_send(*ac, mcx->sock, &ra->sa, ra->blowfish);
@@ -489,10 +616,13 @@ static int mavis_send_in(mavis_ctx * mcx, av_ctx ** ac)
 		char *serial = av_get(*ac, AV_A_SERIAL);
 		q->mcx = mcx;
 		q->ra = ra;
+		q->sent = io_now;
+		q->hedge.q = q;
 		q->ac = *ac;
 		*ac = NULL;
 		q->serial_crc = crc32_update(INITCRC32, (u_char *) serial, strlen(serial));
 		io_sched_add(mcx->io, q, (void *) retransmit, mcx->timeout, 0);
+		hedge_arm(q);
 		RB_insert(mcx->retransmit, q);
 		RB_insert(mcx->retransmit_by_app_ctx, q);
 		ra->backlog++;
@@ -518,9 +648,7 @@ static int mavis_send_in(mavis_ctx * mcx, av_ctx ** ac)
 	ufds[0].events = POLLIN;
 	do {
 	    sockaddr_union sa;
-	    for (ra = rat = mcx->remote_addr; rat; rat = rat->next)
-		if (ra->backlog > rat->backlog)
-		    ra = rat;
+	    ra = select_ra(mcx, NULL);
 	    if ((!tries && mcx->tries)
 		|| (ra->backlog++, MAVIS_FINAL == av_send(*ac, mcx->sock, &ra->sa, ra->blowfish))) {
 		av_set(*ac, AV_A_RESULT, AV_V_RESULT_ERROR);
@@ -572,6 +700,16 @@ static void mavis_io(mavis_ctx * mcx, int cur __attribute__((unused)))
 		RB_delete(mcx->retransmit, r);
 		av_move(qp->ac, ac);
 		RB_insert(mcx->outgoing, qp);
+		if (ra == qp->hedge_ra) {
+		    Debug((DEBUG_PROC, "hedged query won\n"));
+		    rtt_update(mcx, ra, &qp->hedge_sent);
+		    if (qp->ra->backlog > 0)
+			qp->ra->backlog--;
+		    qp->ra = ra;
+		    qp->hedge_ra = NULL;
+		} else if (ra == qp->ra)
+		    rtt_update(mcx, ra, &qp->sent);
+		hedge_disarm(qp);
 		if (ra->backlog > 0)
 		    ra->backlog--;
 		qp->result = MAVIS_FINAL;
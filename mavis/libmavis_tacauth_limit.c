@@ -29,6 +29,7 @@
 #include "misc/strops.h"
 #include "misc/tohex.h"
 #include "misc/mymd5.h"
+#include "misc/shmtab.h"
 
 static const char rcsid[] __attribute__((used)) = "$Id$";
 
@@ -37,6 +38,9 @@ static const char rcsid[] __attribute__((used)) = "$Id$";
 		char *hashfile;		\
 		char *hashfile_tmp;	\
 		off_t hashfile_offset;	\
+		char *shm_path;		\
+		u_int shm_size;		\
+		struct shmtab *shm;	\
 		int skip_recv_out;	\
 		uid_t uid;		\
 		gid_t gid;		\
@@ -57,9 +61,19 @@ static int mavis_init_in(mavis_ctx * mcx)
     mcx->euid = geteuid();
     mcx->egid = getegid();
 
-    if (!mcx->hashdir)
-	logmsg("Warning: %s module lacks directory definition", MAVIS_name);
-    else {
+    if (mcx->shm_path && !mcx->shm) {
+	UNUSED_RESULT(setegid(mcx->gid));
+	UNUSED_RESULT(seteuid(mcx->uid));
+	if (!(mcx->shm = shmtab_open(mcx->shm_path, mcx->shm_size, 0)))
+	    logerr("module %s: %s", MAVIS_name, mcx->shm_path);
+	UNUSED_RESULT(seteuid(mcx->euid));
+	UNUSED_RESULT(setegid(mcx->egid));
+    }
+
+    if (!mcx->hashdir) {
+	if (!mcx->shm_path)
+	    logmsg("Warning: %s module lacks directory definition", MAVIS_name);
+    } else {
 	int fn;
 	pid_t pid;
 	struct stat st;
@@ -120,6 +134,7 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
     mcx->blacklist_period = (time_t) 15 *60;
     mcx->blacklist_count = (u_int) 5;
     mcx->hashbits = (1 << AV_A_USER) | (1 << AV_A_IPADDR) | (1 << AV_A_REALM);
+    mcx->shm_size = 65536;
 
     while (1) {
 	switch (sym->code) {
@@ -138,6 +153,24 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
 	    strset(&mcx->hashdir, sym->buf);
 	    sym_get(sym);
 	    continue;
+	case S_shared:
+	    sym_get(sym);
+	    switch (sym->code) {
+	    case S_file:
+		sym_get(sym);
+		parse(sym, S_equal);
+		strset(&mcx->shm_path, sym->buf);
+		sym_get(sym);
+		break;
+	    case S_size:
+		sym_get(sym);
+		parse(sym, S_equal);
+		mcx->shm_size = (u_int) parse_int(sym);
+		break;
+	    default:
+		parse_error_expect(sym, S_file, S_size, S_unknown);
+	    }
+	    continue;
 	case S_blacklist:
 	    sym_get(sym);
 	    switch (sym->code) {
@@ -175,7 +208,7 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
 	    mavis_module_parse_action(mcx, sym);
 	    continue;
 	default:
-	    parse_error_expect(sym, S_script, S_userid, S_groupid, S_directory, S_hash, S_action, S_closebra, S_unknown);
+	    parse_error_expect(sym, S_script, S_userid, S_groupid, S_directory, S_shared, S_blacklist, S_hash, S_action, S_closebra, S_unknown);
 	}
     }
     DebugOut(DEBUG_MAVIS);
@@ -187,11 +220,12 @@ static void mavis_drop_in(mavis_ctx * mcx)
     Xfree(&mcx->hashdir);
     Xfree(&mcx->hashfile);
     Xfree(&mcx->hashfile_tmp);
+    Xfree(&mcx->shm_path);
+    shmtab_close(mcx->shm);
 }
 
-static void get_hash(mavis_ctx * mcx, av_ctx * ac, char *buf)
+static void get_digest(mavis_ctx * mcx, av_ctx * ac, u_char *u)
 {
-    u_char u[16];
     myMD5_CTX m;
     DebugIn(DEBUG_MAVIS);
     myMD5Init(&m);
@@ -205,17 +239,57 @@ static void get_hash(mavis_ctx * mcx, av_ctx * ac, char *buf)
 	hashbits >>= 1;
     }
     myMD5Final(u, &m);
-    tohex(u, 16, buf);
     DebugOut(DEBUG_MAVIS);
 }
 
+static void get_hash(mavis_ctx * mcx, av_ctx * ac, char *buf)
+{
+    u_char u[16];
+    get_digest(mcx, ac, u);
+    tohex(u, 16, buf);
+}
+
+static int shm_send_in(mavis_ctx * mcx, av_ctx * ac)
+{
+    u_char key[SHMTAB_KEYLEN];
+    time_t mtime;
+    uint32_t count;
+
+    get_digest(mcx, ac, key);
+    char id[2 * SHMTAB_KEYLEN + 1];
+    if (shmtab_get(mcx->shm, key, NULL, 0, &mtime, &count) < 0) {
+	// Failures couldn't be counted, as the bucket is full of banned keys.
+	if (!shmtab_full(mcx->shm, key, mcx->blacklist_count))
+	    return MAVIS_DOWN;
+	av_setf(ac, AV_A_USER_RESPONSE, "Authentication failure (blacklist full) [id: %s]", tohex(key, SHMTAB_KEYLEN, id));
+    } else if (mtime + mcx->blacklist_period < io_now.tv_sec || count < mcx->blacklist_count)
+	return MAVIS_DOWN;
+    else
+	av_setf(ac, AV_A_USER_RESPONSE, "Authentication failure (banned for another %ld seconds) [id: %s]",
+		(long) (mtime + mcx->blacklist_period - io_now.tv_sec), tohex(key, SHMTAB_KEYLEN, id));
+    av_set(ac, AV_A_RESULT, AV_V_RESULT_FAIL);
+    mcx->skip_recv_out = 1;
+    return MAVIS_FINAL;
+}
+
+static void shm_recv_out(mavis_ctx * mcx, av_ctx * ac, char *result)
+{
+    u_char key[SHMTAB_KEYLEN];
+
+    get_digest(mcx, ac, key);
+    if (!strcmp(result, AV_V_RESULT_OK))
+	shmtab_delete(mcx->shm, key);
+    else if (!strcmp(result, AV_V_RESULT_FAIL))
+	shmtab_incr(mcx->shm, key, mcx->blacklist_period, mcx->blacklist_count);
+}
+
 #define HAVE_mavis_send_in
 static int mavis_send_in(mavis_ctx * mcx, av_ctx ** ac)
 {
     int fn;
 
     DebugIn(DEBUG_MAVIS);
-    if (!mcx->hashfile)
+    if (!mcx->hashfile && !mcx->shm)
 	return MAVIS_DOWN;
     char *t = av_get(*ac, AV_A_TYPE);
     if (!t || strcmp(t, AV_V_TYPE_TACPLUS))
@@ -224,6 +298,11 @@ static int mavis_send_in(mavis_ctx * mcx, av_ctx ** ac)
     if (!t || strcmp(t, AV_V_TACTYPE_AUTH))
 	return MAVIS_DOWN;
 
+    if (mcx->shm) {
+	DebugOut(DEBUG_MAVIS);
+	return shm_send_in(mcx, *ac);
+    }
+
     get_hash(mcx, *ac, mcx->hashfile + mcx->hashfile_offset + 3);
     mcx->hashfile[mcx->hashfile_offset] = mcx->hashfile[mcx->hashfile_offset + 3];
     mcx->hashfile[mcx->hashfile_offset + 1] = mcx->hashfile[mcx->hashfile_offset + 4];
@@ -268,7 +347,7 @@ static int mavis_recv_out(mavis_ctx * mcx, av_ctx ** ac)
 	return MAVIS_DOWN;
     }
 
-    if (!mcx->hashdir)
+    if (!mcx->hashdir && !mcx->shm)
 	return MAVIS_DOWN;
 
     DebugIn(DEBUG_MAVIS);
@@ -280,6 +359,13 @@ static int mavis_recv_out(mavis_ctx * mcx, av_ctx ** ac)
     if (!t || strcmp(t, AV_V_TACTYPE_AUTH))
 	return MAVIS_DOWN;
 
+    if (mcx->shm) {
+	if ((t = av_get(*ac, AV_A_RESULT)))
+	    shm_recv_out(mcx, *ac, t);
+	DebugOut(DEBUG_MAVIS);
+	return MAVIS_DOWN;
+    }
+
     get_hash(mcx, *ac, mcx->hashfile + mcx->hashfile_offset + 3);
     mcx->hashfile[mcx->hashfile_offset] = mcx->hashfile[mcx->hashfile_offset + 3];
     mcx->hashfile[mcx->hashfile_offset + 1] = mcx->hashfile[mcx->hashfile_offset + 4];
@@ -28,6 +28,7 @@
 #include "misc/strops.h"
 #include "misc/tohex.h"
 #include "misc/mymd5.h"
+#include "misc/shmtab.h"
 
 static const char rcsid[] __attribute__((used)) = "$Id$";
 
@@ -36,6 +37,10 @@ static const char rcsid[] __attribute__((used)) = "$Id$";
 		char *hashfile;		\
 		char *hashfile_tmp;	\
 		off_t hashfile_offset;	\
+		char *shm_path;		\
+		u_int shm_size;		\
+		struct shmtab *shm;	\
+		fd_set keep_set;	\
 		int skip_recv_out;	\
 		int device_cache_timeout;	\
 		int dacl_cache_timeout;	\
@@ -46,6 +51,13 @@ static const char rcsid[] __attribute__((used)) = "$Id$";
 
 #include "mavis.h"
 
+#define SHM_DATA_SIZE 4000	/* larger entries go to the directory, if any */
+
+static int keep[] = { AV_A_TACPROFILE, AV_A_TACCLIENT, AV_A_TACMEMBER, AV_A_UID, AV_A_GID, AV_A_GIDS,
+    AV_A_HOME, AV_A_ROOT, AV_A_SHELL, AV_A_PATH, AV_A_DN, AV_A_MEMBEROF, AV_A_IDENTITY_SOURCE,
+    AV_A_SSHKEYHASH, AV_A_SSHKEY, AV_A_SSHKEYID, -1
+};
+
 #define HAVE_mavis_init_in
 static int mavis_init_in(mavis_ctx * mcx)
 {
@@ -55,9 +67,22 @@ static int mavis_init_in(mavis_ctx * mcx)
     mcx->euid = geteuid();
     mcx->egid = getegid();
 
-    if (!mcx->hashdir)
-	logmsg("Warning: %s module lacks directory definition", MAVIS_name);
-    else {
+    if (mcx->shm_path && !mcx->shm) {
+	FD_ZERO(&mcx->keep_set);
+	for (int i = 0; keep[i] > -1; i++)
+	    FD_SET(keep[i], &mcx->keep_set);
+	UNUSED_RESULT(setegid(mcx->gid));
+	UNUSED_RESULT(seteuid(mcx->uid));
+	if (!(mcx->shm = shmtab_open(mcx->shm_path, mcx->shm_size, SHM_DATA_SIZE)))
+	    logerr("module %s: %s", MAVIS_name, mcx->shm_path);
+	UNUSED_RESULT(seteuid(mcx->euid));
+	UNUSED_RESULT(setegid(mcx->egid));
+    }
+
+    if (!mcx->hashdir) {
+	if (!mcx->shm_path)
+	    logmsg("Warning: %s module lacks directory definition", MAVIS_name);
+    } else {
 	int fn;
 	pid_t pid;
 	struct stat st;
@@ -117,6 +142,7 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
     DebugIn(DEBUG_MAVIS);
     mcx->device_cache_timeout = 60;
     mcx->dacl_cache_timeout = 60;
+    mcx->shm_size = 65536;
     while (1) {
 	switch (sym->code) {
 	case S_script:
@@ -134,6 +160,24 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
 	    strset(&mcx->hashdir, sym->buf);
 	    sym_get(sym);
 	    continue;
+	case S_shared:
+	    sym_get(sym);
+	    switch (sym->code) {
+	    case S_file:
+		sym_get(sym);
+		parse(sym, S_equal);
+		strset(&mcx->shm_path, sym->buf);
+		sym_get(sym);
+		break;
+	    case S_size:
+		sym_get(sym);
+		parse(sym, S_equal);
+		mcx->shm_size = (u_int) parse_int(sym);
+		break;
+	    default:
+		parse_error_expect(sym, S_file, S_size, S_unknown);
+	    }
+	    continue;
 	case S_eof:
 	case S_closebra:
 	    DebugOut(DEBUG_MAVIS);
@@ -156,7 +200,7 @@ static int mavis_parse_in(mavis_ctx * mcx, struct sym *sym)
 	    mcx->dacl_cache_timeout = parse_int(sym);
 	    continue;
 	default:
-	    parse_error_expect(sym, S_script, S_userid, S_groupid, S_directory, S_action, S_closebra, S_unknown);
+	    parse_error_expect(sym, S_script, S_userid, S_groupid, S_directory, S_shared, S_device, S_dacl, S_action, S_closebra, S_unknown);
 	}
     }
     DebugOut(DEBUG_MAVIS);
@@ -168,11 +212,12 @@ static void mavis_drop_in(mavis_ctx * mcx)
     Xfree(&mcx->hashdir);
     Xfree(&mcx->hashfile);
     Xfree(&mcx->hashfile_tmp);
+    Xfree(&mcx->shm_path);
+    shmtab_close(mcx->shm);
 }
 
-static void get_hash(av_ctx * ac, char *buf)
+static void get_digest(av_ctx * ac, u_char *u)
 {
-    u_char u[16];
     char *t;
     myMD5_CTX m;
     DebugIn(DEBUG_MAVIS);
@@ -191,14 +236,55 @@ static void get_hash(av_ctx * ac, char *buf)
 	myMD5Update(&m, (u_char *) t, strlen(t));
 
     myMD5Final(u, &m);
-    tohex(u, 16, buf);
     DebugOut(DEBUG_MAVIS);
 }
 
-static int keep[] = { AV_A_TACPROFILE, AV_A_TACCLIENT, AV_A_TACMEMBER, AV_A_UID, AV_A_GID, AV_A_GIDS,
-    AV_A_HOME, AV_A_ROOT, AV_A_SHELL, AV_A_PATH, AV_A_DN, AV_A_MEMBEROF, AV_A_IDENTITY_SOURCE,
-    AV_A_SSHKEYHASH, AV_A_SSHKEY, AV_A_SSHKEYID, -1
-};
+static void get_hash(av_ctx * ac, char *buf)
+{
+    u_char u[16];
+    get_digest(ac, u);
+    tohex(u, 16, buf);
+}
+
+static int expired(mavis_ctx * mcx, char *tactype, time_t mtime)
+{
+    if (!strcmp(tactype, AV_V_TACTYPE_HOST))
+	return mtime + mcx->device_cache_timeout < io_now.tv_sec;
+    if (!strcmp(tactype, AV_V_TACTYPE_DACL))
+	return mtime + mcx->dacl_cache_timeout < io_now.tv_sec;
+    return 0;
+}
+
+static int shm_send_in(mavis_ctx * mcx, av_ctx * ac, char *tactype)
+{
+    u_char key[SHMTAB_KEYLEN];
+    char *c = alloca(SHM_DATA_SIZE + 1);
+    time_t mtime;
+
+    get_digest(ac, key);
+    if (shmtab_get(mcx->shm, key, c, SHM_DATA_SIZE + 1, &mtime, NULL) < 0 || expired(mcx, tactype, mtime))
+	return MAVIS_DOWN;
+
+    for (int i = 0; keep[i] > -1; i++)
+	av_unset(ac, keep[i]);
+    av_char_to_array(ac, c, &mcx->keep_set);
+    av_set(ac, AV_A_RESULT, AV_V_RESULT_OK);
+    mcx->skip_recv_out = 1;
+    return MAVIS_FINAL;
+}
+
+// Returns -1 if the entry doesn't fit.
+static int shm_recv_out(mavis_ctx * mcx, av_ctx * ac)
+{
+    u_char key[SHMTAB_KEYLEN];
+    char *c = alloca(SHM_DATA_SIZE + 1);
+
+    int len = av_array_to_char(ac, c, SHM_DATA_SIZE + 1, &mcx->keep_set);
+    if (len < 0)
+	return -1;
+    get_digest(ac, key);
+    return shmtab_set(mcx->shm, key, 0, c, (size_t) len, 0);
+}
 
 #define HAVE_mavis_send_in
 static int mavis_send_in(mavis_ctx * mcx, av_ctx ** ac)
@@ -206,7 +292,7 @@ static int mavis_send_in(mavis_ctx * mcx, av_ctx ** ac)
     int fn;
 
     DebugIn(DEBUG_MAVIS);
-    if (!mcx->hashfile)
+    if (!mcx->hashfile && !mcx->shm)
 	return MAVIS_DOWN;
     char *t = av_get(*ac, AV_A_TYPE);
     if (!t || strcmp(t, AV_V_TYPE_TACPLUS))
@@ -215,6 +301,15 @@ static int mavis_send_in(mavis_ctx * mcx, av_ctx ** ac)
     if (!t || (strcmp(t, AV_V_TACTYPE_INFO) && strcmp(t, AV_V_TACTYPE_HOST) && strcmp(t, AV_V_TACTYPE_DACL)))
 	return MAVIS_DOWN;
 
+    if (mcx->shm && shm_send_in(mcx, *ac, t) == MAVIS_FINAL) {
+	DebugOut(DEBUG_MAVIS);
+	return MAVIS_FINAL;
+    }
+    if (!mcx->hashfile) {
+	DebugOut(DEBUG_MAVIS);
+	return MAVIS_DOWN;
+    }
+
     get_hash(*ac, mcx->hashfile + mcx->hashfile_offset + 3);
     mcx->hashfile[mcx->hashfile_offset] = mcx->hashfile[mcx->hashfile_offset + 3];
     mcx->hashfile[mcx->hashfile_offset + 1] = mcx->hashfile[mcx->hashfile_offset + 4];
@@ -278,7 +373,7 @@ static int mavis_recv_out(mavis_ctx * mcx, av_ctx ** ac)
 	return MAVIS_DOWN;
     }
 
-    if (!mcx->hashdir)
+    if (!mcx->hashdir && !mcx->shm)
 	return MAVIS_DOWN;
 
     DebugIn(DEBUG_MAVIS);
@@ -293,6 +388,11 @@ static int mavis_recv_out(mavis_ctx * mcx, av_ctx ** ac)
     if (!t || strcmp(t, AV_V_RESULT_OK))
 	return MAVIS_DOWN;
 
+    if (mcx->shm && (!shm_recv_out(mcx, *ac) || !mcx->hashdir)) {
+	DebugOut(DEBUG_MAVIS);
+	return MAVIS_DOWN;
+    }
+
     get_hash(*ac, mcx->hashfile + mcx->hashfile_offset + 3);
     mcx->hashfile[mcx->hashfile_offset] = mcx->hashfile[mcx->hashfile_offset + 3];
     mcx->hashfile[mcx->hashfile_offset + 1] = mcx->hashfile[mcx->hashfile_offset + 4];
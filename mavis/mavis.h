@@ -288,6 +288,9 @@ void av_copy(av_ctx *, av_ctx *);
 size_t av_array_to_char_len(av_ctx *);
 int av_array_to_char(av_ctx *, char *, size_t, fd_set *);
 int av_char_to_array(av_ctx *, char *, fd_set *);
+size_t av_array_to_tlv_len(av_ctx *);
+int av_array_to_tlv(av_ctx *, char *, size_t, fd_set *);
+int av_tlv_to_array(av_ctx *, char *, size_t, fd_set *);
 int av_attribute_to_i(char *);
 int av_attr_token_to_i(struct sym *);
 
@@ -394,6 +397,7 @@ struct common_data {
     char **envp;
     struct pidfile *pidfile;
     int singleprocess;
+    int zygote;
     char *conffile;
     char *id;
     time_t cleanup_interval;
@@ -491,12 +495,27 @@ void mavis_detach(void);
 void mavis_module_parse_action(mavis_ctx *, struct sym *);
 
 #define MAVIS_EXT_MAGIC_V1 0x4d610001
+#define MAVIS_EXT_MAGIC_V2 0x4d610002	/* TLV body, see av_array_to_tlv() */
+#define MAVIS_EXT_MAGIC_BATCH 0x4d610003	/* body: V1/V2 frames, result: frame count */
+/*
+ * The result field of a request carries the caller's capabilities. A
+ * child seeing MAVIS_EXT_CAP_TLV may reply with MAVIS_EXT_MAGIC_V2, and the
+ * caller switches to V2 requests once it has received a V2 reply.
+ * A child seeing MAVIS_EXT_CAP_BATCH may announce batch support by sending
+ * a MAVIS_EXT_MAGIC_BATCH frame (possibly empty). The caller will then pack
+ * requests started within the same event loop iteration into batch frames.
+ */
+#define MAVIS_EXT_CAP_TLV 1
+#define MAVIS_EXT_CAP_BATCH 2
 struct mavis_ext_hdr_v1 {
     uint32_t magic;
     uint32_t body_len;
     uint32_t result;
 } __attribute__((__packed__));
 
+int mavis_ext_read_hdr(int, struct mavis_ext_hdr_v1 *);
+int mavis_ext_read_body(int, char *, size_t);
+
 #if defined(MAVIS_name) && defined(DEBUG)
 #undef DebugIn
 #undef DebugOut
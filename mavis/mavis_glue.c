@@ -161,6 +161,10 @@ static int Mavis_send(mavis_ctx * mcx, av_ctx ** ac)
     if (result == MAVIS_DOWN && mcx->down && *ac)
 	result = mcx->down->send(mcx->down, ac);
 
+#ifdef HAVE_mavis_send_out
+    result = mavis_send_out(mcx, ac, result);
+#endif
+
 #ifdef HAVE_mavis_recv_out
     if (result == MAVIS_FINAL && script_verdict != S_skip) {
 	if (mcx->script_interim)
@@ -217,8 +221,12 @@ static int Mavis_recv(mavis_ctx * mcx, av_ctx ** ac, void *app_ctx)
     if (result == MAVIS_DOWN && mcx->down && *ac)
 	result = mcx->down->send(mcx->down, ac);
 
-    if (result == MAVIS_DOWN && mcx->down)
+    if (result == MAVIS_DOWN && mcx->down) {
 	result = mcx->down->recv(mcx->down, ac, app_ctx);
+#ifdef HAVE_mavis_send_out
+	result = mavis_send_out(mcx, ac, result);
+#endif
+    }
 
     if (result == MAVIS_FINAL && mcx->script_interim) {
 	switch (mavis_script_eval(mcx, *ac, mcx->script_interim)) {
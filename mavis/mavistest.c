@@ -78,19 +78,90 @@ static void usage()
 {
     fprintf(stderr,
 	    "mavistest [options] <config> <id> <type> <user> [<password>]\n"
+	    "mavistest -B [-l <loops>] [-a <attribute> -v <value> ...]\n"
 	    "\n"
 	    "Options:\n"
 	    "  -P                  (parse only)\n"
 	    "  -d <debuglevel>     (set debug level)\n"
+	    "  -B                  (benchmark text vs. binary AV encoding)\n"
 	    "\n"
 	    "Valid <type> values: %s, %s\n"
 	    "\n" "Sample usage: mavistest -d -1  /usr/local/etc/tac_plus.cfg tac_plus TACPLUS joe p4ssw0rd\n", AV_V_TYPE_FTP, AV_V_TYPE_TACPLUS);
     exit(-1);
 }
 
+static double elapsed_ns(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+// Encodes and decodes a typical user lookup reply with both AV codecs.
+static void codec_benchmark(av_ctx * acd, int loop)
+{
+    struct {
+	int attr;
+	char *value;
+    } sample[] = {
+	{ AV_A_TYPE, AV_V_TYPE_TACPLUS },
+	{ AV_A_TACTYPE, AV_V_TACTYPE_INFO },
+	{ AV_A_USER, "demo" },
+	{ AV_A_SERIAL, "a3f0c1d2e4b5a6978899aabbccddeeff" },
+	{ AV_A_TIMESTAMP, "mavistest-12345-1700000000-0" },
+	{ AV_A_IPADDR, "192.0.2.17" },
+	{ AV_A_SERVERIP, "192.0.2.1" },
+	{ AV_A_REALM, "default" },
+	{ AV_A_RESULT, AV_V_RESULT_OK },
+	{ AV_A_DN, "uid=demo,ou=people,dc=example,dc=com" },
+	{ AV_A_MEMBEROF,
+	 "\"cn=netadmins,ou=groups,dc=example,dc=com\",\"cn=helpdesk,ou=groups,dc=example,dc=com\","
+	 "\"cn=vpn-users,ou=groups,dc=example,dc=com\",\"cn=staff,ou=groups,dc=example,dc=com\"" },
+	{ AV_A_TACMEMBER, "\"netadmins\",\"helpdesk\",\"vpn-users\",\"staff\"" },
+	{ AV_A_IDENTITY_SOURCE, "ldap" },
+	{ AV_A_UID, "1000" },
+	{ AV_A_GID, "1000" },
+	{ AV_A_HOME, "/home/demo" },
+	{ AV_A_SHELL, "/bin/bash" },
+	{ AV_A_USER_RESPONSE, "Welcome.\nYour password expires in 14 days." },
+	{ -1, NULL }
+    };
+    av_ctx *ac = av_new(NULL, NULL);
+    av_copy(ac, acd);
+    for (int i = 0; sample[i].value; i++)
+	if (!av_get(ac, sample[i].attr))
+	    av_set(ac, sample[i].attr, sample[i].value);
+
+    size_t buflen = av_array_to_char_len(ac) + av_array_to_tlv_len(ac);
+    char *buf = alloca(buflen);
+    struct timespec start;
+    int len;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < loop; i++) {
+	av_ctx *out = av_new(NULL, NULL);
+	len = av_array_to_char(ac, buf, buflen, NULL);
+	av_char_to_array(out, buf, NULL);
+	av_free(out);
+    }
+    printf("text   %5d bytes %8.0f ns/op\n", len, elapsed_ns(&start) / loop);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < loop; i++) {
+	av_ctx *out = av_new(NULL, NULL);
+	len = av_array_to_tlv(ac, buf, buflen, NULL);
+	av_tlv_to_array(out, buf, (size_t) len, NULL);
+	av_free(out);
+    }
+    printf("binary %5d bytes %8.0f ns/op\n", len, elapsed_ns(&start) / loop);
+
+    av_free(ac);
+}
+
 int main(int argc, char *argv[])
 {
-    char opt, *optstring = "a:v:d:l:tP";
+    char opt, *optstring = "a:v:d:l:tPB";
+    int bench = 0;
     int loop = 1;
     int timing = 0;
     time_t start;
@@ -110,6 +181,9 @@ int main(int argc, char *argv[])
 	case 'P':
 	    common_data.parse_only = 1;
 	    break;
+	case 'B':
+	    bench = 1;
+	    break;
 	case 'd':
 	    common_data.debug = atoi(optarg);
 	    break;
@@ -128,6 +202,11 @@ int main(int argc, char *argv[])
     argv = &argv[optind];
     argc -= optind;
 
+    if (bench) {
+	codec_benchmark(acd, loop > 1 ? loop : 100000);
+	exit(EX_OK);
+    }
+
     if (argc < 3)		// config id user
 	usage();
 
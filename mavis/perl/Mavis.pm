@@ -91,7 +91,11 @@ BEGIN {
 		MAVIS_CONF_OK
 		MAVIS_DEFERRED
 		MAVIS_DOWN
+		MAVIS_EXT_CAP_BATCH
+		MAVIS_EXT_CAP_TLV
+		MAVIS_EXT_MAGIC_BATCH
 		MAVIS_EXT_MAGIC_V1
+		MAVIS_EXT_MAGIC_V2
 		MAVIS_FINAL
 		MAVIS_FINAL_DEFERRED
 		MAVIS_IGNORE
@@ -182,7 +186,11 @@ use constant MAVIS_CONF_ERR => 1;
 use constant MAVIS_CONF_OK => 0;
 use constant MAVIS_DEFERRED => 1;
 use constant MAVIS_DOWN => 16;
+use constant MAVIS_EXT_CAP_BATCH => 2;
+use constant MAVIS_EXT_CAP_TLV => 1;
+use constant MAVIS_EXT_MAGIC_BATCH => 0x4d610003;
 use constant MAVIS_EXT_MAGIC_V1 => 0x4d610001;
+use constant MAVIS_EXT_MAGIC_V2 => 0x4d610002;
 use constant MAVIS_FINAL => 0;
 use constant MAVIS_FINAL_DEFERRED => 4;
 use constant MAVIS_IGNORE => 2;
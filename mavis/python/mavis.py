@@ -85,7 +85,11 @@ MAVIS_CONF_ERR = 1
 MAVIS_CONF_OK = 0
 MAVIS_DEFERRED = 1
 MAVIS_DOWN = 16
+MAVIS_EXT_CAP_BATCH = 2
+MAVIS_EXT_CAP_TLV = 1
+MAVIS_EXT_MAGIC_BATCH = 0x4d610003
 MAVIS_EXT_MAGIC_V1 = 0x4d610001
+MAVIS_EXT_MAGIC_V2 = 0x4d610002
 MAVIS_FINAL = 0
 MAVIS_FINAL_DEFERRED = 4
 MAVIS_IGNORE = 2
@@ -35,6 +35,8 @@
 #define TRISTATE_YES    1
 #define TRISTATE_NO     2
 static int is_mt = TRISTATE_DUNNO;
+static int use_tlv = 0;		// caller accepts MAVIS_EXT_MAGIC_V2
+static int use_batch = 0;	// caller knows we accept MAVIS_EXT_MAGIC_BATCH
 
 static void usage(void)
 {
@@ -86,13 +88,18 @@ static pthread_mutex_t mutex_lock;
 
 static void av_write(av_ctx *ac, uint32_t result)
 {
-    size_t len = av_array_to_char_len(ac);
+    int tlv = use_tlv && is_mt == TRISTATE_YES;
+    size_t len = tlv ? av_array_to_tlv_len(ac) : av_array_to_char_len(ac);
     char *buf = alloca(len + sizeof(struct mavis_ext_hdr_v1));
     if (is_mt == TRISTATE_YES) {
-	len = av_array_to_char(ac, buf + sizeof(struct mavis_ext_hdr_v1), len, NULL);
-
 	struct mavis_ext_hdr_v1 *h = (struct mavis_ext_hdr_v1 *) buf;
-	h->magic = htonl(MAVIS_EXT_MAGIC_V1);
+	if (tlv) {
+	    len = av_array_to_tlv(ac, buf + sizeof(struct mavis_ext_hdr_v1), len, NULL);
+	    h->magic = htonl(MAVIS_EXT_MAGIC_V2);
+	} else {
+	    len = av_array_to_char(ac, buf + sizeof(struct mavis_ext_hdr_v1), len, NULL);
+	    h->magic = htonl(MAVIS_EXT_MAGIC_V1);
+	}
 	h->body_len = htonl((uint32_t) len);
 	h->result = htonl(result);
 
@@ -276,20 +283,13 @@ int main(int argc, char **argv)
     }
 
     while (1) {
-	size_t hdr_off = 0;
 	av_ctx *ac = NULL;
 
-	if (is_mt != TRISTATE_NO) {
-	    while (sizeof(struct mavis_ext_hdr_v1) != hdr_off) {
-		int len = read(0, (char *) &hdr + hdr_off, sizeof(struct mavis_ext_hdr_v1) - hdr_off);
-		if (len < 1) {
-		    exit(-1);
-		}
-		hdr_off += len;
-	    }
-	}
+	if (is_mt != TRISTATE_NO && mavis_ext_read_hdr(0, &hdr))
+	    exit(-1);
 
-	if (is_mt != TRISTATE_NO && ntohl(hdr.magic) == MAVIS_EXT_MAGIC_V1) {
+	uint32_t magic = ntohl(hdr.magic);
+	if (is_mt != TRISTATE_NO && (magic == MAVIS_EXT_MAGIC_V1 || magic == MAVIS_EXT_MAGIC_V2)) {
 	    if (is_mt == TRISTATE_DUNNO) {
 		if (pthread_mutex_init(&mutex_lock, NULL))
 		    fprintf(stderr, "pthread_mutex_init() failed, expect trouble\n");
@@ -297,18 +297,25 @@ int main(int argc, char **argv)
 	    }
 	    size_t len = ntohl(hdr.body_len);
 	    char *b = calloc(1, len + 1);
-	    size_t off = 0;
-	    while (len - off > 0) {
-		size_t nlen = read(0, b + off, len - off);
-		if (nlen < 1) {
-		    fprintf(stderr, "Short read (body).\n");
-		    exit(1);
-		}
-		off += nlen;
+	    if (mavis_ext_read_body(0, b, len)) {
+		fprintf(stderr, "Short read (body).\n");
+		exit(1);
 	    }
 	    ac = av_new(NULL, NULL);
-	    av_char_to_array(ac, b, NULL);
+	    if (magic == MAVIS_EXT_MAGIC_V2)
+		av_tlv_to_array(ac, b, len, NULL);
+	    else
+		av_char_to_array(ac, b, NULL);
 	    free(b);
+	    if (magic == MAVIS_EXT_MAGIC_V2 || (ntohl(hdr.result) & MAVIS_EXT_CAP_TLV))
+		use_tlv = 1;
+	    if ((ntohl(hdr.result) & MAVIS_EXT_CAP_BATCH) && !use_batch) {
+		struct mavis_ext_hdr_v1 h = {.magic = htonl(MAVIS_EXT_MAGIC_BATCH) };
+		use_batch = 1;
+		pthread_mutex_lock(&mutex_lock);
+		write(1, &h, sizeof(h));
+		pthread_mutex_unlock(&mutex_lock);
+	    }
 	} else {
 	    if (is_mt == TRISTATE_YES) {
 		fprintf(stderr, "Bad magic.\n");
@@ -30,6 +30,7 @@ int scm_send_msg(int sock, struct scm_data *sd, int fd)
     struct iovec vector = {.iov_base = sd };
     switch (sd->type) {
     case SCM_ACCEPT:
+    case SCM_UDPSHARD:
 	vector.iov_len = sizeof(struct scm_data_accept);
 	break;
     case SCM_UDPDATA:
@@ -87,7 +88,7 @@ int scm_recv_msg(int sock, struct scm_data_accept *sd, size_t sd_len, int *fd)
 	if (len <= sd_len)
 	    vector.iov_len = len;
     }
-    if (sd->type == SCM_ACCEPT || sd->type == SCM_UDPDATA) {
+    if (fd && (sd->type == SCM_ACCEPT || sd->type == SCM_UDPDATA || sd->type == SCM_FORK || sd->type == SCM_UDPSHARD)) {
 	// MSG_PEEK apparently accepts the file descriptor. This is unexpected, and implementations may vary.
 	struct cmsghdr *chdr = CMSG_FIRSTHDR(&msg);
 	if (chdr)
@@ -103,7 +104,7 @@ int scm_recv_msg(int sock, struct scm_data_accept *sd, size_t sd_len, int *fd)
 	return -1;
     }
     if (0 < res) {
-	if (sd->type == SCM_ACCEPT || sd->type == SCM_UDPDATA) {
+	if (fd && (sd->type == SCM_ACCEPT || sd->type == SCM_UDPDATA || sd->type == SCM_FORK || sd->type == SCM_UDPSHARD)) {
 	    struct cmsghdr *chdr = CMSG_FIRSTHDR(&msg);
 	    if (chdr)
 		memcpy(fd, CMSG_DATA(chdr), sizeof(int));
@@ -12,7 +12,7 @@
 #define __SCM_H__
 
 enum scm_token { SCM_DONE = 0, SCM_KEEPALIVE, SCM_MAY_DIE, SCM_DYING, SCM_BAD_CFG, SCM_MAX,
-    SCM_ACCEPT, SCM_UDPDATA,
+    SCM_ACCEPT, SCM_UDPDATA, SCM_FORK, SCM_UDPSHARD,
 };
 
 struct scm_data {
@@ -410,11 +410,24 @@ static void parse_listen(struct sym *sym)
 	case S_sticky:
 	    parse_sticky(sym, &ctx->track_data);
 	    break;
+	case S_shard:
+	    sym_get(sym);
+	    parse(sym, S_equal);
+	    if (sym->code == S_source) {
+		ctx->shard = S_source;
+		sym_get(sym);
+	    } else
+		ctx->shard = parse_bool(sym) ? S_yes : S_unknown;
+	    break;
 	default:
 	    parse_error_expect(sym, S_address, S_path, S_port, S_realm, S_tls, S_userid, S_groupid, S_backlog, S_type, S_protocol, S_retry, S_tcp, S_flag,
-			       S_sticky, S_unknown);
+			       S_sticky, S_shard, S_unknown);
 	}
     }
+    if (ctx->shard && ctx->protocol != IPPROTO_UDP)
+	parse_error(sym, "Sharding is only supported for UDP listeners");
+    if (ctx->shard && ctx->dtls_versions)
+	parse_error(sym, "Sharding isn't supported for DTLS listeners");
     if (ctx->overload_backlog > ctx->listen_backlog)
 	ctx->overload_backlog = ctx->listen_backlog;
     parse(sym, S_closebra);
@@ -607,8 +620,13 @@ void spawnd_parse_decls(struct sym *sym)
 		case S_sticky:
 		    parse_sticky(sym, &spawnd_data.track_data);
 		    break;
+		case S_fork:
+		    sym_get(sym);
+		    parse(sym, S_equal);
+		    spawnd_data.fork = parse_bool(sym);
+		    break;
 		default:
-		    parse_error_expect(sym, S_exec, S_id, S_config, S_instances, S_users, S_userid, S_groupid, S_ipc, S_unknown);
+		    parse_error_expect(sym, S_exec, S_id, S_config, S_instances, S_users, S_userid, S_groupid, S_ipc, S_fork, S_unknown);
 		}
 	    }
 	    parse(sym, S_closebra);
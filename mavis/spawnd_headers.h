@@ -85,6 +85,9 @@ struct spawnd_data {
     int keepidle;
     int keepintvl;
     int scm_bufsize;
+    int fork;			/* fork servers from a preloaded instance */
+    int zygote;			/* channel to preloaded instance */
+    pid_t zygote_pid;
     struct track_data track_data;
 };
 
@@ -105,6 +108,7 @@ struct spawnd_context {
     struct timeval tv;		/* server only */
     int use;			/* server only */
     pid_t pid;			/* server only */
+    int *shard_fd;		/* server only, per listener, see spawnd_shard() */
     char tag[SCM_REALM_SIZE + 1];	/* listener only */
     ssize_t tag_len;		/* listener only */
 #ifdef VRF_BINDTODEVICE
@@ -123,6 +127,7 @@ struct spawnd_context {
     int keepintvl;
     int dscp;
     enum token aaa_protocol;
+    enum token shard;		/* listener only, UDP */
     sockaddr_union sa;
     struct track_data track_data;
 };
@@ -131,14 +136,17 @@ void get_exec_path(char **, char *);
 void spawnd_setup_signals(void);
 void spawnd_process_signals(void);
 int spawnd_spawn_child(pid_t *);
+void spawnd_start_zygote(void);
 int spawnd_note_listener(sockaddr_union *, void *);
 void spawnd_parse_decls(struct sym *);
 int spawnd_send_msg(int, char *, int);
 int spawnd_recv_msg(int, char **, int *);
 void spawnd_add_child(void);
+void spawnd_shard(struct spawnd_context *);
 void spawnd_del_child(int);
 void spawnd_accepted(struct spawnd_context *, int);
 void spawnd_bind_listener(struct spawnd_context *, int);
+int spawnd_listener_socket(struct spawnd_context *);
 int spawnd_acl_check(sockaddr_union *);
 void spawnd_cleanup_internal(struct spawnd_context *, int);
 struct spawnd_context *spawnd_new_context(struct io_context *);
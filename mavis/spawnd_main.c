@@ -72,6 +72,15 @@ static void periodics(struct spawnd_context *ctx, int cur __attribute__((unused)
 	    spawnd_cleanup_internal(spawnd_data.server_arr[0], spawnd_data.server_arr[0]->fn);
     }
 
+    // Sharded UDP bypasses spawnd_accepted(), so restore the minimum here.
+    if (!common_data.singleprocess && common_data.servers_cur < common_data.servers_min)
+	for (i = 0; i < spawnd_data.listeners_max; i++)
+	    if (spawnd_data.listener_arr[i]->shard) {
+		while (common_data.servers_cur < common_data.servers_min)
+		    spawnd_add_child();
+		break;
+	    }
+
     if (io_now.tv_sec & 7) {
 	DebugOut(DEBUG_PROC);
 	return;
@@ -204,67 +213,77 @@ int spawnd_note_listener(sockaddr_union *sa __attribute__((unused)), void *data)
     return 0;
 }
 
-void spawnd_bind_listener(struct spawnd_context *ctx, int cur)
+int spawnd_listener_socket(struct spawnd_context *ctx)
 {
-    char buf[INET6_ADDRSTRLEN];
-
-    DebugIn(DEBUG_NET);
-    if (ctx->fn < 0) {
-	io_sched_del(common_data.io, ctx, (void *) spawnd_bind_listener);
+    int cur = su_socket(ctx->sa.sa.sa_family, ctx->socktype, ctx->protocol);
 
-	cur = su_socket(ctx->sa.sa.sa_family, ctx->socktype, ctx->protocol);
+    if (cur < 0) {
+	logerr("socket(%d, %d, %d) [%s:%d]", ctx->sa.sa.sa_family, ctx->socktype, ctx->protocol, __FILE__, __LINE__);
+	return -1;
+    }
 #if defined(IP_PKTINFO) || defined(IPV6_PKTINFO)
-	if (ctx->socktype == SOCK_DGRAM) {
-	    int one = 1;
+    if (ctx->socktype == SOCK_DGRAM) {
+	int one = 1;
 #ifdef IP_PKTINFO
-	    setsockopt(cur, IPPROTO_IP, IP_PKTINFO, &one, sizeof(one));
+	setsockopt(cur, IPPROTO_IP, IP_PKTINFO, &one, sizeof(one));
 #endif
 #ifdef IPV6_PKTINFO
-	    setsockopt(cur, IPPROTO_IP, IPV6_PKTINFO, &one, sizeof(one));
+	setsockopt(cur, IPPROTO_IP, IPV6_PKTINFO, &one, sizeof(one));
 #endif
-	}
+    }
 #endif
-	fcntl(cur, F_SETFD, fcntl(cur, F_GETFD, 0) | FD_CLOEXEC);
+    fcntl(cur, F_SETFD, fcntl(cur, F_GETFD, 0) | FD_CLOEXEC);
 
-	if (cur < 0) {
-	    logerr("socket(%d, %d, %d) [%s:%d]", ctx->sa.sa.sa_family, ctx->socktype, ctx->protocol, __FILE__, __LINE__);
-	    if (ctx->retry_delay)
-		io_sched_add(common_data.io, ctx, (void *) spawnd_bind_listener, (time_t) ctx->retry_delay, (suseconds_t) 0);
-	    DebugOut(DEBUG_NET);
-	    return;
-	}
 #ifdef AF_UNIX
-	if (ctx->sa.sa.sa_family == AF_UNIX)
-	    unlink(ctx->sa.sun.sun_path);
+    if (ctx->sa.sa.sa_family == AF_UNIX)
+	unlink(ctx->sa.sun.sun_path);
 #endif				/* AF_UNIX */
 
 #ifdef VRF_BINDTODEVICE
-	if (ctx->vrf && (ctx->sa.sa.sa_family == AF_INET || ctx->sa.sa.sa_family == AF_INET6)) {
-	    if (setsockopt(cur, SOL_SOCKET, SO_BINDTODEVICE, ctx->vrf, ctx->vrf_len))
-		logerr("setsockopt failed to set the VRF to \"%s\" [%s:%d]", ctx->vrf, __FILE__, __LINE__);
-	}
+    if (ctx->vrf && (ctx->sa.sa.sa_family == AF_INET || ctx->sa.sa.sa_family == AF_INET6)) {
+	if (setsockopt(cur, SOL_SOCKET, SO_BINDTODEVICE, ctx->vrf, ctx->vrf_len))
+	    logerr("setsockopt failed to set the VRF to \"%s\" [%s:%d]", ctx->vrf, __FILE__, __LINE__);
+    }
 #endif
 #if defined(VRF_RTABLE) || defined(VRF_SETFIB)
-	if (ctx->vrf_id > -1 && (ctx->sa.sa.sa_family == AF_INET || ctx->sa.sa.sa_family == AF_INET6)) {
-	    unsigned int opt = (unsigned int) ctx->vrf_id;
-	    socklen_t optlen = sizeof(opt);
-	    if (setsockopt(cur, SOL_SOCKET,
+    if (ctx->vrf_id > -1 && (ctx->sa.sa.sa_family == AF_INET || ctx->sa.sa.sa_family == AF_INET6)) {
+	unsigned int opt = (unsigned int) ctx->vrf_id;
+	socklen_t optlen = sizeof(opt);
+	if (setsockopt(cur, SOL_SOCKET,
 #ifdef VRF_RTABLE
-			   SO_RTABLE
+		       SO_RTABLE
 #endif
 #ifdef VRF_SETFIB
-			   SO_SETFIB
+		       SO_SETFIB
 #endif
-			   , &opt, optlen))
-		logerr("setsockopt failed to set the VRF to \"%d\" [%s:%d]", ctx->vrf_id, __FILE__, __LINE__);
-	}
+		       , &opt, optlen))
+	    logerr("setsockopt failed to set the VRF to \"%d\" [%s:%d]", ctx->vrf_id, __FILE__, __LINE__);
+    }
 #endif
 #ifdef SO_REUSEPORT
-	if (ctx->protocol == IPPROTO_UDP) {
-	    int one = 1;
-	    setsockopt(cur, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
-	}
+    if (ctx->protocol == IPPROTO_UDP) {
+	int one = 1;
+	setsockopt(cur, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    }
 #endif
+    return cur;
+}
+
+void spawnd_bind_listener(struct spawnd_context *ctx, int cur)
+{
+    char buf[INET6_ADDRSTRLEN];
+
+    DebugIn(DEBUG_NET);
+    if (ctx->fn < 0) {
+	io_sched_del(common_data.io, ctx, (void *) spawnd_bind_listener);
+
+	cur = spawnd_listener_socket(ctx);
+	if (cur < 0) {
+	    if (ctx->retry_delay)
+		io_sched_add(common_data.io, ctx, (void *) spawnd_bind_listener, (time_t) ctx->retry_delay, (suseconds_t) 0);
+	    DebugOut(DEBUG_NET);
+	    return;
+	}
 	ctx->port = su_get_port(&ctx->sa);
 	if (su_bind(cur, &ctx->sa)) {
 	    if (!ctx->logged_retry)
@@ -321,6 +340,15 @@ void spawnd_bind_listener(struct spawnd_context *ctx, int cur)
 
     logmsg("bind to [%s]:%d succeeded%s", su_ntoa(&ctx->sa, buf, (socklen_t) sizeof(buf)), su_get_port(&ctx->sa), ctx->fn ? "" : " (via inetd)");
 
+    if (ctx->shard && !common_data.singleprocess) {
+	// Server processes get sockets of their own, see spawnd_shard().
+	close(ctx->fn);
+	ctx->fn = -1;
+	ctx->is_listener = 1;
+	DebugOut(DEBUG_NET);
+	return;
+    }
+
     if (ctx->socktype != SOCK_DGRAM && listen(ctx->fn, ctx->listen_backlog)) {
 	logerr("listen (%s:%d)", __FILE__, __LINE__);
 	Debug((DEBUG_NET, "- %s (listen error)\n", __func__));
@@ -586,6 +614,9 @@ int spawnd_main(int argc, char **argv, char **envp, char *id)
     spawnd_setup_signals();
     setup_sig_segv(common_data.coredumpdir, common_data.gcorepath, common_data.debug_cmd);
 
+    if (spawnd_data.fork)
+	spawnd_start_zygote();
+
     while (common_data.servers_cur < common_data.servers_min)
 	spawnd_add_child();
 
@@ -643,7 +674,7 @@ void scm_main(int argc, char **argv, char **envp)
 	exit(0);
     }
 
-    while ((c = getopt(argc, argv, "vPd:")) != EOF)
+    while ((c = getopt(argc, argv, "vPZd:")) != EOF)
 	switch (c) {
 	case 'v':
 	    fprintf(stderr, "%s version %s\n", common_data.progname, common_data.version);
@@ -651,6 +682,9 @@ void scm_main(int argc, char **argv, char **envp)
 	case 'P':
 	    common_data.parse_only = 1;
 	    break;
+	case 'Z':
+	    common_data.zygote = 1;
+	    break;
 	case 'd':{
 		int i = atoi(optarg);
 		if (i == DEBUG_TACTRACE_FLAG)
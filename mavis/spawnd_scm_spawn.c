@@ -16,9 +16,14 @@
 #include <sys/un.h>
 #include <unistd.h>
 #include <sysexits.h>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
 
 static const char rcsid[] __attribute__((used)) = "$Id$";
 
+static void shard_steer(void);
+
 void spawnd_cleanup_internal(struct spawnd_context *ctx, int fd __attribute__((unused)))
 {
     DebugIn(DEBUG_PROC);
@@ -40,6 +45,13 @@ void spawnd_cleanup_internal(struct spawnd_context *ctx, int fd __attribute__((u
 	    spawnd_adjust_tracking(common_data.servers_cur, i);
 	    spawnd_data.server_arr[common_data.servers_cur] = NULL;
 	}
+	if (ctx->shard_fd) {
+	    for (i = 0; i < spawnd_data.listeners_max; i++)
+		if (ctx->shard_fd[i] > -1)
+		    close(ctx->shard_fd[i]);
+	    free(ctx->shard_fd);
+	    shard_steer();
+	}
 	set_proctitle(ACCEPT);
     }
 
@@ -48,7 +60,7 @@ void spawnd_cleanup_internal(struct spawnd_context *ctx, int fd __attribute__((u
     DebugOut(DEBUG_PROC);
 }
 
-int spawnd_spawn_child(pid_t * pidp)
+static int spawnd_exec_child(pid_t * pidp, int zygote)
 {
     int socks[2];
     pid_t pid;
@@ -71,6 +83,8 @@ int spawnd_spawn_child(pid_t * pidp)
 	snprintf(deb, 20, "%u", common_data.debug);
 	argv[i++] = deb;
     }
+    if (zygote)
+	argv[i++] = "-Z";
     argv[i++] = spawnd_data.child_config;
     argv[i++] = spawnd_data.child_id;
     argv[i++] = NULL;
@@ -133,6 +147,97 @@ int spawnd_spawn_child(pid_t * pidp)
     }
 }
 
+/*
+ * With "fork = yes", servers are forked from a preloaded instance which has
+ * parsed its configuration once. spawnd passes the server end of a fresh
+ * socket pair to that instance, and the new server reports its pid back.
+ */
+int spawnd_spawn_child(pid_t * pidp)
+{
+    if (spawnd_data.zygote_pid) {
+	int socks[2];
+	int bufsize = spawnd_data.scm_bufsize;
+	int one = 1;
+
+	if (socketpair(PF_UNIX, SOCK_DGRAM, 0, socks)) {
+	    logerr("socketpair (%s:%d)", __FILE__, __LINE__);
+	    exit(EX_OSERR);
+	}
+	for (int i = 0; i < 2; i++) {
+	    if (bufsize) {
+		setsockopt(socks[i], SOL_SOCKET, SO_SNDBUF, (char *) &bufsize, (socklen_t) sizeof(bufsize));
+		setsockopt(socks[i], SOL_SOCKET, SO_RCVBUF, (char *) &bufsize, (socklen_t) sizeof(bufsize));
+	    }
+	    setsockopt(socks[i], SOL_SOCKET, SO_KEEPALIVE, (char *) &one, (socklen_t) sizeof(one));
+	}
+
+	struct scm_data sd = {.type = SCM_FORK };
+	int res = common_data.scm_send_msg(spawnd_data.zygote, &sd, socks[1]);
+	close(socks[1]);
+	if (!res) {
+	    fcntl(socks[0], F_SETFD, fcntl(socks[0], F_GETFD, 0) | FD_CLOEXEC);
+	    if (pidp)
+		*pidp = 0;
+	    return socks[0];
+	}
+	close(socks[0]);
+    }
+    return spawnd_exec_child(pidp, 0);
+}
+
+static void zygote_cleanup(struct spawnd_context *ctx, int cur)
+{
+    logmsg("preloaded instance (pid %u) terminated, servers will be started individually", (u_int) ctx->pid);
+    io_close(ctx->io, cur);
+    free(ctx);
+    spawnd_data.zygote_pid = 0;
+}
+
+static void zygote_recv(struct spawnd_context *ctx, int cur)
+{
+    struct scm_data_accept sd;
+
+    if (common_data.scm_recv_msg(cur, &sd, sizeof(sd), NULL))
+	zygote_cleanup(ctx, cur);
+    else if (sd.type == SCM_BAD_CFG) {
+	logmsg("Child reported fatal configuration problem. Exiting.");
+	exit(EX_CONFIG);
+    }
+}
+
+void spawnd_start_zygote(void)
+{
+    pid_t pid;
+    struct scm_data_accept sd = { 0 };
+    int cur = spawnd_exec_child(&pid, 1);
+
+    // Block until the configuration has been parsed.
+    if (common_data.scm_recv_msg(cur, &sd, sizeof(sd), NULL) || sd.type != SCM_FORK) {
+	if (sd.type == SCM_BAD_CFG) {
+	    logmsg("Child reported fatal configuration problem. Exiting.");
+	    exit(EX_CONFIG);
+	}
+	logmsg("%s doesn't support forking servers, starting them individually", spawnd_data.child_path);
+	close(cur);
+	return;
+    }
+
+    struct spawnd_context *ctx = spawnd_new_context(common_data.io);
+    ctx->pid = pid;
+    ctx->fn = cur;
+    ctx->tv = io_now;
+
+    io_register(common_data.io, cur, ctx);
+    io_set_cb_i(common_data.io, cur, (void *) zygote_recv);
+    io_set_cb_h(common_data.io, cur, (void *) zygote_cleanup);
+    io_set_cb_e(common_data.io, cur, (void *) zygote_cleanup);
+    io_clr_cb_o(common_data.io, cur);
+    io_set_i(common_data.io, cur);
+
+    spawnd_data.zygote = cur;
+    spawnd_data.zygote_pid = pid;
+}
+
 static void recv_childmsg(struct spawnd_context *ctx, int cur)
 {
     int max = -1;
@@ -181,11 +286,105 @@ static void recv_childmsg(struct spawnd_context *ctx, int cur)
 	    break;
 	case SCM_KEEPALIVE:
 	    break;
+	case SCM_FORK:
+	    ctx->pid = (pid_t) (((struct scm_data *) &sd))->count;
+	    break;
 	default:
 	    logmsg("Child used unknown message type %d", (int) sd.type);
 	}
 }
 
+#if defined(SO_ATTACH_REUSEPORT_CBPF) && defined(SKF_NET_OFF)
+/*
+ * Select the group member by source address only, so datagrams from a
+ * particular client end up at the same server regardless of the source
+ * port. The modulus has to match the group size, see shard_steer().
+ */
+static void shard_attach_filter(int s, int n)
+{
+    struct sock_filter code[] = {
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF),
+	BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 2, 0),
+	BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),	// IPv4 source address
+	BPF_JUMP(BPF_JMP | BPF_JA, 1, 0, 0),
+	BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 20),	// lower 32 bits of IPv6 source address
+	BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (u_int) n),
+	BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_fprog prog = {.len = sizeof(code) / sizeof(struct sock_filter),.filter = code };
+
+    if (setsockopt(s, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)))
+	logerr("setsockopt(SO_ATTACH_REUSEPORT_CBPF) (%s:%d)", __FILE__, __LINE__);
+}
+#endif
+
+/*
+ * The filter program belongs to the reuseport group and is replaced with one
+ * of the right modulus whenever a server process comes or goes. spawnd keeps
+ * its copy of each server's "shard = source" socket for this purpose, and
+ * closes it once the server is gone.
+ */
+static void shard_steer(void)
+{
+#if defined(SO_ATTACH_REUSEPORT_CBPF) && defined(SKF_NET_OFF)
+    for (int i = 0; i < spawnd_data.listeners_max; i++) {
+	if (spawnd_data.listener_arr[i]->shard != S_source)
+	    continue;
+	int s = -1, n = 0;
+	for (int j = 0; j < common_data.servers_cur; j++) {
+	    struct spawnd_context *server = spawnd_data.server_arr[j];
+	    if (server->shard_fd && server->shard_fd[i] > -1) {
+		s = server->shard_fd[i];
+		n++;
+	    }
+	}
+	if (n)
+	    shard_attach_filter(s, n);
+    }
+#endif
+}
+
+/*
+ * Hand each server process a socket of its own for all sharded UDP
+ * listeners. The sockets are bound with SO_REUSEPORT, so the kernel
+ * distributes incoming datagrams without involving spawnd.
+ */
+void spawnd_shard(struct spawnd_context *server)
+{
+    for (int i = 0; i < spawnd_data.listeners_max; i++) {
+	struct spawnd_context *ctx = spawnd_data.listener_arr[i];
+	if (!ctx->shard)
+	    continue;
+	if (!server->shard_fd) {
+	    server->shard_fd = Xcalloc(spawnd_data.listeners_max, sizeof(int));
+	    for (int j = 0; j < spawnd_data.listeners_max; j++)
+		server->shard_fd[j] = -1;
+	}
+
+	int s = spawnd_listener_socket(ctx);
+	if (s < 0)
+	    continue;
+	if (su_bind(s, &ctx->sa)) {
+	    logerr("bind (%s:%d)", __FILE__, __LINE__);
+	    close(s);
+	    continue;
+	}
+
+	struct scm_data_accept sd = {.type = SCM_UDPSHARD,.flags = ctx->sd_flags,.tls_versions = ctx->dtls_versions,
+	    .aaa_protocol = ctx->aaa_protocol,.socktype = SOCK_DGRAM,.protocol = ctx->protocol
+	};
+	memcpy(sd.realm, ctx->tag, SCM_REALM_SIZE);
+	if (common_data.scm_send_msg(server->fn, (struct scm_data *) &sd, s))
+	    logerr("scm_send_msg (%s:%d), pid: %d", __FILE__, __LINE__, (int) server->pid);
+	if (ctx->shard == S_source)
+	    server->shard_fd[i] = s;
+	else
+	    close(s);
+    }
+    shard_steer();
+}
+
 void spawnd_add_child()
 {
     if (common_data.servers_cur < common_data.servers_max) {
@@ -204,6 +403,7 @@ void spawnd_add_child()
 	    io_clr_cb_o(common_data.io, cur);
 	    io_set_i(common_data.io, cur);
 	    spawnd_data.server_arr[common_data.servers_cur++] = ctx;
+	    spawnd_shard(ctx);
 	}
     }
 }
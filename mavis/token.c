@@ -0,0 +1,548 @@
+/* automatically generated, do not edit */
+#include "mavis/token.h"
+str_t codestring[] = {
+	{.txt="<unknown>", .len=9 },
+	{ .txt="!", .len=1},
+	{ .txt="&&", .len=2},
+	{ .txt="(", .len=1},
+	{ .txt=")", .len=1},
+	{ .txt=",", .len=1},
+	{ .txt="4", .len=1},
+	{ .txt="5", .len=1},
+	{ .txt="6", .len=1},
+	{ .txt="7", .len=1},
+	{ .txt="8", .len=1},
+	{ .txt="9", .len=1},
+	{ .txt="<end-of-file>", .len=13},
+	{ .txt="<pcre-regex>", .len=12},
+	{ .txt="<string>", .len=8},
+	{ .txt="=", .len=1},
+	{ .txt="ACCOUNT_EXPIRES", .len=15},
+	{ .txt="ACCT", .len=4},
+	{ .txt="ACL", .len=3},
+	{ .txt="ALL", .len=3},
+	{ .txt="AUTHEN", .len=6},
+	{ .txt="AUTHFAIL_BANNER", .len=15},
+	{ .txt="AUTHOR", .len=6},
+	{ .txt="AV", .len=2},
+	{ .txt="BACKEND_FAILED", .len=14},
+	{ .txt="BUFFER", .len=6},
+	{ .txt="CHANGE_PASSWORD", .len=15},
+	{ .txt="CMD", .len=3},
+	{ .txt="CONFIG", .len=6},
+	{ .txt="CONTROL", .len=7},
+	{ .txt="DENIED_BY_ACL", .len=13},
+	{ .txt="DGRAM", .len=5},
+	{ .txt="DNS", .len=3},
+	{ .txt="DTLSv1.0", .len=8},
+	{ .txt="DTLSv1.2", .len=8},
+	{ .txt="DTLSv1.3", .len=8},
+	{ .txt="ENABLE_PASSWORD", .len=15},
+	{ .txt="FORK", .len=4},
+	{ .txt="FS", .len=2},
+	{ .txt="HEX", .len=3},
+	{ .txt="INDEX", .len=5},
+	{ .txt="LOCK", .len=4},
+	{ .txt="LWRES", .len=5},
+	{ .txt="MAVIS", .len=5},
+	{ .txt="MAVIS_PARSE_ERROR", .len=17},
+	{ .txt="NET", .len=3},
+	{ .txt="NONE", .len=4},
+	{ .txt="PACKET", .len=6},
+	{ .txt="PARSE", .len=5},
+	{ .txt="PASSWORD", .len=8},
+	{ .txt="PASSWORD_ABORT", .len=14},
+	{ .txt="PASSWORD_AGAIN", .len=14},
+	{ .txt="PASSWORD_CHANGED", .len=16},
+	{ .txt="PASSWORD_CHANGE_DIALOG", .len=22},
+	{ .txt="PASSWORD_EXPIRED", .len=16},
+	{ .txt="PASSWORD_EXPIRES", .len=16},
+	{ .txt="PASSWORD_INCORRECT", .len=18},
+	{ .txt="PASSWORD_MINREQ", .len=15},
+	{ .txt="PASSWORD_NEW", .len=12},
+	{ .txt="PASSWORD_NOMATCH", .len=16},
+	{ .txt="PASSWORD_OLD", .len=12},
+	{ .txt="PATH", .len=4},
+	{ .txt="PERMISSION_DENIED", .len=17},
+	{ .txt="PROC", .len=4},
+	{ .txt="REGEX", .len=5},
+	{ .txt="RESPONSE", .len=8},
+	{ .txt="RESPONSE_INCORRECT", .len=18},
+	{ .txt="RFC3164", .len=7},
+	{ .txt="RFC5424", .len=7},
+	{ .txt="SCTP", .len=4},
+	{ .txt="SEQPACKET", .len=9},
+	{ .txt="STREAM", .len=6},
+	{ .txt="TCP", .len=3},
+	{ .txt="TIMESTAMP", .len=9},
+	{ .txt="TLSv1.2", .len=7},
+	{ .txt="TLSv1.3", .len=7},
+	{ .txt="UDP", .len=3},
+	{ .txt="USERINPUT", .len=9},
+	{ .txt="USERNAME", .len=8},
+	{ .txt="USER_ACCESS_VERIFICATION", .len=24},
+	{ .txt="[", .len=1},
+	{ .txt="]", .len=1},
+	{ .txt="aaa", .len=3},
+	{ .txt="aaa-realm", .len=9},
+	{ .txt="aaa.protocol", .len=12},
+	{ .txt="aaa.protocol.allowed", .len=20},
+	{ .txt="accept", .len=6},
+	{ .txt="access", .len=6},
+	{ .txt="accounting", .len=10},
+	{ .txt="accttype", .len=8},
+	{ .txt="acl", .len=3},
+	{ .txt="action", .len=6},
+	{ .txt="add", .len=3},
+	{ .txt="address", .len=7},
+	{ .txt="address-mismatch", .len=16},
+	{ .txt="alias", .len=5},
+	{ .txt="all", .len=3},
+	{ .txt="allow-dotfiles", .len=14},
+	{ .txt="alpn", .len=4},
+	{ .txt="anon", .len=4},
+	{ .txt="anonymous-enable", .len=16},
+	{ .txt="any", .len=3},
+	{ .txt="arap", .len=4},
+	{ .txt="arg", .len=3},
+	{ .txt="args", .len=4},
+	{ .txt="asa", .len=3},
+	{ .txt="ascii-size-limit", .len=16},
+	{ .txt="attribute", .len=9},
+	{ .txt="augmented-enable", .len=16},
+	{ .txt="auth", .len=4},
+	{ .txt="authen-action", .len=13},
+	{ .txt="authen-method", .len=13},
+	{ .txt="authen-service", .len=14},
+	{ .txt="authen-type", .len=11},
+	{ .txt="authenticated", .len=13},
+	{ .txt="authentication", .len=14},
+	{ .txt="authentication-failures", .len=23},
+	{ .txt="authmode", .len=8},
+	{ .txt="authorization", .len=13},
+	{ .txt="auto-conversion", .len=15},
+	{ .txt="auto-detect", .len=11},
+	{ .txt="backend", .len=7},
+	{ .txt="background", .len=10},
+	{ .txt="backlog", .len=7},
+	{ .txt="backoff", .len=7},
+	{ .txt="banner", .len=6},
+	{ .txt="banner-action", .len=13},
+	{ .txt="batch", .len=5},
+	{ .txt="binary-only", .len=11},
+	{ .txt="bind", .len=4},
+	{ .txt="blacklist", .len=9},
+	{ .txt="blowfish", .len=8},
+	{ .txt="bottom-up", .len=9},
+	{ .txt="buffer", .len=6},
+	{ .txt="bufsize", .len=7},
+	{ .txt="bug", .len=3},
+	{ .txt="bye", .len=3},
+	{ .txt="ca-file", .len=7},
+	{ .txt="ca-path", .len=7},
+	{ .txt="cache", .len=5},
+	{ .txt="caseless", .len=8},
+	{ .txt="cert", .len=4},
+	{ .txt="cert-file", .len=9},
+	{ .txt="certfile", .len=8},
+	{ .txt="chalresp", .len=8},
+	{ .txt="chap", .len=4},
+	{ .txt="check", .len=5},
+	{ .txt="check-gid", .len=9},
+	{ .txt="check-perm", .len=10},
+	{ .txt="check-uid", .len=9},
+	{ .txt="checksum", .len=8},
+	{ .txt="childs", .len=6},
+	{ .txt="chmod-mask", .len=10},
+	{ .txt="chpass", .len=6},
+	{ .txt="chroot", .len=6},
+	{ .txt="ciphers", .len=7},
+	{ .txt="cleanup", .len=7},
+	{ .txt="clear", .len=5},
+	{ .txt="client", .len=6},
+	{ .txt="client-only", .len=11},
+	{ .txt="client.address", .len=14},
+	{ .txt="client.dnsname", .len=14},
+	{ .txt="client.name", .len=11},
+	{ .txt="clone", .len=5},
+	{ .txt="close", .len=5},
+	{ .txt="cmd", .len=3},
+	{ .txt="coalesce", .len=8},
+	{ .txt="command", .len=7},
+	{ .txt="compatibility", .len=13},
+	{ .txt="compile", .len=7},
+	{ .txt="compliance", .len=10},
+	{ .txt="config", .len=6},
+	{ .txt="config-file", .len=11},
+	{ .txt="config-line", .len=11},
+	{ .txt="conflicting", .len=11},
+	{ .txt="conn.protocol", .len=13},
+	{ .txt="conn.transport", .len=14},
+	{ .txt="connection", .len=10},
+	{ .txt="content", .len=7},
+	{ .txt="context", .len=7},
+	{ .txt="continue", .len=8},
+	{ .txt="coredump", .len=8},
+	{ .txt="count", .len=5},
+	{ .txt="crl-dir", .len=7},
+	{ .txt="crypt", .len=5},
+	{ .txt="custom_0", .len=8},
+	{ .txt="custom_1", .len=8},
+	{ .txt="custom_2", .len=8},
+	{ .txt="custom_3", .len=8},
+	{ .txt="dacl", .len=4},
+	{ .txt="data", .len=4},
+	{ .txt="date", .len=4},
+	{ .txt="debug", .len=5},
+	{ .txt="debug-cmd", .len=9},
+	{ .txt="default", .len=7},
+	{ .txt="defined", .len=7},
+	{ .txt="deflate", .len=7},
+	{ .txt="deflate-level", .len=13},
+	{ .txt="delay", .len=5},
+	{ .txt="delimiter", .len=9},
+	{ .txt="deny", .len=4},
+	{ .txt="depth", .len=5},
+	{ .txt="des", .len=3},
+	{ .txt="destination", .len=11},
+	{ .txt="device", .len=6},
+	{ .txt="device.address", .len=14},
+	{ .txt="device.dnsname", .len=14},
+	{ .txt="device.name", .len=11},
+	{ .txt="device.port", .len=11},
+	{ .txt="device.tag", .len=10},
+	{ .txt="directory", .len=9},
+	{ .txt="dn", .len=2},
+	{ .txt="dns", .len=3},
+	{ .txt="double-quote-values", .len=19},
+	{ .txt="dscp", .len=4},
+	{ .txt="dst", .len=3},
+	{ .txt="dtls", .len=4},
+	{ .txt="else", .len=4},
+	{ .txt="enable", .len=6},
+	{ .txt="enabled", .len=7},
+	{ .txt="enum", .len=4},
+	{ .txt="error", .len=5},
+	{ .txt="eval", .len=4},
+	{ .txt="event", .len=5},
+	{ .txt="exec", .len=4},
+	{ .txt="expire", .len=6},
+	{ .txt="expired", .len=7},
+	{ .txt="expires", .len=7},
+	{ .txt="expiry", .len=6},
+	{ .txt="facility", .len=8},
+	{ .txt="failed", .len=6},
+	{ .txt="fake-group", .len=10},
+	{ .txt="fake-owner", .len=10},
+	{ .txt="fallback", .len=8},
+	{ .txt="fallback-only", .len=13},
+	{ .txt="false", .len=5},
+	{ .txt="file", .len=4},
+	{ .txt="files-only", .len=10},
+	{ .txt="filter", .len=6},
+	{ .txt="flag", .len=4},
+	{ .txt="follow", .len=6},
+	{ .txt="fork", .len=4},
+	{ .txt="format", .len=6},
+	{ .txt="from", .len=4},
+	{ .txt="ftpusers", .len=8},
+	{ .txt="gcore", .len=5},
+	{ .txt="gid", .len=3},
+	{ .txt="gids", .len=4},
+	{ .txt="goodbye", .len=7},
+	{ .txt="greeting", .len=8},
+	{ .txt="group", .len=5},
+	{ .txt="group-membership", .len=16},
+	{ .txt="groupid", .len=7},
+	{ .txt="groups", .len=6},
+	{ .txt="gzip", .len=4},
+	{ .txt="haproxy", .len=7},
+	{ .txt="hash", .len=4},
+	{ .txt="hedge", .len=5},
+	{ .txt="hide-version", .len=12},
+	{ .txt="hint", .len=4},
+	{ .txt="home", .len=4},
+	{ .txt="host", .len=4},
+	{ .txt="hostname", .len=8},
+	{ .txt="hushlogin", .len=9},
+	{ .txt="id", .len=2},
+	{ .txt="ident", .len=5},
+	{ .txt="identity-source", .len=15},
+	{ .txt="idle", .len=4},
+	{ .txt="if", .len=2},
+	{ .txt="if-authenticated", .len=16},
+	{ .txt="in", .len=2},
+	{ .txt="include", .len=7},
+	{ .txt="inherit", .len=7},
+	{ .txt="instances", .len=9},
+	{ .txt="integer", .len=7},
+	{ .txt="interim", .len=7},
+	{ .txt="interval", .len=8},
+	{ .txt="ipaddr", .len=6},
+	{ .txt="ipc", .len=3},
+	{ .txt="ipv4addr", .len=8},
+	{ .txt="ipv6addr", .len=8},
+	{ .txt="keepalive", .len=9},
+	{ .txt="key", .len=3},
+	{ .txt="key-file", .len=8},
+	{ .txt="keyfile", .len=7},
+	{ .txt="ktls", .len=4},
+	{ .txt="label", .len=5},
+	{ .txt="last-recently-used", .len=18},
+	{ .txt="level", .len=5},
+	{ .txt="lifetime", .len=8},
+	{ .txt="limit", .len=5},
+	{ .txt="listen", .len=6},
+	{ .txt="local", .len=5},
+	{ .txt="log", .len=3},
+	{ .txt="log-sequence", .len=12},
+	{ .txt="logformat", .len=9},
+	{ .txt="login", .len=5},
+	{ .txt="logout", .len=6},
+	{ .txt="maintainer", .len=10},
+	{ .txt="mapping", .len=7},
+	{ .txt="mask", .len=4},
+	{ .txt="mavis", .len=5},
+	{ .txt="mavis.latency", .len=13},
+	{ .txt="max", .len=3},
+	{ .txt="max-attempts", .len=12},
+	{ .txt="max-rounds", .len=10},
+	{ .txt="may-close", .len=9},
+	{ .txt="member", .len=6},
+	{ .txt="memberof", .len=8},
+	{ .txt="message", .len=7},
+	{ .txt="mimetypes", .len=9},
+	{ .txt="min", .len=3},
+	{ .txt="missing", .len=7},
+	{ .txt="mmap-size", .len=9},
+	{ .txt="mode", .len=4},
+	{ .txt="module", .len=6},
+	{ .txt="motd", .len=4},
+	{ .txt="ms-chap", .len=7},
+	{ .txt="msgid", .len=5},
+	{ .txt="nac", .len=3},
+	{ .txt="nac-name", .len=8},
+	{ .txt="nac-realm", .len=9},
+	{ .txt="name", .len=4},
+	{ .txt="nas", .len=3},
+	{ .txt="nas-name", .len=8},
+	{ .txt="nas-realm", .len=9},
+	{ .txt="negative", .len=8},
+	{ .txt="net", .len=3},
+	{ .txt="nlst", .len=4},
+	{ .txt="no", .len=2},
+	{ .txt="noauthcache", .len=11},
+	{ .txt="noecho", .len=6},
+	{ .txt="none", .len=4},
+	{ .txt="not", .len=3},
+	{ .txt="not-found", .len=9},
+	{ .txt="octets", .len=6},
+	{ .txt="old-draft", .len=9},
+	{ .txt="opap", .len=4},
+	{ .txt="optional", .len=8},
+	{ .txt="orphan", .len=6},
+	{ .txt="out", .len=3},
+	{ .txt="overload", .len=8},
+	{ .txt="pap", .len=3},
+	{ .txt="parent", .len=6},
+	{ .txt="parent-script", .len=13},
+	{ .txt="passive", .len=7},
+	{ .txt="passphrase", .len=10},
+	{ .txt="passwd", .len=6},
+	{ .txt="password", .len=8},
+	{ .txt="password-new", .len=12},
+	{ .txt="path", .len=4},
+	{ .txt="pbkdf2", .len=6},
+	{ .txt="peer", .len=4},
+	{ .txt="peer.address", .len=12},
+	{ .txt="peer.port", .len=9},
+	{ .txt="period", .len=6},
+	{ .txt="permit", .len=6},
+	{ .txt="pid", .len=3},
+	{ .txt="pid-file", .len=8},
+	{ .txt="pidfile", .len=7},
+	{ .txt="port", .len=4},
+	{ .txt="postfix", .len=7},
+	{ .txt="prefetch", .len=8},
+	{ .txt="prefix", .len=6},
+	{ .txt="preload", .len=7},
+	{ .txt="priority", .len=8},
+	{ .txt="priv-lvl", .len=8},
+	{ .txt="process", .len=7},
+	{ .txt="proctitle", .len=9},
+	{ .txt="profile", .len=7},
+	{ .txt="prohibit", .len=8},
+	{ .txt="prompt", .len=6},
+	{ .txt="protected", .len=9},
+	{ .txt="protocol", .len=8},
+	{ .txt="proxy", .len=5},
+	{ .txt="psk", .len=3},
+	{ .txt="purge", .len=5},
+	{ .txt="queue", .len=5},
+	{ .txt="radius", .len=6},
+	{ .txt="radius.access", .len=13},
+	{ .txt="radius.accounting", .len=17},
+	{ .txt="radius.dictionary", .len=17},
+	{ .txt="radius.dtls", .len=11},
+	{ .txt="radius.key", .len=10},
+	{ .txt="radius.tcp", .len=10},
+	{ .txt="radius.tls", .len=10},
+	{ .txt="radius.udp", .len=10},
+	{ .txt="rargs", .len=5},
+	{ .txt="readme", .len=6},
+	{ .txt="readme-notify", .len=13},
+	{ .txt="readme-once", .len=11},
+	{ .txt="real", .len=4},
+	{ .txt="realm", .len=5},
+	{ .txt="rebalance", .len=9},
+	{ .txt="redirect", .len=8},
+	{ .txt="regex", .len=5},
+	{ .txt="regex-match-case", .len=16},
+	{ .txt="reject", .len=6},
+	{ .txt="remote", .len=6},
+	{ .txt="required", .len=8},
+	{ .txt="reset", .len=5},
+	{ .txt="resolve", .len=7},
+	{ .txt="resolve-ids", .len=11},
+	{ .txt="restriction", .len=11},
+	{ .txt="result", .len=6},
+	{ .txt="retire", .len=6},
+	{ .txt="retry", .len=5},
+	{ .txt="return", .len=6},
+	{ .txt="reverse-lookup", .len=14},
+	{ .txt="rewrite", .len=7},
+	{ .txt="rewritten-only", .len=14},
+	{ .txt="root", .len=4},
+	{ .txt="router", .len=6},
+	{ .txt="rpk", .len=3},
+	{ .txt="rule", .len=4},
+	{ .txt="ruleset", .len=7},
+	{ .txt="same", .len=4},
+	{ .txt="script", .len=6},
+	{ .txt="script-order", .len=12},
+	{ .txt="secure", .len=6},
+	{ .txt="separation", .len=10},
+	{ .txt="separator", .len=9},
+	{ .txt="server", .len=6},
+	{ .txt="server.address", .len=14},
+	{ .txt="server.name", .len=11},
+	{ .txt="server.port", .len=11},
+	{ .txt="servers", .len=7},
+	{ .txt="service", .len=7},
+	{ .txt="session", .len=7},
+	{ .txt="session.id", .len=10},
+	{ .txt="set", .len=3},
+	{ .txt="setenv", .len=6},
+	{ .txt="severity", .len=8},
+	{ .txt="shape-bandwidth", .len=15},
+	{ .txt="shard", .len=5},
+	{ .txt="shared", .len=6},
+	{ .txt="shell", .len=5},
+	{ .txt="shells", .len=6},
+	{ .txt="single", .len=6},
+	{ .txt="single-connection", .len=17},
+	{ .txt="site", .len=4},
+	{ .txt="size", .len=4},
+	{ .txt="skip", .len=4},
+	{ .txt="snapshot", .len=8},
+	{ .txt="sni", .len=3},
+	{ .txt="source", .len=6},
+	{ .txt="spawn", .len=5},
+	{ .txt="spoofing", .len=8},
+	{ .txt="src", .len=3},
+	{ .txt="ssh-key", .len=7},
+	{ .txt="ssh-key-hash", .len=12},
+	{ .txt="ssh-key-id", .len=10},
+	{ .txt="ssl", .len=3},
+	{ .txt="sslusers", .len=8},
+	{ .txt="stale", .len=5},
+	{ .txt="stat", .len=4},
+	{ .txt="state", .len=5},
+	{ .txt="stateless", .len=9},
+	{ .txt="sticky", .len=6},
+	{ .txt="string", .len=6},
+	{ .txt="subject", .len=7},
+	{ .txt="substitute", .len=10},
+	{ .txt="sufficient", .len=10},
+	{ .txt="symlinks", .len=8},
+	{ .txt="syslog", .len=6},
+	{ .txt="tacacs", .len=6},
+	{ .txt="tacacs.tcp", .len=10},
+	{ .txt="tacacs.tls", .len=10},
+	{ .txt="tag", .len=3},
+	{ .txt="target-realm", .len=12},
+	{ .txt="tcp", .len=3},
+	{ .txt="template", .len=8},
+	{ .txt="threads", .len=7},
+	{ .txt="ticket", .len=6},
+	{ .txt="time", .len=4},
+	{ .txt="timeout", .len=7},
+	{ .txt="timespec", .len=8},
+	{ .txt="timestamp", .len=9},
+	{ .txt="tls", .len=3},
+	{ .txt="tls.client.cert.type", .len=20},
+	{ .txt="tls.conn.cipher", .len=15},
+	{ .txt="tls.conn.cipher.strength", .len=24},
+	{ .txt="tls.conn.sni", .len=12},
+	{ .txt="tls.conn.version", .len=16},
+	{ .txt="tls.peer.cert.issuer", .len=20},
+	{ .txt="tls.peer.cert.rpk", .len=17},
+	{ .txt="tls.peer.cert.san", .len=17},
+	{ .txt="tls.peer.cert.san.validation", .len=28},
+	{ .txt="tls.peer.cert.sha1", .len=18},
+	{ .txt="tls.peer.cert.sha256", .len=20},
+	{ .txt="tls.peer.cert.subject", .len=21},
+	{ .txt="tls.peer.cert.validation", .len=24},
+	{ .txt="tls.peer.cn", .len=11},
+	{ .txt="tls.psk.identity", .len=16},
+	{ .txt="tls.server.cert.type", .len=20},
+	{ .txt="tolower", .len=7},
+	{ .txt="top-down", .len=8},
+	{ .txt="toupper", .len=7},
+	{ .txt="trace", .len=5},
+	{ .txt="transfer", .len=8},
+	{ .txt="transmission-mode", .len=17},
+	{ .txt="transmit", .len=8},
+	{ .txt="tries", .len=5},
+	{ .txt="true", .len=4},
+	{ .txt="type", .len=4},
+	{ .txt="type6-key", .len=9},
+	{ .txt="type7-key", .len=9},
+	{ .txt="udp", .len=3},
+	{ .txt="uid", .len=3},
+	{ .txt="umask", .len=5},
+	{ .txt="umessage", .len=8},
+	{ .txt="undef", .len=5},
+	{ .txt="unset", .len=5},
+	{ .txt="until", .len=5},
+	{ .txt="upload", .len=6},
+	{ .txt="usage", .len=5},
+	{ .txt="use-mmap", .len=8},
+	{ .txt="use-sendfile", .len=12},
+	{ .txt="user", .len=4},
+	{ .txt="user.original", .len=13},
+	{ .txt="user.tag", .len=8},
+	{ .txt="userid", .len=6},
+	{ .txt="users", .len=5},
+	{ .txt="valid", .len=5},
+	{ .txt="verdict", .len=7},
+	{ .txt="verify-depth", .len=12},
+	{ .txt="version", .len=7},
+	{ .txt="vrf", .len=3},
+	{ .txt="vsa", .len=3},
+	{ .txt="warn", .len=4},
+	{ .txt="warning", .len=7},
+	{ .txt="weight", .len=6},
+	{ .txt="welcome", .len=7},
+	{ .txt="welcome-action", .len=14},
+	{ .txt="working", .len=7},
+	{ .txt="x509", .len=4},
+	{ .txt="yes", .len=3},
+	{ .txt="z", .len=1},
+	{ .txt="zone", .len=4},
+	{ .txt="{", .len=1},
+	{ .txt="||", .len=2},
+	{ .txt="}", .len=1},
+	{ .txt="~", .len=1},
+	{ 0 },
+};
@@ -0,0 +1,553 @@
+/* automatically generated, do not edit */
+#ifndef __MAVIS_TOKEN_H__
+#define __MAVIS_TOKEN_H__
+#include "misc/str.h"
+extern str_t codestring[];
+enum token {
+	S_unknown = 0,
+	S_exclmark,
+	S_and,
+	S_leftbra,
+	S_rightbra,
+	S_comma,
+	S_4,
+	S_5,
+	S_6,
+	S_7,
+	S_8,
+	S_9,
+	S_eof,
+	S_slash,
+	S_string,
+	S_equal,
+	S_ACCOUNT_EXPIRES,
+	S_ACCT,
+	S_ACL,
+	S_ALL,
+	S_AUTHEN,
+	S_AUTHFAIL_BANNER,
+	S_AUTHOR,
+	S_AV,
+	S_BACKEND_FAILED,
+	S_BUFFER,
+	S_CHANGE_PASSWORD,
+	S_CMD,
+	S_CONFIG,
+	S_CONTROL,
+	S_DENIED_BY_ACL,
+	S_DGRAM,
+	S_DNS,
+	S_DTLS1_0,
+	S_DTLS1_2,
+	S_DTLS1_3,
+	S_ENABLE_PASSWORD,
+	S_FORK,
+	S_FS,
+	S_HEX,
+	S_INDEX,
+	S_LOCK,
+	S_LWRES,
+	S_MAVIS,
+	S_MAVIS_PARSE_ERROR,
+	S_NET,
+	S_NONE,
+	S_PACKET,
+	S_PARSE,
+	S_PASSWORD,
+	S_PASSWORD_ABORT,
+	S_PASSWORD_AGAIN,
+	S_PASSWORD_CHANGED,
+	S_PASSWORD_CHANGE_DIALOG,
+	S_PASSWORD_EXPIRED,
+	S_PASSWORD_EXPIRES,
+	S_PASSWORD_INCORRECT,
+	S_PASSWORD_MINREQ,
+	S_PASSWORD_NEW,
+	S_PASSWORD_NOMATCH,
+	S_PASSWORD_OLD,
+	S_PATH,
+	S_PERMISSION_DENIED,
+	S_PROC,
+	S_REGEX,
+	S_RESPONSE,
+	S_RESPONSE_INCORRECT,
+	S_RFC3164,
+	S_RFC5424,
+	S_SCTP,
+	S_SEQPACKET,
+	S_STREAM,
+	S_TCP,
+	S_TIMESTAMP,
+	S_TLS1_2,
+	S_TLS1_3,
+	S_UDP,
+	S_USERINPUT,
+	S_USERNAME,
+	S_USER_ACCESS_VERIFICATION,
+	S_leftsquarebra,
+	S_rightsquarebra,
+	S_aaa,
+	S_aaarealm,
+	S_aaa_protocol,
+	S_aaa_protocol_allowed,
+	S_accept,
+	S_access,
+	S_accounting,
+	S_accttype,
+	S_acl,
+	S_action,
+	S_add,
+	S_address,
+	S_addressmismatch,
+	S_alias,
+	S_all,
+	S_allowdotfiles,
+	S_alpn,
+	S_anon,
+	S_anonenable,
+	S_any,
+	S_arap,
+	S_arg,
+	S_args,
+	S_asa,
+	S_asciisizelimit,
+	S_attr,
+	S_augmented_enable,
+	S_auth,
+	S_authen_action,
+	S_authen_method,
+	S_authen_service,
+	S_authen_type,
+	S_authenticated,
+	S_authentication,
+	S_authenticationfailures,
+	S_authmode,
+	S_authorization,
+	S_autoconversion,
+	S_autodetect,
+	S_backend,
+	S_background,
+	S_backlog,
+	S_backoff,
+	S_banner,
+	S_banneraction,
+	S_batch,
+	S_binaryonly,
+	S_bind,
+	S_blacklist,
+	S_blowfish,
+	S_bottom_up,
+	S_buffer,
+	S_bufsize,
+	S_bug,
+	S_bye,
+	S_cafile,
+	S_capath,
+	S_cache,
+	S_caseless,
+	S_cert,
+	S_cert_file,
+	S_certfile,
+	S_chalresp,
+	S_chap,
+	S_check,
+	S_checkgid,
+	S_checkperm,
+	S_checkuid,
+	S_checksum,
+	S_childs,
+	S_chmodmask,
+	S_chpass,
+	S_chroot,
+	S_ciphers,
+	S_cleanup,
+	S_clear,
+	S_client,
+	S_clientonly,
+	S_clientaddress,
+	S_clientdns,
+	S_clientname,
+	S_clone,
+	S_close,
+	S_cmd,
+	S_coalesce,
+	S_command,
+	S_compatibility,
+	S_compile,
+	S_compliance,
+	S_config,
+	S_config_file,
+	S_config_line,
+	S_conflicting,
+	S_conn_protocol,
+	S_conn_transport,
+	S_connection,
+	S_content,
+	S_context,
+	S_continue,
+	S_coredump,
+	S_count,
+	S_crldir,
+	S_crypt,
+	S_custom_0,
+	S_custom_1,
+	S_custom_2,
+	S_custom_3,
+	S_dacl,
+	S_data,
+	S_date,
+	S_debug,
+	S_debug_cmd,
+	S_default,
+	S_defined,
+	S_deflate,
+	S_deflatelevel,
+	S_delay,
+	S_delimiter,
+	S_deny,
+	S_depth,
+	S_des,
+	S_destination,
+	S_device,
+	S_deviceaddress,
+	S_devicedns,
+	S_devicename,
+	S_deviceport,
+	S_devicetag,
+	S_directory,
+	S_dn,
+	S_dns,
+	S_double_quote_values,
+	S_dscp,
+	S_dst,
+	S_dtls,
+	S_else,
+	S_enable,
+	S_enabled,
+	S_enum,
+	S_error,
+	S_eval,
+	S_event,
+	S_exec,
+	S_expire,
+	S_expired,
+	S_expires,
+	S_expiry,
+	S_facility,
+	S_failed,
+	S_fakegroup,
+	S_fakeowner,
+	S_fallback,
+	S_fallback_only,
+	S_false,
+	S_file,
+	S_filesonly,
+	S_filter,
+	S_flag,
+	S_follow,
+	S_fork,
+	S_format,
+	S_from,
+	S_ftpusers,
+	S_gcore,
+	S_gid,
+	S_gids,
+	S_goodbye,
+	S_greeting,
+	S_group,
+	S_groupmembership,
+	S_groupid,
+	S_groups,
+	S_gzip,
+	S_haproxy,
+	S_hash,
+	S_hedge,
+	S_hideversion,
+	S_hint,
+	S_home,
+	S_host,
+	S_hostname,
+	S_hushlogin,
+	S_id,
+	S_ident,
+	S_identity_source,
+	S_idle,
+	S_if,
+	S_ifauthenticated,
+	S_in,
+	S_include,
+	S_inherit,
+	S_instances,
+	S_integer,
+	S_interim,
+	S_interval,
+	S_ipaddr,
+	S_ipc,
+	S_ipv4addr,
+	S_ipv6addr,
+	S_keepalive,
+	S_key,
+	S_key_file,
+	S_keyfile,
+	S_ktls,
+	S_label,
+	S_last_recently_used,
+	S_level,
+	S_lifetime,
+	S_limit,
+	S_listen,
+	S_local,
+	S_log,
+	S_logsequence,
+	S_logformat,
+	S_login,
+	S_logout,
+	S_maintainer,
+	S_mapping,
+	S_mask,
+	S_mavis,
+	S_mavis_latency,
+	S_max,
+	S_maxattempts,
+	S_maxrounds,
+	S_mayclose,
+	S_member,
+	S_memberof,
+	S_message,
+	S_mimetypes,
+	S_min,
+	S_missing,
+	S_mmapsize,
+	S_mode,
+	S_module,
+	S_motd,
+	S_mschap,
+	S_msgid,
+	S_nac,
+	S_nacname,
+	S_nacrealm,
+	S_name,
+	S_nas,
+	S_nasname,
+	S_nasrealm,
+	S_negative,
+	S_net,
+	S_nlst,
+	S_no,
+	S_noauthcache,
+	S_noecho,
+	S_none,
+	S_not,
+	S_notfound,
+	S_octets,
+	S_olddraft,
+	S_opap,
+	S_optional,
+	S_orphan,
+	S_out,
+	S_overload,
+	S_pap,
+	S_parent,
+	S_parent_script,
+	S_passive,
+	S_passphrase,
+	S_passwd,
+	S_password,
+	S_password_new,
+	S_path,
+	S_pbkdf2,
+	S_peer,
+	S_peer_address,
+	S_peer_port,
+	S_period,
+	S_permit,
+	S_pid,
+	S_pid_file,
+	S_pidfile,
+	S_port,
+	S_postfix,
+	S_prefetch,
+	S_prefix,
+	S_preload,
+	S_priority,
+	S_privlvl,
+	S_process,
+	S_proctitle,
+	S_profile,
+	S_prohibit,
+	S_prompt,
+	S_protected,
+	S_protocol,
+	S_proxy,
+	S_psk,
+	S_purge,
+	S_queue,
+	S_radius,
+	S_radius_access,
+	S_radius_accounting,
+	S_radius_dictionary,
+	S_radius_dtls,
+	S_radius_key,
+	S_radius_tcp,
+	S_radius_tls,
+	S_radius_udp,
+	S_rargs,
+	S_readme,
+	S_readmenotify,
+	S_readmeonce,
+	S_real,
+	S_realm,
+	S_rebalance,
+	S_redirect,
+	S_regex,
+	S_regex_match_case,
+	S_reject,
+	S_remote,
+	S_required,
+	S_reset,
+	S_resolve,
+	S_resolveids,
+	S_restriction,
+	S_result,
+	S_retire,
+	S_retry,
+	S_return,
+	S_reverselookup,
+	S_rewrite,
+	S_rewritten_only,
+	S_root,
+	S_router,
+	S_rpk,
+	S_rule,
+	S_ruleset,
+	S_same,
+	S_script,
+	S_script_order,
+	S_secure,
+	S_separation,
+	S_separator,
+	S_server,
+	S_server_address,
+	S_server_name,
+	S_server_port,
+	S_servers,
+	S_service,
+	S_session,
+	S_session_id,
+	S_set,
+	S_setenv,
+	S_severity,
+	S_shapebandwidth,
+	S_shard,
+	S_shared,
+	S_shell,
+	S_shells,
+	S_single,
+	S_singleconnection,
+	S_site,
+	S_size,
+	S_skip,
+	S_snapshot,
+	S_sni,
+	S_source,
+	S_spawn,
+	S_spoofing,
+	S_src,
+	S_ssh_key,
+	S_ssh_key_hash,
+	S_ssh_key_id,
+	S_ssl,
+	S_sslusers,
+	S_stale,
+	S_stat,
+	S_state,
+	S_stateless,
+	S_sticky,
+	S_string_keyword,
+	S_subject,
+	S_substitute,
+	S_sufficient,
+	S_symlinks,
+	S_syslog,
+	S_tacacs,
+	S_tacacs_tcp,
+	S_tacacs_tls,
+	S_tag,
+	S_target_realm,
+	S_tcp,
+	S_template,
+	S_threads,
+	S_ticket,
+	S_time,
+	S_timeout,
+	S_timespec,
+	S_timestamp,
+	S_tls,
+	S_tls_client_cert_type,
+	S_tls_conn_cipher,
+	S_tls_conn_cipher_strength,
+	S_tls_conn_sni,
+	S_tls_conn_version,
+	S_tls_peer_cert_issuer,
+	S_tls_peer_cert_rpk,
+	S_tls_peer_cert_san,
+	S_tls_peer_cert_san_validation,
+	S_tls_peer_cert_sha1,
+	S_tls_peer_cert_sha256,
+	S_tls_peer_cert_subject,
+	S_tls_peer_cert_validation,
+	S_tls_peer_cn,
+	S_tls_psk_identity,
+	S_tls_server_cert_type,
+	S_tolower,
+	S_top_down,
+	S_toupper,
+	S_trace,
+	S_transfer,
+	S_transmissionmode,
+	S_transmit,
+	S_tries,
+	S_true,
+	S_type,
+	S_type6key,
+	S_type7key,
+	S_udp,
+	S_uid,
+	S_umask,
+	S_umessage,
+	S_undef,
+	S_unset,
+	S_until,
+	S_upload,
+	S_usage,
+	S_usemmap,
+	S_usesendfile,
+	S_user,
+	S_user_original,
+	S_usertag,
+	S_userid,
+	S_users,
+	S_valid,
+	S_verdict,
+	S_verify_depth,
+	S_version,
+	S_vrf,
+	S_vsa,
+	S_warn,
+	S_warning,
+	S_weight,
+	S_welcome,
+	S_welcomeaction,
+	S_working,
+	S_x509,
+	S_yes,
+	S_z,
+	S_zone,
+	S_openbra,
+	S_or,
+	S_closebra,
+	S_tilde,
+	S_null
+};
+#define MAVIS_TOKEN_VERSION "c8192cfcca12e881d4c88ddff036a5ef"
+#endif
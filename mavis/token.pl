@@ -123,6 +123,7 @@ auto-detect			S_autodetect
 backend				S_backend
 background			S_background
 backlog				S_backlog
+batch				S_batch
 banner				S_banner
 banner-action			S_banneraction
 binary-only			S_binaryonly
@@ -155,6 +156,7 @@ cleanup				S_cleanup
 interval			S_interval
 client-only			S_clientonly
 cmd				S_cmd
+coalesce			S_coalesce
 command				S_command
 config				S_config
 connection			S_connection
@@ -186,6 +188,7 @@ fake-owner			S_fakeowner
 file				S_file
 files-only			S_filesonly
 follow				S_follow
+fork				S_fork
 from				S_from
 ftpusers			S_ftpusers
 goodbye				S_goodbye
@@ -193,6 +196,7 @@ greeting			S_greeting
 group				S_group
 groupid				S_groupid
 gzip				S_gzip
+hedge				S_hedge
 hide-version			S_hideversion
 home				S_home
 host				S_host
@@ -207,8 +211,10 @@ instances			S_instances
 key				S_key
 keyfile				S_keyfile
 key-file			S_key_file
+ktls				S_ktls
 level				S_level
 severity			S_severity
+lifetime			S_lifetime
 limit				S_limit
 listen				S_listen
 local				S_local
@@ -235,6 +241,7 @@ nac-name			S_nacname
 name				S_name
 nas				S_nas
 nas-name			S_nasname
+negative			S_negative
 nlst				S_nlst
 no				S_no
 noauthcache			S_noauthcache
@@ -287,6 +294,8 @@ service				S_service
 set				S_set
 setenv				S_setenv
 shape-bandwidth			S_shapebandwidth
+shard				S_shard
+shared				S_shared
 shell				S_shell
 shells				S_shells
 site				S_site
@@ -295,17 +304,22 @@ spawn				S_spawn
 src				S_src
 ssl				S_ssl
 sslusers			S_sslusers
+stale				S_stale
 stat				S_stat
 state				S_state
 subject				S_subject
 substitute			S_substitute
+snapshot			S_snapshot
 sufficient			S_sufficient
 symlinks			S_symlinks
 syslog				S_syslog
 tag				S_tag
 template			S_template
 clone				S_clone
+compile				S_compile
+ticket				S_ticket
 time				S_time
+threads				S_threads
 timeout				S_timeout
 timespec			S_timespec
 timestamp			S_timestamp
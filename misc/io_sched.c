@@ -25,7 +25,6 @@
 #include <limits.h>
 
 #include "misc/io_sched.h"
-#include "misc/rb.h"
 #include "mavis/debug.h"
 #include "mavis/log.h"
 #include "misc/memops.h"
@@ -54,6 +53,11 @@ static const char rcsid[] __attribute__((used)) = "$Id$";
 #ifdef WITH_PORT
 #include <port.h>
 #endif
+#ifdef WITH_IO_URING
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+#endif
 
 #define IO_MODE_kqueue	(1 << 0)
 #define IO_MODE_devpoll	(1 << 1)
@@ -61,6 +65,7 @@ static const char rcsid[] __attribute__((used)) = "$Id$";
 #define IO_MODE_poll	(1 << 3)
 #define IO_MODE_select	(1 << 4)
 #define IO_MODE_port	(1 << 5)
+#define IO_MODE_uring	(1 << 6)
 
 #define ARRAYINC 8192
 #define LISTINC 8192
@@ -149,15 +154,88 @@ struct port_io_context {
 };
 #endif
 
+#ifdef WITH_IO_URING
+struct uring_io_context {
+    int fd;
+    unsigned sq_entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned to_submit;		/* SQEs queued, but not yet submitted */
+    int *changelist;
+    int *changemap;
+    int *armed;			/* fd -> poll mask currently armed in the kernel */
+    uint32_t *gen;		/* fd -> poll generation, for detecting stale completions */
+    int *eventlist;		/* fds reported by the last io_uring_enter(2) call */
+    int nchanges;
+    int nevents;
+};
+#endif
+
 struct event_cache {
     int fd;
     int events;
 };
 
+struct io_event {
+    void *proc;
+    struct timeval time_wait;
+    struct io_event *next;
+};
+
+struct io_sched {
+    void *data;			/* context pointer, e.g. */
+    struct timeval time_when;	/* when next event is triggered */
+    struct timeval time_real;	/* when next event should be triggered */
+    struct io_event *event;	/* event pointer */
+    struct io_sched *hnext;	/* hash chain, or free list */
+    struct io_sched *next;	/* wheel slot or expiry list */
+    struct io_sched **pprev;
+    int slot;			/* wheel slot, or -1 if not in wheel */
+};
+
+struct io_sched_list {
+    struct io_sched *first;
+};
+
+#define SCHED_CHUNK 1024
+
+struct io_sched_chunk {
+    struct io_sched_chunk *next;
+    struct io_sched isc[SCHED_CHUNK];
+    struct io_event ioe[SCHED_CHUNK];
+};
+
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
 struct io_context {
     struct io_handler *handler;
-    rb_tree_t *events_by_data;
-    rb_tree_t *events_by_time;
+    struct io_sched_list wheel[WHEEL_LEVELS * WHEEL_SLOTS];
+    uint64_t wheel_map[WHEEL_LEVELS * WHEEL_SLOTS / 64];	/* non-empty wheel slots */
+    uint64_t wheel_tick;	/* milliseconds since wheel_base */
+    time_t wheel_base;
+    int wheel_count;
+    struct io_sched_list sched_expired;
+    struct io_sched **sched_hash;
+    u_int sched_hash_size;
+    u_int sched_count;
+    struct io_sched *sched_free;
+    struct io_event *event_free;
+    struct io_sched_chunk *sched_chunks;
+    struct io_sched *sched_current;	/* being executed by io_sched_exec() */
     void *io_invalid_i;
     void *io_invalid_o;
     void *io_invalid_h;
@@ -190,23 +268,14 @@ struct io_context {
 #ifdef WITH_PORT
 	struct port_io_context port;
 #define Port mechanism.port
+#endif
+#ifdef WITH_IO_URING
+	struct uring_io_context uring;
+#define Uring mechanism.uring
 #endif
     } mechanism;
 };
 
-struct io_event {
-    void *proc;
-    struct timeval time_wait;
-    struct io_event *next;
-};
-
-struct io_sched {
-    void *data;			/* context pointer, e.g. */
-    struct timeval time_when;	/* when next event is triggered */
-    struct timeval time_real;	/* when next event should be triggered */
-    struct io_event *event;	/* event pointer */
-};
-
 static void (*mech_io_set_i)(struct io_context *, int);
 static void (*mech_io_set_o)(struct io_context *, int);
 static void (*mech_io_clr_i)(struct io_context *, int);
@@ -215,6 +284,7 @@ static void (*mech_io_register)(struct io_context *, int);
 static void (*mech_io_unregister)(struct io_context *, int);
 static void (*mech_io_close)(struct io_context *, int);
 static void (*mech_io_destroy)(struct io_context *);
+static void (*mech_io_init)(struct io_context *);
 static int (*mech_io_poll)(struct io_context *, int, int *);
 static void (*mech_io_poll_finish)(struct io_context *, int);
 
@@ -230,34 +300,6 @@ static __inline__ int MAXIMUM(int a, int b)
     return (a < b) ? b : a;
 }
 
-#define SIOS(A) ((struct io_sched *)(A))
-
-static int cmp_tv(const void *a, const void *b)
-{
-    if (SIOS(a)->time_when.tv_sec < SIOS(b)->time_when.tv_sec)
-	return -1;
-    if (SIOS(a)->time_when.tv_sec > SIOS(b)->time_when.tv_sec)
-	return +1;
-    if (SIOS(a)->time_when.tv_usec < SIOS(b)->time_when.tv_usec)
-	return -1;
-    if (SIOS(a)->time_when.tv_usec > SIOS(b)->time_when.tv_usec)
-	return +1;
-    if (a < b)
-	return -1;
-    if (a > b)
-	return +1;
-    return 0;
-}
-
-static int cmp_data(const void *a, const void *b)
-{
-    if (SIOS(a)->data < SIOS(b)->data)
-	return -1;
-    if (SIOS(a)->data > SIOS(b)->data)
-	return +1;
-    return 0;
-}
-
 static void io_invalid_i(void *v __attribute__((unused)), int cur)
 {
     logmsg("io_invalid_i (%d)", cur);
@@ -364,8 +406,12 @@ int io_poll(struct io_context *io, int poll_timeout)
 struct io_context *io_destroy(struct io_context *io, void (*freeproc)(void *))
 {
     if (io) {
-	RB_tree_delete(io->events_by_data);
-	RB_tree_delete(io->events_by_time);
+	while (io->sched_chunks) {
+	    struct io_sched_chunk *c = io->sched_chunks;
+	    io->sched_chunks = c->next;
+	    free(c);
+	}
+	free(io->sched_hash);
 
 	if (freeproc) {
 	    int i;
@@ -1514,86 +1560,623 @@ static void port_io_destroy(struct io_context *io)
 }
 #endif
 
-static void insert_isc(rb_tree_t *t, struct io_sched *isc)
+#ifdef WITH_IO_URING
+/*
+ * io_uring(7) is used as a readiness notification mechanism only: interest
+ * changes are queued as one-shot IORING_OP_POLL_ADD/IORING_OP_POLL_REMOVE
+ * submissions and handed to the kernel in one go, together with waiting for
+ * completions. That's a single system call per loop iteration, regardless of
+ * the number of changes.
+ */
+
+#define URING_ENTRIES 4096
+#define URING_UD_REMOVE (~(__u64) 0)
+
+static __inline__ __u64 uring_ud(struct io_context *io, int fd)
+{
+    return ((__u64) io->Uring.gen[fd] << 32) | (__u64) (u_int) fd;
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
 {
-    while (!RB_insert(t, isc)) {
-	isc->time_when.tv_usec++;
-	if (isc->time_when.tv_usec > 1000000)
-	    isc->time_when.tv_usec -= 1000000, isc->time_when.tv_sec++;
-	isc->time_real.tv_sec = isc->time_when.tv_sec;
-	isc->time_real.tv_usec = isc->time_when.tv_usec;
+    return (int) syscall(SYS_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static void uring_submit(struct io_context *io)
+{
+    while (io->Uring.to_submit > 0) {
+	int res = uring_enter(io->Uring.fd, io->Uring.to_submit, 0, 0, NULL, 0);
+	if (res < 0) {
+	    if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+		continue;
+	    logerr("io_uring_enter (%s:%d)", __FILE__, __LINE__);
+	    abort();
+	}
+	io->Uring.to_submit -= (unsigned) res;
+    }
+}
+
+static struct io_uring_sqe *uring_get_sqe(struct io_context *io)
+{
+    unsigned tail = *io->Uring.sq_tail;
+
+    if (tail - __atomic_load_n(io->Uring.sq_head, __ATOMIC_ACQUIRE) >= io->Uring.sq_entries) {
+	uring_submit(io);
+	tail = *io->Uring.sq_tail;
     }
+
+    unsigned idx = tail & *io->Uring.sq_mask;
+    struct io_uring_sqe *sqe = &io->Uring.sqes[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    io->Uring.sq_array[idx] = idx;
+    __atomic_store_n(io->Uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    io->Uring.to_submit++;
+    return sqe;
+}
+
+static void uring_disarm(struct io_context *io, int fd)
+{
+    if (io->Uring.armed[fd]) {
+	struct io_uring_sqe *sqe = uring_get_sqe(io);
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = uring_ud(io, fd);
+	sqe->user_data = URING_UD_REMOVE;
+	io->Uring.armed[fd] = 0;
+    }
+    io->Uring.gen[fd]++;
+}
+
+static void uring_addchange(struct io_context *io, int fd)
+{
+    if (io->Uring.changemap[fd] < 0) {
+	io->Uring.changemap[fd] = io->Uring.nchanges;
+	io->Uring.changelist[io->Uring.nchanges++] = fd;
+    }
+}
+
+static void uring_io_set_i(struct io_context *io, int fd)
+{
+    if (!io->handler[fd].want_read) {
+	io->handler[fd].want_read = 1;
+	uring_addchange(io, fd);
+    }
+}
+
+static void uring_io_clr_i(struct io_context *io, int fd)
+{
+    if (io->handler[fd].want_read) {
+	io->handler[fd].want_read = 0;
+	uring_addchange(io, fd);
+    }
+}
+
+static void uring_io_set_o(struct io_context *io, int fd)
+{
+    if (!io->handler[fd].want_write) {
+	io->handler[fd].want_write = 1;
+	uring_addchange(io, fd);
+    }
+}
+
+static void uring_io_clr_o(struct io_context *io, int fd)
+{
+    if (io->handler[fd].want_write) {
+	io->handler[fd].want_write = 0;
+	uring_addchange(io, fd);
+    }
+}
+
+static int uring_setup(struct io_uring_params *p)
+{
+    memset(p, 0, sizeof(struct io_uring_params));
+    p->flags = IORING_SETUP_CQSIZE;
+    p->cq_entries = 4 * URING_ENTRIES;
+    int fd = (int) syscall(SYS_io_uring_setup, URING_ENTRIES, p);
+    if (fd > -1 && (!(p->features & IORING_FEAT_EXT_ARG) || !(p->features & IORING_FEAT_NODROP))) {
+	close(fd);
+	errno = ENOSYS;
+	fd = -1;
+    }
+    return fd;
+}
+
+static void uring_io_init(struct io_context *io)
+{
+    struct io_uring_params p;
+    int flags;
+
+    if ((io->Uring.fd = uring_setup(&p)) < 0) {
+	logerr("io_uring_setup (%s:%d)", __FILE__, __LINE__);
+	abort();
+    }
+
+    flags = fcntl(io->Uring.fd, F_GETFD, 0) | FD_CLOEXEC;
+    fcntl(io->Uring.fd, F_SETFD, flags);
+
+    io->Uring.sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    io->Uring.cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    io->Uring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    io->Uring.sq_ring = mmap(NULL, io->Uring.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->Uring.fd, IORING_OFF_SQ_RING);
+    io->Uring.cq_ring = mmap(NULL, io->Uring.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->Uring.fd, IORING_OFF_CQ_RING);
+    io->Uring.sqes = mmap(NULL, io->Uring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->Uring.fd, IORING_OFF_SQES);
+    if (io->Uring.sq_ring == MAP_FAILED || io->Uring.cq_ring == MAP_FAILED || io->Uring.sqes == MAP_FAILED) {
+	logerr("io_uring mmap (%s:%d)", __FILE__, __LINE__);
+	abort();
+    }
+
+    io->Uring.sq_entries = p.sq_entries;
+    io->Uring.sq_head = (unsigned *) ((char *) io->Uring.sq_ring + p.sq_off.head);
+    io->Uring.sq_tail = (unsigned *) ((char *) io->Uring.sq_ring + p.sq_off.tail);
+    io->Uring.sq_mask = (unsigned *) ((char *) io->Uring.sq_ring + p.sq_off.ring_mask);
+    io->Uring.sq_array = (unsigned *) ((char *) io->Uring.sq_ring + p.sq_off.array);
+    io->Uring.cq_head = (unsigned *) ((char *) io->Uring.cq_ring + p.cq_off.head);
+    io->Uring.cq_tail = (unsigned *) ((char *) io->Uring.cq_ring + p.cq_off.tail);
+    io->Uring.cq_mask = (unsigned *) ((char *) io->Uring.cq_ring + p.cq_off.ring_mask);
+    io->Uring.cqes = (struct io_uring_cqe *) ((char *) io->Uring.cq_ring + p.cq_off.cqes);
+    io->Uring.to_submit = 0;
+
+    io->Uring.nchanges = io->Uring.nevents = 0;
+    io->Uring.changelist = Xcalloc(io->nfds_max, sizeof(int));
+    io->Uring.changemap = Xcalloc(io->nfds_max, sizeof(int));
+    io->Uring.armed = Xcalloc(io->nfds_max, sizeof(int));
+    io->Uring.gen = Xcalloc(io->nfds_max, sizeof(uint32_t));
+    io->Uring.eventlist = Xcalloc(io->nfds_max, sizeof(int));
+    for (int i = 0; i < io->nfds_max; i++) {
+	io->Uring.changelist[i] = -1;
+	io->Uring.changemap[i] = -1;
+    }
+}
+
+static int uring_io_poll(struct io_context *io, int poll_timeout, int *cax)
+{
+    Debug((DEBUG_PROC, "io_poll (%p)\n", io));
+
+    *cax = 0;
+
+    for (int i = 0; i < io->Uring.nchanges; i++) {
+	int fd = io->Uring.changelist[i];
+	if (fd > -1 && io->Uring.changemap[fd] == i) {
+	    int events = (io->handler[fd].want_read ? POLLIN : 0) | (io->handler[fd].want_write ? POLLOUT : 0);
+	    if (events != io->Uring.armed[fd]) {
+		uring_disarm(io, fd);
+		if (events) {
+		    struct io_uring_sqe *sqe = uring_get_sqe(io);
+		    sqe->opcode = IORING_OP_POLL_ADD;
+		    sqe->fd = fd;
+		    sqe->poll32_events = (__u32) events;
+		    sqe->user_data = uring_ud(io, fd);
+		    io->Uring.armed[fd] = events;
+		}
+	    }
+	    io->Uring.changemap[fd] = -1;
+	}
+	io->Uring.changelist[i] = -1;
+    }
+    io->Uring.nchanges = 0;
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (poll_timeout > -1) {
+	ts.tv_sec = poll_timeout / 1000;
+	ts.tv_nsec = 1000000 * (poll_timeout - 1000 * ts.tv_sec);
+	arg.ts = (__u64) (uintptr_t) & ts;
+    }
+
+    int res = uring_enter(io->Uring.fd, io->Uring.to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (res < 0) {
+	if (errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+	    logerr("io_uring_enter (%s:%d)", __FILE__, __LINE__);
+	    exit(EX_SOFTWARE);
+	}
+    } else
+	io->Uring.to_submit -= (unsigned) res;
+
+    gettimeofday(&io_now, NULL);
+
+    io->Uring.nevents = 0;
+
+    unsigned head = *io->Uring.cq_head;
+    unsigned tail = __atomic_load_n(io->Uring.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+	struct io_uring_cqe *cqe = &io->Uring.cqes[head & *io->Uring.cq_mask];
+	int cur = (int) (cqe->user_data & 0xffffffff);
+
+	if (cqe->user_data == URING_UD_REMOVE || cur >= io->nfds_max || !io->Uring.armed[cur] || cqe->user_data != uring_ud(io, cur))
+	    continue;		// stale or POLL_REMOVE completion
+
+	io->Uring.armed[cur] = 0;
+
+	if (io->rcache_map[cur] < 0) {
+	    io->rcache[*cax].events = 0;
+	    io->rcache[*cax].fd = cur;
+	    io->rcache_map[cur] = (*cax)++;
+	    io->Uring.eventlist[io->Uring.nevents++] = cur;
+	}
+
+	io->rcache[io->rcache_map[cur]].events = (cqe->res < 0) ? POLLERR : cqe->res;
+    }
+    __atomic_store_n(io->Uring.cq_head, head, __ATOMIC_RELEASE);
+
+    return *cax;
+}
+
+static void uring_io_poll_finish(struct io_context *io, int nevents __attribute__((unused)))
+{
+    // POLL_ADD is one-shot. Re-arm whatever is still of interest.
+    for (int i = 0; i < io->Uring.nevents; i++) {
+	int cur = io->Uring.eventlist[i];
+	if (io->handler[cur].want_read || io->handler[cur].want_write)
+	    uring_addchange(io, cur);
+    }
+    io->Uring.nevents = 0;
+}
+
+static void uring_io_unregister(struct io_context *io, int fd)
+{
+    Debug((DEBUG_PROC, " io_unregister %d\n", fd));
+    uring_disarm(io, fd);
+    if (io->Uring.changemap[fd] > -1) {
+	io->Uring.changelist[io->Uring.changemap[fd]] = -1;
+	io->Uring.changemap[fd] = -1;
+    }
+}
+
+static void uring_io_close(struct io_context *io, int fd __attribute__((unused)))
+{
+    // Armed polls hold a file reference. Submit the POLL_REMOVE queued by
+    // uring_io_unregister() now, or close(2) would be deferred until the
+    // next io_poll() call.
+    uring_submit(io);
+}
+
+static void uring_io_register(struct io_context *io, int fd)
+{
+    Debug((DEBUG_PROC, " io_register %d\n", fd));
+
+    if (fd >= io->nfds_max) {
+	int omax = io->nfds_max;
+	io_resize(io, fd);
+	io->Uring.changelist = Xrealloc(io->Uring.changelist, io->nfds_max * sizeof(int));
+	io->Uring.changemap = Xrealloc(io->Uring.changemap, io->nfds_max * sizeof(int));
+	io->Uring.armed = Xrealloc(io->Uring.armed, io->nfds_max * sizeof(int));
+	io->Uring.gen = Xrealloc(io->Uring.gen, io->nfds_max * sizeof(uint32_t));
+	io->Uring.eventlist = Xrealloc(io->Uring.eventlist, io->nfds_max * sizeof(int));
+	for (int i = omax; i < io->nfds_max; i++) {
+	    io->Uring.changelist[i] = -1;
+	    io->Uring.changemap[i] = -1;
+	    io->Uring.armed[i] = 0;
+	    io->Uring.gen[i] = 0;
+	}
+    }
+}
+
+static void uring_io_destroy(struct io_context *io)
+{
+    munmap(io->Uring.sqes, io->Uring.sqes_size);
+    munmap(io->Uring.cq_ring, io->Uring.cq_ring_size);
+    munmap(io->Uring.sq_ring, io->Uring.sq_ring_size);
+    free(io->Uring.changelist);
+    free(io->Uring.changemap);
+    free(io->Uring.armed);
+    free(io->Uring.gen);
+    free(io->Uring.eventlist);
+    close(io->Uring.fd);
+}
+#endif
+
+/*
+ * Timers are kept in a hierarchical timing wheel with millisecond resolution
+ * (WHEEL_LEVELS levels of WHEEL_SLOTS slots each, covering about 49 days).
+ * Entries are found by data pointer through a hash table. Both use intrusive
+ * links, and entries are recycled through free lists, so adding, renewing
+ * and cancelling timers is O(1) and doesn't allocate memory in the steady
+ * state.
+ *
+ * Renewing only updates time_real. Once time_when is reached, an entry with
+ * a later time_real is re-inserted instead of being executed.
+ */
+
+static __inline__ uint64_t tv2tick(struct io_context *io, struct timeval *tv)
+{
+    if (tv->tv_sec < io->wheel_base)
+	return 0;
+    return (uint64_t) (tv->tv_sec - io->wheel_base) * 1000 + (uint64_t) tv->tv_usec / 1000;
+}
+
+static __inline__ uint64_t tv2tick_ceil(struct io_context *io, struct timeval *tv)
+{
+    if (tv->tv_sec < io->wheel_base)
+	return 0;
+    return (uint64_t) (tv->tv_sec - io->wheel_base) * 1000 + ((uint64_t) tv->tv_usec + 999) / 1000;
+}
+
+static __inline__ void tv_add(struct timeval *res, struct timeval *a, struct timeval *b)
+{
+    res->tv_sec = a->tv_sec + b->tv_sec;
+    res->tv_usec = a->tv_usec + b->tv_usec;
+    if (res->tv_usec >= 1000000)
+	res->tv_usec -= 1000000, res->tv_sec++;
+}
+
+static __inline__ int tv_after(struct timeval *a, struct timeval *b)
+{
+    return (a->tv_sec > b->tv_sec) || (a->tv_sec == b->tv_sec && a->tv_usec > b->tv_usec);
+}
+
+static __inline__ u_int hash_data(struct io_context *io, void *data)
+{
+    uint64_t h = ((uintptr_t) data >> 3) * 0x9E3779B97F4A7C15ULL;
+    return (u_int) (h >> 32) & (io->sched_hash_size - 1);
+}
+
+static void list_add(struct io_sched_list *l, struct io_sched *isc)
+{
+    isc->next = l->first;
+    if (isc->next)
+	isc->next->pprev = &isc->next;
+    l->first = isc;
+    isc->pprev = &l->first;
+}
+
+static void list_del(struct io_context *io, struct io_sched *isc)
+{
+    if (isc->pprev) {
+	*isc->pprev = isc->next;
+	if (isc->next)
+	    isc->next->pprev = isc->pprev;
+	isc->next = NULL;
+	isc->pprev = NULL;
+	if (isc->slot > -1) {
+	    if (!io->wheel[isc->slot].first)
+		io->wheel_map[isc->slot >> 6] &= ~((uint64_t) 1 << (isc->slot & 63));
+	    io->wheel_count--;
+	}
+	isc->slot = -1;
+    }
+}
+
+// Find the next non-empty slot of a wheel level, starting at slot "from".
+// Returns WHEEL_SLOTS if there's none.
+static int wheel_next(struct io_context *io, int level, int from)
+{
+    uint64_t *map = &io->wheel_map[level * WHEEL_SLOTS / 64];
+    for (int i = from / 64; i < WHEEL_SLOTS / 64; i++) {
+	uint64_t m = map[i];
+	if (i == from / 64)
+	    m &= ~(uint64_t) 0 << (from & 63);
+	if (m)
+	    return i * 64 + __builtin_ctzll(m);
+    }
+    return WHEEL_SLOTS;
+}
+
+static void wheel_insert(struct io_context *io, struct io_sched *isc)
+{
+    uint64_t expires = tv2tick_ceil(io, &isc->time_when);
+
+    if (expires <= io->wheel_tick) {
+	list_add(&io->sched_expired, isc);
+	return;
+    }
+
+    uint64_t delta = expires - io->wheel_tick;
+    int level = 0;
+    if (delta >= ((uint64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)))
+	expires = io->wheel_tick + ((uint64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    while (level < WHEEL_LEVELS - 1 && delta >= ((uint64_t) 1 << (WHEEL_BITS * (level + 1))))
+	level++;
+
+    isc->slot = level * WHEEL_SLOTS + (int) ((expires >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+    io->wheel_map[isc->slot >> 6] |= (uint64_t) 1 << (isc->slot & 63);
+    io->wheel_count++;
+    list_add(&io->wheel[isc->slot], isc);
+}
+
+static void wheel_move(struct io_context *io, struct io_sched_list *from, struct io_sched_list *to)
+{
+    struct io_sched *isc;
+    while ((isc = from->first)) {
+	list_del(io, isc);
+	if (to)
+	    list_add(to, isc);
+	else
+	    wheel_insert(io, isc);
+    }
+}
+
+// Advance the wheel to "now", moving expired entries to the "due" list.
+// Empty level 0 slots are skipped.
+static void wheel_advance(struct io_context *io, uint64_t now, struct io_sched_list *due)
+{
+    while (io->wheel_tick < now) {
+	if (!io->wheel_count) {
+	    io->wheel_tick = now;
+	    break;
+	}
+	int idx = (int) (io->wheel_tick & (WHEEL_SLOTS - 1));
+	uint64_t target = io->wheel_tick - idx + wheel_next(io, 0, idx + 1);
+	if (target > now) {
+	    io->wheel_tick = now;
+	    break;
+	}
+	io->wheel_tick = target;
+	for (int level = 1; level < WHEEL_LEVELS && !(target & (((uint64_t) 1 << (WHEEL_BITS * level)) - 1)); level++)
+	    wheel_move(io, &io->wheel[level * WHEEL_SLOTS + (int) ((target >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1))], NULL);
+	wheel_move(io, &io->wheel[target & (WHEEL_SLOTS - 1)], due);
+    }
+}
+
+// Returns the tick of the next slot that needs attention. Entries in upper
+// levels are cascaded at their slot start, so this may be early, but never late.
+static uint64_t wheel_next_tick(struct io_context *io)
+{
+    uint64_t res = UINT64_MAX;
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+	uint64_t pos = io->wheel_tick >> (WHEEL_BITS * level);
+	int idx = (int) (pos & (WHEEL_SLOTS - 1));
+	int s = wheel_next(io, level, idx + 1);
+	if (s == WHEEL_SLOTS) {
+	    s = wheel_next(io, level, 0);
+	    if (s == WHEEL_SLOTS)
+		continue;
+	    s += WHEEL_SLOTS;
+	}
+	uint64_t t = (pos - idx + s) << (WHEEL_BITS * level);
+	if (t < res)
+	    res = t;
+    }
+    return res;
+}
+
+static void sched_chunk_alloc(struct io_context *io)
+{
+    struct io_sched_chunk *c = Xcalloc(1, sizeof(struct io_sched_chunk));
+    c->next = io->sched_chunks;
+    io->sched_chunks = c;
+    for (int i = 0; i < SCHED_CHUNK; i++) {
+	c->isc[i].hnext = io->sched_free;
+	io->sched_free = &c->isc[i];
+	c->ioe[i].next = io->event_free;
+	io->event_free = &c->ioe[i];
+    }
+}
+
+static struct io_sched *isc_alloc(struct io_context *io)
+{
+    if (!io->sched_free)
+	sched_chunk_alloc(io);
+    struct io_sched *isc = io->sched_free;
+    io->sched_free = isc->hnext;
+    memset(isc, 0, sizeof(struct io_sched));
+    isc->slot = -1;
+    return isc;
+}
+
+static struct io_event *ioe_alloc(struct io_context *io)
+{
+    if (!io->event_free)
+	sched_chunk_alloc(io);
+    struct io_event *ioe = io->event_free;
+    io->event_free = ioe->next;
+    memset(ioe, 0, sizeof(struct io_event));
+    return ioe;
+}
+
+static void ioe_free(struct io_context *io, struct io_event *ioe)
+{
+    ioe->next = io->event_free;
+    io->event_free = ioe;
+}
+
+static void sched_hash_resize(struct io_context *io)
+{
+    u_int osize = io->sched_hash_size;
+    struct io_sched **ohash = io->sched_hash;
+
+    io->sched_hash_size = osize ? osize << 1 : SCHED_CHUNK;
+    io->sched_hash = Xcalloc(io->sched_hash_size, sizeof(struct io_sched *));
+    for (u_int i = 0; i < osize; i++)
+	for (struct io_sched * isc = ohash[i], *next; isc; isc = next) {
+	    u_int h = hash_data(io, isc->data);
+	    next = isc->hnext;
+	    isc->hnext = io->sched_hash[h];
+	    io->sched_hash[h] = isc;
+	}
+    free(ohash);
+}
+
+static struct io_sched *sched_lookup(struct io_context *io, void *data)
+{
+    struct io_sched *isc = io->sched_hash[hash_data(io, data)];
+    while (isc && isc->data != data)
+	isc = isc->hnext;
+    return isc;
+}
+
+static struct io_sched *sched_create(struct io_context *io, void *data)
+{
+    if (io->sched_count >= io->sched_hash_size)
+	sched_hash_resize(io);
+    struct io_sched *isc = isc_alloc(io);
+    u_int h = hash_data(io, data);
+    isc->data = data;
+    isc->hnext = io->sched_hash[h];
+    io->sched_hash[h] = isc;
+    io->sched_count++;
+    return isc;
+}
+
+static void sched_destroy(struct io_context *io, struct io_sched *isc)
+{
+    struct io_sched **p = &io->sched_hash[hash_data(io, isc->data)];
+    while (*p != isc)
+	p = &(*p)->hnext;
+    *p = isc->hnext;
+    io->sched_count--;
+
+    list_del(io, isc);
+    while (isc->event) {
+	struct io_event *i = isc->event;
+	isc->event = i->next;
+	ioe_free(io, i);
+    }
+    if (io->sched_current == isc)
+	io->sched_current = NULL;
+    isc->hnext = io->sched_free;
+    io->sched_free = isc;
+}
+
+static void sched_set(struct io_context *io, struct io_sched *isc)
+{
+    tv_add(&isc->time_when, &io_now, &isc->event->time_wait);
+    isc->time_real = isc->time_when;
+    list_del(io, isc);
+    wheel_insert(io, isc);
 }
 
 void io_sched_add(struct io_context *io, void *data, void *proc, time_t tv_sec, suseconds_t tv_usec)
 {
-    rb_node_t *rbn;
-    struct io_event *ioe = Xcalloc(1, sizeof(struct io_event));
-    struct io_sched *isc, is;
+    struct io_sched *isc;
+    struct io_event *ioe = ioe_alloc(io);
 
     Debug((DEBUG_PROC, "io_sched_add %p %ld.%ld\n", data, (long) tv_sec, (long) tv_usec));
 
     gettimeofday(&io_now, NULL);
 
-    is.data = data;
-    rbn = RB_search(io->events_by_data, &is);
-
     ioe->proc = proc;
     ioe->time_wait.tv_sec = tv_sec;
     ioe->time_wait.tv_usec = tv_usec;
 
-    if (rbn) {
-	isc = RB_payload(rbn, struct io_sched *);
-	ioe->next = isc->event;
-	RB_search_and_delete(io->events_by_time, isc);
-    } else {
-	isc = Xcalloc(1, sizeof(struct io_sched));
-	isc->data = data;
-	RB_insert(io->events_by_data, isc);
-    }
+    if (!(isc = sched_lookup(io, data)))
+	isc = sched_create(io, data);
+    ioe->next = isc->event;
     isc->event = ioe;
-    isc->time_when.tv_sec = io_now.tv_sec + ioe->time_wait.tv_sec;
-    isc->time_when.tv_usec = io_now.tv_usec + ioe->time_wait.tv_usec;
-    if (isc->time_when.tv_usec > 1000000)
-	isc->time_when.tv_usec -= 1000000, isc->time_when.tv_sec++;
-    isc->time_real.tv_sec = isc->time_when.tv_sec;
-    isc->time_real.tv_usec = isc->time_when.tv_usec;
-    insert_isc(io->events_by_time, isc);
+    sched_set(io, isc);
 }
 
 void io_sched_app(struct io_context *io, void *data, void *proc, time_t tv_sec, suseconds_t tv_usec)
 {
-    rb_node_t *rbn;
-    struct io_event *ioe = Xcalloc(1, sizeof(struct io_event));
-    struct io_sched is;
+    struct io_sched *isc;
+    struct io_event *ioe = ioe_alloc(io);
 
     DebugIn(DEBUG_PROC);
 
-    is.data = data;
-    rbn = RB_search(io->events_by_data, &is);
-
     ioe->proc = proc;
     ioe->time_wait.tv_sec = tv_sec;
     ioe->time_wait.tv_usec = tv_usec;
 
-    if (rbn) {
-	struct io_event *i = RB_payload(rbn, struct io_sched *)->event;
+    if ((isc = sched_lookup(io, data))) {
+	struct io_event *i = isc->event;
 	while (i->next)
 	    i = i->next;
 	i->next = ioe;
     } else {
-	struct io_sched *isc;
-	isc = Xcalloc(1, sizeof(struct io_sched));
-	isc->data = data;
+	isc = sched_create(io, data);
 	isc->event = ioe;
-	isc->time_when.tv_sec = io_now.tv_sec + ioe->time_wait.tv_sec;
-	isc->time_when.tv_usec = io_now.tv_usec + ioe->time_wait.tv_usec;
-	if (isc->time_when.tv_usec > 1000000)
-	    isc->time_when.tv_usec -= 1000000, isc->time_when.tv_sec++;
-	isc->time_real.tv_sec = isc->time_when.tv_sec;
-	isc->time_real.tv_usec = isc->time_when.tv_usec;
-	RB_insert(io->events_by_data, isc);
-	insert_isc(io->events_by_time, isc);
+	sched_set(io, isc);
     }
 
     DebugOut(DEBUG_PROC);
@@ -1601,34 +2184,20 @@ void io_sched_app(struct io_context *io, void *data, void *proc, time_t tv_sec,
 
 void *io_sched_pop(struct io_context *io, void *data)
 {
-    rb_node_t *rbn;
-    struct io_sched is;
+    struct io_sched *isc;
     void *result = NULL;
 
     DebugIn(DEBUG_PROC);
 
-    is.data = data;
-    rbn = RB_search(io->events_by_data, &is);
-    if (rbn) {
-	struct io_sched *isc = RB_payload(rbn, struct io_sched *);
+    if ((isc = sched_lookup(io, data))) {
 	struct io_event *i = isc->event;
-
 	isc->event = i->next;
-	free(i);
-	RB_search_and_delete(io->events_by_time, isc);
+	ioe_free(io, i);
 	if (isc->event) {
-	    isc->time_when.tv_sec = io_now.tv_sec + isc->event->time_wait.tv_sec;
-	    isc->time_when.tv_usec = io_now.tv_usec + isc->event->time_wait.tv_usec;
-	    if (isc->time_when.tv_usec > 1000000)
-		isc->time_when.tv_usec -= 1000000, isc->time_when.tv_sec++;
-	    isc->time_real.tv_sec = isc->time_when.tv_sec;
-	    isc->time_real.tv_usec = isc->time_when.tv_usec;
-	    insert_isc(io->events_by_time, isc);
+	    sched_set(io, isc);
 	    result = isc->event->proc;
-	} else {
-	    RB_delete(io->events_by_data, rbn);
-	    free(isc);
-	}
+	} else
+	    sched_destroy(io, isc);
     }
     DebugOut(DEBUG_PROC);
     return result;
@@ -1636,43 +2205,24 @@ void *io_sched_pop(struct io_context *io, void *data)
 
 void io_sched_drop(struct io_context *io, void *data)
 {
-    rb_node_t *rbn;
-    struct io_sched is;
+    struct io_sched *isc;
 
     DebugIn(DEBUG_PROC);
 
-    is.data = data;
-    rbn = RB_search(io->events_by_data, &is);
-    if (rbn) {
-	struct io_sched *isc = RB_payload(rbn, struct io_sched *);
-	struct io_event *i = isc->event;
+    if ((isc = sched_lookup(io, data)))
+	sched_destroy(io, isc);
 
-	isc->event = i->next;
-	free(i);
-	RB_search_and_delete(io->events_by_time, isc);
-	while (isc->event) {
-	    i = isc->event;
-	    isc->event = i->next;
-	    free(i);
-	}
-	RB_delete(io->events_by_data, rbn);
-	free(isc);
-    }
     DebugOut(DEBUG_PROC);
 }
 
 int io_sched_del(struct io_context *io, void *data, void *proc)
 {
     int result = 0;
-    struct io_sched is;
-    rb_node_t *rbn;
+    struct io_sched *isc;
 
     DebugIn(DEBUG_PROC);
 
-    is.data = data;
-    rbn = RB_search(io->events_by_data, &is);
-    if (rbn) {
-	struct io_sched *isc = RB_payload(rbn, struct io_sched *);
+    if ((isc = sched_lookup(io, data))) {
 	struct io_event *i = isc->event;
 	if (i) {
 	    if (i->proc == proc)
@@ -1683,7 +2233,7 @@ int io_sched_del(struct io_context *io, void *data, void *proc)
 		    if (i->next->proc == proc) {
 			next = i->next;
 			i->next = next->next;
-			free(next);
+			ioe_free(io, next);
 			result = -1;
 		    } else
 			i = i->next;
@@ -1696,102 +2246,76 @@ int io_sched_del(struct io_context *io, void *data, void *proc)
 
 int io_sched_renew_proc(struct io_context *io, void *data, void *proc)
 {
-    struct io_sched is;
-    rb_node_t *rbn;
+    struct io_sched *isc;
     Debug((DEBUG_PROC, "io_sched_renew_proc %p\n", data));
-    is.data = data;
-    rbn = RB_search(io->events_by_data, &is);
-    if (rbn) {
-	struct io_sched *isc = RB_payload(rbn, struct io_sched *);
-	if (isc && isc->event && (!proc || isc->event->proc == proc)) {
-	    isc->time_real.tv_sec = io_now.tv_sec + isc->event->time_wait.tv_sec;
-	    isc->time_real.tv_usec = io_now.tv_usec + isc->event->time_wait.tv_usec;
-	    if (isc->time_real.tv_usec > 1000000)
-		isc->time_real.tv_usec -= 1000000, isc->time_real.tv_sec++;
-	    Debug((DEBUG_PROC, "to be fired at %.8lx:%.8lx\n", (long) (isc->time_real.tv_sec), (long) (isc->time_real.tv_usec)));
-	    return 0;
-	}
+    if ((isc = sched_lookup(io, data)) && isc->event && (!proc || isc->event->proc == proc)) {
+	tv_add(&isc->time_real, &io_now, &isc->event->time_wait);
+	Debug((DEBUG_PROC, "to be fired at %.8lx:%.8lx\n", (long) (isc->time_real.tv_sec), (long) (isc->time_real.tv_usec)));
+	return 0;
     }
     return -1;
 }
 
 void *io_sched_peek(struct io_context *io, void *data)
 {
-    struct io_event *ioe;
-    rb_node_t *rbn;
-    struct io_sched is;
-    is.data = data;
-    rbn = RB_search(io->events_by_data, &is);
-    if (rbn && (ioe = RB_payload(rbn, struct io_sched *)->event))
-	 return (void *) (ioe->proc);
+    struct io_sched *isc = sched_lookup(io, data);
+    if (isc && isc->event)
+	return (void *) (isc->event->proc);
     return NULL;
 }
 
 struct timeval *io_sched_peek_time(struct io_context *io, void *data)
 {
-    struct io_sched *ios;
-    rb_node_t *rbn;
-    struct io_sched is;
-    is.data = data;
-    rbn = RB_search(io->events_by_data, &is);
-    if (rbn && (ios = RB_payload(rbn, struct io_sched *))->event)
-	 return &ios->time_real;
+    struct io_sched *isc = sched_lookup(io, data);
+    if (isc && isc->event)
+	return &isc->time_real;
     return NULL;
 }
 
-static void io_reschedule(struct io_context *io)
-{
-    struct io_sched *ios;
-
-    for (rb_node_t * rbnext, *rbn = RB_first(io->events_by_time);
-	 rbn &&
-	 ((ios =
-	   RB_payload(rbn,
-		      struct io_sched *))->time_when.tv_sec < io_now.tv_sec
-	  || (ios->time_when.tv_sec == io_now.tv_sec && ios->time_when.tv_usec <= io_now.tv_usec)); rbn = rbnext) {
-	rbnext = RB_next(rbn);
-	if (ios->time_when.tv_sec != ios->time_real.tv_sec || ios->time_when.tv_usec != ios->time_real.tv_usec) {
-	    RB_delete(io->events_by_time, rbn);
-	    ios->time_when.tv_sec = ios->time_real.tv_sec;
-	    ios->time_when.tv_usec = ios->time_real.tv_usec;
-	    insert_isc(io->events_by_time, ios);
-	    Debug((DEBUG_PROC, " rescheduled at %.8lx:%.8lx (%lds)\n",
-		   (long) (ios->time_when.tv_sec), (long) (ios->time_when.tv_usec), (long) (ios->time_when.tv_sec) - (long) io_now.tv_sec));
-	}
-    }
-}
-
 int io_sched_exec(struct io_context *io)
 {
     int poll_timeout = -1;
-    struct io_sched *ios;
+    struct io_sched *isc;
+    struct io_sched_list due = { 0 };
+    uint64_t now = tv2tick(io, &io_now);
 
     Debug((DEBUG_PROC, "io_sched_exec (%p)\n", io));
 
-    io_reschedule(io);
+    wheel_advance(io, now, &due);
+    wheel_move(io, &io->sched_expired, &due);
 
-    for (rb_node_t * rbnext, *rbn = RB_first(io->events_by_time);
-	 rbn && (ios = RB_payload(rbn, struct io_sched *)) && (ios->time_when.tv_sec < io_now.tv_sec
-							       || (ios->time_when.tv_sec == io_now.tv_sec && ios->time_when.tv_usec <= io_now.tv_usec));
-	 rbn = rbnext) {
-	rbnext = RB_next(rbn);
+    while ((isc = due.first)) {
+	list_del(io, isc);
+	if (tv_after(&isc->time_real, &io_now)) {
+	    isc->time_when = isc->time_real;
+	    wheel_insert(io, isc);
+	    Debug((DEBUG_PROC, " rescheduled at %.8lx:%.8lx (%lds)\n",
+		   (long) (isc->time_when.tv_sec), (long) (isc->time_when.tv_usec), (long) (isc->time_when.tv_sec) - (long) io_now.tv_sec));
+	    continue;
+	}
 	Debug((DEBUG_PROC, " executing ...\n"));
-	if (ios->event->proc)
-	    ((void (*)(void *, int)) (ios->event->proc)) (ios->data, -1);
+	io->sched_current = isc;
+	if (isc->event->proc)
+	    ((void (*)(void *, int)) (isc->event->proc)) (isc->data, -1);
 	Debug((DEBUG_PROC, "... done.\n"));
+	// Neither popped, nor dropped, nor re-added by the callback. Runs again
+	// at the next invocation, unless renewed.
+	if (io->sched_current == isc && !isc->pprev) {
+	    isc->time_when = isc->time_real;
+	    wheel_insert(io, isc);
+	}
     }
+    io->sched_current = NULL;
 
-    io_reschedule(io);
-
-    rb_node_t *rbn = RB_first(io->events_by_time);
-    if (rbn) {
-	ios = RB_payload(rbn, struct io_sched *);
-	if (ios)
-	    poll_timeout = 1 + (int) ((ios->time_when.tv_sec - io_now.tv_sec) * 1000) + (int) ((ios->time_when.tv_usec - io_now.tv_usec) / 1000);
-
-	Debug((DEBUG_PROC, "poll_timeout = %dms\n", poll_timeout));
+    if (io->sched_expired.first)
+	poll_timeout = 0;
+    else if (io->wheel_count) {
+	uint64_t next = wheel_next_tick(io);
+	poll_timeout = (next > now) ? (int) ((next - now > INT_MAX / 2) ? INT_MAX / 2 : next - now) : 0;
     }
 
+    Debug((DEBUG_PROC, "poll_timeout = %dms\n", poll_timeout));
+
     return poll_timeout;
 }
 
@@ -1808,7 +2332,6 @@ void io_main(struct io_context *io)
 struct io_context *io_init()
 {
     static int once = 0;
-    void (*mech_io_init)(struct io_context *);
     int mode = 0
 #ifdef WITH_POLL
 	| IO_MODE_poll
@@ -1827,6 +2350,9 @@ struct io_context *io_init()
 #endif
 #ifdef WITH_PORT
 	| IO_MODE_port
+#endif
+#ifdef WITH_IO_URING
+	| IO_MODE_uring
 #endif
 	;
     char *mech, *e;
@@ -1960,6 +2486,33 @@ struct io_context *io_init()
     }
 #endif
 
+#ifdef WITH_IO_URING
+// io_uring(7) requires Linux 5.11 or later and may be disabled by the
+// administrator. Placed *after* standard poll on purpose, so it won't be
+// used unless specified.
+    if (mode & IO_MODE_uring) {
+	struct io_uring_params p;
+	int fd = uring_setup(&p);
+	mech = "io_uring";
+	if (fd > -1) {
+	    close(fd);
+	    mech_io_poll = uring_io_poll;
+	    mech_io_poll_finish = uring_io_poll_finish;
+	    mech_io_set_i = uring_io_set_i;
+	    mech_io_set_o = uring_io_set_o;
+	    mech_io_clr_i = uring_io_clr_i;
+	    mech_io_clr_o = uring_io_clr_o;
+	    mech_io_register = uring_io_register;
+	    mech_io_unregister = uring_io_unregister;
+	    mech_io_destroy = uring_io_destroy;
+	    mech_io_init = uring_io_init;
+	    mech_io_close = uring_io_close;
+	    goto gotit;
+	}
+	logerr(EVENT_MECHANISM_DEFUNCT, mech);
+    }
+#endif
+
 #ifdef WITH_SELECT
 // select(2) comes last and won't be used unless manually chosen.
     if (mode & IO_MODE_select) {
@@ -1997,8 +2550,9 @@ struct io_context *io_init()
 
     mech_io_init(io);
 
-    io->events_by_time = RB_tree_new(cmp_tv, NULL);
-    io->events_by_data = RB_tree_new(cmp_data, NULL);
+    gettimeofday(&io_now, NULL);
+    io->wheel_base = io_now.tv_sec;
+    sched_hash_resize(io);
     io->io_invalid_i = (void *) io_invalid_i;
     io->io_invalid_o = (void *) io_invalid_o;
     io->io_invalid_e = (void *) io_invalid_e;
@@ -2014,6 +2568,30 @@ struct io_context *io_init()
     return io;
 }
 
+/*
+ * After fork(2), kernel based event queues are shared with the parent
+ * process. io_reinit() sets up a private one and re-registers all file
+ * descriptors currently known.
+ */
+void io_reinit(struct io_context *io)
+{
+    mech_io_destroy(io);
+    mech_io_init(io);
+
+    for (int fd = 0; fd < io->nfds_max; fd++)
+	if (io->handler[fd].data) {
+	    int want_read = io->handler[fd].want_read;
+	    int want_write = io->handler[fd].want_write;
+	    io->handler[fd].want_read = 0;
+	    io->handler[fd].want_write = 0;
+	    mech_io_register(io, fd);
+	    if (want_read)
+		mech_io_set_i(io, fd);
+	    if (want_write)
+		mech_io_set_o(io, fd);
+	}
+}
+
 static void io_resize(struct io_context *io, int fd)
 {
     int i, omax = io->nfds_max;
@@ -43,6 +43,7 @@ int io_sched_renew_proc(io_context_t *, void *, void *);
 int io_sched_exec(io_context_t *);
 io_context_t *io_init();
 io_context_t *io_destroy(io_context_t *, void (*)(void *));
+void io_reinit(io_context_t *);
 struct timeval *io_sched_peek_time(io_context_t * io, void *data);
 void *io_sched_pop(io_context_t *, void *);
 void io_sched_drop(io_context_t *, void *);
@@ -8,6 +8,7 @@
  */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <sysexits.h>
 #include "misc/memops.h"
@@ -193,6 +194,136 @@ static __inline__ void *memlist_detach(memlist_t * list, void *ptr)
     return NULL;
 }
 
+////
+
+/*
+ * Arena: small objects are carved from larger chunks, with freed objects going
+ * to per-size-class freelists. Oversized objects and those attached from
+ * elsewhere are tracked in a memlist. Destroying the arena frees whole chunks,
+ * without touching individual objects. Objects carved from a chunk can't be
+ * detached.
+ */
+
+#define ARENA_CHUNK_SIZE 8192
+#define ARENA_CLASSES 8		/* 16, 32, ..., 2048 bytes */
+#define ARENA_CLASS_SIZE(A) ((size_t) 16 << (A))
+#define ARENA_MAX_SIZE ARENA_CLASS_SIZE(ARENA_CLASSES - 1)
+
+typedef union {
+    u_int class;
+    long double align;
+} arena_hdr_t;
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t used;
+    union {
+	char data[1];
+	long double align;
+    } u;
+};
+
+#define ARENA_CHUNK_DATA (ARENA_CHUNK_SIZE - offsetof(struct arena_chunk, u))
+
+typedef struct {
+    struct arena_chunk *chunk;
+    void *freelist[ARENA_CLASSES];
+    memlist_t heap;
+} arena_t;
+
+static __inline__ int arena_owns(arena_t * a, void *p)
+{
+    for (struct arena_chunk * c = a->chunk; c; c = c->next)
+	if ((char *) p > c->u.data && (char *) p < c->u.data + c->used)
+	    return -1;
+    return 0;
+}
+
+static __inline__ int arena_heap_index(arena_t * a, void *p)
+{
+    for (u_int i = 0; i < a->heap.arr_count; i++)
+	if (a->heap.arr[i] == p)
+	    return (int) i;
+    return -1;
+}
+
+static __inline__ void *arena_carve(arena_t * a, size_t size)
+{
+    struct arena_chunk *c = a->chunk;
+    if (c->used + size > ARENA_CHUNK_DATA) {
+	c = calloc(1, ARENA_CHUNK_SIZE);
+	c->next = a->chunk;
+	a->chunk = c;
+    }
+    void *p = c->u.data + c->used;
+    c->used += size;
+    return p;
+}
+
+static void *arena_alloc(arena_t * a, size_t size)
+{
+    if (size > ARENA_MAX_SIZE)
+	return memlist_attach(&a->heap, calloc(1, size));
+
+    u_int class = 0;
+    while (ARENA_CLASS_SIZE(class) < size)
+	class++;
+
+    void *p = a->freelist[class];
+    if (p) {
+	a->freelist[class] = *(void **) p;
+	memset(p, 0, ARENA_CLASS_SIZE(class));
+	return p;
+    }
+
+    arena_hdr_t *h = arena_carve(a, sizeof(arena_hdr_t) + ARENA_CLASS_SIZE(class));
+    h->class = class;
+    return h + 1;
+}
+
+static void arena_free(arena_t * a, void *p)
+{
+    int i = arena_heap_index(a, p);
+    if (i > -1) {
+	free(p);
+	a->heap.arr[i] = a->heap.arr[--a->heap.arr_count];
+    } else if (arena_owns(a, p)) {
+	u_int class = ((arena_hdr_t *) p - 1)->class;
+	*(void **) p = a->freelist[class];
+	a->freelist[class] = p;
+    }
+}
+
+static void *arena_realloc(arena_t * a, void *p, size_t size)
+{
+    if (!p)
+	return arena_alloc(a, size ? size : 1);
+
+    int i = arena_heap_index(a, p);
+    if (i > -1)
+	return a->heap.arr[i] = realloc(p, size);
+
+    if (!arena_owns(a, p))
+	return realloc(p, size);
+
+    size_t old = ARENA_CLASS_SIZE(((arena_hdr_t *) p - 1)->class);
+    if (size <= old)
+	return p;
+    void *n = arena_alloc(a, size);
+    memcpy(n, p, old);
+    arena_free(a, p);
+    return n;
+}
+
+static void *arena_detach(arena_t * a, void *p)
+{
+    int i = arena_heap_index(a, p);
+    if (i < 0)
+	return NULL;
+    a->heap.arr[i] = a->heap.arr[--a->heap.arr_count];
+    return p;
+}
+
 //
 
 struct mem_free_s {
@@ -204,6 +335,7 @@ struct mem {
     union {
 	memlist_t *list;
 	rb_tree_t *pool;
+	arena_t *arena;
     } u;
     enum mem_type type;
     u_int arr_count;
@@ -212,6 +344,16 @@ struct mem {
 
 mem_t *mem_create(enum mem_type type)
 {
+    if (type == M_ARENA) {
+	// The first chunk hosts the arena itself.
+	struct arena_chunk *c = calloc(1, ARENA_CHUNK_SIZE);
+	arena_t tmp = {.chunk = c };
+	mem_t *m = arena_carve(&tmp, (sizeof(mem_t) + sizeof(arena_t) + sizeof(arena_hdr_t) - 1) & ~(sizeof(arena_hdr_t) - 1));
+	m->type = type;
+	m->u.arena = (arena_t *) ((char *) m + sizeof(mem_t));
+	m->u.arena->chunk = c;
+	return m;
+    }
     if (type) {
 	mem_t *m = calloc(1, sizeof(struct mem));
 	m->type = type;
@@ -226,6 +368,9 @@ mem_t *mem_create(enum mem_type type)
 
 void *mem_alloc(mem_t * m, size_t size)
 {
+    if (m && m->type == M_ARENA)
+	return arena_alloc(m->u.arena, size);
+
     char *p = calloc(1, size);
     if (m) {
 	if (m->type == M_LIST)
@@ -247,7 +392,18 @@ void *mem_destroy(mem_t * m)
 	    m->arr[i].f(m->arr[i].p);
 	if (m->arr)
 	    free(m->arr);
-	free(m);
+	if (m->type == M_ARENA) {
+	    arena_t *a = m->u.arena;
+	    for (u_int i = 0; i < a->heap.arr_count; i++)
+		free(a->heap.arr[i]);
+	    free(a->heap.arr);
+	    // m lives in the last chunk
+	    for (struct arena_chunk * c = a->chunk, *next; c; c = next) {
+		next = c->next;
+		free(c);
+	    }
+	} else
+	    free(m);
     }
     return NULL;
 }
@@ -261,6 +417,8 @@ void *mem_free(mem_t * m, void *ptr)
 		mempool_free(m->u.pool, ptr);
 	    else if (m->type == M_LIST)
 		memlist_free(m->u.list, ptr);
+	    else if (m->type == M_ARENA)
+		arena_free(m->u.arena, *p);
 	} else
 	    free(*p);
 	*p = NULL;
@@ -270,6 +428,9 @@ void *mem_free(mem_t * m, void *ptr)
 
 char *mem_strdup(mem_t * m, char *s)
 {
+    if (m && m->type == M_ARENA)
+	return mem_copy(m, s, strlen(s));
+
     char *p = strdup(s);
     mem_attach(m, p);
     return p;
@@ -281,6 +442,9 @@ char *mem_strndup(mem_t * m, u_char * s, size_t len)
      * Add space for a null terminator if needed. Also, no telling
      * what various mallocs will do when asked for a length of zero.
      */
+    if (m && m->type == M_ARENA)
+	return mem_copy(m, s, len);
+
     char *p = calloc(1, len + 1);
     memcpy(p, s, len);
     mem_attach(m, p);
@@ -294,12 +458,20 @@ void *mem_realloc(mem_t * m, void *p, size_t len)
 	    return memlist_realloc(m->u.list, p, len);
 	if (m->type == M_POOL)
 	    return mempool_realloc(m->u.pool, p, len);
+	if (m->type == M_ARENA)
+	    return arena_realloc(m->u.arena, p, len);
     }
     return realloc(p, len);
 }
 
 void *mem_copy(mem_t * m, void *p, size_t len)
 {
+    if (m && m->type == M_ARENA) {
+	char *b = arena_alloc(m->u.arena, len + 1);
+	memcpy(b, p, len);
+	return b;
+    }
+
     void *b = malloc(len + 1);
     memcpy(b, p, len);
     ((char *) b)[len] = 0;
@@ -325,6 +497,8 @@ void *mem_attach(mem_t * m, void *p)
 	    return memlist_attach(m->u.list, p);
 	if (m->type == M_POOL)
 	    return mempool_attach(m->u.pool, p);
+	if (m->type == M_ARENA)
+	    return memlist_attach(&m->u.arena->heap, p);
     }
     return p;
 }
@@ -336,6 +510,8 @@ void *mem_detach(mem_t * m, void *p)
 	    return memlist_detach(m->u.list, p);
 	if (m->type == M_POOL)
 	    return mempool_detach(m->u.pool, p);
+	if (m->type == M_ARENA)
+	    return arena_detach(m->u.arena, p);
     }
     return p;
 }
@@ -31,7 +31,7 @@ static __inline__ void Xfree(void *pa)
     }
 }
 
-enum mem_type { M_STD = 0, M_LIST, M_POOL };
+enum mem_type { M_STD = 0, M_LIST, M_POOL, M_ARENA };
 
 struct mem;
 typedef struct mem mem_t;
@@ -0,0 +1,484 @@
+/*
+ * shmtab.c
+ *
+ * Hash table in a memory mapped file, shared by all processes mapping it.
+ * Entries are keyed by a 16 byte digest and carry a time stamp, an optional
+ * expiry time, a counter and a fixed maximum amount of data. The table is
+ * split into buckets of SHMTAB_WAYS slots; a key may live in any slot of its
+ * bucket. When the bucket is full, unused and expired slots are replaced
+ * first, then the one with the lowest counter, then the least recently
+ * used. Counters at or above the caller's limit are never replaced before
+ * they expire. The file header keeps the number of entries per type and
+ * a few counters for statistics.
+ *
+ * Keys are digests of attributes anyone may know, such as user name and
+ * client address. To keep others from choosing keys that share a bucket,
+ * the bucket is derived from an HMAC of the key with a random secret that
+ * is stored in the file header when the file is created.
+ *
+ * Readers don't lock: each bucket carries a sequence counter that writers
+ * make odd while modifying the bucket, and readers retry if it changed
+ * while they were copying, finally falling back to a shared lock. Writers
+ * serialize per bucket using fcntl() record locks, which are released if a
+ * process dies.
+ *
+ * $Id$
+ *
+ */
+
+#include "misc/sysconf.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stddef.h>
+
+#include "misc/shmtab.h"
+#include "misc/mymd5.h"
+#include "misc/io_sched.h"
+#include "mavis/log.h"
+
+static const char rcsid[] __attribute__((used)) = "$Id$";
+
+#define SHMTAB_MAGIC 0x4d537435
+#define SHMTAB_WAYS 8
+#define SHMTAB_BUCKET_HDR 64
+#define SHMTAB_TRIES 4
+#define SHMTAB_SECRET 16
+#define HMAC_BLOCK 64
+
+struct shmtab_hdr {
+    uint32_t magic;
+    uint32_t buckets;
+    uint32_t slot_size;
+    uint32_t ways;
+    uint32_t entries[SHMTAB_TYPES];	/* used slots, by type */
+    uint64_t counter[SHMTAB_COUNTERS];
+    u_char secret[SHMTAB_SECRET];
+    char pad[SHMTAB_BUCKET_HDR - (4 + SHMTAB_TYPES) * sizeof(uint32_t) - SHMTAB_SECRET];
+};
+
+struct shmtab_slot {
+    u_char key[SHMTAB_KEYLEN];
+    int64_t mtime;		/* 0: slot is unused */
+    int64_t expire;		/* 0: never */
+    int64_t used;
+    int64_t refresh;		/* see shmtab_fetch() */
+    uint32_t counter;
+    uint32_t len;
+    uint32_t type;
+    char data[1];
+};
+
+struct shmtab {
+    int fd;
+    uint32_t buckets;
+    size_t slot_size;
+    size_t data_size;
+    size_t len;
+    char *base;
+    myMD5_CTX inner;		/* HMAC state after the padded secret */
+    myMD5_CTX outer;
+};
+
+static inline off_t bucket_offset(struct shmtab *t, uint32_t bucket)
+{
+    return (off_t) sizeof(struct shmtab_hdr) + (off_t) bucket *(off_t) (SHMTAB_BUCKET_HDR + SHMTAB_WAYS * t->slot_size);
+}
+
+static void hmac_init(struct shmtab *t, u_char *secret)
+{
+    u_char pad[HMAC_BLOCK];
+
+    memset(pad, 0x36, sizeof(pad));
+    for (int i = 0; i < SHMTAB_SECRET; i++)
+	pad[i] ^= secret[i];
+    myMD5Init(&t->inner);
+    myMD5Update(&t->inner, pad, sizeof(pad));
+
+    memset(pad, 0x5c, sizeof(pad));
+    for (int i = 0; i < SHMTAB_SECRET; i++)
+	pad[i] ^= secret[i];
+    myMD5Init(&t->outer);
+    myMD5Update(&t->outer, pad, sizeof(pad));
+}
+
+static uint32_t key_bucket(struct shmtab *t, u_char *key)
+{
+    u_char digest[16];
+    myMD5_CTX m = t->inner;
+    myMD5Update(&m, key, SHMTAB_KEYLEN);
+    myMD5Final(digest, &m);
+    m = t->outer;
+    myMD5Update(&m, digest, sizeof(digest));
+    myMD5Final(digest, &m);
+
+    uint32_t b;
+    memcpy(&b, digest, sizeof(b));
+    return b % t->buckets;
+}
+
+static int random_bytes(u_char *buf, size_t len)
+{
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+	return -1;
+    ssize_t res = read(fd, buf, len);
+    close(fd);
+    return res == (ssize_t) len ? 0 : -1;
+}
+
+static inline uint32_t *bucket_seq(struct shmtab *t, uint32_t bucket)
+{
+    return (uint32_t *) (t->base + bucket_offset(t, bucket));
+}
+
+static inline struct shmtab_slot *bucket_slot(struct shmtab *t, uint32_t bucket, int way)
+{
+    return (struct shmtab_slot *) (t->base + bucket_offset(t, bucket) + SHMTAB_BUCKET_HDR + (size_t) way * t->slot_size);
+}
+
+static void lock(struct shmtab *t, off_t start, off_t len, short type)
+{
+    struct flock fl = {.l_type = type,.l_whence = SEEK_SET,.l_start = start,.l_len = len };
+    while (fcntl(t->fd, F_SETLKW, &fl) && errno == EINTR);
+}
+
+struct shmtab *shmtab_open(char *path, u_int entries, size_t data_size)
+{
+    struct shmtab *t = calloc(1, sizeof(struct shmtab));
+    t->buckets = (entries + SHMTAB_WAYS - 1) / SHMTAB_WAYS;
+    if (!t->buckets)
+	t->buckets = 1;
+    t->data_size = data_size;
+    t->slot_size = (sizeof(struct shmtab_slot) + data_size + 63) & ~(size_t) 63;
+    t->len = (size_t) bucket_offset(t, t->buckets);
+
+    // Give up if the file keeps being replaced.
+    for (int attempt = 0; attempt < 4; attempt++) {
+	t->fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW, 0600);
+	if (t->fd < 0)
+	    break;
+	fcntl(t->fd, F_SETFD, FD_CLOEXEC);
+	// Initialization is serialized by locking the whole file.
+	lock(t, 0, 0, F_WRLCK);
+
+	struct stat st, pst;
+	struct shmtab_hdr hdr = { 0 };
+	if (fstat(t->fd, &st))
+	    goto fail;
+	if (!S_ISREG(st.st_mode)) {
+	    logmsg("%s: not a regular file", path);
+	    errno = EINVAL;
+	    goto fail;
+	}
+	// Another process may have replaced the file while we were waiting for the lock.
+	if (stat(path, &pst) || pst.st_dev != st.st_dev || pst.st_ino != st.st_ino) {
+	    close(t->fd);
+	    t->fd = -1;
+	    errno = EAGAIN;
+	    continue;
+	}
+	if (!st.st_size) {
+	    hdr.magic = SHMTAB_MAGIC;
+	    hdr.buckets = t->buckets;
+	    hdr.slot_size = (uint32_t) t->slot_size;
+	    hdr.ways = SHMTAB_WAYS;
+	    if (random_bytes(hdr.secret, sizeof(hdr.secret)) || ftruncate(t->fd, (off_t) t->len)
+		|| pwrite(t->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+		goto fail;
+	} else if (pread(t->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || hdr.magic != SHMTAB_MAGIC) {
+	    // Not ours, or from an incompatible version. Leave it alone.
+	    logmsg("%s: unknown file format, refusing to use it", path);
+	    errno = EINVAL;
+	    goto fail;
+	} else if (hdr.buckets != t->buckets || hdr.slot_size != t->slot_size || hdr.ways != SHMTAB_WAYS || (size_t) st.st_size != t->len) {
+	    // Different size. Processes still using the old file keep their mapping.
+	    logmsg("%s: size changed, recreating", path);
+	    unlink(path);
+	    close(t->fd);
+	    t->fd = -1;
+	    errno = EAGAIN;
+	    continue;
+	}
+
+	t->base = mmap(NULL, t->len, PROT_READ | PROT_WRITE, MAP_SHARED, t->fd, 0);
+	if (t->base == MAP_FAILED)
+	    goto fail;
+	hmac_init(t, hdr.secret);
+	memset(&hdr, 0, sizeof(hdr));
+	lock(t, 0, 0, F_UNLCK);
+	return t;
+    }
+
+  fail:
+    if (t->fd > -1) {
+	int e = errno;
+	close(t->fd);
+	errno = e;
+    }
+    free(t);
+    return NULL;
+}
+
+void shmtab_close(struct shmtab *t)
+{
+    if (t) {
+	munmap(t->base, t->len);
+	close(t->fd);
+	free(t);
+    }
+}
+
+static struct shmtab_slot *find(struct shmtab *t, uint32_t bucket, u_char *key)
+{
+    for (int w = 0; w < SHMTAB_WAYS; w++) {
+	struct shmtab_slot *slot = bucket_slot(t, bucket, w);
+	if (slot->mtime && !memcmp(slot->key, key, SHMTAB_KEYLEN))
+	    return slot;
+    }
+    return NULL;
+}
+
+static inline int expired(struct shmtab_slot *slot)
+{
+    return slot->expire && slot->expire <= io_now.tv_sec;
+}
+
+// Copies the slot's header to meta and its data to data, unless it expired more than stale seconds ago.
+static ssize_t copy(struct shmtab *t, struct shmtab_slot *slot, time_t stale, char *data, size_t data_size, struct shmtab_slot *meta)
+{
+    if (slot->expire && slot->expire + stale <= io_now.tv_sec)
+	return -1;
+    memcpy(meta, slot, offsetof(struct shmtab_slot, data));
+    size_t len = meta->len;
+    if (len > t->data_size)
+	len = t->data_size;
+    if (data && data_size) {
+	if (len > data_size - 1)
+	    len = data_size - 1;
+	memcpy(data, slot->data, len);
+	data[len] = 0;
+    }
+    // Keeps the cache line clean if the slot was used already this second.
+    if (meta->used != io_now.tv_sec)
+	__atomic_store_n(&slot->used, (int64_t) io_now.tv_sec, __ATOMIC_RELAXED);
+    return (ssize_t) len;
+}
+
+static ssize_t lookup(struct shmtab *t, u_char *key, time_t stale, char *data, size_t data_size, struct shmtab_slot *meta,
+		      struct shmtab_slot **found)
+{
+    uint32_t bucket = key_bucket(t, key);
+    uint32_t *seq = bucket_seq(t, bucket);
+    ssize_t res = -1;
+
+    for (int tries = 0; tries < SHMTAB_TRIES; tries++) {
+	uint32_t s = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+	if (s & 1)
+	    continue;
+	struct shmtab_slot *slot = find(t, bucket, key);
+	res = slot ? copy(t, slot, stale, data, data_size, meta) : -1;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(seq, __ATOMIC_RELAXED) == s) {
+	    *found = slot;
+	    return res;
+	}
+    }
+
+    // Writers keep the bucket busy, so wait for them.
+    off_t pos = bucket_offset(t, bucket);
+    lock(t, pos, 1, F_RDLCK);
+    struct shmtab_slot *slot = find(t, bucket, key);
+    res = slot ? copy(t, slot, stale, data, data_size, meta) : -1;
+    lock(t, pos, 1, F_UNLCK);
+    *found = slot;
+    return res;
+}
+
+ssize_t shmtab_get(struct shmtab *t, u_char *key, char *data, size_t data_size, time_t *mtime, uint32_t *counter)
+{
+    struct shmtab_slot meta, *slot;
+    ssize_t res = lookup(t, key, 0, data, data_size, &meta, &slot);
+    if (res > -1) {
+	if (mtime)
+	    *mtime = (time_t) meta.mtime;
+	if (counter)
+	    *counter = meta.counter;
+    }
+    return res;
+}
+
+/*
+ * Like shmtab_get(), but returns entries that expired less than stale
+ * seconds ago, too. Of all processes getting such an entry, the first one
+ * (and another one every retry seconds) gets *refresh set, and is expected
+ * to replace the entry.
+ */
+ssize_t shmtab_fetch(struct shmtab *t, u_char *key, char *data, size_t data_size, time_t stale, time_t retry, int *refresh)
+{
+    struct shmtab_slot meta, *slot;
+    ssize_t res = lookup(t, key, stale, data, data_size, &meta, &slot);
+    if (res > -1 && expired(&meta)) {
+	int64_t claimed = meta.refresh;
+	if (claimed + retry <= io_now.tv_sec)
+	    *refresh = __atomic_compare_exchange_n(&slot->refresh, &claimed, (int64_t) io_now.tv_sec, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+    return res;
+}
+
+static void account(struct shmtab *t, struct shmtab_slot *slot, int delta)
+{
+    __atomic_add_fetch(&((struct shmtab_hdr *) t->base)->entries[slot->type % SHMTAB_TYPES], (uint32_t) delta, __ATOMIC_RELAXED);
+}
+
+// Returns the rank of a slot to replace, lower ranks first, or -1 if it has to be kept.
+static inline int64_t evictable(struct shmtab_slot *slot, uint32_t keep)
+{
+    if (!slot->mtime)
+	return 0;
+    if (expired(slot))
+	return 1;
+    if (keep && slot->counter >= keep)
+	return -1;
+    return 2 + slot->counter;
+}
+
+// Returns the slot for key, or the one to replace, or NULL. The bucket needs to be locked.
+static struct shmtab_slot *claim(struct shmtab *t, uint32_t bucket, u_char *key, uint32_t keep)
+{
+    struct shmtab_slot *victim = NULL;
+    int64_t victim_rank = 0;
+    for (int w = 0; w < SHMTAB_WAYS; w++) {
+	struct shmtab_slot *slot = bucket_slot(t, bucket, w);
+	if (slot->mtime && !memcmp(slot->key, key, SHMTAB_KEYLEN))
+	    return slot;
+	int64_t rank = evictable(slot, keep);
+	if (rank < 0)
+	    continue;
+	if (!victim || rank < victim_rank || (rank == victim_rank && slot->used < victim->used))
+	    victim = slot, victim_rank = rank;
+    }
+    if (victim && victim->mtime) {
+	account(t, victim, -1);
+	victim->mtime = 0;
+    }
+    return victim;
+}
+
+static void update_begin(struct shmtab *t, uint32_t bucket)
+{
+    uint32_t *seq = bucket_seq(t, bucket);
+    lock(t, bucket_offset(t, bucket), 1, F_WRLCK);
+    // A writer that died mid-update may have left the counter odd.
+    __atomic_store_n(seq, __atomic_load_n(seq, __ATOMIC_RELAXED) | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void update_end(struct shmtab *t, uint32_t bucket)
+{
+    uint32_t *seq = bucket_seq(t, bucket);
+    __atomic_store_n(seq, __atomic_load_n(seq, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+    lock(t, bucket_offset(t, bucket), 1, F_UNLCK);
+}
+
+// Stores data for key. Entries with a non-zero expiry time are replaced first once that has passed.
+int shmtab_set(struct shmtab *t, u_char *key, u_int type, char *data, size_t len, time_t expire)
+{
+    if (len > t->data_size)
+	return -1;
+
+    uint32_t bucket = key_bucket(t, key);
+    update_begin(t, bucket);
+    struct shmtab_slot *slot = claim(t, bucket, key, 0);
+    if (slot->mtime)
+	account(t, slot, -1);
+    else
+	slot->counter = 0;
+    slot->type = (uint32_t) type;
+    account(t, slot, +1);
+    memcpy(slot->key, key, SHMTAB_KEYLEN);
+    memcpy(slot->data, data, len);
+    slot->len = (uint32_t) len;
+    slot->expire = (int64_t) expire;
+    slot->refresh = 0;
+    slot->used = slot->mtime = (int64_t) io_now.tv_sec;
+    update_end(t, bucket);
+    return 0;
+}
+
+/*
+ * Increments the counter for key, unless it wasn't touched for more than
+ * period seconds. Counters that reached keep aren't replaced by others.
+ * Returns 0 if there's no room for key.
+ */
+uint32_t shmtab_incr(struct shmtab *t, u_char *key, time_t period, uint32_t keep)
+{
+    uint32_t bucket = key_bucket(t, key);
+    update_begin(t, bucket);
+    struct shmtab_slot *slot = claim(t, bucket, key, keep);
+    uint32_t counter = 0;
+    if (slot) {
+	if (!slot->mtime) {
+	    slot->type = 0;
+	    account(t, slot, +1);
+	}
+	if (!slot->mtime || expired(slot)) {
+	    slot->counter = 0;
+	    slot->len = 0;
+	}
+	memcpy(slot->key, key, SHMTAB_KEYLEN);
+	counter = ++slot->counter;
+	slot->expire = (int64_t) (io_now.tv_sec + period + 1);
+	slot->used = slot->mtime = (int64_t) io_now.tv_sec;
+    }
+    update_end(t, bucket);
+    return counter;
+}
+
+// Tells whether key is missing and there's no room for it, without locking.
+int shmtab_full(struct shmtab *t, u_char *key, uint32_t keep)
+{
+    uint32_t bucket = key_bucket(t, key);
+    for (int w = 0; w < SHMTAB_WAYS; w++) {
+	struct shmtab_slot *slot = bucket_slot(t, bucket, w);
+	if ((slot->mtime && !memcmp(slot->key, key, SHMTAB_KEYLEN)) || evictable(slot, keep) > -1)
+	    return 0;
+    }
+    return 1;
+}
+
+void shmtab_delete(struct shmtab *t, u_char *key)
+{
+    uint32_t bucket = key_bucket(t, key);
+    // Cheap check first, as most keys won't be there.
+    if (shmtab_get(t, key, NULL, 0, NULL, NULL) < 0)
+	return;
+    update_begin(t, bucket);
+    struct shmtab_slot *slot = find(t, bucket, key);
+    if (slot) {
+	account(t, slot, -1);
+	slot->mtime = 0;
+    }
+    update_end(t, bucket);
+}
+
+// Returns the number of used slots of the given type.
+u_int shmtab_count(struct shmtab *t, u_int type)
+{
+    return __atomic_load_n(&((struct shmtab_hdr *) t->base)->entries[type % SHMTAB_TYPES], __ATOMIC_RELAXED);
+}
+
+// Adds incr to the i-th header counter and returns the result.
+uint64_t shmtab_counter(struct shmtab *t, u_int i, uint64_t incr)
+{
+    if (i >= SHMTAB_COUNTERS)
+	return 0;
+    uint64_t *counter = &((struct shmtab_hdr *) t->base)->counter[i];
+    return incr ? __atomic_add_fetch(counter, incr, __ATOMIC_RELAXED) : __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,29 @@
+/*
+ * shmtab.h
+ *
+ * $Id$
+ *
+ */
+
+#ifndef __SHMTAB_H__
+#define __SHMTAB_H__
+#include <sys/types.h>
+#include <stdint.h>
+#include <time.h>
+
+#define SHMTAB_KEYLEN 16
+#define SHMTAB_COUNTERS 8
+#define SHMTAB_TYPES 4
+
+struct shmtab;
+struct shmtab *shmtab_open(char *, u_int, size_t);
+void shmtab_close(struct shmtab *);
+ssize_t shmtab_get(struct shmtab *, u_char *, char *, size_t, time_t *, uint32_t *);
+ssize_t shmtab_fetch(struct shmtab *, u_char *, char *, size_t, time_t, time_t, int *);
+int shmtab_set(struct shmtab *, u_char *, u_int, char *, size_t, time_t);
+uint32_t shmtab_incr(struct shmtab *, u_char *, time_t, uint32_t);
+int shmtab_full(struct shmtab *, u_char *, uint32_t);
+void shmtab_delete(struct shmtab *, u_char *);
+u_int shmtab_count(struct shmtab *, u_int);
+uint64_t shmtab_counter(struct shmtab *, u_int, uint64_t);
+#endif				/* __SHMTAB_H__ */
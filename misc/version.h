@@ -0,0 +1 @@
+#define VERSION "0e92ba93a83710a59363e5030083411fdf79df95"
@@ -71,6 +71,15 @@
 #include "misc/mymd5.h"
 #include "misc/md5crypt.h"
 #include "misc/utf.h"
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#ifdef __GLIBC__
+#include <crypt.h>
+#endif
+#endif
+#ifdef WITH_SSL
+#include <openssl/rand.h>
+#endif
 
 #if defined(WITH_CRYPTO)
 #if OPENSSL_VERSION_NUMBER < 0x30000000
@@ -458,6 +467,354 @@ static enum token compare_pwdat(struct pwdat *a, char *username __attribute__((u
     return S_permit;
 }
 
+/*
+ * Slow password hashes (crypt(3), PBKDF2, Type 8 and 9) are verified by a
+ * small pool of threads. The session is suspended while the hash is being
+ * computed and resumed afterwards, just as for MAVIS queries. Successful
+ * verifications are remembered in an LRU cache, keyed by a salted digest of
+ * user name, hash and password, so repeated logins skip the KDF.
+ */
+
+static int pwhash_is_slow(struct pwdat *a)
+{
+    switch (a->type) {
+    // crypt(3) isn't reentrant. Without crypt_r(3), compare_pwdat() handles it inline.
+#ifdef __GLIBC__
+    case S_crypt:
+	return !(a->value[0] == '$' && a->value[1] == '1' && a->value[2] == '$');
+#endif
+#ifdef WITH_SSL
+    case S_pbkdf2:
+    case S_8:
+#ifndef OPENSSL_NO_SCRYPT
+    case S_9:
+#endif
+	return -1;
+#endif
+    default:
+	return 0;
+    }
+}
+
+#ifdef WITH_SSL
+#define PWHASH_DIGEST_LEN 32
+
+struct pwhash_cache_entry {
+    u_char digest[PWHASH_DIGEST_LEN];
+    time_t expires;
+    struct pwhash_cache_entry *prev;
+    struct pwhash_cache_entry *next;
+};
+
+static struct {
+    rb_tree_t *tree;
+    struct pwhash_cache_entry *first;	/* least recently used */
+    struct pwhash_cache_entry *last;
+    int count;
+    u_char salt[16];
+} pwhash_cache = { 0 };
+
+static int pwhash_cache_cmp(const void *a, const void *b)
+{
+    return memcmp(((struct pwhash_cache_entry *) a)->digest, ((struct pwhash_cache_entry *) b)->digest, PWHASH_DIGEST_LEN);
+}
+
+static void pwhash_digest(u_char *digest, char *user, struct pwdat *a, char *passwd)
+{
+    if (!pwhash_cache.tree) {
+	pwhash_cache.tree = RB_tree_new(pwhash_cache_cmp, free);
+	RAND_bytes(pwhash_cache.salt, sizeof(pwhash_cache.salt));
+    }
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL);
+    EVP_DigestUpdate(mdctx, pwhash_cache.salt, sizeof(pwhash_cache.salt));
+    EVP_DigestUpdate(mdctx, user ? user : "", (user ? strlen(user) : 0) + 1);
+    EVP_DigestUpdate(mdctx, a->value, strlen(a->value) + 1);
+    EVP_DigestUpdate(mdctx, passwd, strlen(passwd));
+    EVP_DigestFinal_ex(mdctx, digest, NULL);
+    EVP_MD_CTX_free(mdctx);
+}
+
+static void pwhash_cache_unlink(struct pwhash_cache_entry *e)
+{
+    if (e->prev)
+	e->prev->next = e->next;
+    else
+	pwhash_cache.first = e->next;
+    if (e->next)
+	e->next->prev = e->prev;
+    else
+	pwhash_cache.last = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void pwhash_cache_append(struct pwhash_cache_entry *e)
+{
+    e->prev = pwhash_cache.last;
+    if (pwhash_cache.last)
+	pwhash_cache.last->next = e;
+    else
+	pwhash_cache.first = e;
+    pwhash_cache.last = e;
+}
+
+static void pwhash_cache_drop(struct pwhash_cache_entry *e)
+{
+    pwhash_cache_unlink(e);
+    pwhash_cache.count--;
+    RB_search_and_delete(pwhash_cache.tree, e);
+}
+
+static int pwhash_cache_lookup(u_char *digest)
+{
+    if (!config.pwhash_cache_size)
+	return 0;
+
+    struct pwhash_cache_entry k;
+    memcpy(k.digest, digest, PWHASH_DIGEST_LEN);
+    rb_node_t *rbn = RB_search(pwhash_cache.tree, &k);
+    if (!rbn)
+	return 0;
+
+    struct pwhash_cache_entry *e = RB_payload(rbn, struct pwhash_cache_entry *);
+    if (e->expires < io_now.tv_sec) {
+	pwhash_cache_drop(e);
+	return 0;
+    }
+    pwhash_cache_unlink(e);
+    pwhash_cache_append(e);
+    return -1;
+}
+
+static void pwhash_cache_add(u_char *digest)
+{
+    if (!config.pwhash_cache_size)
+	return;
+
+    struct pwhash_cache_entry *e = calloc(1, sizeof(struct pwhash_cache_entry));
+    memcpy(e->digest, digest, PWHASH_DIGEST_LEN);
+    e->expires = io_now.tv_sec + config.pwhash_cache_timeout;
+
+    rb_node_t *rbn = RB_search(pwhash_cache.tree, e);
+    if (rbn)
+	pwhash_cache_drop(RB_payload(rbn, struct pwhash_cache_entry *));
+    while (pwhash_cache.count >= config.pwhash_cache_size && pwhash_cache.first)
+	pwhash_cache_drop(pwhash_cache.first);
+
+    RB_insert(pwhash_cache.tree, e);
+    pwhash_cache_append(e);
+    pwhash_cache.count++;
+}
+#endif
+
+#ifdef WITH_PTHREAD
+struct pwhash_job {
+    tac_session *session;	/* NULL if the session went away */
+    void (*resume)(tac_session *);
+    enum token type;
+    int res;
+    char *hash;
+    char *passwd;
+#ifdef WITH_SSL
+    u_char digest[PWHASH_DIGEST_LEN];
+#endif
+    struct pwhash_job *next;
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct pwhash_job *first;
+    struct pwhash_job *last;
+    int threads;
+    int fd[2];
+} pwhash_pool = {.mutex = PTHREAD_MUTEX_INITIALIZER,.cond = PTHREAD_COND_INITIALIZER,.fd = { -1, -1 } };
+
+static void *pwhash_thread(void *arg __attribute__((unused)))
+{
+#ifdef __GLIBC__
+    struct crypt_data *cd = calloc(1, sizeof(struct crypt_data));
+#endif
+    for (;;) {
+	pthread_mutex_lock(&pwhash_pool.mutex);
+	while (!pwhash_pool.first)
+	    pthread_cond_wait(&pwhash_pool.cond, &pwhash_pool.mutex);
+	struct pwhash_job *job = pwhash_pool.first;
+	pwhash_pool.first = job->next;
+	if (!pwhash_pool.first)
+	    pwhash_pool.last = NULL;
+	job->next = NULL;
+	pthread_mutex_unlock(&pwhash_pool.mutex);
+
+	job->res = -1;
+	switch (job->type) {
+#ifdef __GLIBC__
+	case S_crypt:{
+		char *c = crypt_r(job->passwd, job->hash, cd);
+		if (c)
+		    job->res = strcmp(job->hash, c);
+		break;
+	    }
+#endif
+#ifdef WITH_SSL
+	case S_pbkdf2:
+	    job->res = verify_cisco_asa_pbkdf2(job->passwd, job->hash);
+	    break;
+	case S_8:
+	    job->res = verify_cisco_type89(job->passwd, job->hash, '8');
+	    break;
+	case S_9:
+	    job->res = verify_cisco_type89(job->passwd, job->hash, '9');
+	    break;
+#endif
+	default:
+	    ;
+	}
+	UNUSED_RESULT(write(pwhash_pool.fd[1], &job, sizeof(job)));
+    }
+    return NULL;
+}
+
+static void pwhash_collect(void *unused __attribute__((unused)), int cur)
+{
+    struct pwhash_job *job;
+    while (read(cur, &job, sizeof(job)) == (ssize_t) sizeof(job)) {
+	tac_session *session = job->session;
+	if (session) {
+	    session->pwhash_job = NULL;
+	    session->pwhash_res = job->res ? S_deny : S_permit;
+#ifdef WITH_SSL
+	    if (!job->res)
+		pwhash_cache_add(job->digest);
+#endif
+	    job->resume(session);
+	}
+	free(job);
+    }
+}
+
+static int pwhash_pool_init(void)
+{
+    if (pwhash_pool.threads)
+	return 0;
+    if (pipe(pwhash_pool.fd))
+	return -1;
+    fcntl(pwhash_pool.fd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pwhash_pool.fd[1], F_SETFD, FD_CLOEXEC);
+    fcntl(pwhash_pool.fd[0], F_SETFL, O_NONBLOCK);
+    io_register(common_data.io, pwhash_pool.fd[0], &pwhash_pool);
+    io_set_cb_i(common_data.io, pwhash_pool.fd[0], (void *) pwhash_collect);
+    io_set_i(common_data.io, pwhash_pool.fd[0]);
+
+    for (int i = 0; i < config.pwhash_threads; i++) {
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, pwhash_thread, NULL)) {
+	    report(NULL, LOG_ERR, ~0, "pthread_create: %s", strerror(errno));
+	    break;
+	}
+	pthread_detach(thread);
+	pwhash_pool.threads++;
+    }
+    return pwhash_pool.threads ? 0 : -1;
+}
+
+void pwhash_cancel(tac_session *session)
+{
+    struct pwhash_job *job = session->pwhash_job, *prev = NULL;
+    session->pwhash_job = NULL;
+
+    pthread_mutex_lock(&pwhash_pool.mutex);
+    struct pwhash_job *j = pwhash_pool.first;
+    for (; j && j != job; j = j->next)
+	prev = j;
+    if (j) {			// not started yet
+	if (prev)
+	    prev->next = j->next;
+	else
+	    pwhash_pool.first = j->next;
+	if (pwhash_pool.last == j)
+	    pwhash_pool.last = prev;
+	free(j);
+    } else
+	job->session = NULL;
+    pthread_mutex_unlock(&pwhash_pool.mutex);
+}
+#endif
+
+/*
+ * Returns -1 if password verification was handed over to the thread pool. The
+ * function f will be called again once the result is available.
+ */
+static int query_pwhash(tac_session *session, void (*f)(tac_session *), struct pwdat *a, char *passwd)
+{
+    if (!a || !passwd || session->mavisauth_res != S_unknown || session->pwhash_res != S_unknown || !pwhash_is_slow(a))
+	return 0;
+#ifdef WITH_SSL
+    u_char digest[PWHASH_DIGEST_LEN];
+    pwhash_digest(digest, session->username.txt, a, passwd);
+    if (pwhash_cache_lookup(digest)) {
+	report(DEBAUTHC, "password hash verified by cache");
+	session->pwhash_pwdat = a;
+	session->pwhash_res = S_permit;
+	return 0;
+    }
+#endif
+#ifdef WITH_PTHREAD
+    if (session->pwhash_job)
+	return -1;
+    if (config.pwhash_threads < 1 || pwhash_pool_init())
+	return 0;
+
+    size_t hash_len = strlen(a->value) + 1;
+    size_t passwd_len = strlen(passwd) + 1;
+    struct pwhash_job *job = calloc(1, sizeof(struct pwhash_job) + hash_len + passwd_len);
+    job->session = session;
+    job->resume = f;
+    job->type = a->type;
+    job->hash = (char *) (job + 1);
+    memcpy(job->hash, a->value, hash_len);
+    job->passwd = job->hash + hash_len;
+    memcpy(job->passwd, passwd, passwd_len);
+#ifdef WITH_SSL
+    memcpy(job->digest, digest, PWHASH_DIGEST_LEN);
+#endif
+    session->pwhash_job = job;
+    session->pwhash_pwdat = a;
+
+    pthread_mutex_lock(&pwhash_pool.mutex);
+    if (pwhash_pool.last)
+	pwhash_pool.last->next = job;
+    else
+	pwhash_pool.first = job;
+    pwhash_pool.last = job;
+    pthread_cond_signal(&pwhash_pool.cond);
+    pthread_mutex_unlock(&pwhash_pool.mutex);
+    return -1;
+#else
+    return 0;
+#endif
+}
+
+static enum token compare_pwdat_session(tac_session *session, struct pwdat *a, char *b, enum hint_enum *hint)
+{
+    if (session->pwhash_res != S_unknown && session->pwhash_pwdat == a) {
+	enum token res = session->pwhash_res;
+	session->pwhash_res = S_unknown;
+	session->pwhash_pwdat = NULL;
+	*hint = (res == S_permit) ? hint_succeeded : hint_failed;
+	return res;
+    }
+    enum token res = compare_pwdat(a, session->username.txt, b, hint);
+#ifdef WITH_SSL
+    if (res == S_permit && b && pwhash_is_slow(a)) {
+	u_char digest[PWHASH_DIGEST_LEN];
+	pwhash_digest(digest, session->username.txt, a, b);
+	pwhash_cache_add(digest);
+    }
+#endif
+    return res;
+}
+
 static enum token lookup_and_set_user(tac_session *session)
 {
     enum token res = S_unknown;
@@ -538,6 +895,8 @@ static int query_mavis_auth_login(tac_session *session, void (*f)(tac_session *)
 
 static int query_mavis_info_login(tac_session *session, void (*f)(tac_session *))
 {
+    if (mavis_prefetch_wait(session, f))
+	return 1;
     int res = !session->flag_mavis_info && !session->user && (session->ctx->realm->mavis_login_prefetch == TRISTATE_YES);
     session->flag_mavis_info = 1;
     if (res)
@@ -548,6 +907,8 @@ static int query_mavis_info_login(tac_session *session, void (*f)(tac_session *)
 #ifdef WITH_CRYPTO
 static int query_mavis_info_mschap(tac_session *session, void (*f)(tac_session *))
 {
+    if (mavis_prefetch_wait(session, f))
+	return 1;
     int res = !session->flag_mavis_info && !session->user && (session->ctx->realm->mavis_mschap_prefetch == TRISTATE_YES);
     session->flag_mavis_info = 1;
     if (res)
@@ -572,6 +933,8 @@ static int query_mavis_mschap_login(tac_session *session, void (*f)(tac_session
 
 int query_mavis_info(tac_session *session, void (*f)(tac_session *), enum pw_ix pw_ix)
 {
+    if (mavis_prefetch_wait(session, f))
+	return 1;
     int res = !session->flag_mavis_info && !session->user;
     session->flag_mavis_info = 1;
     if (res)
@@ -592,6 +955,8 @@ static int query_mavis_auth_pap(tac_session *session, void (*f)(tac_session *),
 
 static int query_mavis_info_pap(tac_session *session, void (*f)(tac_session *))
 {
+    if (mavis_prefetch_wait(session, f))
+	return 1;
     int res = !session->user && (session->ctx->realm->mavis_pap_prefetch == TRISTATE_YES) && !session->flag_mavis_info;
     session->flag_mavis_info = 1;
     if (res)
@@ -715,7 +1080,7 @@ static enum token check_access(tac_session *session, struct pwdat *pwdat, char *
 	if (res == S_error && session->ctx->host->authfallback != TRISTATE_YES)
 	    res = S_deny;
     } else if (pwdat)
-	res = compare_pwdat(pwdat, session->username.txt, passwd, hint);
+	res = compare_pwdat_session(session, pwdat, passwd, hint);
 
     switch (res) {
     case S_permit:
@@ -920,6 +1285,9 @@ static void do_chpass(tac_session *session)
     }
 
     char *resp = NULL;
+    if (query_pwhash(session, do_chpass, pwdat, session->password_new))
+	return;
+
     enum token res = check_access(session, pwdat, session->password_new, &hint, &resp);
 
     if (res == S_permit) {
@@ -1011,6 +1379,9 @@ static void do_enable_login(tac_session *session)
     if (query_mavis_auth_login(session, do_enable_login, pw_ix))
 	return;
 
+    if (query_pwhash(session, do_enable_login, pwdat, session->password))
+	return;
+
     enum token res = check_access(session, pwdat, session->password, &hint, &resp);
 
     report_auth(session, info, hint, res);
@@ -1069,8 +1440,11 @@ static void do_enable_augmented(tac_session *session)
 	cfg_get_enable(session, &session->enable);
 
 	if (session->enable) {
-	    if (session->enable->type == S_login)
+	    if (session->enable->type == S_login) {
+		if (query_pwhash(session, do_enable_augmented, pwdat, session->password))
+		    return;
 		res = check_access(session, pwdat, session->password, &hint, &resp);
+	    }
 	}
     }
 
@@ -1135,8 +1509,11 @@ static void do_enable(tac_session *session)
 	    return;
 	}
 
+	if (session->enable && query_pwhash(session, do_enable, session->enable, session->authen_data->msg))
+	    return;
+
 	if (session->enable)
-	    res = compare_pwdat(session->enable, session->username.txt, session->authen_data->msg, &hint);
+	    res = compare_pwdat_session(session, session->enable, session->authen_data->msg, &hint);
     }
 
     report_auth(session, info, hint, res);
@@ -1215,6 +1592,9 @@ static void do_ascii_login(tac_session *session)
 	hint = hint_failed_password_retry;
 	session->password_bad_again = 1;
     } else {
+	if (query_pwhash(session, do_ascii_login, pwdat, session->password))
+	    return;
+
 	res = check_access(session, pwdat, session->password, &hint, &resp);
 	session->password_bad_again = 0;
     }
@@ -1382,6 +1762,9 @@ static void do_enable_getuser(tac_session *session)
 
     set_pwdat(session, &pwdat, &pw_ix);
 
+    if (query_pwhash(session, do_enable_getuser, pwdat, session->password))
+	return;
+
     res = check_access(session, pwdat, session->password, &hint, &resp);
     mem_free(session->mem, &session->challenge);
 
@@ -1622,6 +2005,9 @@ static void do_login(tac_session *session)
     if (query_mavis_auth_login(session, do_login, pw_ix))
 	return;
 
+    if (query_pwhash(session, do_login, pwdat, session->password))
+	return;
+
     res = check_access(session, pwdat, session->password, &hint, &resp);
 
     report_auth(session, info, hint, res);
@@ -1669,6 +2055,9 @@ static void do_pap(tac_session *session)
     if (query_mavis_auth_pap(session, do_pap, pw_ix))
 	return;
 
+    if (query_pwhash(session, do_pap, pwdat, session->password))
+	return;
+
     res = check_access(session, pwdat, session->password, &hint, &resp);
 
     report_auth(session, info, hint, res);
@@ -1986,6 +2375,34 @@ char *check_client_bug_invalid_remote_address(tac_session *session)
     return res;
 }
 
+static void do_radius_login(tac_session *);
+
+// Starts the INFO lookup the authentication function is going to do anyway, see mavis_prefetch().
+static void prefetch_user(tac_session *session)
+{
+    tac_realm *r = session->ctx->realm;
+    int info = 1;
+
+    if (session->authfn == do_ascii_login || session->authfn == do_login)
+	info = (r->mavis_login_prefetch == TRISTATE_YES);
+    else if (session->authfn == do_pap)
+	info = (r->mavis_pap_prefetch == TRISTATE_YES);
+    else if (session->authfn == do_radius_login) {
+	void *val = NULL;
+	size_t val_len = 0;
+	if (!rad_get(session->radius_data->pak_in, session->mem, -1, RADIUS_A_USER_PASSWORD, S_octets, &val, &val_len))
+	    info = (r->mavis_login_prefetch == TRISTATE_YES);
+    } else if (session->authfn != do_chap && session->authfn != do_sshkeyhash
+#ifdef WITH_CRYPTO
+	       && session->authfn != do_mschapv1 && session->authfn != do_mschapv2
+#endif
+	)
+	info = 0;
+
+    if (info)
+	mavis_prefetch(session, PW_LOGIN);
+}
+
 void authen(tac_session *session, tac_pak_hdr *hdr)
 {
     int username_required = 1;
@@ -2129,6 +2546,8 @@ void authen(tac_session *session, tac_pak_hdr *hdr)
 	if (username_required && !session->username.txt[0])
 	    send_authen_error(session, "No username in packet");
 	else {
+	    if (hdr->seq_no == 1)
+		prefetch_user(session);
 #ifdef WITH_DNS
 	    if ((hdr->seq_no == 1) && (session->ctx->host->dns_timeout > 0) && (session->revmap_pending || session->ctx->revmap_pending)) {
 		session->resumefn = session->authfn;
@@ -2251,6 +2670,9 @@ static void do_radius_login(tac_session *session)
 	if (query_mavis_auth_login(session, do_radius_login, pw_ix))
 	    return;
 	if (session->user) {
+	    if (query_pwhash(session, do_radius_login, pwdat, session->password))
+		return;
+
 	    res = check_access(session, pwdat, session->password, &hint, &resp);
 	    user_expiry_check(&res, session->user, &hint);
 	}
@@ -2371,6 +2793,7 @@ void rad_authen(tac_session *session)
 	session->authfn = do_radius_login;
 	if (session->nac_addr_valid)
 	    get_revmap_nac(session);
+	prefetch_user(session);
 #ifdef WITH_DNS
 	if ((session->ctx->host->dns_timeout > 0) && (session->revmap_pending || session->ctx->revmap_pending)) {
 	    session->resumefn = session->authfn;
@@ -67,6 +67,8 @@
 #include <sys/utsname.h>
 
 #include <glob.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #ifndef GLOB_NOMAGIC
 #define GLOB_NOMAGIC 0
 #endif
@@ -87,6 +89,10 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/x509_vfy.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000
+#include <openssl/core_names.h>
+#endif
 #include "type6.h"
 #endif
 
@@ -117,6 +123,7 @@ static void parse_net(struct sym *, tac_realm *, tac_user *, tac_net *);
 static void parse_user(struct sym *, tac_realm *);
 static void parse_group(struct sym *, tac_realm *, tac_group *);
 static void parse_ruleset(struct sym *, tac_realm *);
+static void compile_ruleset(tac_realm *);
 static void parse_profile(struct sym *, tac_realm *, tac_profile *, tac_user *);
 static void parse_profile_attr(struct sym *, tac_profile *, tac_realm *, tac_user *);
 static void parse_user_attr(struct sym *, tac_user *);
@@ -238,6 +245,18 @@ void complete_realm(tac_realm *r)
     r->complete = 1;
     tac_realm *rp = r->parent;
 #ifdef WITH_SSL
+    // needs to be known before ssl_init() runs
+    if (rp) {
+	if (!r->tls_ticket_key) {
+	    r->tls_ticket_key = rp->tls_ticket_key;
+	    r->tls_ticket_key_len = rp->tls_ticket_key_len;
+	}
+	if (r->tls_ticket_lifetime < 0)
+	    r->tls_ticket_lifetime = rp->tls_ticket_lifetime;
+	if (r->tls_ktls == TRISTATE_DUNNO)
+	    r->tls_ktls = rp->tls_ktls;
+    } else if (r->tls_ticket_lifetime < 0)
+	r->tls_ticket_lifetime = 7200;
     if (r->tls_cert || r->tls_key) {
 	if (!r->tls)
 	    r->tls = ssl_init(r, 0, 0);
@@ -268,6 +287,7 @@ void complete_realm(tac_realm *r)
 	RS(mavis_mschap, TRISTATE_DUNNO);
 	RS(mavis_pap_prefetch, TRISTATE_DUNNO);
 	RS(mavis_login_prefetch, TRISTATE_DUNNO);
+	RS(mavis_prefetch, TRISTATE_DUNNO);
 	RS(script_profile_parent_first, TRISTATE_DUNNO);
 	RS(script_host_parent_first, TRISTATE_DUNNO);
 	RS(script_realm_parent_first, TRISTATE_DUNNO);
@@ -350,6 +370,8 @@ void complete_realm(tac_realm *r)
 		if (!r->default_host->user_messages[um])
 		    r->default_host->user_messages[um] = rp->default_host->user_messages[um];
     }
+    if (r->rules && config.ruleset_compile)
+	compile_ruleset(r);
     if (r->realms) {
 	for (rb_node_t * rbn = RB_first(r->realms); rbn; rbn = RB_next(rbn))
 	    complete_realm(RB_payload(rbn, tac_realm *));
@@ -487,6 +509,7 @@ static tac_realm *new_realm(char *name, tac_realm *parent)
     r->debug = parent ? 0 : common_data.debug;
 #if defined(WITH_SSL)
     r->tls_verify_depth = -1;
+    r->tls_ticket_lifetime = -1;
     //r->tls_ciphers = "TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256";
 #endif
 
@@ -1165,6 +1188,55 @@ static void add_sni(struct sym *sym, tac_realm *r)
     r->sni_list = l;
     sym_get(sym);
 }
+
+#define TLS_TICKET_KEY_MIN 32
+#define TLS_TICKET_KEY_MAX 1024
+
+// The ticket key file is shared by all processes, possibly by multiple servers, too.
+// If it doesn't exist, it's created with random content in a private (O_EXCL, 0600)
+// temporary file, and link() makes sure the first process to do so wins. Files that
+// others could read or replace are refused.
+static void parse_tls_ticket_key(struct sym *sym, tac_realm *r)
+{
+    char *path = confdir_strdup(sym->buf);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT) {
+	char tmp[strlen(path) + 20];
+	u_char k[64];
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+	int tfd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (tfd < 0 && errno == EEXIST && !unlink(tmp))	// left over from an earlier process with our pid
+	    tfd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (tfd > -1) {
+	    if (RAND_bytes(k, sizeof(k)) == 1 && write(tfd, k, sizeof(k)) == (ssize_t) sizeof(k) && !fsync(tfd))
+		link(tmp, path);
+	    OPENSSL_cleanse(k, sizeof(k));
+	    close(tfd);
+	    unlink(tmp);
+	}
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0)
+	parse_error(sym, "TLS ticket key file '%s' can't be opened: %s", path, strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077)) {
+	close(fd);
+	parse_error(sym, "TLS ticket key file '%s' needs to be a regular file owned by uid %d with mode 0600 or stricter", path, (int) geteuid());
+    }
+
+    u_char buf[TLS_TICKET_KEY_MAX + 1];
+    ssize_t len = read(fd, buf, sizeof(buf));
+    close(fd);
+    if (len < TLS_TICKET_KEY_MIN || len > TLS_TICKET_KEY_MAX)
+	parse_error(sym, "TLS ticket key file '%s' needs to hold %d to %d bytes", path, TLS_TICKET_KEY_MIN, TLS_TICKET_KEY_MAX);
+    r->tls_ticket_key = malloc(len);
+    memcpy(r->tls_ticket_key, buf, len);
+    r->tls_ticket_key_len = (size_t) len;
+    OPENSSL_cleanse(buf, sizeof(buf));
+    free(path);
+    sym_get(sym);
+}
 #endif
 
 static int password_is_printable(char *s)
@@ -1277,8 +1349,38 @@ void parse_decls_real(struct sym *sym, tac_realm *r)
 		parse(sym, S_equal);
 		r->default_host->password_expiry_warning = to_seconds(sym);
 		continue;
+	    case S_hash:
+		top_only(sym, r);
+		sym_get(sym);
+		switch (sym->code) {
+		case S_threads:
+		    sym_get(sym);
+		    parse(sym, S_equal);
+		    config.pwhash_threads = parse_int(sym);
+		    if (config.pwhash_threads < 0 || config.pwhash_threads > 64)
+			parse_error(sym, "number of password hash threads needs to be in the range of 0 to 64");
+		    continue;
+		case S_cache:
+		    sym_get(sym);
+		    switch (sym->code) {
+		    case S_size:
+			sym_get(sym);
+			parse(sym, S_equal);
+			config.pwhash_cache_size = parse_int(sym);
+			continue;
+		    case S_timeout:
+			sym_get(sym);
+			parse(sym, S_equal);
+			config.pwhash_cache_timeout = to_seconds(sym);
+			continue;
+		    default:
+			parse_error_expect(sym, S_size, S_timeout, S_unknown);
+		    }
+		default:
+		    parse_error_expect(sym, S_threads, S_cache, S_unknown);
+		}
 	    default:
-		parse_error_expect(sym, S_acl, S_maxattempts, S_expiry, S_unknown);
+		parse_error_expect(sym, S_acl, S_maxattempts, S_expiry, S_hash, S_unknown);
 	    }
 	case S_pap:
 	    sym_get(sym);
@@ -1578,6 +1680,24 @@ void parse_decls_real(struct sym *sym, tac_realm *r)
 	    parse(sym, S_equal);
 	    config.ctx_lru_threshold = parse_int(sym);
 	    continue;
+	case S_snapshot:
+	    top_only(sym, r);
+	    sym_get(sym);
+	    parse(sym, S_directory);
+	    parse(sym, S_equal);
+	    config.snapshot_dir = strdup(sym->buf);
+	    sym_get(sym);
+	    continue;
+	case S_udp:
+	    top_only(sym, r);
+	    sym_get(sym);
+	    parse(sym, S_batch);
+	    parse(sym, S_size);
+	    parse(sym, S_equal);
+	    config.udp_batch = parse_int(sym);
+	    if (config.udp_batch < 1 || config.udp_batch > 1024)
+		parse_error(sym, "UDP batch size needs to be in the range of 1 to 1024");
+	    continue;
 	case S_radius_dictionary:
 	    top_only(sym, r);
 	    parse_radius_dictionary(sym);
@@ -1617,6 +1737,11 @@ void parse_decls_real(struct sym *sym, tac_realm *r)
 		sym_get(sym);
 		r->mavis_noauthcache = TRISTATE_YES;
 		continue;
+	    case S_prefetch:
+		sym_get(sym);
+		parse(sym, S_equal);
+		r->mavis_prefetch = parse_tristate(sym);
+		continue;
 	    case S_user:
 		sym_get(sym);
 		parse(sym, S_filter);
@@ -1643,7 +1768,7 @@ void parse_decls_real(struct sym *sym, tac_realm *r)
 		r->mavis_custom_attr[i] = parse_log_format(sym, NULL);
 		continue;
 	    default:
-		parse_error_expect(sym, S_module, S_path, S_cache, S_format, S_unknown);
+		parse_error_expect(sym, S_module, S_path, S_cache, S_format, S_prefetch, S_unknown);
 	    }
 	case S_enable:
 	    sym_get(sym);
@@ -1923,9 +2048,32 @@ void parse_decls_real(struct sym *sym, tac_realm *r)
 		parse(sym, S_equal);
 		r->tls_autodetect = parse_tristate(sym);
 		continue;
+	    case S_ktls:
+		sym_get(sym);
+		parse(sym, S_equal);
+		r->tls_ktls = parse_tristate(sym);
+		continue;
+	    case S_ticket:
+		sym_get(sym);
+		switch (sym->code) {
+		case S_key_file:
+		    sym_get(sym);
+		    parse(sym, S_equal);
+		    parse_tls_ticket_key(sym, r);
+		    continue;
+		case S_lifetime:
+		    sym_get(sym);
+		    parse(sym, S_equal);
+		    r->tls_ticket_lifetime = parse_seconds(sym);
+		    if (r->tls_ticket_lifetime < 60)
+			parse_error(sym, "TLS ticket lifetime needs to be at least 60 seconds");
+		    continue;
+		default:
+		    parse_error_expect(sym, S_key_file, S_lifetime, S_unknown);
+		}
 	    default:
 		parse_error_expect(sym, S_cert_file, S_key_file, S_cafile, S_passphrase, S_ciphers, S_peer, S_accept, S_verify_depth, S_alpn, S_autodetect,
-				   S_psk, S_sni, S_unknown);
+				   S_psk, S_sni, S_ticket, S_ktls, S_unknown);
 	    }
 	    continue;
 #endif
@@ -2002,7 +2150,7 @@ void parse_decls_real(struct sym *sym, tac_realm *r)
 	    continue;
 	default:
 	    parse_error_expect(sym, S_password, S_pap, S_login, S_accounting, S_authentication, S_access, S_authorization, S_warning,
-			       S_connection, S_dns, S_cache, S_log, S_umask, S_retire, S_user, S_group, S_profile, S_acl, S_mavis,
+			       S_connection, S_dns, S_cache, S_log, S_umask, S_retire, S_udp, S_snapshot, S_user, S_group, S_profile, S_acl, S_mavis,
 			       S_enable, S_net, S_parent, S_ruleset, S_time, S_realm, S_trace, S_debug, S_dacl,
 			       S_anonenable, S_mschap,
 			       S_key, S_motd, S_welcome, S_reject, S_permit, S_bug, S_augmented_enable, S_singleconnection, S_context,
@@ -2213,6 +2361,13 @@ static void parse_ruleset(struct sym *sym, tac_realm *realm)
 	r = &(*r)->next;
 
     sym_get(sym);
+    if (sym->code == S_compile) {
+	top_only(sym, realm);
+	sym_get(sym);
+	parse(sym, S_equal);
+	config.ruleset_compile = parse_bool(sym);
+	return;
+    }
     if (sym->code == S_equal)
 	sym_get(sym);
     parse(sym, S_openbra);
@@ -2310,6 +2465,247 @@ static void cache_user_profile(tac_session *session, enum token res)
     session->ctx->user_profile_cache[j].valid_until = io_now.tv_sec + 120;
 }
 
+/*
+ * Compiled rulesets. Most rules only act if some condition on device
+ * address, host, realm, tags or connection type holds. Those conditions
+ * can't change during the lifetime of a connection, so they're collected
+ * (and deduplicated) per realm at configuration time and evaluated at most
+ * once per connection. Rules that can't possibly match are skipped without
+ * running the script interpreter. Device address prefixes are resolved by
+ * a single radix tree walk.
+ */
+
+struct rule_alt {		/* top-level "if" statement of a rule */
+    int n;
+    int *id;			/* connection-constant conjuncts */
+};
+
+struct rule_guard {
+    int n;			/* 0: rule needs to be evaluated */
+    struct rule_alt *alt;
+};
+
+struct rule_index {
+    int rules;
+    struct rule_guard *guard;	/* indexed by rule position */
+    int conds;
+    struct mavis_cond **cond;
+    u_char *devaddr;		/* condition is a device address prefix */
+    radixtree_t *devtree;	/* device address prefix => condition id + 1 */
+};
+
+struct rule_state {
+    struct rule_state *next;
+    tac_realm *realm;		/* owner of the rule index */
+    tac_realm *ctx_realm;
+    tac_host *host;
+    int devaddr_done;
+    u_char res[1];		/* per condition: 0 = unknown, 1 = false, 2 = true */
+};
+
+static int tac_script_cond_eval(tac_session *, struct mavis_cond *);
+
+static int rule_cond_is_constant(struct mavis_cond *m)
+{
+    switch (m->type) {
+    case S_exclmark:
+	return rule_cond_is_constant(m->m.e[0]);
+    case S_and:
+    case S_or:
+	for (int i = 0; i < m->m.n; i++)
+	    if (!rule_cond_is_constant(m->m.e[i]))
+		return 0;
+	return -1;
+    case S_aaa_protocol:
+    case S_host:
+    case S_realm:
+	return -1;
+    case S_address:
+	return m->s.token == S_nas || m->s.token == S_deviceaddress;
+    case S_net:
+	return m->s.token == S_nas;
+    case S_devicetag:
+	return m->s.rhs_token == S_string || m->s.rhs_token == S_devicetag;
+    case S_equal:
+    case S_regex:
+    case S_slash:
+	switch (m->s.token) {
+	case S_vrf:
+	case S_conn_protocol:
+	case S_conn_transport:
+	case S_nas:
+	case S_deviceaddress:
+	case S_devicetag:
+	case S_devicename:
+	case S_host:
+	case S_realm:
+#if defined(WITH_SSL)
+	case S_tls_conn_version:
+	case S_tls_conn_cipher:
+	case S_tls_peer_cert_issuer:
+	case S_tls_peer_cert_subject:
+	case S_tls_conn_cipher_strength:
+	case S_tls_peer_cn:
+	case S_tls_psk_identity:
+#endif
+	    return -1;
+	default:
+	    return 0;
+	}
+    default:
+	return 0;
+    }
+}
+
+static int rule_cond_equal(struct mavis_cond *a, struct mavis_cond *b)
+{
+    if (a == b)
+	return -1;
+    if (a->type != b->type)
+	return 0;
+    switch (a->type) {
+    case S_exclmark:
+    case S_and:
+    case S_or:
+	return 0;
+    case S_address:
+	return ((struct in6_cidr *) a->s.rhs)->mask == ((struct in6_cidr *) b->s.rhs)->mask
+	    && !memcmp(&((struct in6_cidr *) a->s.rhs)->addr, &((struct in6_cidr *) b->s.rhs)->addr, sizeof(struct in6_addr));
+    default:
+	if (a->s.token != b->s.token || a->s.rhs_token != b->s.rhs_token)
+	    return 0;
+	return a->s.rhs == b->s.rhs || (a->s.rhs_txt && b->s.rhs_txt && !strcmp(a->s.rhs_txt, b->s.rhs_txt));
+    }
+}
+
+static int rule_cond_add(struct rule_index *ri, struct mavis_cond *m)
+{
+    for (int i = 0; i < ri->conds; i++)
+	if (rule_cond_equal(ri->cond[i], m))
+	    return i;
+
+    ri->cond = realloc(ri->cond, (ri->conds + 1) * sizeof(struct mavis_cond *));
+    ri->devaddr = realloc(ri->devaddr, ri->conds + 1);
+    ri->cond[ri->conds] = m;
+    ri->devaddr[ri->conds] = 0;
+    if (m->type == S_address) {
+	struct in6_cidr c = *(struct in6_cidr *) m->s.rhs;
+	if (!ri->devtree)
+	    ri->devtree = radix_new(NULL, NULL);
+	radix_add(ri->devtree, &c.addr, c.mask, (void *) (long) (ri->conds + 1));
+	ri->devaddr[ri->conds] = 1;
+    }
+    return ri->conds++;
+}
+
+static void rule_alt_add(struct rule_index *ri, struct rule_alt *alt, struct mavis_cond *m)
+{
+    if (rule_cond_is_constant(m)) {
+	alt->id = realloc(alt->id, (alt->n + 1) * sizeof(int));
+	alt->id[alt->n++] = rule_cond_add(ri, m);
+    } else if (m->type == S_and)
+	for (int i = 0; i < m->m.n; i++)
+	    rule_alt_add(ri, alt, m->m.e[i]);
+}
+
+static void compile_rule(struct rule_index *ri, struct tac_rule *rule, struct rule_guard *g)
+{
+    int n = 0;
+    struct mavis_action *m;
+
+    /* Only scripts consisting of plain "if" statements can be guarded. */
+    for (m = rule->acl.action; m; m = m->n, n++)
+	if (m->code != S_if || m->c.a)
+	    return;
+
+    struct rule_alt *alt = calloc(n, sizeof(struct rule_alt));
+    n = 0;
+    for (m = rule->acl.action; m; m = m->n, n++) {
+	rule_alt_add(ri, &alt[n], m->a.c);
+	if (!alt[n].n)
+	    break;
+    }
+    if (m) {
+	for (int i = 0; i <= n; i++)
+	    free(alt[i].id);
+	free(alt);
+	return;
+    }
+    g->n = n;
+    g->alt = alt;
+}
+
+static void compile_ruleset(tac_realm *r)
+{
+    struct rule_index *ri = calloc(1, sizeof(struct rule_index));
+    for (struct tac_rule * rule = r->rules; rule; rule = rule->next)
+	ri->rules++;
+    ri->guard = calloc(ri->rules, sizeof(struct rule_guard));
+    int i = 0, guarded = 0;
+    for (struct tac_rule * rule = r->rules; rule; rule = rule->next, i++) {
+	compile_rule(ri, rule, &ri->guard[i]);
+	if (ri->guard[i].n)
+	    guarded++;
+    }
+    r->rule_index = ri;
+    report(NULL, LOG_DEBUG, DEBUG_ACL_FLAG, "realm %s: %d of %d rules guarded by %d connection-constant conditions",
+	   r->name.txt, guarded, ri->rules, ri->conds);
+}
+
+static struct rule_state *rule_state_get(tac_session *session, tac_realm *r)
+{
+    struct context *ctx = session->ctx;
+    struct rule_index *ri = r->rule_index;
+    struct rule_state *st;
+
+    for (st = ctx->rule_state; st && st->realm != r; st = st->next);
+    if (!st) {
+	st = mem_alloc(ctx->mem, sizeof(struct rule_state) + ri->conds);
+	st->realm = r;
+	st->next = ctx->rule_state;
+	ctx->rule_state = st;
+    } else if (st->host == session->host && st->ctx_realm == ctx->realm)
+	return st;
+    else {
+	memset(st->res, 0, ri->conds);
+	st->devaddr_done = 0;
+    }
+    st->host = session->host;
+    st->ctx_realm = ctx->realm;
+    return st;
+}
+
+static int rule_cond_eval(tac_session *session, struct rule_index *ri, struct rule_state *st, int id)
+{
+    if (!st->res[id]) {
+	if (ri->devaddr[id] && !st->devaddr_done) {
+	    void *arr[130] = { 0 };
+	    radix_lookup(ri->devtree, &session->ctx->device_addr, arr);
+	    for (int i = 0; i < ri->conds; i++)
+		if (ri->devaddr[i])
+		    st->res[i] = 1;
+	    for (int i = 0; i < 130 && arr[i]; i++)
+		st->res[(long) arr[i] - 1] = 2;
+	    st->devaddr_done = 1;
+	} else
+	    st->res[id] = tac_script_cond_eval(session, ri->cond[id]) ? 2 : 1;
+    }
+    return st->res[id] == 2;
+}
+
+static int rule_may_match(tac_session *session, struct rule_index *ri, struct rule_state *st, struct rule_guard *g)
+{
+    if (!g->n)
+	return -1;
+    for (int i = 0; i < g->n; i++) {
+	int j = 0;
+	for (; j < g->alt[i].n && rule_cond_eval(session, ri, st, g->alt[i].id[j]); j++);
+	if (j == g->alt[i].n)
+	    return -1;
+    }
+    return 0;
+}
+
 enum token eval_ruleset_r(tac_session *session, tac_realm *realm, int parent_first)
 {
     enum token res = S_unknown;
@@ -2328,10 +2724,16 @@ enum token eval_ruleset_r(tac_session *session, tac_realm *realm, int parent_fir
     if (res == S_permit || res == S_deny)
 	return res;
 
-    for (struct tac_rule * rule = realm->rules; rule; rule = rule->next)
+    struct rule_state *st = realm->rule_index ? rule_state_get(session, realm) : NULL;
+    int i = 0;
+#define DEBACL session, LOG_DEBUG, DEBUG_ACL_FLAG
+    for (struct tac_rule * rule = realm->rules; rule; rule = rule->next, i++)
 	if (rule->enabled) {
+	    if (st && !rule_may_match(session, realm->rule_index, st, &realm->rule_index->guard[i])) {
+		report(DEBACL, "%s@%s: ACL %s: skipped", session->username.txt, session->nac_addr_ascii.txt, rule->acl.name.txt);
+		continue;
+	    }
 	    res = eval_tac_acl(session, &rule->acl);
-#define DEBACL session, LOG_DEBUG, DEBUG_ACL_FLAG
 	    report(DEBACL | DEBUG_REGEX_FLAG,
 		   "%s@%s: ACL %s: %s (profile: %s)", session->username.txt,
 		   session->nac_addr_ascii.txt, rule->acl.name.txt, codestring[res].txt, session->profile ? session->profile->name.txt : "n/a");
@@ -3277,9 +3679,143 @@ static void add_net(struct sym *sym, radixtree_t *ht, tac_net *net)
     radix_add(ht, &a, cm, net);
 }
 
+/*
+ * Address file snapshots. Host and net address files are parsed once and
+ * stored as a flat binary array of prefixes in the snapshot directory.
+ * Subsequent configuration loads (including "tac_plus-ng -P", which may be
+ * used to prepare snapshots) map the snapshot instead of running the
+ * text parser, as long as the source file is unchanged. Snapshots contain
+ * no pointers and are shared via the page cache.
+ */
+
+#define SNAPSHOT_MAGIC 0x74616373	/* native byte order */
+#define SNAPSHOT_VERSION 2
+
+struct snapshot_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime;
+    int64_t mtime_nsec;		/* files may change more than once per second */
+    uint32_t count;
+    uint32_t path_len;		/* source path, padded to 8 bytes, follows */
+};
+
+struct snapshot_rec {
+    struct in6_addr a;
+    int32_t cm;
+};
+
+static int64_t snapshot_mtime_nsec(struct stat *st)
+{
+#if defined(__APPLE__)
+    return (int64_t) st->st_mtimespec.tv_nsec;
+#else
+    return (int64_t) st->st_mtim.tv_nsec;
+#endif
+}
+
+static int snapshot_path(char *url, struct stat *st, char *path, size_t len)
+{
+    if (!config.snapshot_dir || strstr(url, "://") || stat(url, st) || !S_ISREG(st->st_mode))
+	return -1;
+    uint32_t crc = crc32_update(INITCRC32, (u_char *) url, strlen(url));
+    return snprintf(path, len, "%s/%08x.snap", config.snapshot_dir, crc) >= (int) len;
+}
+
+static int snapshot_read(char *url, struct stat *st, char *path, radixtree_t *ht, tac_host *host, tac_net *net)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+	return -1;
+
+    struct stat sst;
+    if (fstat(fd, &sst) || (size_t) sst.st_size < sizeof(struct snapshot_hdr)) {
+	close(fd);
+	return -1;
+    }
+
+    char *buf = mmap(NULL, sst.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED)
+	return -1;
+
+    struct snapshot_hdr *hdr = (struct snapshot_hdr *) buf;
+    size_t path_len = (hdr->path_len + 7) & ~7;
+    size_t url_len = strlen(url);
+    if (hdr->magic != SNAPSHOT_MAGIC || hdr->version != SNAPSHOT_VERSION
+	|| hdr->dev != (uint64_t) st->st_dev || hdr->ino != (uint64_t) st->st_ino
+	|| hdr->size != (uint64_t) st->st_size || hdr->mtime != (int64_t) st->st_mtime
+	|| hdr->mtime_nsec != snapshot_mtime_nsec(st)
+	|| hdr->path_len != url_len
+	|| (size_t) sst.st_size != sizeof(struct snapshot_hdr) + path_len + hdr->count * sizeof(struct snapshot_rec)
+	|| memcmp(buf + sizeof(struct snapshot_hdr), url, url_len)) {
+	munmap(buf, sst.st_size);
+	return -1;
+    }
+
+    struct snapshot_rec *rec = (struct snapshot_rec *) (buf + sizeof(struct snapshot_hdr) + path_len);
+    for (uint32_t i = 0; i < hdr->count; i++) {
+	struct in6_addr a = rec[i].a;
+	if (host) {
+	    tac_host *h;
+	    if (ht && (h = radix_add(ht, &a, rec[i].cm, host))) {
+		char s[INET6_ADDRSTRLEN];
+		v6_ntoh(&a, &rec[i].a);
+		report_cfg_error(LOG_ERR, ~0, "%s: Address '%s/%d' already assigned to host '%s'.", url,
+				 inet_ntop(AF_INET6, &a, s, sizeof(s)), rec[i].cm, h->name.txt);
+		tac_exit(EX_CONFIG);
+	    }
+	}
+	if (net)
+	    radix_add(ht, &a, rec[i].cm, net);
+    }
+    report(NULL, LOG_DEBUG, DEBUG_PARSE_FLAG, "%s: %u addresses read from snapshot %s", url, hdr->count, path);
+    munmap(buf, sst.st_size);
+    return 0;
+}
+
+static void snapshot_write(char *url, struct stat *st, char *path, struct snapshot_rec *rec, uint32_t count)
+{
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid()) >= (int) sizeof(tmp))
+	return;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+	report(NULL, LOG_INFO, ~0, "Couldn't create snapshot %s: %s", tmp, strerror(errno));
+	return;
+    }
+
+    size_t url_len = strlen(url);
+    size_t path_len = (url_len + 7) & ~7;
+    struct snapshot_hdr hdr = {.magic = SNAPSHOT_MAGIC,.version = SNAPSHOT_VERSION,.dev = st->st_dev,.ino = st->st_ino,
+	.size = st->st_size,.mtime = st->st_mtime,.mtime_nsec = snapshot_mtime_nsec(st),.count = count,.path_len = url_len
+    };
+    char pad[8] = { 0 };
+    struct iovec iov[4] = {
+	{.iov_base = &hdr,.iov_len = sizeof(hdr) },
+	{.iov_base = url,.iov_len = url_len },
+	{.iov_base = pad,.iov_len = path_len - url_len },
+	{.iov_base = rec,.iov_len = count * sizeof(struct snapshot_rec) },
+    };
+    ssize_t len = (ssize_t) (sizeof(hdr) + path_len + count * sizeof(struct snapshot_rec));
+    if (writev(fd, iov, 4) != len || close(fd) || rename(tmp, path)) {
+	report(NULL, LOG_INFO, ~0, "Couldn't write snapshot %s: %s", path, strerror(errno));
+	unlink(tmp);
+    }
+}
+
 static void parse_file(char *url, radixtree_t *ht, tac_host *host, tac_net *net)
 {
     struct sym sym = {.filename = url,.line = 1 };
+    char path[PATH_MAX];
+    struct stat st;
+    int snapshot = !snapshot_path(url, &st, path, sizeof(path));
+
+    if (snapshot && !snapshot_read(url, &st, path, ht, host, net))
+	return;
 
     if (setjmp(sym.env))
 	tac_exit(EX_CONFIG);
@@ -3298,7 +3834,19 @@ static void parse_file(char *url, radixtree_t *ht, tac_host *host, tac_net *net)
 
     sym_init(&sym);
 
+    struct snapshot_rec *rec = NULL;
+    uint32_t count = 0, size = 0;
+
     while (sym.code != S_eof) {
+	if (snapshot) {
+	    if (count == size) {
+		size += 1024;
+		rec = realloc(rec, size * sizeof(struct snapshot_rec));
+	    }
+	    int cm;
+	    if (!v6_ptoh(&rec[count].a, &cm, sym.buf))
+		rec[count++].cm = cm;
+	}
 	if (host)
 	    add_host(&sym, ht, host);
 	if (net)
@@ -3307,6 +3855,11 @@ static void parse_file(char *url, radixtree_t *ht, tac_host *host, tac_net *net)
     }
 
     cfg_close(url, buf, bufsize);
+
+    if (snapshot) {
+	snapshot_write(url, &st, path, rec, count);
+	free(rec);
+    }
 }
 
 static void parse_rewrite(struct sym *sym, tac_realm *r)
@@ -4436,6 +4989,11 @@ void attr_add(tac_session *session, char ***v, int *i, char *attr, size_t attr_l
 void cfg_init(void)
 {
     config.mask = 0644;
+    config.udp_batch = 16;
+    config.pwhash_threads = 2;
+    config.pwhash_cache_size = 1024;
+    config.pwhash_cache_timeout = 3600;
+    config.ruleset_compile = 1;
 
     struct utsname utsname = { 0 };
     if (uname(&utsname) || !*(utsname.nodename))
@@ -6060,6 +6618,78 @@ static int sni_cb(SSL *ssl, int *al __attribute__((unused)), void *arg __attribu
     return SSL_TLSEXT_ERR_ALERT_FATAL;
 }
 
+#if OPENSSL_VERSION_NUMBER >= 0x30000000
+struct tls_ticket_keys {
+    u_char name[16];
+    u_char aes[32];
+    u_char hmac[32];
+};
+
+// Ticket keys are derived from the shared secret and the current epoch, so
+// all processes agree on them without further coordination, and they change
+// every tls_ticket_lifetime seconds.
+static void tls_ticket_keys(tac_realm *r, int64_t epoch, struct tls_ticket_keys *k)
+{
+    u_char e[8], md[EVP_MAX_MD_SIZE];
+    for (int i = 7; i > -1; i--, epoch >>= 8)
+	e[i] = epoch & 0xff;
+
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(mdctx, EVP_sha512(), NULL);
+    EVP_DigestUpdate(mdctx, "keys", 4);
+    EVP_DigestUpdate(mdctx, e, sizeof(e));
+    EVP_DigestUpdate(mdctx, r->tls_ticket_key, r->tls_ticket_key_len);
+    EVP_DigestFinal_ex(mdctx, md, NULL);
+    memcpy(k->aes, md, 32);
+    memcpy(k->hmac, md + 32, 32);
+
+    EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL);
+    EVP_DigestUpdate(mdctx, "name", 4);
+    EVP_DigestUpdate(mdctx, e, sizeof(e));
+    EVP_DigestUpdate(mdctx, r->tls_ticket_key, r->tls_ticket_key_len);
+    EVP_DigestFinal_ex(mdctx, md, NULL);
+    memcpy(k->name, md, 16);
+    EVP_MD_CTX_free(mdctx);
+    OPENSSL_cleanse(md, sizeof(md));
+}
+
+static int tls_ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv, EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc)
+{
+    tac_realm *r = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+    int64_t epoch = (int64_t) io_now.tv_sec / r->tls_ticket_lifetime;
+    struct tls_ticket_keys k;
+    int res = 0;
+
+    if (enc) {
+	tls_ticket_keys(r, epoch, &k);
+	if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1
+	    || !EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, k.aes, iv))
+	    res = -1;
+	else {
+	    memcpy(key_name, k.name, sizeof(k.name));
+	    res = 1;
+	}
+    } else
+	// Tickets from the previous epoch are still accepted, but get renewed.
+	for (int i = 0; i < 2 && !res; i++) {
+	    tls_ticket_keys(r, epoch - i, &k);
+	    if (!memcmp(key_name, k.name, sizeof(k.name)))
+		res = EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, k.aes, iv) ? 1 + i : -1;
+	}
+
+    if (res > 0) {
+	OSSL_PARAM params[] = {
+	    OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, k.hmac, sizeof(k.hmac)),
+	    OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0),
+	    OSSL_PARAM_construct_end()
+	};
+	if (!EVP_MAC_CTX_set_params(hctx, params))
+	    res = -1;
+    }
+    OPENSSL_cleanse(&k, sizeof(k));
+    return res;
+}
+#endif
 
 static SSL_CTX *ssl_init(struct realm *r, int dtls, int use_tls_psk __attribute__((unused)))
 {
@@ -6103,6 +6733,20 @@ static SSL_CTX *ssl_init(struct realm *r, int dtls, int use_tls_psk __attribute_
 	    SSL_CTX_set_tlsext_servername_callback(ctx, sni_cb);
     }
     SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+#ifdef SSL_OP_ENABLE_KTLS
+    // OpenSSL falls back to user space if the kernel or cipher doesn't support kTLS
+    if (r->tls_ktls == TRISTATE_YES && !dtls)
+	SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+    if (r->tls_ticket_key && !dtls && !use_tls_psk) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000
+	SSL_CTX_set_app_data(ctx, r);
+	SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, tls_ticket_key_cb);
+	SSL_CTX_set_timeout(ctx, r->tls_ticket_lifetime);
+#else
+	report(NULL, LOG_ERR, ~0, "%s %d: realm %s: TLS session tickets require OpenSSL 3.0 or later", __func__, __LINE__, r->name.txt);
+#endif
+    }
 
     char *sslkeylogfile = getenv("SSLKEYLOGFILE");
     if (sslkeylogfile) {
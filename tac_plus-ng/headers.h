@@ -96,6 +96,7 @@
 #include "misc/rb.h"
 #include "misc/io_sched.h"
 #include "misc/sig_segv.h"
+#include "misc/mymd5.h"
 #include "misc/setproctitle.h"
 #include "misc/memops.h"
 #include "mavis/set_proctitle.h"
@@ -354,6 +355,12 @@ struct config {
     tac_realm *default_realm;	/* actually the one called "default" */
     uint32_t syslog_filter;
     int dscp;
+    int udp_batch;		/* max. number of datagrams per recvmmsg()/sendmmsg() */
+    int pwhash_threads;		/* password hash verification threads */
+    int pwhash_cache_size;	/* max. number of cached password verifications */
+    int pwhash_cache_timeout;
+    int ruleset_compile;	/* precompile rulesets at configuration time */
+    char *snapshot_dir;		/* directory for address file snapshots */
 };
 
 struct tac_acl {
@@ -368,6 +375,8 @@ struct tac_rule {
     struct tac_acl acl;
 };
 
+struct rule_index;
+struct rule_state;
 struct sni_list;
 
 struct realm {
@@ -397,6 +406,7 @@ struct realm {
     mavis_ctx *mcx;
     struct log_item *mavis_custom_attr[S_custom_3 - S_custom_0 + 1];
     struct tac_rule *rules;
+    struct rule_index *rule_index;	/* compiled ruleset */
     tac_host *default_host;
     struct {
 	BISTATE(complete);
@@ -412,6 +422,7 @@ struct realm {
 	TRISTATE(mavis_pap_prefetch);
 	TRISTATE(mavis_login_prefetch);
 	TRISTATE(mavis_mschap_prefetch);
+	TRISTATE(mavis_prefetch);	/* start INFO lookups as soon as the user name is known */
 	TRISTATE(script_profile_parent_first);
 	TRISTATE(script_host_parent_first);
 	TRISTATE(script_realm_parent_first);
@@ -431,6 +442,7 @@ struct realm {
 	TRISTATE(tls_accept_expired);
 	TRISTATE(tls_autodetect);
 	TRISTATE(tls_sni_required);
+	TRISTATE(tls_ktls);
 #endif
     } __attribute__((__packed__));
     int dns_caching_period;	/* dns caching period */
@@ -462,6 +474,9 @@ struct realm {
     rb_tree_t *fingerprints;
     char *tls_psk_hint;
     str_t crl_basedir;
+    u_char *tls_ticket_key;	/* session ticket secret, see tls_ticket_key_cb() */
+    size_t tls_ticket_key_len;
+    int tls_ticket_lifetime;
 #endif
     u_int debug;
     int rulecount;
@@ -599,6 +614,7 @@ struct tac_session {
 	BISTATE(flag_mavis_auth);
 	BISTATE(flag_chalresp);
 	BISTATE(mavis_pending);
+	BISTATE(mavis_prefetched);	/* speculative INFO lookup started */
 	BISTATE(revmap_pending);
 	BISTATE(revmap_timedout);
 	BISTATE(enable_getuser);
@@ -612,6 +628,9 @@ struct tac_session {
 	BISTATE(eval_log_raw);
     } __attribute__((__packed__));
     enum token mavisauth_res;
+    enum token pwhash_res;	/* result of asynchronous password hash verification */
+    struct pwdat *pwhash_pwdat;
+    void *pwhash_job;
     u_int authfail_delay;
     u_int debug;
     u_char seq_no;		/* seq. no. of last packet exchanged */
@@ -631,6 +650,12 @@ struct tac_session {
     u_long mavis_latency;
 };
 
+struct udp_peer {		/* sharded RADIUS/UDP, see udp_shard_dispatch() */
+    sockaddr_union peer;
+    sockaddr_union local;	/* address the requests were sent to */
+    struct context *ctx;
+};
+
 struct user_profile_cache {
     tac_user *user;
     tac_profile *profile;
@@ -669,6 +694,9 @@ struct context {
     union pak_hdr hdr;
     ssize_t hdroff;
     struct tac_key *key;
+    struct tac_key *md5_key;	/* key and session md5_mid is valid for */
+    int md5_session_id;
+    myMD5_CTX md5_mid;		/* MD5 state after session_id and key, see md5_xor() */
     time_t last_io;
     struct radius_data *radius_data;
 #ifdef WITH_SSL
@@ -687,20 +715,25 @@ struct context {
     size_t tls_peer_cert_san_count;
     BIO *rbio;
     struct fingerprint *fingerprint;
+    char *mavis_host_profile;	/* host profile returned by MAVIS, cached in session tickets */
+    time_t mavis_host_time;	/* time of the MAVIS host lookup */
 #endif
     u_int tls_versions;
 
     str_t *msgid;
     str_t *acct_type;
     str_t vrf;
+    struct udp_peer *udp_peer;	/* sharded RADIUS/UDP only, sock is shared with other peers */
 #define USER_PROFILE_CACHE_SIZE 8
     char *hint;
     struct user_profile_cache user_profile_cache[USER_PROFILE_CACHE_SIZE];
+    struct rule_state *rule_state;	/* per-connection ruleset condition cache */
     struct {
 #ifdef WITH_SSL
 	TRISTATE(alpn_passed);
 	BISTATE(sni_passed);
 	BISTATE(fingerprint_matched);
+	BISTATE(ktls);		/* kTLS in both directions, plain read(2)/write(2) */
 #endif
 	TRISTATE(cleanup_when_idle);	/* cleanup context when idle */
 	BISTATE(unencrypted_flag);	/* not MD5 encrypted? */
@@ -718,6 +751,9 @@ struct context {
 	BISTATE(rad_acct);
 	BISTATE(reset_tcp);
 	BISTATE(udp);
+	BISTATE(udp_shard);	/* not accounted for by spawnd */
+	BISTATE(batch_busy);	/* processing buffered packets, defer cleanup and cork output */
+	BISTATE(batch_cleanup);
 	BISTATE(radius_1_1);
 	BISTATE(use_tls_psk);
     } __attribute__((__packed__));
@@ -730,6 +766,13 @@ struct context {
     u_char *inject_buf;
     size_t inject_len;
     size_t inject_off;
+#define READ_AHEAD_SIZE 16384
+    u_char *rbuf;		/* TCP/TLS read-ahead buffer */
+    size_t rbuf_len;
+    size_t rbuf_off;
+#define WRITE_COALESCE_SIZE 16384	/* maximum TLS record size */
+    u_char *wbuf;		/* TLS output, coalesced into one record */
+    size_t wbuf_len;
     struct context *lru_prev;
     struct context *lru_next;
 };
@@ -797,6 +840,9 @@ void dump_rad_pak(tac_session *, rad_pak_hdr *);
 void authen(tac_session *, tac_pak_hdr *);
 void rad_authen(tac_session *);
 void authen_init(void);
+#ifdef WITH_PTHREAD
+void pwhash_cancel(tac_session *);
+#endif
 
 /* author.c */
 void author(tac_session *, tac_pak_hdr *);
@@ -833,18 +879,58 @@ static __inline__ int minimum(int a, int b)
 void tac_read(struct context *, int);
 void tac_write(struct context *, int);
 void rad_read(struct context *, int);
+void rad_read_udp(struct context *, int);
+void rad_read_udp_shard(struct context *, u_char *, size_t);
 
 int rad_get_password(tac_session * session, char **val, size_t *val_len);
 
 void rad_udp_inject(struct context *);
 ssize_t recv_inject(struct context *ctx, void *buf, size_t len, int flags, enum io_status *status);
 
+#ifndef MSG_WAITFORONE		/* no recvmmsg(2)/sendmmsg(2) */
+struct mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+#endif
+
+struct udp_batch_stats {
+    unsigned long long calls;
+    unsigned long long datagrams;
+#define UDP_BATCH_BUCKETS 8
+    unsigned long long bucket[UDP_BATCH_BUCKETS];	/* 1, 2-3, 4-7, ..., 128+ */
+};
+
+struct udp_batch {
+    int size;
+    u_char *buf;		/* size * INJECT_BUF_SIZE */
+    u_char *cbuf;		/* size * UDP_BATCH_CBUF_SIZE */
+#define UDP_BATCH_CBUF_SIZE 256
+    sockaddr_union *peer;
+    struct iovec *iov;
+    struct mmsghdr *msgs;
+};
+
+struct stream_io_stats {
+    unsigned long long calls;	/* recv(2)/SSL_read(3) or writev(2)/SSL_write(3) calls */
+    unsigned long long packets;
+};
+
+extern struct udp_batch_stats udp_batch_rx, udp_batch_tx;
+extern struct stream_io_stats read_ahead_rx, write_coalesce_tx;
+void udp_batch_account(struct udp_batch_stats *, int);
+int udp_batch_recv(struct udp_batch *, int);
+void io_stats_report(int);
+
 void cleanup_session(tac_session *);
 struct log_item *parse_log_format(struct sym *, mem_t *);
 
 void mavis_lookup(tac_session *, void (*)(tac_session *), const char *const, enum pw_ix);
+void mavis_prefetch(tac_session *, enum pw_ix);
+int mavis_prefetch_wait(tac_session *, void (*)(tac_session *));
 void mavis_dacl_lookup(tac_session *, void (*)(tac_session *), const char *const);
 void mavis_ctx_lookup(struct context *, void (*)(struct context *), const char *const);
+int mavis_host_profile(struct context *, char *);
 tac_user *lookup_user(tac_session *);
 mavis_ctx *lookup_mcx(tac_realm *);
 tac_realm *lookup_realm(char *, tac_realm *);
@@ -41,6 +41,7 @@
 #include "misc/version.h"
 #include <sys/resource.h>
 #include <signal.h>
+#include <poll.h>
 #include <netinet/tcp.h>
 #include "misc/buffer.h"
 #include "misc/strops.h"
@@ -74,15 +75,22 @@ static void die(int signum)
 int die_when_idle = 0;
 static struct context *ctx_spawnd = NULL;
 
+struct udp_shard;
+static struct udp_shard *udp_shards = NULL;
+static rb_tree_t *udp_peers = NULL;
+static void udp_shard_close(void);
+
 static void cleanup_spawnd(struct context *ctx __attribute__((unused)), int cur __attribute__((unused)))
 {
     if (ctx_spawnd) {
 	io_close(ctx->io, ctx_spawnd->sock);
 	ctx_spawnd = NULL;
     }
+    udp_shard_close();
 
     if (common_data.users_cur == 0 /*&& logs_flushed(config.default_realm) FIXME */ ) {
 	drop_mcx(config.default_realm);
+	io_stats_report(LOG_INFO);
 	if (!(common_data.debug & DEBUG_TACTRACE_FLAG))
 	    report(NULL, LOG_INFO, ~0, "Exiting.");
 	tac_exit(EX_OK);
@@ -136,6 +144,8 @@ struct scm_data_accept_ext {
     tac_realm *realm;
     size_t vrf_len;
     char vrf[IFNAMSIZ + 1];
+    int shard;			/* received via a sharded UDP socket */
+    struct udp_peer *udp_peer;	/* sharded UDP: peer and local address */
     union {
 	struct scm_data_accept sd;
 	struct scm_data_udp sd_udp;
@@ -210,6 +220,12 @@ static void users_inc(void)
     set_proctitle(die_when_idle ? ACCEPT_NEVER : ACCEPT_YES);
 }
 
+static void users_dec_shard(void)
+{
+    common_data.users_cur--;
+    set_proctitle(die_when_idle ? ACCEPT_NEVER : ACCEPT_YES);
+}
+
 void users_dec(void)
 {
     static int pending = 0;
@@ -293,6 +309,7 @@ static void periodics(struct context *ctx, int cur __attribute__((unused)))
 
     expire_dynamic_users(config.default_realm);
     expire_dynamic_acls(config.default_realm);
+    io_stats_report(LOG_DEBUG);
 
 #ifdef WITH_DNS
     expire_dns(config.default_realm);
@@ -339,6 +356,68 @@ static void accept_control_tls(struct context *, int);
 #endif
 static void setup_signals(void);
 
+/*
+ * Preloaded instance ("fork = yes" in spawnd configuration): The
+ * configuration has been parsed once, and servers are forked on spawnd's
+ * request, sharing it copy-on-write. Returns in the forked server, with
+ * its spawnd channel on file descriptor 0.
+ */
+static void zygote(void)
+{
+    time_t parsed = io_now.tv_sec;
+    struct scm_data sd = {.type = SCM_FORK,.count = (int) getpid() };
+
+    if (common_data.scm_send_msg(0, &sd, -1))
+	tac_exit(EX_OSERR);
+
+    while (1) {
+	struct scm_data_accept sda;
+	struct pollfd pfd = {.fd = 0,.events = POLLIN };
+	int fd = -1;
+
+	process_signals();
+	if (die_when_idle)
+	    tac_exit(EX_OK);
+
+	// spawnd terminating isn't signalled on datagram sockets, but sending fails
+	if (!poll(&pfd, 1, common_data.cleanup_interval * 1000)) {
+	    struct scm_data sdk = {.type = SCM_KEEPALIVE };
+	    if (common_data.scm_send_msg(0, &sdk, -1))
+		tac_exit(EX_OK);
+	    continue;
+	}
+
+	if (common_data.scm_recv_msg(0, &sda, sizeof(sda), &fd))
+	    tac_exit(EX_OK);
+
+	if (sda.type != SCM_FORK || fd < 0) {
+	    if (fd > -1)
+		close(fd);
+	    if (sda.type == SCM_MAY_DIE)
+		tac_exit(EX_OK);
+	    continue;
+	}
+
+	switch (fork()) {
+	case 0:
+	    dup2(fd, 0);
+	    close(fd);
+	    common_data.pid = getpid();
+	    io_reinit(common_data.io);
+	    gettimeofday(&io_now, NULL);
+	    if (config.suicide)
+		config.suicide += io_now.tv_sec - parsed;
+	    sd.count = (int) common_data.pid;
+	    common_data.scm_send_msg(0, &sd, -1);
+	    return;
+	case -1:
+	    report(NULL, LOG_ERR, ~0, "fork: %s", strerror(errno));
+	default:
+	    close(fd);
+	}
+    }
+}
+
 int main(int argc, char **argv, char **envp)
 {
     scm_main(argc, argv, envp);
@@ -379,6 +458,8 @@ int main(int argc, char **argv, char **envp)
 	common_data.scm_udpdata = accept_control_udp_singleprocess;
     } else {
 	setproctitle_init(argv, envp);
+	if (common_data.zygote)
+	    zygote();
 	ctx_spawnd = new_context(common_data.io, NULL);
 	ctx_spawnd->sock = dup(0);
 	dup2(2, 0);
@@ -419,6 +500,11 @@ void update_bio(struct context *ctx)
 
 void cleanup(struct context *ctx, int cur __attribute__((unused)))
 {
+    if (ctx->batch_busy) {
+	// tac_read()/rad_read()/rad_read_udp() will call us again once the batch is done
+	ctx->batch_cleanup = BISTATE_YES;
+	return;
+    }
 #ifdef WITH_SSL
     if (ctx->tls) {
 	update_bio(ctx);
@@ -474,7 +560,16 @@ static str_t msgid_ ## A = { .txt = B, .len = sizeof(B) - 1 }
 	    mavis_cancel(mcx, ctx);
     }
 
-    users_dec();
+    if (ctx->udp_peer) {
+	rb_node_t *rbn = RB_search(udp_peers, ctx->udp_peer);
+	if (rbn)
+	    RB_delete(udp_peers, rbn);
+    }
+
+    if (ctx->udp_shard)
+	users_dec_shard();
+    else
+	users_dec();
     context_lru_remove(ctx);
     mem_destroy(ctx->mem);
 
@@ -688,6 +783,102 @@ void complete_host(tac_host *);
 #if defined(WITH_SSL)
 static int query_mavis_host(struct context *, void (*)(struct context *));
 
+/*
+ * Session tickets (see tls_ticket_key_cb() in config.c) are issued once the host is
+ * known. With TLS 1.3, they carry the MAVIS host lookup result: version, lookup time,
+ * then device address, host name and MAVIS host profile, each NUL-terminated.
+ */
+#define TLS_TICKET_APPDATA_VERSION 1
+#define TLS_TICKET_APPDATA_HDR 9
+
+static void tls_ticket_issue(struct context *ctx)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000
+    if (ctx->udp || !SSL_CTX_get_app_data(SSL_get_SSL_CTX(ctx->tls)) || SSL_version(ctx->tls) != TLS1_3_VERSION)
+	return;
+    if (ctx->mavis_host_time && ctx->mavis_result == S_permit) {
+	// a MAVIS host profile results in a dynamic host, derived from the one the lookup was for
+	tac_host *h = (ctx->mavis_host_profile && ctx->host->parent) ? ctx->host->parent : ctx->host;
+	char *profile = ctx->mavis_host_profile ? ctx->mavis_host_profile : "";
+	size_t profile_len = strlen(profile);
+	size_t len = TLS_TICKET_APPDATA_HDR + ctx->device_addr_ascii.len + 1 + h->name.len + 1 + profile_len + 1;
+	u_char buf[len];
+	u_char *p = buf;
+	int64_t t = (int64_t) ctx->mavis_host_time;
+	*p++ = TLS_TICKET_APPDATA_VERSION;
+	memcpy(p, &t, sizeof(t));
+	p += sizeof(t);
+	memcpy(p, ctx->device_addr_ascii.txt, ctx->device_addr_ascii.len + 1);
+	p += ctx->device_addr_ascii.len + 1;
+	memcpy(p, h->name.txt, h->name.len + 1);
+	p += h->name.len + 1;
+	memcpy(p, profile, profile_len + 1);
+	SSL_SESSION_set1_ticket_appdata(SSL_get_session(ctx->tls), buf, len);
+    }
+    SSL_new_session_ticket(ctx->tls);
+#endif
+}
+
+// Returns 1 if the resumed session carries a MAVIS host lookup result that is still valid.
+static int tls_ticket_resume(struct context *ctx)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000
+    tac_realm *r = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ctx->tls));
+    void *data = NULL;
+    size_t len = 0;
+    if (!r || !SSL_session_reused(ctx->tls) || !SSL_SESSION_get0_ticket_appdata(SSL_get_session(ctx->tls), &data, &len))
+	return 0;
+
+    char *buf = data, *end = buf + len;
+    int64_t t;
+    if (len < TLS_TICKET_APPDATA_HDR + 3 || buf[0] != TLS_TICKET_APPDATA_VERSION || buf[len - 1])
+	return 0;
+    memcpy(&t, buf + 1, sizeof(t));
+    if (t + r->tls_ticket_lifetime < io_now.tv_sec)
+	return 0;
+
+    char *addr = buf + TLS_TICKET_APPDATA_HDR;
+    char *name = addr + strlen(addr) + 1;
+    if (name >= end)
+	return 0;
+    char *profile = name + strlen(name) + 1;
+    if (profile >= end || strcmp(addr, ctx->device_addr_ascii.txt) || strcmp(name, ctx->host->name.txt))
+	return 0;
+    profile = *profile ? mem_strdup(ctx->mem, profile) : NULL;
+    if (profile && mavis_host_profile(ctx, profile))
+	return 0;
+
+    ctx->mavis_tried = 1;
+    ctx->mavis_result = S_permit;
+    ctx->mavis_host_profile = profile;
+    ctx->mavis_host_time = (time_t) t;
+    tac_session session = {.ctx = ctx };
+    report(&session, LOG_INFO_MAVIS, ~0, "result for host %s is %s [TLS session ticket]", ctx->device_addr_ascii.txt, AV_V_RESULT_OK);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * With kTLS in both directions, packets are read and written with plain read(2)/write(2).
+ * This requires that OpenSSL has nothing pending, including a session ticket from
+ * tls_ticket_issue(). Non-data records fail with EIO and are passed on to OpenSSL,
+ * see read_ahead() in packet.c.
+ */
+static void tls_ktls_check(struct context *ctx)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+    if (ctx->udp || !BIO_get_ktls_send(SSL_get_wbio(ctx->tls)) || !BIO_get_ktls_recv(SSL_get_rbio(ctx->tls)))
+	return;
+    if (SSL_do_handshake(ctx->tls) != 1 || SSL_has_pending(ctx->tls))
+	return;
+    ctx->ktls = BISTATE_YES;
+    tac_session session = {.ctx = ctx };
+    report(&session, LOG_DEBUG, DEBUG_NET_FLAG, "kTLS enabled (%s, %s)", SSL_get_version(ctx->tls), SSL_get_cipher(ctx->tls));
+#endif
+}
+
 static void complete_host_mavis_tls(struct context *ctx)
 {
     if (query_mavis_host(ctx, complete_host_mavis_tls))
@@ -698,6 +889,8 @@ static void complete_host_mavis_tls(struct context *ctx)
 	reject_conn(ctx, ctx->hint, __func__, __LINE__);
 	return;
     }
+    tls_ticket_issue(ctx);
+    tls_ktls_check(ctx);
     accept_control_final(ctx);
 }
 
@@ -1200,10 +1393,13 @@ static void accept_control_tls(struct context *ctx, int cur)
     if (ctx->host) {
 	complete_host(ctx->host);
 	if (ctx->host && (ctx->host->try_mavis == TRISTATE_YES)) {
-	    ctx->mavis_tried = 0;
+	    ctx->mavis_tried = tls_ticket_resume(ctx);
 	    complete_host_mavis_tls(ctx);
 	    return;
 	}
+	ctx->mavis_host_time = 0;
+	tls_ticket_issue(ctx);
+	tls_ktls_check(ctx);
 	accept_control_final(ctx);
 	return;
     }
@@ -1447,7 +1643,9 @@ static int cert_verify(struct context *ctx)
     }
     if (ctx->host->tls_peer_cert_validation == S_cert || ctx->host->tls_peer_cert_validation == S_any) {
 	char *reason = NULL;
-	if (X509_verify_cert_post_handshake(ctx->tls, ctx->mem, &reason) == 1) {
+	// A resumed session doesn't carry the peer's chain, but the verification result from the full handshake.
+	if ((SSL_session_reused(ctx->tls) && SSL_get_verify_result(ctx->tls) == X509_V_OK)
+	    || X509_verify_cert_post_handshake(ctx->tls, ctx->mem, &reason) == 1) {
 	    X509_free(cert);
 	    return 1;
 	}
@@ -1587,7 +1785,9 @@ static void set_ctx_info(struct context *ctx, struct scm_data_accept_ext *sd_ext
 {
     sockaddr_union me = { 0 };
     socklen_t me_len = (socklen_t) sizeof(me);
-    if (!getsockname(ctx->sock, &me.sa, &me_len)) {
+    if (ctx->udp_peer)
+	me = ctx->udp_peer->local;
+    if (ctx->udp_peer || !getsockname(ctx->sock, &me.sa, &me_len)) {
 	char buf[256];
 	su_convert(&me, AF_INET);
 	snprintf(buf, 10, "%u", su_get_port(&me));
@@ -1607,12 +1807,17 @@ static void accept_control_common(int s, struct scm_data_accept_ext *sd_ext, soc
     sockaddr_union peer = { 0 };
     socklen_t peer_len = (socklen_t) sizeof(peer);
 
-    if (getpeername(s, &peer.sa, &peer_len)) {
+    if (sd_ext->udp_peer)
+	peer = sd_ext->udp_peer->peer;
+    else if (getpeername(s, &peer.sa, &peer_len)) {
 	// error path
 	report(NULL, LOG_DEBUG, DEBUG_PACKET_FLAG, "getpeername: %s", strerror(errno));
 	io_close(common_data.io, s);
 
-	users_dec();
+	if (sd_ext->shard)
+	    users_dec_shard();
+	else
+	    users_dec();
 
 	if (ctx_spawnd && die_when_idle)
 	    cleanup_spawnd(ctx_spawnd, -1);
@@ -1654,8 +1859,15 @@ static void accept_control_common(int s, struct scm_data_accept_ext *sd_ext, soc
 	}
     }
     ctx->rad_acct = (sd_ext->sd.flags & SCM_FLAG_RADACCT) ? BISTATE_YES : BISTATE_NO;
+    ctx->udp_shard = sd_ext->shard ? BISTATE_YES : BISTATE_NO;
     ctx->sock = s;
     io_register(ctx->io, ctx->sock, ctx);
+    if (sd_ext->udp_peer) {
+	ctx->udp_peer = mem_alloc(ctx->mem, sizeof(struct udp_peer));
+	*ctx->udp_peer = *sd_ext->udp_peer;
+	ctx->udp_peer->ctx = ctx;
+	RB_insert(udp_peers, ctx->udp_peer);
+    }
 
     context_lru_append(ctx);
     ctx->tls_versions = sd_ext->sd.tls_versions;
@@ -1730,7 +1942,8 @@ static void complete_host_mavis(struct context *ctx)
     io_set_cb_h(ctx->io, ctx->sock, (void *) cleanup);
     io_set_cb_e(ctx->io, ctx->sock, (void *) cleanup);
     io_sched_add(ctx->io, ctx, (void *) periodics_ctx, 60, 0);
-    io_set_i(ctx->io, ctx->sock);
+    if (!ctx->udp_peer)
+	io_set_i(ctx->io, ctx->sock);
     if (ctx->udp)
 	accept_control_check_tls(ctx, ctx->sock);
 #else
@@ -1738,8 +1951,94 @@ static void complete_host_mavis(struct context *ctx)
 #endif
 }
 
+struct udp_batch_stats udp_batch_rx = { 0 }, udp_batch_tx = { 0 };
+struct stream_io_stats read_ahead_rx = { 0 }, write_coalesce_tx = { 0 };
+
+void udp_batch_account(struct udp_batch_stats *st, int n)
+{
+    int i = 0;
+    st->calls++;
+    st->datagrams += n;
+    while ((n >>= 1) && i < UDP_BATCH_BUCKETS - 1)
+	i++;
+    st->bucket[i]++;
+}
+
+static char *udp_batch_stats_str(struct udp_batch_stats *st, char *buf, size_t buf_len)
+{
+    int l = snprintf(buf, buf_len, "%llu datagrams in %llu calls [", st->datagrams, st->calls);
+    for (int i = 0; i < UDP_BATCH_BUCKETS && l > 0 && (size_t) l < buf_len; i++)
+	l += snprintf(buf + l, buf_len - l, "%s%d%s: %llu", i ? " " : "", 1 << i, (i == UDP_BATCH_BUCKETS - 1) ? "+" : "", st->bucket[i]);
+    if (l > 0 && (size_t) l < buf_len)
+	snprintf(buf + l, buf_len - l, "]");
+    return buf;
+}
+
+void io_stats_report(int priority)
+{
+    static unsigned long long last = 0, last_reads = 0, last_writes = 0;
+    if (udp_batch_rx.calls + udp_batch_tx.calls != last) {
+	last = udp_batch_rx.calls + udp_batch_tx.calls;
+	char rx[256], tx[256];
+	report(NULL, priority, DEBUG_NET_FLAG, "UDP batches received: %s, sent: %s",
+	       udp_batch_stats_str(&udp_batch_rx, rx, sizeof(rx)), udp_batch_stats_str(&udp_batch_tx, tx, sizeof(tx)));
+    }
+    if (read_ahead_rx.calls != last_reads) {
+	last_reads = read_ahead_rx.calls;
+	report(NULL, priority, DEBUG_NET_FLAG, "TCP/TLS read-ahead: %llu packets in %llu reads", read_ahead_rx.packets, read_ahead_rx.calls);
+    }
+    if (write_coalesce_tx.calls != last_writes) {
+	last_writes = write_coalesce_tx.calls;
+	report(NULL, priority, DEBUG_NET_FLAG, "TCP/TLS output: %llu packets in %llu writes", write_coalesce_tx.packets, write_coalesce_tx.calls);
+    }
+}
+
+/*
+ * Receive up to "udp batch size" datagrams with a single system call. Returns
+ * the number of datagrams, or -1 with errno set.
+ */
+int udp_batch_recv(struct udp_batch *b, int s)
+{
+    if (b->size != config.udp_batch) {
+	b->size = config.udp_batch;
+	b->buf = realloc(b->buf, b->size * INJECT_BUF_SIZE);
+	b->cbuf = realloc(b->cbuf, b->size * UDP_BATCH_CBUF_SIZE);
+	b->peer = realloc(b->peer, b->size * sizeof(sockaddr_union));
+	b->iov = realloc(b->iov, b->size * sizeof(struct iovec));
+	b->msgs = realloc(b->msgs, b->size * sizeof(struct mmsghdr));
+    }
+    for (int i = 0; i < b->size; i++) {
+	b->iov[i].iov_base = b->buf + i * INJECT_BUF_SIZE;
+	b->iov[i].iov_len = INJECT_BUF_SIZE;
+	memset(&b->msgs[i], 0, sizeof(struct mmsghdr));
+	b->msgs[i].msg_hdr.msg_name = &b->peer[i];
+	b->msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_union);
+	b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+	b->msgs[i].msg_hdr.msg_iovlen = 1;
+	b->msgs[i].msg_hdr.msg_control = (caddr_t) (b->cbuf + i * UDP_BATCH_CBUF_SIZE);
+	b->msgs[i].msg_hdr.msg_controllen = UDP_BATCH_CBUF_SIZE;
+    }
+#ifdef MSG_WAITFORONE
+    int n = recvmmsg(s, b->msgs, b->size, MSG_DONTWAIT, NULL);
+#else
+    ssize_t len = recvmsg(s, &b->msgs[0].msg_hdr, MSG_DONTWAIT);
+    int n = (len < 0) ? -1 : 1;
+    if (n > 0)
+	b->msgs[0].msg_len = (unsigned int) len;
+#endif
+    if (n > 0)
+	udp_batch_account(&udp_batch_rx, n);
+    return n;
+}
+
 ssize_t recv_inject(struct context *ctx, void *buf, size_t len, int flags, enum io_status *status)
 {
+    if (ctx->udp_peer && !ctx->inject_len) {
+	// the socket is shared, datagrams are read by udp_shard_read() only
+	if (status)
+	    *status = io_status_retry;
+	return 0;
+    }
     if (ctx->inject_buf && !ctx->inject_len) {
 	ssize_t l = recv(ctx->sock, ctx->inject_buf, INJECT_BUF_SIZE, 0);
 	if (l > -1)
@@ -1904,7 +2203,7 @@ static void accept_control_check_tls(struct context *ctx, int cur __attribute__(
 {
     u_char tmp[6];
     if (recv_inject(ctx, tmp, sizeof(tmp), MSG_PEEK, NULL) == (ssize_t) sizeof(tmp)) {
-	if (ctx->udp && tmp[0] == 0x17 && tmp[1] == 0xfe && dtls_ver_ok(ctx->tls_versions, tmp[2])) {
+	if (ctx->udp && !ctx->udp_peer && tmp[0] == 0x17 && tmp[1] == 0xfe && dtls_ver_ok(ctx->tls_versions, tmp[2])) {
 	    // DTLS Application Data, but we haven't seen the handshake, possibly due to a daemon
 	    // restart. Just return some junk data back , the peer is likely to retry with a new handshake.
 	    char junk[128] = { 0 };
@@ -1914,7 +2213,7 @@ static void accept_control_check_tls(struct context *ctx, int cur __attribute__(
 	}
 	if (ctx->realm->tls_autodetect == TRISTATE_YES && tmp[0] == 0x16) {
 	    if (ctx->udp)
-		ctx->use_dtls = (tmp[1] == 0xfe && dtls_ver_ok(ctx->tls_versions, tmp[2])) ? BISTATE_YES : BISTATE_NO;
+		ctx->use_dtls = (!ctx->udp_peer && tmp[1] == 0xfe && dtls_ver_ok(ctx->tls_versions, tmp[2])) ? BISTATE_YES : BISTATE_NO;
 	    else
 		ctx->use_tls = (tmp[1] == 0x03 && tmp[2] == 0x01 && tmp[5] == 1) ? BISTATE_YES : BISTATE_NO;
 	}
@@ -1998,7 +2297,15 @@ static void accept_control_check_tls_final(struct context *ctx)
 	    }
 	    SSL_set_min_proto_version(ctx->tls, ver);
 	    SSL_set_fd(ctx->tls, ctx->sock);
-	    SSL_set_session_id_context(ctx->tls, (const unsigned char *) &ctx, sizeof(ctx));
+	    if (SSL_CTX_get_app_data(SSL_get_SSL_CTX(ctx->tls))) {
+		// session tickets are enabled, see ssl_init()
+		u_char sid_ctx[MD5_LEN];
+		struct iovec iov[1] = { {.iov_base = ctx->realm->name.txt,.iov_len = ctx->realm->name.len } };
+		md5v(sid_ctx, MD5_LEN, iov, 1);
+		SSL_set_session_id_context(ctx->tls, sid_ctx, MD5_LEN);
+	    } else
+		SSL_set_session_id_context(ctx->tls, (const unsigned char *) &ctx, sizeof(ctx));
+	    // TLS 1.3 tickets are sent by tls_ticket_issue() once the host is known
 	    SSL_set_num_tickets(ctx->tls, 0);
 
 	    if (!ctx->use_tls_psk) {
@@ -2063,7 +2370,8 @@ static void accept_control_final(struct context *ctx)
     io_set_cb_o(ctx->io, ctx->sock, (void *) tac_write);
     io_set_cb_h(ctx->io, ctx->sock, (void *) cleanup);
     io_set_cb_e(ctx->io, ctx->sock, (void *) cleanup);
-    io_set_i(ctx->io, ctx->sock);
+    if (!ctx->udp_peer)
+	io_set_i(ctx->io, ctx->sock);
     io_sched_add(ctx->io, ctx, (void *) periodics_ctx, 60, 0);
     if (config.retire && (++count == config.retire) && !common_data.singleprocess) {
 	report(&session, LOG_INFO, ~0, "Retire limit reached. Told parent about this.");
@@ -2080,6 +2388,129 @@ static void accept_control_final(struct context *ctx)
     tac_read(ctx, ctx->sock);
 }
 
+/*
+ * Sharded UDP listeners: spawnd hands out a SO_REUSEPORT socket per listener
+ * to each server process and the kernel distributes the datagrams, so spawnd
+ * is neither involved in nor aware of these requests. Each peer gets a
+ * context of its own. Its socket is a duplicate of the shared one that is
+ * used for replies only, see udp_peer_msghdr(), while input is read here and
+ * passed on by peer address.
+ */
+struct udp_shard {
+    int sock;
+    struct scm_data_accept_ext sd_ext;
+    struct udp_shard *next;
+};
+
+static int compare_udp_peer(const void *a, const void *b)
+{
+    int r = su_cmp(&((struct udp_peer *) a)->peer, &((struct udp_peer *) b)->peer);
+    return r ? r : su_cmp(&((struct udp_peer *) a)->local, &((struct udp_peer *) b)->local);
+}
+
+static void udp_shard_close(void)
+{
+    while (udp_shards) {
+	struct udp_shard *u = udp_shards;
+	udp_shards = u->next;
+	io_close(common_data.io, u->sock);
+	free(u);
+    }
+    // The peer contexts keep the sockets in the reuseport group, so they have to go, too.
+    while (udp_peers && !RB_empty(udp_peers)) {
+	struct udp_peer *p = RB_payload(RB_first(udp_peers), struct udp_peer *);
+	RB_delete(udp_peers, RB_first(udp_peers));
+	cleanup(p->ctx, p->ctx->sock);
+    }
+}
+
+static void udp_shard_dispatch(struct udp_shard *u, int cur, struct msghdr *msg, size_t len)
+{
+    u_char *buf = msg->msg_iov->iov_base;
+    struct udp_peer key = { 0 };
+    memcpy(&key.peer, msg->msg_name, msg->msg_namelen);
+
+    if (len < sizeof(rad_pak_hdr) || len != ntohs(((rad_pak_hdr *) buf)->length))
+	return;
+
+    socklen_t local_len = (socklen_t) sizeof(key.local);
+    if (getsockname(cur, &key.local.sa, &local_len))
+	return;
+
+    for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+#ifdef IP_PKTINFO
+	if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO && key.local.sa.sa_family == AF_INET) {
+	    memcpy(&key.local.sin.sin_addr, &((struct in_pktinfo *) CMSG_DATA(cmsg))->ipi_addr, 4);
+	    break;
+	}
+#ifdef AF_INET6
+	if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO && key.local.sa.sa_family == AF_INET6) {
+	    // IPv4 datagram on a dual-stack socket
+	    memset(&key.local.sin6.sin6_addr, 0, 10);
+	    memset((u_char *) &key.local.sin6.sin6_addr + 10, 0xff, 2);
+	    memcpy((u_char *) &key.local.sin6.sin6_addr + 12, &((struct in_pktinfo *) CMSG_DATA(cmsg))->ipi_addr, 4);
+	    break;
+	}
+#endif
+#endif
+#ifdef IPV6_PKTINFO
+	if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO && key.local.sa.sa_family == AF_INET6) {
+	    memcpy(&key.local.sin6.sin6_addr, &((struct in6_pktinfo *) CMSG_DATA(cmsg))->ipi6_addr, 16);
+	    break;
+	}
+#endif
+    }
+
+    rb_node_t *rbn = RB_search(udp_peers, &key);
+    if (rbn) {
+	rad_read_udp_shard(RB_payload(rbn, struct udp_peer *)->ctx, buf, len);
+	return;
+    }
+
+    int s = dup(cur);
+    if (s < 0)
+	return;
+
+    struct scm_data_accept_ext sd_ext = u->sd_ext;
+    sd_ext.udp_peer = &key;
+    users_inc();
+    accept_control_common(s, &sd_ext, NULL, buf, len);
+}
+
+static void udp_shard_read(struct udp_shard *u, int cur)
+{
+    static struct udp_batch b = { 0 };
+    int n = udp_batch_recv(&b, cur);
+
+    if (!rad_dict_initialized())
+	return;
+
+    for (int i = 0; i < n && !die_when_idle; i++)
+	udp_shard_dispatch(u, cur, &b.msgs[i].msg_hdr, b.msgs[i].msg_len);
+}
+
+static void udp_shard_add(int s, struct scm_data_accept *sd)
+{
+    struct udp_shard *u = calloc(1, sizeof(struct udp_shard));
+    u->sock = s;
+    memcpy(&u->sd_ext.sd, sd, sizeof(struct scm_data_accept));
+    u->sd_ext.sd.type = SCM_UDPDATA;
+    u->sd_ext.shard = 1;
+    set_sd_realm(s, &u->sd_ext);
+    u->next = udp_shards;
+    udp_shards = u;
+    if (!udp_peers)
+	udp_peers = RB_tree_new(compare_udp_peer, NULL);
+
+    fcntl(s, F_SETFD, FD_CLOEXEC);
+    fcntl(s, F_SETFL, O_NONBLOCK);
+    io_register(common_data.io, s, u);
+    io_set_cb_i(common_data.io, s, (void *) udp_shard_read);
+    io_set_cb_h(common_data.io, s, (void *) udp_shard_read);
+    io_set_cb_e(common_data.io, s, (void *) udp_shard_read);
+    io_set_i(common_data.io, s);
+}
+
 static void accept_control(struct context *ctx, int cur)
 {
     int s = -1;
@@ -2137,6 +2568,11 @@ static void accept_control(struct context *ctx, int cur)
 	else
 	    accept_control_raw(s, &sd_ext);
 	return;
+    case SCM_UDPSHARD:
+	if (s > -1 && !die_when_idle) {
+	    udp_shard_add(s, &u.sd);
+	    return;
+	}
     default:
 	if (s > -1)
 	    close(s);
@@ -47,6 +47,7 @@ struct mavis_data {
     enum pw_ix pw_ix;
     void (*mavisfn)(tac_session *);
     struct timeval start;
+    char *prefetch_user;
 };
 
 struct mavis_ctx_data {
@@ -130,6 +131,9 @@ void mavis_lookup(tac_session *session, void (*f)(tac_session *), const char *co
 	return;
     }
 
+    if (mavis_prefetch_wait(session, f))
+	return;
+
     if (session->mavis_pending)
 	return;
 
@@ -224,6 +228,57 @@ void mavis_lookup(tac_session *session, void (*f)(tac_session *), const char *co
     }
 }
 
+static void mavis_prefetch_done(tac_session *session __attribute__((unused)))
+{
+    // The result is kept in the session until the authentication code asks for it.
+}
+
+/*
+ * Speculative INFO lookup, started as soon as the user name is known for
+ * authentication types that look the user up before the password anyway. The
+ * session continues meanwhile, and whatever needs the result first waits for
+ * it by calling mavis_prefetch_wait().
+ */
+void mavis_prefetch(tac_session *session, enum pw_ix pw_ix)
+{
+    tac_realm *r = session->ctx->realm;
+
+    if ((r->mavis_prefetch != TRISTATE_YES) || (r->mavis_userdb != TRISTATE_YES) || session->flag_mavis_info || session->mavis_pending
+	|| !session->username.len || !lookup_mcx(r) || lookup_user(session))
+	return;
+
+    report(session, LOG_DEBUG, DEBUG_MAVIS_FLAG, "prefetching user %s", session->username.txt);
+    session->flag_mavis_info = 1;
+    mavis_lookup(session, mavis_prefetch_done, AV_V_TACTYPE_INFO, pw_ix);
+    if (session->mavis_data) {
+	session->mavis_data->prefetch_user = mem_strdup(session->mem, session->username.txt);
+	session->mavis_prefetched = 1;
+    }
+}
+
+// Returns 1 if a prefetch is still pending. f will be called once it finishes.
+int mavis_prefetch_wait(tac_session *session, void (*f)(tac_session *))
+{
+    if (!session->mavis_prefetched)
+	return 0;
+    if (session->mavis_pending) {
+	session->mavis_data->mavisfn = f;
+	return 1;
+    }
+    session->mavis_prefetched = 0;
+    if (strcmp(session->mavis_data->prefetch_user, session->username.txt)) {
+	// The user name was rewritten meanwhile, so the result is of no use.
+	report(session, LOG_DEBUG, DEBUG_MAVIS_FLAG, "discarding prefetched user %s", session->mavis_data->prefetch_user);
+	if (session->user && session->user_is_session_specific)
+	    free_user(session->user);
+	session->user = NULL;
+	session->user_is_session_specific = 0;
+	session->mavisauth_res = S_unknown;
+	session->flag_mavis_info = 0;
+    }
+    return 0;
+}
+
 static int parse_user_profile_multi(av_ctx *avc, struct sym *sym, tac_user *u, char *format, int attribute)
 {
     int res = 0;
@@ -511,6 +566,9 @@ void mavis_ctx_lookup(struct context *ctx, void (*f)(struct context *), const ch
     ctx->mavis_data->mavisfn = f;
     ctx->mavis_data->mavistype = type;
     ctx->mavis_data->start = io_now;
+#if defined(WITH_SSL)
+    ctx->mavis_host_time = 0;
+#endif
 
     av_ctx *avc = av_new((void *) mavis_ctx_callback, (void *) ctx);
     av_set(avc, AV_A_TYPE, AV_V_TYPE_TACPLUS);
@@ -660,6 +718,25 @@ void mavis_ctx_lookup(struct context *ctx, void (*f)(struct context *), const ch
     }
 }
 
+// Derives a dynamic host from ctx->host and a MAVIS host profile.
+int mavis_host_profile(struct context *ctx, char *profile)
+{
+    tac_host *h = mem_alloc(ctx->mem, sizeof(tac_host));
+    h->mem = ctx->mem;
+    init_host(h, ctx->host, ctx->realm, 0);
+
+    struct sym sym = {.filename = ctx->device_addr_ascii.txt,.line = 1,.flag_prohibit_include = 1 };
+    sym.in = sym.tin = profile;
+    sym.len = sym.tlen = strlen(profile);
+    if (parse_host_profile(&sym, ctx->realm, h))
+	return -1;
+    if (!h->name.txt)
+	h->name = ctx->host->name;
+    complete_host(h);
+    ctx->host = h;
+    return 0;
+}
+
 static void mavis_ctx_lookup_final(struct context *ctx, av_ctx *avc)
 {
     char *t, *result = NULL;
@@ -672,23 +749,13 @@ static void mavis_ctx_lookup_final(struct context *ctx, av_ctx *avc)
 	(result = av_get(avc, AV_A_RESULT)) && !strcmp(result, AV_V_RESULT_OK)) {
 
 	char *profile = av_get(avc, AV_A_TACPROFILE);
-	if (profile) {
-	    tac_host *h = mem_alloc(ctx->mem, sizeof(tac_host));
-	    h->mem = ctx->mem;
-	    init_host(h, ctx->host, ctx->realm, 0);
-
-	    struct sym sym = {.filename = ctx->device_addr_ascii.txt,.line = 1,.flag_prohibit_include = 1 };
-	    sym.in = sym.tin = profile;
-	    sym.len = sym.tlen = strlen(profile);
-	    if (!parse_host_profile(&sym, ctx->realm, h)) {
-		if (!h->name.txt)
-		    h->name = ctx->host->name;
-		complete_host(h);
-		ctx->host = h;
-		ctx->mavis_result = S_permit;
-	    }
-	} else
+	if (!profile || !mavis_host_profile(ctx, profile)) {
 	    ctx->mavis_result = S_permit;
+#ifdef WITH_SSL
+	    ctx->mavis_host_profile = profile ? mem_strdup(ctx->mem, profile) : NULL;
+	    ctx->mavis_host_time = io_now.tv_sec;
+#endif
+	}
     }
     if (result) {
 	ctx->mavis_latency = timediff(&ctx->mavis_data->start);
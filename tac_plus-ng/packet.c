@@ -68,27 +68,39 @@ static const char rcsid[] __attribute__((used)) = "$Id$";
 static void write_packet(struct context *, tac_pak *);
 static tac_session *new_session(struct context *, tac_pak_hdr *, rad_pak_hdr *);
 
-static void md5_xor(tac_pak_hdr *hdr, char *key, int keylen)
+/*
+ * The pad is MD5(session_id, key, version, seq_no[, previous hash]) per 16
+ * bytes. The state after session_id and key is cached in the context, and the
+ * state after version and seq_no is reused for every block of the packet.
+ */
+static void md5_xor(struct context *ctx, tac_pak_hdr *hdr, struct tac_key *key)
 {
-    if (key && *key) {
+    if (key && *key->key) {
 	u_char *data = tac_payload(hdr, u_char *);
-	int data_len = ntohl(hdr->datalength), h = 0;
-	u_char hash[MD5_LEN][2];
+	int data_len = ntohl(hdr->datalength);
+	u_char hash[MD5_LEN];
+	myMD5_CTX base, md5;
+
+	if (ctx->md5_key != key || ctx->md5_session_id != hdr->session_id) {
+	    myMD5Init(&ctx->md5_mid);
+	    myMD5Update(&ctx->md5_mid, &hdr->session_id, sizeof(hdr->session_id));
+	    myMD5Update(&ctx->md5_mid, key->key, key->len);
+	    ctx->md5_key = key;
+	    ctx->md5_session_id = hdr->session_id;
+	}
+	base = ctx->md5_mid;
+	myMD5Update(&base, &hdr->version, sizeof(hdr->version));
+	myMD5Update(&base, &hdr->seq_no, sizeof(hdr->seq_no));
 
 	for (int i = 0; i < data_len; i += 16) {
 	    int min = minimum(data_len - i, 16);
-	    struct iovec iov[5] = {
-		{.iov_base = &hdr->session_id,.iov_len = sizeof(hdr->session_id) },
-		{.iov_base = key,.iov_len = keylen },
-		{.iov_base = &hdr->version,.iov_len = sizeof(hdr->version) },
-		{.iov_base = &hdr->seq_no,.iov_len = sizeof(hdr->seq_no) },
-		{.iov_base = hash[h ^ 1],.iov_len = MD5_LEN }
-	    };
-	    md5v(hash[h], MD5_LEN, iov, i ? 5 : 4);
+	    md5 = base;
+	    if (i)
+		myMD5Update(&md5, hash, MD5_LEN);
+	    myMD5Final(hash, &md5);
 
 	    for (int j = 0; j < min; j++)
-		data[i + j] ^= hash[h][j];
-	    h ^= 1;
+		data[i + j] ^= hash[j];
 	}
 	hdr->flags ^= TAC_PLUS_UNENCRYPTED_FLAG;
     }
@@ -345,6 +357,21 @@ static void set_response_authenticator(tac_session *session, rad_pak_hdr *pak)
     md5v(pak->authenticator, MD5_LEN, iov, 4);
 }
 
+/*
+ * Queue a packet for output. While a batch of buffered input is processed
+ * the output is corked, and read_loop() flushes it once the batch is done.
+ * Otherwise, tac_write() is called as soon as the socket is writable.
+ */
+static void queue_packet(struct context *ctx, tac_pak *p)
+{
+    tac_pak **pp;
+    for (pp = &ctx->out; *pp; pp = &(*pp)->next);
+    *pp = p;
+
+    if (!ctx->batch_busy)
+	io_set_o(ctx->io, ctx->sock);
+}
+
 static void rad_send_reply(tac_session *session, u_char status)
 {
     tac_pak *pak = new_rad_pak(session, status);
@@ -354,12 +381,8 @@ static void rad_send_reply(tac_session *session, u_char status)
 
     if (session->authfail_delay && !(common_data.debug & DEBUG_TACTRACE_FLAG) && session->ctx->udp)
 	delay_packet(session->ctx, (tac_pak *) pak, session->authfail_delay);
-    else {
-	tac_pak **pp;
-	for (pp = &session->ctx->out; *pp; pp = &(*pp)->next);
-	*pp = (tac_pak *) pak;
-	io_set_o(session->ctx->io, session->ctx->sock);
-    }
+    else
+	queue_packet(session->ctx, (tac_pak *) pak);
     if (status != RADIUS_CODE_ACCESS_CHALLENGE)
 	cleanup_session(session);
 }
@@ -450,13 +473,9 @@ static void write_packet(struct context *ctx, tac_pak *p)
 
     /* encrypt the data portion */
     if (!ctx->unencrypted_flag && ctx->key)
-	md5_xor(&p->pak.tac, ctx->key->key, ctx->key->len);
-
-    tac_pak **pp;
-    for (pp = &ctx->out; *pp; pp = &(*pp)->next);
-    *pp = p;
+	md5_xor(ctx, &p->pak.tac, ctx->key);
 
-    io_set_o(ctx->io, ctx->sock);
+    queue_packet(ctx, p);
 }
 
 static int authen_pak_looks_bogus(struct context *ctx)
@@ -532,7 +551,58 @@ static int check_status(struct context *ctx, enum io_status status)
     }
 }
 
-void tac_read(struct context *ctx, int cur)
+/*
+ * TCP and TLS input goes through a per-context read-ahead buffer: a single
+ * recv(2) or SSL_read(3) pulls in whatever is available, and header and body
+ * reads are served from that buffer. Pipelined packets thus don't cost
+ * additional system calls. UDP and DTLS are datagram based and bypass this.
+ */
+static ssize_t read_ahead(struct context *ctx, void *buf, size_t len, int cur, void *cb, enum io_status *status)
+{
+    *status = io_status_ok;
+    if (ctx->udp) {
+#ifdef WITH_SSL
+	update_bio(ctx);
+	if (ctx->tls)
+	    return io_SSL_read_ex(ctx->tls, buf, len, ctx->io, cur, cb, status);
+#endif
+	return recv_inject(ctx, buf, len, 0, status);
+    }
+
+    if (ctx->rbuf_off == ctx->rbuf_len) {
+	ssize_t l;
+	if (!ctx->rbuf)
+	    ctx->rbuf = mem_alloc(ctx->mem, READ_AHEAD_SIZE);
+	ctx->rbuf_off = ctx->rbuf_len = 0;
+#ifdef WITH_SSL
+	if (ctx->tls && !ctx->ktls)
+	    l = io_SSL_read_ex(ctx->tls, ctx->rbuf, READ_AHEAD_SIZE, ctx->io, cur, cb, status);
+	else
+#endif
+	    l = recv_inject(ctx, ctx->rbuf, READ_AHEAD_SIZE, 0, status);
+#ifdef WITH_SSL
+	// kTLS refuses to return alerts or handshake records to plain reads, OpenSSL takes over from here.
+	if (ctx->ktls && *status == io_status_error && errno == EIO) {
+	    ctx->ktls = BISTATE_NO;
+	    l = io_SSL_read_ex(ctx->tls, ctx->rbuf, READ_AHEAD_SIZE, ctx->io, cur, cb, status);
+	}
+#endif
+	read_ahead_rx.calls++;
+	if (*status != io_status_ok || l < 1)
+	    return 0;
+	ctx->rbuf_len = (size_t) l;
+    }
+
+    if (len > ctx->rbuf_len - ctx->rbuf_off)
+	len = ctx->rbuf_len - ctx->rbuf_off;
+    memcpy(buf, ctx->rbuf + ctx->rbuf_off, len);
+    ctx->rbuf_off += len;
+    return (ssize_t) len;
+}
+
+static void rad_read_pak(struct context *, int);
+
+static void tac_read_pak(struct context *ctx, int cur)
 {
     ssize_t len;
     int detached = 0;
@@ -541,14 +611,8 @@ void tac_read(struct context *ctx, int cur)
     context_lru_append(ctx);
 
     if (ctx->hdroff != TAC_PLUS_HDR_SIZE) {
-	enum io_status status = io_status_ok;
-#ifdef WITH_SSL
-	update_bio(ctx);
-	if (ctx->tls)
-	    len = io_SSL_read_ex(ctx->tls, &ctx->hdr.uchar + ctx->hdroff, TAC_PLUS_HDR_SIZE - ctx->hdroff, ctx->io, cur, (void *) tac_read, &status);
-	else
-#endif
-	    len = recv_inject(ctx, &ctx->hdr.uchar + ctx->hdroff, TAC_PLUS_HDR_SIZE - ctx->hdroff, 0, &status);
+	enum io_status status;
+	len = read_ahead(ctx, &ctx->hdr.uchar + ctx->hdroff, TAC_PLUS_HDR_SIZE - ctx->hdroff, cur, (void *) tac_read, &status);
 
 	if (check_status(ctx, status))
 	    return;
@@ -631,8 +695,15 @@ void tac_read(struct context *ctx, int cur)
 	if (ctx->key && !ctx->key->next)
 	    ctx->key_fixed = BISTATE_YES;
 
-	io_set_cb_i(ctx->io, ctx->sock, (void *) rad_read);
-	rad_read(ctx, ctx->sock);
+	if (ctx->udp
+#ifdef WITH_SSL
+	    && !ctx->tls
+#endif
+	    )
+	    io_set_cb_i(ctx->io, ctx->sock, (void *) rad_read_udp);
+	else
+	    io_set_cb_i(ctx->io, ctx->sock, (void *) rad_read);
+	rad_read_pak(ctx, ctx->sock);
 	return;
     }
 
@@ -686,14 +757,8 @@ void tac_read(struct context *ctx, int cur)
 	ctx->in->length = TAC_PLUS_HDR_SIZE + data_len;
 	memcpy(&ctx->in->pak.tac, &ctx->hdr, TAC_PLUS_HDR_SIZE);
     }
-    enum io_status status = io_status_ok;
-#ifdef WITH_SSL
-    update_bio(ctx);
-    if (ctx->tls)
-	len = io_SSL_read_ex(ctx->tls, &ctx->in->pak.uchar + ctx->in->offset, ctx->in->length - ctx->in->offset, ctx->io, cur, (void *) tac_read, &status);
-    else
-#endif
-	len = recv_inject(ctx, &ctx->in->pak.uchar + ctx->in->offset, ctx->in->length - ctx->in->offset, 0, &status);
+    enum io_status status;
+    len = read_ahead(ctx, &ctx->in->pak.uchar + ctx->in->offset, ctx->in->length - ctx->in->offset, cur, (void *) tac_read, &status);
 
     if (check_status(ctx, status))
 	return;
@@ -701,6 +766,7 @@ void tac_read(struct context *ctx, int cur)
     ctx->in->offset += len;
     if (ctx->in->offset != ctx->in->length)
 	return;
+    read_ahead_rx.packets++;
 
     tac_session *session = RB_lookup_session(ctx->sessions, ctx->hdr.tac.session_id);
 
@@ -793,12 +859,12 @@ void tac_read(struct context *ctx, int cur)
 
 	if (!ctx->unencrypted_flag) {
 	    if (more_keys) {
-		md5_xor(&ctx->in->pak.tac, ctx->key->key, ctx->key->len);
+		md5_xor(ctx, &ctx->in->pak.tac, ctx->key);
 		ctx->key = ctx->key->next;
 		more_keys = 0;
 	    }
 	    if (ctx->key)
-		md5_xor(&ctx->in->pak.tac, ctx->key->key, ctx->key->len);
+		md5_xor(ctx, &ctx->in->pak.tac, ctx->key);
 	}
 
 	switch (ctx->hdr.tac.type) {
@@ -997,7 +1063,7 @@ static void rad_set_fields(tac_session *session)
     }
 }
 
-void rad_read(struct context *ctx, int cur)
+static void rad_read_pak(struct context *ctx, int cur)
 {
     ssize_t len;
     int detached = 0;
@@ -1006,14 +1072,8 @@ void rad_read(struct context *ctx, int cur)
     context_lru_append(ctx);
 
     if (ctx->hdroff != RADIUS_HDR_SIZE) {
-	enum io_status status = io_status_ok;
-#ifdef WITH_SSL
-	update_bio(ctx);
-	if (ctx->tls)
-	    len = io_SSL_read_ex(ctx->tls, &ctx->hdr.uchar + ctx->hdroff, RADIUS_HDR_SIZE - ctx->hdroff, ctx->io, cur, (void *) rad_read, &status);
-	else
-#endif
-	    len = recv_inject(ctx, &ctx->hdr.uchar + ctx->hdroff, RADIUS_HDR_SIZE - ctx->hdroff, 0, &status);
+	enum io_status status;
+	len = read_ahead(ctx, &ctx->hdr.uchar + ctx->hdroff, RADIUS_HDR_SIZE - ctx->hdroff, cur, (void *) rad_read, &status);
 
 	if (check_status(ctx, status))
 	    return;
@@ -1046,14 +1106,8 @@ void rad_read(struct context *ctx, int cur)
 	ctx->in->length = RADIUS_HDR_SIZE + data_len;
 	memcpy(&ctx->in->pak.rad, &ctx->hdr, RADIUS_HDR_SIZE);
     }
-    enum io_status status = io_status_ok;
-#ifdef WITH_SSL
-    update_bio(ctx);
-    if (ctx->tls)
-	len = io_SSL_read_ex(ctx->tls, &ctx->in->pak.uchar + ctx->in->offset, ctx->in->length - ctx->in->offset, ctx->io, cur, (void *) rad_read, &status);
-    else
-#endif
-	len = recv_inject(ctx, &ctx->in->pak.uchar + ctx->in->offset, ctx->in->length - ctx->in->offset, 0, &status);
+    enum io_status status;
+    len = read_ahead(ctx, &ctx->in->pak.uchar + ctx->in->offset, ctx->in->length - ctx->in->offset, cur, (void *) rad_read, &status);
 
     if (check_status(ctx, status))
 	return;
@@ -1061,6 +1115,8 @@ void rad_read(struct context *ctx, int cur)
     ctx->in->offset += len;
     if (ctx->in->offset != ctx->in->length)
 	return;
+    if (!ctx->udp)
+	read_ahead_rx.packets++;
 
     rad_pak_hdr *pak = &ctx->in->pak.rad;
 
@@ -1122,12 +1178,219 @@ void rad_read(struct context *ctx, int cur)
     ctx->hdroff = 0;
 }
 
-static ssize_t write_ex(int fd, const void *buf, size_t count, enum io_status *status)
+static int read_pending(struct context *ctx)
+{
+    if (ctx->rbuf_off < ctx->rbuf_len)
+	return -1;
+#ifdef WITH_SSL
+    if (ctx->tls && SSL_pending(ctx->tls) > 0)
+	return -1;
+#endif
+    return 0;
+}
+
+/*
+ * Process packets until the read-ahead buffer is drained. The socket won't
+ * become readable again for data that's already buffered. Cleanup is
+ * deferred until the loop is done, and replies are written in one go.
+ */
+static void read_loop(struct context *ctx, int cur)
+{
+    ctx->batch_busy = BISTATE_YES;
+    do {
+	size_t off = ctx->rbuf_off, len = ctx->rbuf_len;
+	int pending = 0;
+#ifdef WITH_SSL
+	if (ctx->tls)
+	    pending = SSL_pending(ctx->tls);
+#endif
+	switch (ctx->aaa_protocol) {
+	case S_radius_tcp:
+	case S_radius_tls:
+	case S_radius_udp:
+	case S_radius_dtls:
+	    rad_read_pak(ctx, cur);
+	    break;
+	default:
+	    tac_read_pak(ctx, cur);
+	}
+	// stop if nothing was consumed, e.g. for a silently ignored RADIUS/TLS packet
+	if (off == ctx->rbuf_off && len == ctx->rbuf_len
+#ifdef WITH_SSL
+	    && (!ctx->tls || pending == SSL_pending(ctx->tls))
+#endif
+	    )
+	    break;
+    } while (!ctx->batch_cleanup && read_pending(ctx));
+    ctx->batch_busy = BISTATE_NO;
+
+    if (ctx->batch_cleanup)
+	cleanup(ctx, cur);
+    else if (ctx->out)
+	tac_write(ctx, cur);
+}
+
+void tac_read(struct context *ctx, int cur)
 {
-    ssize_t len = write(fd, buf, count);
+    read_loop(ctx, cur);
+}
+
+void rad_read(struct context *ctx, int cur)
+{
+    read_loop(ctx, cur);
+}
+
+/*
+ * Plain RADIUS/UDP: drain the socket with recvmmsg(2) and feed the datagrams
+ * to rad_read_pak() one by one. Cleanup is deferred until the batch is done.
+ */
+void rad_read_udp(struct context *ctx, int cur)
+{
+    static struct udp_batch b = { 0 };
+    int n = udp_batch_recv(&b, cur);
+
+    if (n < 1) {
+	// let rad_read_pak() sort out errors
+	rad_read_pak(ctx, cur);
+	return;
+    }
+
+    ctx->batch_busy = BISTATE_YES;
+    for (int i = 0; i < n && !ctx->batch_cleanup; i++) {
+	memcpy(ctx->inject_buf, b.iov[i].iov_base, b.msgs[i].msg_len);
+	ctx->inject_len = b.msgs[i].msg_len;
+	ctx->inject_off = 0;
+	rad_read_pak(ctx, cur);
+    }
+    ctx->batch_busy = BISTATE_NO;
+
+    if (ctx->batch_cleanup)
+	cleanup(ctx, cur);
+    else if (ctx->out)
+	tac_write(ctx, cur);
+}
+
+/*
+ * Sharded RADIUS/UDP: udp_shard_read() receives the datagrams on the shared
+ * socket and hands them to the peer's context here. A datagram that arrives
+ * while the previous one is still waiting to be processed is dropped, the
+ * client will retransmit.
+ */
+void rad_read_udp_shard(struct context *ctx, u_char *buf, size_t len)
+{
+    if (ctx->inject_len || len > INJECT_BUF_SIZE)
+	return;
+
+    ctx->batch_busy = BISTATE_YES;
+    memcpy(ctx->inject_buf, buf, len);
+    ctx->inject_len = len;
+    ctx->inject_off = 0;
+    rad_read_pak(ctx, ctx->sock);
+    ctx->batch_busy = BISTATE_NO;
+
+    if (ctx->batch_cleanup)
+	cleanup(ctx, ctx->sock);
+    else if (ctx->out)
+	tac_write(ctx, ctx->sock);
+}
+
+#define UDP_PEER_CBUF_SIZE 64
+
+/*
+ * The socket of a sharded RADIUS/UDP context isn't connected, so replies are
+ * addressed explicitly and sent from the address the request came in on. If
+ * that isn't known, the kernel picks one.
+ */
+static void udp_peer_msghdr(struct context *ctx, struct msghdr *msg, u_char *cbuf)
+{
+    struct udp_peer *p = ctx->udp_peer;
+
+    msg->msg_name = &p->peer;
+    msg->msg_namelen = su_len(&p->peer);
+    msg->msg_control = NULL;
+    msg->msg_controllen = 0;
+    memset(cbuf, 0, UDP_PEER_CBUF_SIZE);
+#ifdef IP_PKTINFO
+    if (p->local.sa.sa_family == AF_INET && p->local.sin.sin_addr.s_addr != INADDR_ANY) {
+	msg->msg_control = (caddr_t) cbuf;
+	msg->msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+	cmsg->cmsg_level = IPPROTO_IP;
+	cmsg->cmsg_type = IP_PKTINFO;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+	((struct in_pktinfo *) CMSG_DATA(cmsg))->ipi_spec_dst = p->local.sin.sin_addr;
+    }
+#endif
+#ifdef IPV6_PKTINFO
+    if (p->local.sa.sa_family == AF_INET6 && !IN6_IS_ADDR_UNSPECIFIED(&p->local.sin6.sin6_addr)) {
+	msg->msg_control = (caddr_t) cbuf;
+	msg->msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo));
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+	cmsg->cmsg_level = IPPROTO_IPV6;
+	cmsg->cmsg_type = IPV6_PKTINFO;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
+	((struct in6_pktinfo *) CMSG_DATA(cmsg))->ipi6_addr = p->local.sin6.sin6_addr;
+    }
+#endif
+}
+
+#ifdef MSG_WAITFORONE
+/*
+ * Send all queued RADIUS/UDP replies with as few sendmmsg(2) calls as possible.
+ * Anything left is handled by the regular write path.
+ */
+static void rad_write_udp(struct context *ctx, int cur)
+{
+    while (ctx->out && ctx->out->next) {
+	struct mmsghdr msgs[config.udp_batch];
+	struct iovec iov[config.udp_batch];
+	u_char cbuf[ctx->udp_peer ? config.udp_batch : 1][UDP_PEER_CBUF_SIZE];
+	int n = 0;
+
+	for (tac_pak * p = ctx->out; p && n < config.udp_batch; p = p->next, n++) {
+	    iov[n].iov_base = &p->pak.uchar + p->offset;
+	    iov[n].iov_len = p->length - p->offset;
+	    memset(&msgs[n], 0, sizeof(struct mmsghdr));
+	    msgs[n].msg_hdr.msg_iov = &iov[n];
+	    msgs[n].msg_hdr.msg_iovlen = 1;
+	    if (ctx->udp_peer)
+		udp_peer_msghdr(ctx, &msgs[n].msg_hdr, cbuf[n]);
+	}
+
+	n = sendmmsg(cur, msgs, n, MSG_DONTWAIT);
+	if (n < 1)
+	    return;
+	udp_batch_account(&udp_batch_tx, n);
+
+	while (n--) {
+	    tac_pak *next = ctx->out->next;
+	    mem_free(ctx->mem, &ctx->out);
+	    ctx->out = next;
+	}
+    }
+}
+#endif
+
+static ssize_t writev_ex(int fd, const struct iovec *iov, int iovcnt, enum io_status *status)
+{
+    ssize_t len = writev(fd, iov, iovcnt);
     if (len == 0)
 	*status = io_status_close;
-    else if (len < -1) {
+    else if (len < 0) {
+	if (errno == EAGAIN || errno == EWOULDBLOCK) {
+	    len = 0;
+	    *status = io_status_retry;
+	} else
+	    *status = io_status_error;
+    } else
+	*status = io_status_ok;
+    return len;
+}
+
+static ssize_t sendmsg_ex(int fd, const struct msghdr *msg, enum io_status *status)
+{
+    ssize_t len = sendmsg(fd, msg, 0);
+    if (len < 0) {
 	if (errno == EAGAIN || errno == EWOULDBLOCK) {
 	    len = 0;
 	    *status = io_status_retry;
@@ -1138,30 +1401,118 @@ static ssize_t write_ex(int fd, const void *buf, size_t count, enum io_status *s
     return len;
 }
 
+#define WRITEV_MAX 64
+
+/*
+ * Plain TCP and kTLS: hand as much of the output queue as possible to a
+ * single writev(2). Datagrams are written one at a time.
+ */
+static ssize_t write_out(struct context *ctx, int cur, enum io_status *status)
+{
+    struct iovec iov[WRITEV_MAX];
+    int n = 0, max = ctx->udp ? 1 : WRITEV_MAX;
+
+    for (tac_pak * p = ctx->out; p && n < max; p = p->next, n++) {
+	iov[n].iov_base = &p->pak.uchar + p->offset;
+	iov[n].iov_len = p->length - p->offset;
+    }
+    if (ctx->udp_peer) {
+	u_char cbuf[UDP_PEER_CBUF_SIZE];
+	struct msghdr msg = {.msg_iov = iov,.msg_iovlen = n };
+	udp_peer_msghdr(ctx, &msg, cbuf);
+	return sendmsg_ex(cur, &msg, status);
+    }
+    return writev_ex(cur, iov, n, status);
+}
+
+#ifdef WITH_SSL
+/*
+ * TLS: copy queued packets to the coalescing buffer and send them as a single
+ * record. The buffer is only refilled after a successful write, as SSL_write(3)
+ * needs to be retried with the same arguments. Packets that don't fit, and
+ * DTLS packets, are written directly.
+ */
+static ssize_t tls_write_out(struct context *ctx, int cur, enum io_status *status)
+{
+    if (!ctx->udp && !ctx->wbuf_len && ctx->out->length - ctx->out->offset <= WRITE_COALESCE_SIZE) {
+	if (!ctx->wbuf)
+	    ctx->wbuf = mem_alloc(ctx->mem, WRITE_COALESCE_SIZE);
+	for (tac_pak * p = ctx->out; p && ctx->wbuf_len + p->length - p->offset <= WRITE_COALESCE_SIZE; p = p->next) {
+	    memcpy(ctx->wbuf + ctx->wbuf_len, &p->pak.uchar + p->offset, p->length - p->offset);
+	    ctx->wbuf_len += p->length - p->offset;
+	}
+    }
+    if (!ctx->wbuf_len)
+	return io_SSL_write_ex(ctx->tls, &ctx->out->pak.uchar + ctx->out->offset, ctx->out->length - ctx->out->offset, ctx->io, cur,
+			       (void *) tac_write, status);
+
+    ssize_t len = io_SSL_write_ex(ctx->tls, ctx->wbuf, ctx->wbuf_len, ctx->io, cur, (void *) tac_write, status);
+    if (*status == io_status_ok)
+	ctx->wbuf_len = 0;
+    return len;
+}
+#endif
+
+// Advance the output queue by len bytes, releasing completed packets.
+static void output_consumed(struct context *ctx, size_t len)
+{
+    while (len) {
+	size_t l = ctx->out->length - ctx->out->offset;
+	if (l > len) {
+	    ctx->out->offset += len;
+	    return;
+	}
+	len -= l;
+	tac_pak *n = ctx->out->next;
+	mem_free(ctx->mem, &ctx->out);
+	ctx->out = n;
+	write_coalesce_tx.packets++;
+    }
+}
+
 void tac_write(struct context *ctx, int cur)
 {
     ctx->last_io = io_now.tv_sec;
     context_lru_append(ctx);
+    int plain_udp = ctx->udp
+#ifdef WITH_SSL
+	&& !ctx->tls
+#endif
+	;
+#ifdef MSG_WAITFORONE
+    if (plain_udp && config.udp_batch > 1)
+	rad_write_udp(ctx, cur);
+#endif
     while (ctx->out) {
 	ssize_t len;
 	enum io_status status = io_status_ok;
 #ifdef WITH_SSL
-	if (ctx->tls)
-	    len =
-		io_SSL_write_ex(ctx->tls, &ctx->out->pak.uchar + ctx->out->offset, ctx->out->length - ctx->out->offset, ctx->io, cur, (void *) tac_write,
-				&status);
+	if (ctx->tls && !ctx->ktls)
+	    len = tls_write_out(ctx, cur, &status);
 	else
 #endif
-	    len = write_ex(cur, &ctx->out->pak.uchar + ctx->out->offset, ctx->out->length - ctx->out->offset, &status);
+	    len = write_out(ctx, cur, &status);
 
+	if (status == io_status_retry) {
+	    // we may have been called directly at the end of a read batch
+	    io_set_o(ctx->io, cur);
+	    return;
+	}
 	if (check_status(ctx, status))
 	    return;
 
-	ctx->out->offset += len;
-	if (ctx->out->offset == ctx->out->length) {
-	    tac_pak *n = ctx->out->next;
-	    mem_free(ctx->mem, &ctx->out);
-	    ctx->out = n;
+	if (ctx->udp) {
+	    ctx->out->offset += len;
+	    if (ctx->out->offset == ctx->out->length) {
+		if (plain_udp)
+		    udp_batch_account(&udp_batch_tx, 1);
+		tac_pak *n = ctx->out->next;
+		mem_free(ctx->mem, &ctx->out);
+		ctx->out = n;
+	    }
+	} else {
+	    write_coalesce_tx.calls++;
+	    output_consumed(ctx, (size_t) len);
 	}
     }
     io_clr_o(ctx->io, cur);
@@ -1187,7 +1538,7 @@ static tac_session *new_session(struct context *ctx, tac_pak_hdr *tac_hdr, rad_p
     session->ctx = ctx;
     session->host = ctx->host;
     session->debug = ctx->debug;
-    session->mem = mem_create(M_LIST);
+    session->mem = mem_create(M_ARENA);
     if (tac_hdr) {
 	session->version = tac_hdr->version;
 	session->session_id = tac_hdr->session_id;
@@ -1249,6 +1600,10 @@ void cleanup_session(tac_session *session)
 
     if (session->mavis_pending && mcx)
 	mavis_cancel(mcx, session);
+#ifdef WITH_PTHREAD
+    if (session->pwhash_job)
+	pwhash_cancel(session);
+#endif
     mem_destroy(session->mem);
     mem_free(ctx->mem, &session);
     if ((ctx->cleanup_when_idle == TRISTATE_YES)
@@ -0,0 +1,209 @@
+#!/usr/bin/perl -w
+#
+# tac_rulebench.pl
+#
+# Compares authorization throughput of tac_plus-ng with compiled
+# ("ruleset compile = yes") and interpreted ("ruleset compile = no")
+# rulesets. By default a configuration with a large number of rules is
+# generated; alternatively an existing configuration can be used, in which
+# case the "ruleset compile" directive is injected into its tac_plus-ng
+# section.
+#
+
+use strict;
+use POSIX;
+use Socket;
+use IO::Socket::INET;
+use Digest::MD5 qw(md5);
+use Time::HiRes qw(time sleep);
+use File::Temp qw(tempdir);
+use Getopt::Long;
+
+our $exec = "/usr/local/sbin/tac_plus-ng";
+our $config = undef;
+our $id = "tac_plus-ng";
+our $port = 4949;
+our $key = "demo";
+our $username = "demo";
+our $rules = 500;
+our $requests = 20000;
+our $mode = "both";
+
+sub help {
+	print <<EOT
+Usage: $0 [ <Options> ]
+
+Options:
+  --help		show this text
+  --exec=<path>		tac_plus-ng binary [$exec]
+  --config=<file>	use existing configuration instead of a generated one
+  --id=<id>		tac_plus-ng section id [$id]
+  --port=<port>		TCP port tac_plus-ng is listening on [$port]
+  --key=<key>		TACACS+ key [$key]
+  --username=<user>	user name for authorization requests [$username]
+  --rules=<n>		number of rules in generated configuration [$rules]
+  --requests=<n>	number of authorization requests per run [$requests]
+  --mode=<mode>		compiled, interpreted or both [$mode]
+
+The generated configuration puts the only matching rule last, so the
+interpreter needs to evaluate all other rules for every request.
+EOT
+	;
+	exit(0);
+}
+
+GetOptions(
+	"help"		=> \&help,
+	"exec=s"	=> \$exec,
+	"config=s"	=> \$config,
+	"id=s"		=> \$id,
+	"port=i"	=> \$port,
+	"key=s"		=> \$key,
+	"username=s"	=> \$username,
+	"rules=i"	=> \$rules,
+	"requests=i"	=> \$requests,
+	"mode=s"	=> \$mode,
+) or help();
+
+my $dir = tempdir(CLEANUP => 1);
+
+sub generated_config {
+	my $c = <<EOT
+id = spawnd {
+	background = no
+	single process = yes
+	listen { address = 127.0.0.1 port = $port }
+}
+
+id = $id {
+	host world {
+		address = 0.0.0.0/0
+		key = $key
+	}
+	group admin
+	profile admin {
+		script { permit }
+	}
+	user $username {
+		password login = clear $username
+		member = admin
+	}
+	ruleset {
+EOT
+	;
+	for (my $i = 0; $i < $rules; $i++) {
+		my $net = sprintf("10.%d.%d.0/24", $i / 256, $i % 256);
+		$c .= <<EOT
+		rule r$i {
+			script {
+				if (device.address == $net && member == admin) {
+					profile = admin
+					permit
+				}
+			}
+		}
+EOT
+		;
+	}
+	$c .= <<EOT
+		rule localhost {
+			script {
+				if (device.address == 127.0.0.1 && member == admin) {
+					profile = admin
+					permit
+				}
+			}
+		}
+	}
+}
+EOT
+	;
+	return $c;
+}
+
+sub write_config {
+	my $compile = shift;
+	my $c;
+	if (defined $config) {
+		open(F, "<", $config) or die "$config: $!\n";
+		$c = join("", <F>);
+		close F;
+	} else {
+		$c = generated_config();
+	}
+	$c =~ s/(id\s*=\s*\Q$id\E\s*\{)/$1\n\truleset compile = $compile\n/ or die "no section $id\n";
+	my $file = "$dir/tac_plus-ng-$compile.cfg";
+	open(F, ">", $file) or die "$file: $!\n";
+	print F $c;
+	close F;
+	return $file;
+}
+
+sub crypt_body {
+	my ($session_id, $version, $seq, $body) = @_;
+	my $pad = "";
+	my $prev = "";
+	while (length($pad) < length($body)) {
+		$prev = md5(pack("N", $session_id) . $key . pack("CC", $version, $seq) . $prev);
+		$pad .= $prev;
+	}
+	return $body ^ substr($pad, 0, length($body));
+}
+
+sub author {
+	my $sock = shift;
+	my $session_id = int(rand(0xffffffff));
+	my $version = 0xc0;
+	my $tty = "tty" . int(rand(1000000));
+	my @args = ("service=shell", "cmd=");
+	my $body = pack("CCCCCCCC", 6, 1, 1, 1, length($username), length($tty), length("127.0.0.1"), scalar(@args));
+	$body .= pack("C", length($_)) foreach (@args);
+	$body .= $username . $tty . "127.0.0.1" . join("", @args);
+	$sock->syswrite(pack("CCCCNN", $version, 2, 1, 4, $session_id, length($body)) . crypt_body($session_id, $version, 1, $body));
+
+	my $hdr = "";
+	while (length($hdr) < 12) {
+		$sock->sysread($hdr, 12 - length($hdr), length($hdr)) or die "connection closed\n";
+	}
+	my ($v, $t, $seq, $flags, $sid, $len) = unpack("CCCCNN", $hdr);
+	my $reply = "";
+	while (length($reply) < $len) {
+		$sock->sysread($reply, $len - length($reply), length($reply)) or die "connection closed\n";
+	}
+	$reply = crypt_body($sid, $v, $seq, $reply);
+	return unpack("C", $reply);
+}
+
+sub run {
+	my $compile = shift;
+	my $file = write_config($compile);
+	my $pid = fork();
+	die "fork: $!\n" unless defined $pid;
+	if (!$pid) {
+		open(STDOUT, ">", "/dev/null");
+		open(STDERR, ">", "/dev/null");
+		exec($exec, $file) or POSIX::_exit(1);
+	}
+	my $sock;
+	for (my $i = 0; $i < 50 && !$sock; $i++) {
+		sleep(0.1);
+		$sock = IO::Socket::INET->new(PeerAddr => "127.0.0.1", PeerPort => $port, Proto => "tcp");
+	}
+	die "Can't connect to port $port\n" unless $sock;
+
+	my $pass = 0;
+	my $start = time();
+	for (my $i = 0; $i < $requests; $i++) {
+		my $status = author($sock);
+		$pass++ if $status == 1 || $status == 2;
+	}
+	my $elapsed = time() - $start;
+	close $sock;
+	kill('TERM', $pid);
+	waitpid($pid, 0);
+	printf("%-12s %d requests, %d passed, %.3f s, %.0f requests/s\n", $compile eq "yes" ? "compiled" : "interpreted",
+		$requests, $pass, $elapsed, $requests / $elapsed);
+}
+
+run("no") if $mode eq "interpreted" || $mode eq "both";
+run("yes") if $mode eq "compiled" || $mode eq "both";
@@ -583,7 +583,7 @@ static tac_session *new_session(struct context *ctx, tac_pak_hdr * hdr)
     tac_session *session = mem_alloc(ctx->mem, sizeof(tac_session));
     session->ctx = ctx;
     session->debug = ctx->debug;
-    session->mem = mem_create(M_LIST);
+    session->mem = mem_create(M_ARENA);
     session->version = hdr->version;
     session->session_id = hdr->session_id;
     session->seq_no = 1;
@@ -35,6 +35,17 @@ void aaa_free(struct aaa *aaa)
     free(aaa);
 }
 
+static void aaa_clear_iv(struct aaa *aaa)
+{
+    for (int i = 0; i < aaa->ic; i++)
+	if (aaa->iv[i].iov_base) {
+	    free(aaa->iv[i].iov_base);
+	    aaa->iv[i].iov_base = NULL;
+	    aaa->iv[i].iov_len = 0;
+	}
+    aaa->ic = 0;
+}
+
 void aaa_clear(struct aaa *aaa)
 {
     for (int i = 0; i < aaa->oc; i++)
@@ -43,14 +54,8 @@ void aaa_clear(struct aaa *aaa)
 	    aaa->ov[i].iov_base = NULL;
 	    aaa->ov[i].iov_len = 0;
 	}
-    for (int i = 0; i < aaa->ic; i++)
-	if (aaa->iv[i].iov_base) {
-	    free(aaa->iv[i].iov_base);
-	    aaa->iv[i].iov_base = NULL;
-	    aaa->iv[i].iov_len = 0;
-	}
     aaa->oc = 0;
-    aaa->ic = 0;
+    aaa_clear_iv(aaa);
 }
 
 static __inline__ int minimum(int a, int b)
@@ -285,22 +290,21 @@ static int aaa_authc_tacacs(struct aaa *aaa, char *user, char *remoteaddr, char
     return aaa_authc_tacacs_ascii(aaa, user, remoteaddr, remotetty, pass);
 }
 
-static int aaa_authz_tacacs(struct aaa *aaa, char *user, char *remoteaddr, char *remotetty)
+static tac_pak_hdr *tac_author_pak(struct aaa *aaa, char *user, char *remoteaddr, char *remotetty)
 {
     size_t user_len = strlen(user);
     size_t remotetty_len = strlen(remotetty);
     size_t remoteaddr_len = strlen(remoteaddr);
     if (user_len & ~0xff || remotetty_len & ~0xff || remoteaddr_len & ~0xff)
-	return -1;
+	return NULL;
 
     ssize_t data_len = TAC_AUTHOR_REQ_FIXED_FIELDS_SIZE + user_len + remoteaddr_len + remotetty_len;
     for (int i = 0; i < aaa->oc; i++) {
 	if (aaa->ov[i].iov_len & ~0xff)
-	    return -1;
+	    return NULL;
 	data_len += aaa->ov[i].iov_len + 1;
     }
-    tac_pak_hdr *opak = alloca(TAC_PLUS_HDR_SIZE + data_len);
-    memset(opak, 0, TAC_PLUS_HDR_SIZE + data_len);
+    tac_pak_hdr *opak = calloc(1, TAC_PLUS_HDR_SIZE + data_len);
     opak->version = TAC_PLUS_MAJOR_VER | TAC_PLUS_MINOR_VER_DEFAULT;
     opak->type = TAC_PLUS_AUTHOR;
     opak->session_id = aaa->conn->id++;
@@ -333,26 +337,42 @@ static int aaa_authz_tacacs(struct aaa *aaa, char *user, char *remoteaddr, char
 
     if (aaa->conn->key)
 	md5_xor(opak, aaa->conn->key, strlen(aaa->conn->key));
-    if (conn_write(aaa->conn, opak, TAC_PLUS_HDR_SIZE + data_len) != (TAC_PLUS_HDR_SIZE + data_len))
-	return -1;
+    return opak;
+}
+
+static ssize_t conn_read_all(struct conn *conn, void *buf, size_t cnt)
+{
+    size_t off = 0;
+    while (off < cnt) {
+	ssize_t len = conn_read(conn, (u_char *) buf + off, cnt - off);
+	if (len < 1)
+	    return -1;
+	off += len;
+    }
+    return (ssize_t) off;
+}
+
+// session_id may be NULL if replies aren't necessarily in request order
+static int tac_author_reply(struct aaa *aaa, int *session_id)
+{
     tac_pak_hdr hdr;
-    if (conn_read(aaa->conn, &hdr, TAC_PLUS_HDR_SIZE) != TAC_PLUS_HDR_SIZE)
+    if (conn_read_all(aaa->conn, &hdr, TAC_PLUS_HDR_SIZE) != TAC_PLUS_HDR_SIZE)
 	return -1;
-    if (hdr.session_id != opak->session_id)
+    if (session_id && hdr.session_id != *session_id)
 	return -1;
-    data_len = ntohl(hdr.datalength);
+    ssize_t data_len = ntohl(hdr.datalength);
 
     tac_pak_hdr *pak = alloca(TAC_PLUS_HDR_SIZE + data_len);
     struct author_reply *reply = (struct author_reply *) ((u_char *) pak + TAC_PLUS_HDR_SIZE);
     memcpy(pak, &hdr, TAC_PLUS_HDR_SIZE);
-    if (conn_read(aaa->conn, reply, data_len) != data_len)
+    if (conn_read_all(aaa->conn, reply, data_len) != data_len)
 	return -1;
     if (aaa->conn->key)
 	md5_xor(pak, aaa->conn->key, strlen(aaa->conn->key));
     if (author_reply_looks_bogus(pak))
 	return -1;
     if (reply->status == TAC_PLUS_AUTHOR_STATUS_PASS_ADD || reply->status == TAC_PLUS_AUTHOR_STATUS_PASS_REPL) {
-	t = (u_char *) reply + TAC_AUTHOR_REPLY_FIXED_FIELDS_SIZE + ntohs(reply->msg_len) + ntohs(reply->data_len);
+	u_char *t = (u_char *) reply + TAC_AUTHOR_REPLY_FIXED_FIELDS_SIZE + ntohs(reply->msg_len) + ntohs(reply->data_len);
 	for (u_int i = 0; i < reply->arg_cnt && i < AAA_ATTR_MAX; i++) {
 	    aaa->iv[i].iov_len = *t++;
 	}
@@ -368,22 +388,35 @@ static int aaa_authz_tacacs(struct aaa *aaa, char *user, char *remoteaddr, char
     return -1;
 }
 
-static int aaa_acct_tacacs(struct aaa *aaa, char *user, char *remoteaddr, char *remotetty)
+static int aaa_authz_tacacs(struct aaa *aaa, char *user, char *remoteaddr, char *remotetty)
+{
+    tac_pak_hdr *opak = tac_author_pak(aaa, user, remoteaddr, remotetty);
+    if (!opak)
+	return -1;
+    ssize_t len = TAC_PLUS_HDR_SIZE + ntohl(opak->datalength);
+    int session_id = opak->session_id;
+    ssize_t res = conn_write(aaa->conn, opak, len);
+    free(opak);
+    if (res != len)
+	return -1;
+    return tac_author_reply(aaa, &session_id);
+}
+
+static tac_pak_hdr *tac_acct_pak(struct aaa *aaa, char *user, char *remoteaddr, char *remotetty)
 {
     size_t user_len = strlen(user);
     size_t remotetty_len = strlen(remotetty);
     size_t remoteaddr_len = strlen(remoteaddr);
     if (user_len & ~0xff || remotetty_len & ~0xff || remoteaddr_len & ~0xff)
-	return -1;
+	return NULL;
 
     ssize_t data_len = TAC_ACCT_REQ_FIXED_FIELDS_SIZE + user_len + remoteaddr_len + remotetty_len;
     for (int i = 0; i < aaa->oc; i++) {
 	if (aaa->ov[i].iov_len & ~0xff)
-	    return -1;
+	    return NULL;
 	data_len += aaa->ov[i].iov_len + 1;
     }
-    tac_pak_hdr *opak = alloca(TAC_PLUS_HDR_SIZE + data_len);
-    memset(opak, 0, TAC_PLUS_HDR_SIZE + data_len);
+    tac_pak_hdr *opak = calloc(1, TAC_PLUS_HDR_SIZE + data_len);
     opak->version = TAC_PLUS_MAJOR_VER | TAC_PLUS_MINOR_VER_DEFAULT;
     opak->type = TAC_PLUS_ACCT;
     opak->session_id = aaa->conn->id++;
@@ -416,19 +449,23 @@ static int aaa_acct_tacacs(struct aaa *aaa, char *user, char *remoteaddr, char *
 
     if (aaa->conn->key)
 	md5_xor(opak, aaa->conn->key, strlen(aaa->conn->key));
-    if (conn_write(aaa->conn, opak, TAC_PLUS_HDR_SIZE + data_len) != (TAC_PLUS_HDR_SIZE + data_len))
-	return -1;
+    return opak;
+}
+
+// session_id may be NULL if replies aren't necessarily in request order
+static int tac_acct_reply(struct aaa *aaa, int *session_id)
+{
     tac_pak_hdr hdr;
-    if (conn_read(aaa->conn, &hdr, TAC_PLUS_HDR_SIZE) != TAC_PLUS_HDR_SIZE)
+    if (conn_read_all(aaa->conn, &hdr, TAC_PLUS_HDR_SIZE) != TAC_PLUS_HDR_SIZE)
 	return -1;
-    if (hdr.session_id != opak->session_id)
+    if (session_id && hdr.session_id != *session_id)
 	return -1;
-    data_len = ntohl(hdr.datalength);
+    ssize_t data_len = ntohl(hdr.datalength);
 
     tac_pak_hdr *pak = alloca(TAC_PLUS_HDR_SIZE + data_len);
     struct acct_reply *reply = (struct acct_reply *) ((u_char *) pak + TAC_PLUS_HDR_SIZE);
     memcpy(pak, &hdr, TAC_PLUS_HDR_SIZE);
-    if (conn_read(aaa->conn, reply, data_len) != data_len)
+    if (conn_read_all(aaa->conn, reply, data_len) != data_len)
 	return -1;
     if (aaa->conn->key)
 	md5_xor(pak, aaa->conn->key, strlen(aaa->conn->key));
@@ -439,6 +476,60 @@ static int aaa_acct_tacacs(struct aaa *aaa, char *user, char *remoteaddr, char *
     return -1;
 }
 
+static int aaa_acct_tacacs(struct aaa *aaa, char *user, char *remoteaddr, char *remotetty)
+{
+    tac_pak_hdr *opak = tac_acct_pak(aaa, user, remoteaddr, remotetty);
+    if (!opak)
+	return -1;
+    ssize_t len = TAC_PLUS_HDR_SIZE + ntohl(opak->datalength);
+    int session_id = opak->session_id;
+    ssize_t res = conn_write(aaa->conn, opak, len);
+    free(opak);
+    if (res != len)
+	return -1;
+    return tac_acct_reply(aaa, &session_id);
+}
+
+/*
+ * Benchmark helper: write count TACACS+ requests in one go and collect the
+ * replies afterwards. Returns the number of successful replies, or -1.
+ */
+static int aaa_pipeline_tacacs(struct aaa *aaa, int acct, char *user, char *remoteaddr, char *remotetty, int count)
+{
+    u_char *buf = NULL;
+    size_t buf_len = 0;
+    for (int i = 0; i < count; i++) {
+	tac_pak_hdr *opak = acct ? tac_acct_pak(aaa, user, remoteaddr, remotetty) : tac_author_pak(aaa, user, remoteaddr, remotetty);
+	if (!opak) {
+	    free(buf);
+	    return -1;
+	}
+	size_t len = TAC_PLUS_HDR_SIZE + ntohl(opak->datalength);
+	buf = realloc(buf, buf_len + len);
+	memcpy(buf + buf_len, opak, len);
+	buf_len += len;
+	free(opak);
+    }
+
+    size_t off = 0;
+    while (off < buf_len) {
+	ssize_t res = conn_write(aaa->conn, buf + off, buf_len - off);
+	if (res < 1) {
+	    free(buf);
+	    return -1;
+	}
+	off += res;
+    }
+    free(buf);
+
+    int ok = 0;
+    for (int i = 0; i < count; i++) {
+	if (!(acct ? tac_acct_reply(aaa, NULL) : tac_author_reply(aaa, NULL)))
+	    ok++;
+	aaa_clear_iv(aaa);
+    }
+    return ok;
+}
 
 static int rad_set_password(u_char **data, size_t *data_len, const char *key, size_t key_len, const u_char *authenticator, char *pass)
 {
@@ -1010,6 +1101,28 @@ int aaa_acct(struct aaa *aaa, char *user, char *remoteaddr, char *remotetty)
     }
 }
 
+int aaa_authz_pipeline(struct aaa *aaa, char *user, char *remoteaddr, char *remotetty, int count)
+{
+    switch (aaa->conn->protocol) {
+    case S_tacacs_tls:
+    case S_tacacs_tcp:
+	return aaa_pipeline_tacacs(aaa, 0, user, remoteaddr, remotetty, count);
+    default:
+	return -1;
+    }
+}
+
+int aaa_acct_pipeline(struct aaa *aaa, char *user, char *remoteaddr, char *remotetty, int count)
+{
+    switch (aaa->conn->protocol) {
+    case S_tacacs_tls:
+    case S_tacacs_tcp:
+	return aaa_pipeline_tacacs(aaa, 1, user, remoteaddr, remotetty, count);
+    default:
+	return -1;
+    }
+}
+
 int aaa_set(struct aaa *aaa, u_char *data, size_t data_len)
 {
     if (aaa->oc < AAA_ATTR_MAX) {
@@ -35,6 +35,10 @@ int aaa_authc(struct aaa *, char *user, char *remoteaddr, char *remotetty, char
 int aaa_authz(struct aaa *, char *user, char *remoteaddr, char *remotetty);
 int aaa_acct(struct aaa *, char *user, char *remoteaddr, char *remotetty);
 
+// TACACS+ only: send count requests back-to-back, returns the number of successful replies
+int aaa_authz_pipeline(struct aaa *, char *user, char *remoteaddr, char *remotetty, int count);
+int aaa_acct_pipeline(struct aaa *, char *user, char *remoteaddr, char *remotetty, int count);
+
 void aaa_set_tac_authen_pap(struct aaa *aaa, int onoff);
 void aaa_set_tac_authen_svc(struct aaa *aaa, int svc);
 void aaa_set_tac_authen_meth(struct aaa *aaa, int meth);
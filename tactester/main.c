@@ -254,6 +254,7 @@ static void usage()
     fprintf(stderr, "  -C <config_file>    [%s]\n", arg_config);
     fprintf(stderr, "  -I <config_id>      [%s]\n", arg_config_id);
     fprintf(stderr, "  -s <server>         [first found]\n");
+    fprintf(stderr, "  -n <count>          send <count> TACACS+ authz or acct requests back-to-back\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "Author:  Marc.Huber@web.de\n");
     fprintf(stderr, "GIT:     https://github.com/MarcJHuber/event-driven-servers/\n");
@@ -264,7 +265,7 @@ static void usage()
 
 int main(int argc, char *argv[])
 {
-    char opt, *optstring = "d:PA:u:p:m:R:T:A:M:S:C:I:s:";
+    char opt, *optstring = "d:PA:u:p:m:R:T:A:M:S:C:I:s:n:";
 
 #define AAA_AUTHC 0
 #define AAA_AUTHZ 1
@@ -274,6 +275,7 @@ int main(int argc, char *argv[])
     int tac_authen_pap = 0;
     int tac_authen_svc = TAC_PLUS_AUTHEN_SVC_LOGIN;
     int tac_authen_meth = TAC_PLUS_AUTHEN_METH_TACACSPLUS;
+    int count = 0;
 
     init_common_data();
 
@@ -307,6 +309,9 @@ int main(int argc, char *argv[])
 	case 's':
 	    arg_server = optarg;
 	    break;
+	case 'n':
+	    count = atoi(optarg);
+	    break;
 	case 'm':
 	    if (!strcmp(optarg, "authc"))
 		mode = AAA_AUTHC;
@@ -381,7 +386,19 @@ int main(int argc, char *argv[])
 	argv++;
     }
 
-    if (mode == AAA_AUTHC) {
+    if (count > 0 && mode != AAA_AUTHC) {
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	int ok = (mode == AAA_AUTHZ) ? aaa_authz_pipeline(aaa, arg_user, arg_remoteip, arg_tty, count)
+	    : aaa_acct_pipeline(aaa, arg_user, arg_remoteip, arg_tty, count);
+	gettimeofday(&end, NULL);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	if (ok < 0)
+	    printf("%s pipeline failed\n", (mode == AAA_AUTHZ) ? "authz" : "acct");
+	else
+	    printf("%s: %d of %d requests succeeded in %.3f seconds (%.0f/s)\n", (mode == AAA_AUTHZ) ? "authz" : "acct", ok, count, elapsed,
+		   elapsed > 0 ? count / elapsed : 0);
+    } else if (mode == AAA_AUTHC) {
 	if (aaa_authc(aaa, arg_user, arg_remoteip, arg_tty, arg_pass))
 	    printf("authc nak\n");
 	else